@@ -0,0 +1,287 @@
+/*
+    cook.h
+
+    Shared by the converters in data/: a portable directory scan, a job pool, and a cache of content hashes,
+    so that a converter only redoes the inputs that changed since its last run, and does those in parallel.
+
+    The cache is a text file with a "<hash> <path>" line per input. The hash covers the content of the input
+    and the version string of the converter, bump the version when the output of the converter changes.
+    An input is converted again when its hash changed, or when one of its outputs is missing.
+*/
+#ifndef COOK_H_
+#define COOK_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>  // for _mkdir
+#else
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define COOK_MAX_FILES 4096
+#define COOK_MAX_PATH 512
+#define COOK_MAX_THREADS 64
+#ifdef _MSC_VER
+#define COOK_THREAD_LOCAL __declspec(thread)
+#else
+#define COOK_THREAD_LOCAL __thread
+#endif
+
+struct CookFile {
+    char path[COOK_MAX_PATH];
+    unsigned long long hash; // of the content and the version of the converter, 0 if the input could not be read
+    unsigned long long cached_hash; // from the last run, 0 if the input is new
+    int converted; // 1 converted, -1 failed, 0 up to date
+};
+static struct CookFile cook_files[COOK_MAX_FILES];
+static int cook_file_count = 0;
+
+#pragma region JOBS
+static int cook_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int) info.dwNumberOfProcessors;
+#else
+    int count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (count > COOK_MAX_THREADS) count = COOK_MAX_THREADS;
+    return count < 1 ? 1 : count;
+}
+
+struct CookBatch {
+    void (*job)(void *data, int index);
+    void *data;
+    int count;
+#ifdef _WIN32
+    volatile LONG next;
+#else
+    int next;
+    pthread_mutex_t lock;
+#endif
+};
+
+static int cook_next_index(struct CookBatch *batch) {
+#ifdef _WIN32
+    return (int) InterlockedIncrement(&batch->next) - 1;
+#else
+    pthread_mutex_lock(&batch->lock);
+    int index = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    return index;
+#endif
+}
+
+static COOK_THREAD_LOCAL int cook_in_job; // set while the thread runs a job of cook_parallel
+
+#ifdef _WIN32
+static DWORD WINAPI cook_worker(LPVOID param) {
+#else
+static void *cook_worker(void *param) {
+#endif
+    struct CookBatch *batch = (struct CookBatch *) param;
+    int in_job = cook_in_job;
+    cook_in_job = 1;
+    for (int i = cook_next_index(batch); i < batch->count; i = cook_next_index(batch)) batch->job(batch->data, i);
+    cook_in_job = in_job;
+    return 0;
+}
+
+// runs job(data, 0..count-1) on all cores, the calling thread works along, returns when every job is done
+// *info* called from inside a job it runs the jobs right there, the cores are already busy with the outer jobs
+static void cook_parallel(void (*job)(void *data, int index), void *data, int count) {
+    if (cook_in_job) {
+        for (int i = 0; i < count; i++) job(data, i);
+        return;
+    }
+    struct CookBatch batch = {.job = job, .data = data, .count = count};
+    int worker_count = cook_cpu_count() - 1;
+    if (worker_count > count - 1) worker_count = count - 1;
+    int started = 0;
+#ifdef _WIN32
+    HANDLE workers[COOK_MAX_THREADS];
+    for (int i = 0; i < worker_count; i++) {
+        workers[started] = CreateThread(NULL, 0, cook_worker, &batch, 0, NULL);
+        if (workers[started]) started++;
+    }
+    cook_worker(&batch);
+    if (started) WaitForMultipleObjects(started, workers, TRUE, INFINITE);
+    for (int i = 0; i < started; i++) CloseHandle(workers[i]);
+#else
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_t workers[COOK_MAX_THREADS];
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&workers[started], NULL, cook_worker, &batch) == 0) started++;
+    }
+    cook_worker(&batch);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    pthread_mutex_destroy(&batch.lock);
+#endif
+}
+#pragma endregion
+
+#pragma region FILES
+static void cook_mkdir(const char *path) {
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+    // if the folder already exists that is fine
+}
+
+static int cook_file_exists(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    fclose(f);
+    return 1;
+}
+
+// the file name without folders or extension, eg. "cube" for "./models/cube.obj"
+static void cook_base_name(const char *path, char *out, size_t size) {
+    const char *name = path;
+    for (const char *c = path; *c; c++) if (*c == '/' || *c == '\\') name = c + 1;
+    snprintf(out, size, "%s", name);
+    char *dot = strrchr(out, '.');
+    if (dot) *dot = '\0';
+}
+
+static int cook_has_extension(const char *name, const char *extension) {
+    const char *dot = strrchr(name, '.');
+    if (!dot || strlen(dot) != strlen(extension)) return 0;
+    for (int i = 0; dot[i]; i++) if (tolower((unsigned char) dot[i]) != tolower((unsigned char) extension[i])) return 0;
+    return 1;
+}
+
+static void cook_add_file(const char *path) {
+    if (cook_file_count >= COOK_MAX_FILES) {
+        fprintf(stderr, "More than %d inputs, skipping %s\n", COOK_MAX_FILES, path);
+        return;
+    }
+    struct CookFile *file = &cook_files[cook_file_count++];
+    memset(file, 0, sizeof(*file));
+    snprintf(file->path, sizeof(file->path), "%s", path);
+}
+
+// recursively collects the files with the extension (case-insensitive) in cook_files
+static void cook_scan(const char *directory, const char *extension) {
+#ifdef _WIN32
+    char search_path[COOK_MAX_PATH];
+    snprintf(search_path, sizeof(search_path), "%s/*", directory);
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA(search_path, &find_data);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        const char *name = find_data.cFileName;
+        int is_directory = (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+    DIR *dir = opendir(directory);
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        const char *name = entry->d_name;
+        char entry_path[COOK_MAX_PATH];
+        snprintf(entry_path, sizeof(entry_path), "%s/%s", directory, name);
+        struct stat st;
+        if (stat(entry_path, &st) != 0) continue;
+        int is_directory = S_ISDIR(st.st_mode);
+#endif
+        // skip the special directories "." and ".."
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        char full_path[COOK_MAX_PATH];
+        snprintf(full_path, sizeof(full_path), "%s/%s", directory, name);
+        if (is_directory) cook_scan(full_path, extension);
+        else if (cook_has_extension(name, extension)) cook_add_file(full_path);
+#ifdef _WIN32
+    } while (FindNextFileA(find, &find_data));
+    FindClose(find);
+#else
+    }
+    closedir(dir);
+#endif
+}
+#pragma endregion
+
+#pragma region CACHE
+// 64 bit fnv1a over the version and the content, 0 if the file cannot be read
+static unsigned long long cook_hash_file(const char *path, const char *version) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    for (const char *c = version; *c; c++) { hash ^= (unsigned char) *c; hash *= 0x100000001b3ull; }
+    unsigned char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        for (size_t i = 0; i < read; i++) { hash ^= buffer[i]; hash *= 0x100000001b3ull; }
+    }
+    fclose(f);
+    return hash ? hash : 1;
+}
+
+static void cook_load_cache(const char *cache_path) {
+    FILE *f = fopen(cache_path, "r");
+    if (!f) return; // first run, everything is converted
+    char line[COOK_MAX_PATH + 32];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long hash;
+        char path[COOK_MAX_PATH];
+        line[strcspn(line, "\r\n")] = 0;
+        if (sscanf(line, "%llx %511[^\n]", &hash, path) != 2) continue;
+        for (int i = 0; i < cook_file_count; i++) {
+            if (strcmp(cook_files[i].path, path) == 0) { cook_files[i].cached_hash = hash; break; }
+        }
+    }
+    fclose(f);
+}
+
+// only the inputs that are up to date or converted without failing are remembered
+static void cook_save_cache(const char *cache_path) {
+    FILE *f = fopen(cache_path, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to write cache: %s\n", cache_path);
+        return;
+    }
+    for (int i = 0; i < cook_file_count; i++) {
+        if (cook_files[i].hash && cook_files[i].converted >= 0) fprintf(f, "%016llx %s\n", cook_files[i].hash, cook_files[i].path);
+    }
+    fclose(f);
+}
+#pragma endregion
+
+struct Cooker {
+    const char *version;
+    int (*convert)(const char *path); // 0 on success
+    int (*outputs_exist)(const char *path);
+};
+
+static void cook_job(void *data, int index) {
+    struct Cooker *cooker = (struct Cooker *) data;
+    struct CookFile *file = &cook_files[index];
+    file->hash = cook_hash_file(file->path, cooker->version);
+    if (file->hash && file->hash == file->cached_hash && cooker->outputs_exist(file->path)) return;
+    file->converted = cooker->convert(file->path) == 0 ? 1 : -1;
+}
+
+// converts every input in cook_files that changed since the last run, in parallel, returns the number of failures
+static int cook(const char *cache_path, const char *version, int (*convert)(const char *path), int (*outputs_exist)(const char *path)) {
+    struct Cooker cooker = {version, convert, outputs_exist};
+    cook_load_cache(cache_path);
+    cook_parallel(cook_job, &cooker, cook_file_count);
+    cook_save_cache(cache_path);
+    int converted = 0, failed = 0;
+    for (int i = 0; i < cook_file_count; i++) {
+        if (cook_files[i].converted > 0) converted++;
+        if (cook_files[i].converted < 0) failed++;
+    }
+    printf("Converted %d, up to date %d, failed %d\n", converted, cook_file_count - converted - failed, failed);
+    return failed;
+}
+
+#endif
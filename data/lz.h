@@ -0,0 +1,59 @@
+/*
+    lz.h
+
+    The LZ encoder of the converters in data/, used by textures/convert_to_binary.c for the bands of the .tex files and
+    by pack.c for the entries of the asset pack. platform.h has the decoder, keep the two in step.
+
+    Byte oriented LZ77 with a 64kb window, greedy matching with a hash table of 4 byte sequences.
+    Sequence: token (literal length << 4 | match length - 4), 255-extended literal length, literals,
+    2 byte offset, 255-extended match length. The last sequence only has literals.
+*/
+#ifndef LZ_H_
+#define LZ_H_
+
+#include <string.h>
+
+#define LZ_HASH_BITS 14
+static unsigned int lz_read32(const unsigned char *p) {
+    return (unsigned int) p[0] | ((unsigned int) p[1] << 8) | ((unsigned int) p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static unsigned char *lz_write_length(unsigned char *op, int length) {
+    while (length >= 255) { *op++ = 255; length -= 255; }
+    *op++ = (unsigned char) length;
+    return op;
+}
+
+// dst needs room for n + n / 255 + 16 bytes, returns the compressed size
+static int lz_compress(const unsigned char *src, int n, unsigned char *dst) {
+    int table[1 << LZ_HASH_BITS]; // on the stack, the textures are compressed in parallel
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) table[i] = -1;
+    unsigned char *op = dst;
+    int ip = 0, anchor = 0;
+    while (ip + 4 <= n) {
+        unsigned int seq = lz_read32(src + ip);
+        unsigned int h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int ref = table[h];
+        table[h] = ip;
+        if (ref < 0 || ip - ref > 65535 || lz_read32(src + ref) != seq) { ip++; continue; }
+        int length = 4;
+        while (ip + length < n && src[ref + length] == src[ip + length]) length++;
+        int literals = ip - anchor;
+        unsigned char *token = op++;
+        *token = (unsigned char) (((literals < 15 ? literals : 15) << 4) | (length - 4 < 15 ? length - 4 : 15));
+        if (literals >= 15) op = lz_write_length(op, literals - 15);
+        memcpy(op, src + anchor, literals); op += literals;
+        *op++ = (unsigned char) ((ip - ref) & 0xFF);
+        *op++ = (unsigned char) ((ip - ref) >> 8);
+        if (length - 4 >= 15) op = lz_write_length(op, length - 4 - 15);
+        ip += length;
+        anchor = ip;
+    }
+    int literals = n - anchor;
+    *op++ = (unsigned char) ((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) op = lz_write_length(op, literals - 15);
+    memcpy(op, src + anchor, literals); op += literals;
+    return (int) (op - dst);
+}
+
+#endif
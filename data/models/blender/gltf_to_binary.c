@@ -5,6 +5,8 @@
     for each into a folder called "bin". It uses only standard C, cgltf.h, and minimal
     directory routines, and fixes the bone transforms so the vertex shader can do
     FinalVertex = BoneMatrix * Vertex without extra inverse-bind multiplication.
+    Every animation in the file is baked, the clip table after the bone frames says where each one starts.
+    The baked frames are then cut back to the keys that keep every vertex within ANIMATION_KEY_TOLERANCE, see ANIMATION KEYS.
 */
 
 #include <stdio.h>
@@ -12,6 +14,7 @@
 #include <string.h>
 #include <math.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <limits.h>  // For UCHAR_MAX
 
 #ifdef _WIN32
@@ -28,32 +31,14 @@
 // Include cgltf (make sure cgltf.h is in the same folder)
 #define CGLTF_IMPLEMENTATION
 #include "cgltf.h"
+#include "../optimize.h"
+#include "../vertex.h"
+#include "../mesh_format.h"
+#include "../../cook.h"
 
-// Binary file header.
-#pragma pack(push, 1)
-typedef struct {
-    unsigned int vertexCount;
-    unsigned int indexCount;
-    unsigned int boneCount;    // Always MAX_BONES if skin exists
-    unsigned int frameCount;
-    unsigned int vertexArrayOffset;
-    unsigned int indexArrayOffset;
-    unsigned int boneFramesArrayOffset;
-} AnimatedMeshHeader;
-#pragma pack(pop)
-
-// Vertex structure.
-typedef struct {
-    unsigned int data[4];         // 16 bytes (unused placeholder)
-    float position[3];            // 12 bytes
-    char normal[4];               // 4 bytes (signed normalized)
-    char tangent[4];              // 4 bytes (signed normalized)
-    unsigned short uv[2];         // 4 bytes (16-bit texcoords)
-    unsigned char bone_weights[4]; // 4 bytes (0–255 weights)
-    unsigned char bone_indices[4]; // 4 bytes (bone indices)
-} Vertex;
 
 #define MAX_BONES 64
+#define ANIMATION_FPS 30.0 // keep in sync with graphics.h, the runtime interpolates between frames
 
 // Convert a float in [0,1] to an 8-bit unsigned normalized value.
 static unsigned char float_to_unorm8(float v) {
@@ -249,74 +234,44 @@ static void slerp(const float q0[4], const float q1[4], float t, float out[4]) {
     }
 }
 
-// Compute a node's local transform in column-major order.
-static void compute_node_local_transform(cgltf_node *node, cgltf_animation *anim, float t, float out[16]) {
-    // If the node defines a full matrix, use it directly.
-    if (node->has_matrix) {
-        memcpy(out, node->matrix, 16 * sizeof(float));
-        return;
-    }
+#pragma region ANIMATION BAKING
+// *info* every clip in the file is baked at ANIMATION_FPS, all frames of all clips one after the other in the bone frames,
+// each frame is evaluated once: the nodes in parent before child order, every global is its parent's global times its local
 
-    // Build TRS from the node’s data.
-    float translation[3] = {
-        node->has_translation ? node->translation[0] : 0.0f,
-        node->has_translation ? node->translation[1] : 0.0f,
-        node->has_translation ? node->translation[2] : 0.0f
-    };
-    float rotation[4] = {
-        node->has_rotation ? node->rotation[0] : 0.0f,
-        node->has_rotation ? node->rotation[1] : 0.0f,
-        node->has_rotation ? node->rotation[2] : 0.0f,
-        node->has_rotation ? node->rotation[3] : 1.0f
-    };
-    float scale[3] = {
-        node->has_scale ? node->scale[0] : 1.0f,
-        node->has_scale ? node->scale[1] : 1.0f,
-        node->has_scale ? node->scale[2] : 1.0f
-    };
+typedef struct {
+    int node; // index in data->nodes
+    cgltf_animation_path_type path;
+    cgltf_interpolation_type interpolation;
+    float *times;  // key_count
+    float *values; // key_count * components, 3 times that for cubic splines (in tangent, value, out tangent)
+    size_t key_count;
+    int components;
+} BakeChannel;
 
-    // Apply animation channels if available.
-    if (anim) {
-        for (size_t c = 0; c < anim->channels_count; c++) {
-            cgltf_animation_channel* channel = &anim->channels[c];
-            if (channel->target_node != node)
-                continue;
-            cgltf_accessor* input = channel->sampler->input;
-            cgltf_accessor* output = channel->sampler->output;
-            size_t key_count = input->count;
-            if (key_count == 0)
-                continue;
-            size_t key0 = 0, key1 = 0;
-            float t0 = 0.f, t1 = 0.f;
-            for (size_t k = 0; k < key_count; k++) {
-                float timeVal;
-                cgltf_accessor_read_float(input, k, &timeVal, 1);
-                if (timeVal <= t) { key0 = k; t0 = timeVal; }
-                if (timeVal >= t) { key1 = k; cgltf_accessor_read_float(input, k, &t1, 1); break; }
-            }
-            float factor = (t1 - t0) > 1e-10f ? (t - t0) / (t1 - t0) : 0.0f;
-            if (channel->target_path == cgltf_animation_path_type_translation) {
-                float val0[3], val1[3];
-                cgltf_accessor_read_float(output, key0, val0, 3);
-                cgltf_accessor_read_float(output, key1, val1, 3);
-                for (int j = 0; j < 3; j++)
-                    translation[j] = val0[j] * (1.0f - factor) + val1[j] * factor;
-            } else if (channel->target_path == cgltf_animation_path_type_rotation) {
-                float q0[4], q1[4];
-                cgltf_accessor_read_float(output, key0, q0, 4);
-                cgltf_accessor_read_float(output, key1, q1, 4);
-                slerp(q0, q1, factor, rotation);
-            } else if (channel->target_path == cgltf_animation_path_type_scale) {
-                float val0[3], val1[3];
-                cgltf_accessor_read_float(output, key0, val0, 3);
-                cgltf_accessor_read_float(output, key1, val1, 3);
-                for (int j = 0; j < 3; j++)
-                    scale[j] = val0[j] * (1.0f - factor) + val1[j] * factor;
-            }
-        }
-    }
+typedef struct {
+    char name[24];
+    float start;
+    unsigned int first_frame, frame_count;
+    BakeChannel *channels; size_t channel_count;
+} BakeClip;
+
+typedef struct { float translation[3], rotation[4], scale[3]; int has_matrix; } NodePose;
 
-    // Build TRS matrices in column-major order.
+typedef struct {
+    cgltf_data *data;
+    size_t node_count;
+    int *parent; // -1 for the roots
+    int *order;  // parents before their children
+    NodePose *rest;
+    BakeClip *clips; unsigned int clip_count, frame_count;
+    int bone_nodes[MAX_BONES]; unsigned int bone_count;
+    float *inverse_bind; // bone_count * 16
+    float *frames;       // frame_count * MAX_BONES * 16
+    int failed;
+} Baker;
+
+// the matrix of a translation, rotation and scale, column-major
+static void trs_matrix(const float translation[3], const float rotation[4], const float scale[3], float out[16]) {
     float T[16] = {
         1, 0, 0, 0,
         0, 1, 0, 0,
@@ -341,28 +296,473 @@ static void compute_node_local_transform(cgltf_node *node, cgltf_animation *anim
 
     float RS[16];
     multiply_matrix4x4(R, S, RS);
-    float TR[16];
-    multiply_matrix4x4(T, RS, TR);
-    memcpy(out, TR, 16 * sizeof(float));
+    multiply_matrix4x4(T, RS, out);
+}
+
+// the value of a channel at time t, held before the first and after the last key
+static void sample_channel(const BakeChannel *channel, float t, float *out) {
+    int n = channel->components;
+    int cubic = channel->interpolation == cgltf_interpolation_type_cubic_spline;
+    size_t stride = cubic ? 3 * n : n, value = cubic ? n : 0; // the value sits between the tangents of a cubic key
+    size_t last = channel->key_count - 1;
+    if (t <= channel->times[0] || t >= channel->times[last]) {
+        memcpy(out, &channel->values[(t <= channel->times[0] ? 0 : last) * stride + value], n * sizeof(float));
+        return;
+    }
+    // first key at or after t
+    size_t low = 0, high = last;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (channel->times[mid] < t) low = mid + 1; else high = mid;
+    }
+    size_t key1 = low, key0 = channel->times[low] > t ? low - 1 : low;
+    const float *val0 = &channel->values[key0 * stride + value], *val1 = &channel->values[key1 * stride + value];
+    if (key0 == key1 || channel->interpolation == cgltf_interpolation_type_step) {
+        memcpy(out, val0, n * sizeof(float));
+        return;
+    }
+    float t0 = channel->times[key0], t1 = channel->times[key1];
+    float factor = (t - t0) / (t1 - t0);
+    if (cubic) {
+        // hermite spline with the out tangent of key0 and the in tangent of key1, scaled to the time between them
+        float dt = t1 - t0, f2 = factor * factor, f3 = f2 * factor;
+        const float *out_tangent = &channel->values[key0 * stride + 2 * n], *in_tangent = &channel->values[key1 * stride];
+        for (int j = 0; j < n; j++) {
+            out[j] = (2*f3 - 3*f2 + 1) * val0[j] + (f3 - 2*f2 + factor) * dt * out_tangent[j]
+                   + (-2*f3 + 3*f2) * val1[j] + (f3 - f2) * dt * in_tangent[j];
+        }
+        if (channel->path == cgltf_animation_path_type_rotation) {
+            float len = sqrtf(out[0]*out[0] + out[1]*out[1] + out[2]*out[2] + out[3]*out[3]);
+            if (len > 1e-10f) for (int j = 0; j < 4; j++) out[j] /= len;
+        }
+    } else if (channel->path == cgltf_animation_path_type_rotation) {
+        slerp(val0, val1, factor, out);
+    } else {
+        for (int j = 0; j < n; j++)
+            out[j] = val0[j] * (1.0f - factor) + val1[j] * factor;
+    }
+}
+
+// the globals of all nodes in the pose of the clip at time t, the rest pose without a clip
+static void evaluate_pose(const Baker *baker, const BakeClip *clip, float t, NodePose *pose, float *globals) {
+    memcpy(pose, baker->rest, baker->node_count * sizeof(NodePose));
+    for (size_t c = 0; clip && c < clip->channel_count; c++) {
+        const BakeChannel *channel = &clip->channels[c];
+        NodePose *node = &pose[channel->node];
+        if (channel->path == cgltf_animation_path_type_translation) sample_channel(channel, t, node->translation);
+        else if (channel->path == cgltf_animation_path_type_rotation) sample_channel(channel, t, node->rotation);
+        else if (channel->path == cgltf_animation_path_type_scale) sample_channel(channel, t, node->scale);
+    }
+    for (size_t i = 0; i < baker->node_count; i++) {
+        int node = baker->order[i];
+        float local[16];
+        // a node with a full matrix is not animated
+        if (pose[node].has_matrix) memcpy(local, baker->data->nodes[node].matrix, 16 * sizeof(float));
+        else trs_matrix(pose[node].translation, pose[node].rotation, pose[node].scale, local);
+        if (baker->parent[node] >= 0) multiply_matrix4x4(&globals[baker->parent[node] * 16], local, &globals[node * 16]);
+        else memcpy(&globals[node * 16], local, 16 * sizeof(float));
+    }
+}
+
+// one frame of one clip, run on all cores by cook_parallel
+static void bake_frame(void *data, int index) {
+    Baker *baker = (Baker *) data;
+    const BakeClip *clip = &baker->clips[0];
+    for (unsigned int c = 1; c < baker->clip_count && baker->clips[c].first_frame <= (unsigned int) index; c++) clip = &baker->clips[c];
+    unsigned int f = (unsigned int) index - clip->first_frame;
+    float t = clip->channel_count ? (clip->start + (float)f / (float)ANIMATION_FPS) : 0.0f;
+    NodePose *pose = (NodePose *) malloc(baker->node_count * sizeof(NodePose));
+    float *globals = (float *) malloc(baker->node_count * 16 * sizeof(float));
+    if (!pose || !globals) {
+        baker->failed = 1;
+        free(pose); free(globals);
+        return;
+    }
+    evaluate_pose(baker, clip->channel_count ? clip : NULL, t, pose, globals);
+    for (unsigned int b = 0; b < MAX_BONES; b++) {
+        float *finalBone = &baker->frames[((size_t) index * MAX_BONES + b) * 16];
+        if (b < baker->bone_count) {
+            multiply_matrix4x4(&globals[baker->bone_nodes[b] * 16], &baker->inverse_bind[b * 16], finalBone);
+#ifdef DEBUG_BONES
+            if (index == 0) {
+                printf("Bone %u final transform (frame=0):\n", b);
+                for (int rr = 0; rr < 4; rr++) {
+                    printf("  [ %f %f %f %f ]\n",
+                           finalBone[rr*4+0], finalBone[rr*4+1],
+                           finalBone[rr*4+2], finalBone[rr*4+3]);
+                }
+            }
+#endif
+        } else {
+            for (int i = 0; i < 16; i++)
+                finalBone[i] = (i%5==0) ? 1.0f : 0.0f;
+        }
+    }
+    free(pose);
+    free(globals);
+}
+
+// the channels of a clip that move a node, unpacked to floats
+static int load_clip(cgltf_data *data, cgltf_animation *anim, BakeClip *clip) {
+    snprintf(clip->name, sizeof(clip->name), "%s", anim->name ? anim->name : "");
+    clip->channels = (BakeChannel *) calloc(anim->channels_count ? anim->channels_count : 1, sizeof(BakeChannel));
+    if (!clip->channels) return 0;
+    float anim_start = 1e30f, anim_end = -1e30f;
+    for (size_t i = 0; i < anim->samplers_count; i++) {
+        cgltf_accessor* input = anim->samplers[i].input;
+        if (input->count > 0) {
+            float tmin = input->min[0];
+            float tmax = input->max[0];
+            if (tmin < anim_start) anim_start = tmin;
+            if (tmax > anim_end)   anim_end   = tmax;
+        }
+    }
+    for (size_t c = 0; c < anim->channels_count; c++) {
+        cgltf_animation_channel *source = &anim->channels[c];
+        if (!source->target_node || source->sampler->input->count == 0) continue;
+        if (source->target_path != cgltf_animation_path_type_translation && source->target_path != cgltf_animation_path_type_rotation && source->target_path != cgltf_animation_path_type_scale) continue;
+        BakeChannel *channel = &clip->channels[clip->channel_count];
+        channel->node = (int)(source->target_node - data->nodes);
+        channel->path = source->target_path;
+        channel->interpolation = source->sampler->interpolation;
+        channel->components = source->target_path == cgltf_animation_path_type_rotation ? 4 : 3;
+        channel->key_count = source->sampler->input->count;
+        size_t value_count = cgltf_accessor_unpack_floats(source->sampler->output, NULL, 0);
+        size_t needed = channel->key_count * channel->components * (channel->interpolation == cgltf_interpolation_type_cubic_spline ? 3 : 1);
+        if (value_count < needed) continue; // broken sampler
+        channel->times = (float *) malloc(channel->key_count * sizeof(float));
+        channel->values = (float *) malloc(value_count * sizeof(float));
+        if (!channel->times || !channel->values) return 0;
+        cgltf_accessor_unpack_floats(source->sampler->input, channel->times, channel->key_count);
+        cgltf_accessor_unpack_floats(source->sampler->output, channel->values, value_count);
+        clip->channel_count++;
+    }
+    clip->start = anim_start;
+    clip->frame_count = anim_end >= anim_start ? (unsigned int)((anim_end - anim_start) * (double)ANIMATION_FPS) + 1 : 1;
+    return 1;
+}
+
+static void free_baker(Baker *baker) {
+    for (unsigned int c = 0; c < baker->clip_count; c++) {
+        for (size_t i = 0; i < baker->clips[c].channel_count; i++) {
+            free(baker->clips[c].channels[i].times);
+            free(baker->clips[c].channels[i].values);
+        }
+        free(baker->clips[c].channels);
+    }
+    free(baker->clips);
+    free(baker->parent);
+    free(baker->order);
+    free(baker->rest);
+    free(baker->inverse_bind);
+    free(baker->frames);
+}
+
+// bakes the bone matrices of every clip in the file, so that the vertex shader can do BoneMatrix * Vertex
+// a skin without clips gets one clip of a single frame in the rest pose
+static int bake_animations(cgltf_data *data, cgltf_skin *skin, Baker *baker) {
+    memset(baker, 0, sizeof(*baker));
+    baker->data = data;
+    baker->node_count = data->nodes_count;
+    baker->bone_count = (unsigned int)(skin->joints_count < MAX_BONES ? skin->joints_count : MAX_BONES);
+    if (skin->joints_count > MAX_BONES) printf("  [Warning] %zu bones, only the first %d are baked\n", skin->joints_count, MAX_BONES);
+    size_t count = baker->node_count ? baker->node_count : 1;
+    baker->parent = (int *) malloc(count * sizeof(int));
+    baker->order = (int *) malloc(count * sizeof(int));
+    baker->rest = (NodePose *) malloc(count * sizeof(NodePose));
+    baker->inverse_bind = (float *) malloc((baker->bone_count ? baker->bone_count : 1) * 16 * sizeof(float));
+    baker->clips = (BakeClip *) calloc(data->animations_count ? data->animations_count : 1, sizeof(BakeClip));
+    if (!baker->parent || !baker->order || !baker->rest || !baker->inverse_bind || !baker->clips) return 0;
+
+    // the rest pose, and the order: the roots first, then the children of every node that is in it already
+    size_t ordered = 0;
+    for (size_t i = 0; i < baker->node_count; i++) {
+        cgltf_node *node = &data->nodes[i];
+        baker->parent[i] = node->parent ? (int)(node->parent - data->nodes) : -1;
+        if (!node->parent) baker->order[ordered++] = (int) i;
+        NodePose *rest = &baker->rest[i];
+        rest->has_matrix = node->has_matrix;
+        for (int j = 0; j < 3; j++) rest->translation[j] = node->has_translation ? node->translation[j] : 0.0f;
+        for (int j = 0; j < 4; j++) rest->rotation[j] = node->has_rotation ? node->rotation[j] : (j == 3 ? 1.0f : 0.0f);
+        for (int j = 0; j < 3; j++) rest->scale[j] = node->has_scale ? node->scale[j] : 1.0f;
+    }
+    for (size_t i = 0; i < ordered; i++) {
+        cgltf_node *node = &data->nodes[baker->order[i]];
+        for (size_t c = 0; c < node->children_count; c++) baker->order[ordered++] = (int)(node->children[c] - data->nodes);
+    }
+
+    // the inverse of the global of every bone in the rest pose
+    NodePose *pose = (NodePose *) malloc(count * sizeof(NodePose));
+    float *globals = (float *) malloc(count * 16 * sizeof(float));
+    if (!pose || !globals) { free(pose); free(globals); return 0; }
+    evaluate_pose(baker, NULL, 0.0f, pose, globals);
+    for (unsigned int b = 0; b < baker->bone_count; b++) {
+        baker->bone_nodes[b] = (int)(skin->joints[b] - data->nodes);
+        float *invG = &baker->inverse_bind[b * 16];
+        if (!invert_matrix4x4(&globals[baker->bone_nodes[b] * 16], invG)) {
+            for (int i = 0; i < 16; i++)
+                invG[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+        }
+#ifdef DEBUG_BONES
+        printf("Bone %u inverseBind:\n", b);
+        for (int i = 0; i < 4; i++) {
+            printf("  [ %f %f %f %f ]\n",
+                   invG[i*4+0], invG[i*4+1],
+                   invG[i*4+2], invG[i*4+3]);
+        }
+#endif
+    }
+    free(pose);
+    free(globals);
+
+    // the clip table
+    for (size_t a = 0; a < data->animations_count; a++) {
+        BakeClip *clip = &baker->clips[baker->clip_count++];
+        if (!load_clip(data, &data->animations[a], clip)) return 0;
+        clip->first_frame = baker->frame_count;
+        baker->frame_count += clip->frame_count;
+    }
+    if (baker->clip_count == 0) {
+        BakeClip *clip = &baker->clips[baker->clip_count++];
+        snprintf(clip->name, sizeof(clip->name), "rest");
+        clip->frame_count = 1;
+        baker->frame_count = 1;
+    }
+
+    baker->frames = (float *) calloc((size_t) baker->frame_count * MAX_BONES * 16, sizeof(float));
+    if (!baker->frames) return 0;
+    cook_parallel(bake_frame, baker, (int) baker->frame_count);
+    return !baker->failed;
+}
+#pragma endregion
+
+// the bounds of the mesh in every baked frame, skinned like the vertex shader does it
+static void skinned_bounds(MeshBounds *bounds, const Vertex *vertices, unsigned int vertexCount, const float *boneFrames, unsigned int frameCount) {
+    bounds_reset(bounds);
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned int f = 0; f < frameCount; f++) {
+            const float *bones = &boneFrames[(size_t) f * MAX_BONES * 16];
+            for (unsigned int v = 0; v < vertexCount; v++) {
+                const Vertex *vertex = &vertices[v];
+                float p[3] = {0, 0, 0};
+                for (int j = 0; j < 4; j++) {
+                    if (!vertex->bone_weights[j]) continue;
+                    const float *m = &bones[(vertex->bone_indices[j] % MAX_BONES) * 16];
+                    float w = vertex->bone_weights[j] / 255.0f;
+                    for (int c = 0; c < 3; c++)
+                        p[c] += w * (m[c] * vertex->position[0] + m[4 + c] * vertex->position[1] + m[8 + c] * vertex->position[2] + m[12 + c]);
+                }
+                if (pass == 0) bounds_add_box(bounds, p);
+                else bounds_add_sphere(bounds, p);
+            }
+        }
+    }
+    bounds_finish(bounds);
 }
 
-// Recursively compute the global transform for a node.
-static void compute_global_transform(cgltf_node *node, cgltf_animation *anim, float t, float out[16]) {
-    float local[16];
-    compute_node_local_transform(node, anim, t, local);
+#pragma region ANIMATION KEYS
+// *info* the baked bone matrices of every clip are cut back to keys: per bone per clip the frames go to translation,
+// rotation and scale, quantized in the range of the curve, and a key is only kept where interpolating between the
+// keys around it would move a vertex of that bone more than ANIMATION_KEY_TOLERANCE
+// the matrices are the ones the shader uses, bind space to model space, so an error does not add up along the skeleton
+#define ANIMATION_KEY_TOLERANCE 0.0005f // in model units
 
-    if (node->parent) {
-       float parent_global[16];
-       compute_global_transform(node->parent, anim, t, parent_global);
+typedef struct {
+    float probes[8][3]; // corners of the bind space box of the vertices the bone moves
+    AnimationCurve *curve;
+    const float *frames; // of the bone in the clip, MAX_BONES * 16 floats apart
+    unsigned int frame_count;
+} ReduceCurve;
 
-       float global[16];
-       multiply_matrix4x4(parent_global, local, global);
-       memcpy(out, global, 16*sizeof(float));
+typedef struct {
+    ReduceCurve *curves; // clip major like the curve table
+    AnimationKey *keys;  // the room for a key on every frame of every curve, the keys of a curve start at its firstKey
+    int failed;
+} Reducer;
+
+// the translation, rotation and scale that trs_matrix turns back into m, a matrix with shear comes out wrong
+static void decompose_matrix(const float m[16], float translation[3], float rotation[4], float scale[3]) {
+    float r[9];
+    for (int c = 0; c < 3; c++) {
+        translation[c] = m[12 + c];
+        scale[c] = sqrtf(m[c * 4] * m[c * 4] + m[c * 4 + 1] * m[c * 4 + 1] + m[c * 4 + 2] * m[c * 4 + 2]);
+    }
+    float det = m[0] * (m[5] * m[10] - m[9] * m[6]) - m[4] * (m[1] * m[10] - m[9] * m[2]) + m[8] * (m[1] * m[6] - m[5] * m[2]);
+    if (det < 0) scale[0] = -scale[0]; // a mirror goes in the scale, the rotation stays a rotation
+    for (int c = 0; c < 3; c++)
+        for (int j = 0; j < 3; j++) r[c * 3 + j] = scale[c] != 0 ? m[c * 4 + j] / scale[c] : (c == j ? 1.0f : 0.0f);
+    // the quaternion of the column-major rotation, from its largest component
+    float trace = r[0] + r[4] + r[8];
+    if (trace > 0) {
+        float k = 0.5f / sqrtf(trace + 1.0f);
+        rotation[0] = (r[5] - r[7]) * k; rotation[1] = (r[6] - r[2]) * k; rotation[2] = (r[1] - r[3]) * k; rotation[3] = 0.25f / k;
+    } else if (r[0] > r[4] && r[0] > r[8]) {
+        float k = 2.0f * sqrtf(1.0f + r[0] - r[4] - r[8]);
+        rotation[0] = 0.25f * k; rotation[1] = (r[3] + r[1]) / k; rotation[2] = (r[6] + r[2]) / k; rotation[3] = (r[5] - r[7]) / k;
+    } else if (r[4] > r[8]) {
+        float k = 2.0f * sqrtf(1.0f + r[4] - r[0] - r[8]);
+        rotation[0] = (r[3] + r[1]) / k; rotation[1] = 0.25f * k; rotation[2] = (r[7] + r[5]) / k; rotation[3] = (r[6] - r[2]) / k;
     } else {
-       memcpy(out, local, 16*sizeof(float));
+        float k = 2.0f * sqrtf(1.0f + r[8] - r[0] - r[4]);
+        rotation[0] = (r[6] + r[2]) / k; rotation[1] = (r[7] + r[5]) / k; rotation[2] = 0.25f * k; rotation[3] = (r[1] - r[3]) / k;
+    }
+    float length = sqrtf(rotation[0] * rotation[0] + rotation[1] * rotation[1] + rotation[2] * rotation[2] + rotation[3] * rotation[3]);
+    for (int i = 0; i < 4; i++) rotation[i] /= length;
+}
+
+static unsigned short quantize_unorm16(float value, float min, float extent) {
+    if (extent <= 0) return 0;
+    float n = roundf((value - min) / extent * 65535.0f);
+    return (unsigned short) (n < 0 ? 0 : n > 65535 ? 65535 : n);
+}
+
+// how far the probes end up apart under two matrices
+static float matrix_error(const float probes[8][3], const float a[16], const float b[16]) {
+    float largest = 0;
+    for (int p = 0; p < 8; p++) {
+        float d2 = 0;
+        for (int c = 0; c < 3; c++) {
+            float d = (a[c] - b[c]) * probes[p][0] + (a[4 + c] - b[4 + c]) * probes[p][1] + (a[8 + c] - b[8 + c]) * probes[p][2] + (a[12 + c] - b[12 + c]);
+            d2 += d * d;
+        }
+        if (d2 > largest) largest = d2;
     }
+    return sqrtf(largest);
 }
 
+// whether the frames between two keys are within the tolerance when they are interpolated
+static int keys_fit(const ReduceCurve *reduce, const AnimationKey *a, const AnimationKey *b) {
+    float m[16];
+    for (unsigned int f = a->frame; f <= b->frame; f++) {
+        float t = b->frame > a->frame ? (float) (f - a->frame) / (float) (b->frame - a->frame) : 0.0f;
+        animation_key_matrix(reduce->curve, a, b, t, m);
+        if (matrix_error(reduce->probes, m, &reduce->frames[(size_t) f * MAX_BONES * 16]) > ANIMATION_KEY_TOLERANCE) return 0;
+    }
+    return 1;
+}
+
+// the keys of one bone in one clip into keys, its range into the curve, returns the number of keys, 0 when even a key
+// on every frame is not within the tolerance (a matrix with shear)
+static unsigned int reduce_curve(ReduceCurve *reduce, AnimationKey *keys) {
+    unsigned int n = reduce->frame_count;
+    float (*trs)[10] = (float (*)[10]) malloc(n * sizeof(*trs));
+    AnimationKey *all = (AnimationKey *) calloc(n, sizeof(AnimationKey));
+    if (!trs || !all) { free(trs); free(all); return 0; }
+    AnimationCurve *curve = reduce->curve;
+    float low[6], high[6];
+    for (int c = 0; c < 6; c++) { low[c] = FLT_MAX; high[c] = -FLT_MAX; }
+    for (unsigned int f = 0; f < n; f++) {
+        decompose_matrix(&reduce->frames[(size_t) f * MAX_BONES * 16], &trs[f][0], &trs[f][3], &trs[f][7]);
+        // the same half of the quaternion sphere as the frame before, so that the interpolation takes the short way
+        if (f > 0 && trs[f][3] * trs[f - 1][3] + trs[f][4] * trs[f - 1][4] + trs[f][5] * trs[f - 1][5] + trs[f][6] * trs[f - 1][6] < 0)
+            for (int i = 3; i < 7; i++) trs[f][i] = -trs[f][i];
+        for (int c = 0; c < 3; c++) {
+            if (trs[f][c] < low[c]) low[c] = trs[f][c];
+            if (trs[f][c] > high[c]) high[c] = trs[f][c];
+            if (trs[f][7 + c] < low[3 + c]) low[3 + c] = trs[f][7 + c];
+            if (trs[f][7 + c] > high[3 + c]) high[3 + c] = trs[f][7 + c];
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        curve->translationMin[c] = low[c]; curve->translationExtent[c] = high[c] - low[c];
+        curve->scaleMin[c] = low[3 + c]; curve->scaleExtent[c] = high[3 + c] - low[3 + c];
+    }
+    for (unsigned int f = 0; f < n; f++) {
+        all[f].frame = (uint16_t) f;
+        for (int i = 0; i < 4; i++) all[f].rotation[i] = float_to_snorm16(trs[f][3 + i]);
+        for (int c = 0; c < 3; c++) {
+            all[f].translation[c] = quantize_unorm16(trs[f][c], low[c], high[c] - low[c]);
+            all[f].scale[c] = quantize_unorm16(trs[f][7 + c], low[3 + c], high[3 + c] - low[3 + c]);
+        }
+    }
+    free(trs);
+
+    // from every kept key, the next one as far along as the frames in between allow
+    unsigned int count = 0;
+    for (unsigned int f = 0; f < n; f++) if (!keys_fit(reduce, &all[f], &all[f])) { free(all); return 0; }
+    keys[count++] = all[0];
+    for (unsigned int k = 0; k + 1 < n;) {
+        unsigned int next = k + 1;
+        while (next + 1 < n && keys_fit(reduce, &all[k], &all[next + 1])) next++;
+        keys[count++] = all[next];
+        k = next;
+    }
+    // a bone that holds still gets one key, the sampler holds the last key
+    if (count == 2) {
+        float m[16];
+        animation_key_matrix(curve, &keys[0], &keys[0], 0.0f, m);
+        int holds = 1;
+        for (unsigned int f = 0; f < n && holds; f++) holds = matrix_error(reduce->probes, m, &reduce->frames[(size_t) f * MAX_BONES * 16]) <= ANIMATION_KEY_TOLERANCE;
+        if (holds) count = 1;
+    }
+    free(all);
+    return count;
+}
+
+// one curve, run on all cores by cook_parallel
+static void reduce_job(void *data, int index) {
+    Reducer *reducer = (Reducer *) data;
+    ReduceCurve *reduce = &reducer->curves[index];
+    reduce->curve->keyCount = reduce_curve(reduce, &reducer->keys[reduce->curve->firstKey]);
+    if (!reduce->curve->keyCount) reducer->failed = 1;
+}
+
+// the curves and keys of all clips, NULL curves when the bone frames are kept as they are
+static void reduce_animation(const Baker *baker, const Vertex *vertices, unsigned int vertexCount, AnimationCurve **out_curves, AnimationKey **out_keys, size_t *out_key_count) {
+    *out_curves = NULL; *out_keys = NULL; *out_key_count = 0;
+    size_t curve_count = (size_t) baker->clip_count * MAX_BONES;
+    Reducer reducer = {0};
+    reducer.curves = (ReduceCurve *) calloc(curve_count, sizeof(ReduceCurve));
+    reducer.keys = (AnimationKey *) malloc((size_t) baker->frame_count * MAX_BONES * sizeof(AnimationKey));
+    AnimationCurve *curves = (AnimationCurve *) calloc(curve_count, sizeof(AnimationCurve));
+    if (!reducer.curves || !reducer.keys || !curves) {
+        free(reducer.curves); free(reducer.keys); free(curves);
+        return;
+    }
+
+    // the box of the vertices of every bone, the box of the mesh for a bone without vertices
+    MeshBounds boxes[MAX_BONES + 1];
+    for (int b = 0; b <= MAX_BONES; b++) bounds_reset(&boxes[b]);
+    for (unsigned int v = 0; v < vertexCount; v++) {
+        bounds_add_box(&boxes[MAX_BONES], vertices[v].position);
+        for (int j = 0; j < 4; j++)
+            if (vertices[v].bone_weights[j]) bounds_add_box(&boxes[vertices[v].bone_indices[j] % MAX_BONES], vertices[v].position);
+    }
+    if (boxes[MAX_BONES].min[0] > boxes[MAX_BONES].max[0]) // no vertices at all, a unit box
+        for (int c = 0; c < 3; c++) { boxes[MAX_BONES].min[c] = -1; boxes[MAX_BONES].max[c] = 1; }
+
+    for (unsigned int c = 0; c < baker->clip_count; c++) {
+        const BakeClip *clip = &baker->clips[c];
+        for (unsigned int b = 0; b < MAX_BONES; b++) {
+            ReduceCurve *reduce = &reducer.curves[c * MAX_BONES + b];
+            const MeshBounds *box = boxes[b].min[0] <= boxes[b].max[0] ? &boxes[b] : &boxes[MAX_BONES];
+            for (int p = 0; p < 8; p++)
+                for (int k = 0; k < 3; k++) reduce->probes[p][k] = (p >> k) & 1 ? box->max[k] : box->min[k];
+            reduce->curve = &curves[c * MAX_BONES + b];
+            reduce->curve->firstKey = clip->first_frame * MAX_BONES + b * clip->frame_count;
+            reduce->frames = &baker->frames[((size_t) clip->first_frame * MAX_BONES + b) * 16];
+            reduce->frame_count = clip->frame_count;
+        }
+    }
+    cook_parallel(reduce_job, &reducer, (int) curve_count);
+
+    // the keys of the curves one after the other
+    size_t key_count = 0;
+    for (size_t i = 0; !reducer.failed && i < curve_count; i++) {
+        memmove(&reducer.keys[key_count], &reducer.keys[curves[i].firstKey], curves[i].keyCount * sizeof(AnimationKey));
+        curves[i].firstKey = (uint32_t) key_count;
+        key_count += curves[i].keyCount;
+    }
+    free(reducer.curves);
+    if (reducer.failed) {
+        printf("  [Warning] a bone matrix has shear, the bone frames are kept as they are\n");
+        free(reducer.keys); free(curves);
+        return;
+    }
+    *out_curves = curves; *out_keys = reducer.keys; *out_key_count = key_count;
+}
+#pragma endregion
+
 static void process_file(const char* filename) {
     printf("Processing file: %s\n", filename);
 
@@ -548,118 +948,29 @@ static void process_file(const char* filename) {
                 indices[i+2] = temp;
             }
         }
+        // Reorder for the post-transform cache, overdraw and vertex fetch (see ../optimize.h).
+        vertexCount = (unsigned int)optimize_mesh(filename, vertices, sizeof(Vertex), offsetof(Vertex, position), vertexCount, indices, indexCount);
     }
 
     // Skins / Bones.
+    Baker baker;
+    memset(&baker, 0, sizeof(baker));
     cgltf_skin* skin = NULL;
-    unsigned int usedBoneCount = 0;
-    if (data->skins_count > 0) {
+    if (data->skins_count > 0 && data->skins[0].joints_count > 0) {
         skin = &data->skins[0];
-        usedBoneCount = (unsigned int)skin->joints_count;
-    }
-
-    // Prepare inverse bind arrays.
-    float* corrected_invBind = NULL;
-    if (skin && usedBoneCount > 0) {
-        corrected_invBind = (float*)malloc(usedBoneCount * 16 * sizeof(float));
-        if (!corrected_invBind) {
-            printf("  [Error] Out of memory for corrected inverse bind matrices\n");
-            free(indices);
-            free(vertices);
-            cgltf_free(data);
-            return;
-        }
-        for (unsigned int b = 0; b < usedBoneCount; b++) {
-            cgltf_node* bone_node = skin->joints[b];
-            float G_bind[16];
-            compute_global_transform(bone_node, NULL, 0.0f, G_bind);
-            float invG[16];
-            if (!invert_matrix4x4(G_bind, invG)) {
-                for (int i = 0; i < 16; i++)
-                    invG[i] = (i % 5 == 0) ? 1.0f : 0.0f;
-            }
-            memcpy(&corrected_invBind[b * 16], invG, 16 * sizeof(float));
-#ifdef DEBUG_BONES
-            printf("Bone %u inverseBind:\n", b);
-            for (int i = 0; i < 4; i++) {
-                printf("  [ %f %f %f %f ]\n",
-                       invG[i*4+0], invG[i*4+1],
-                       invG[i*4+2], invG[i*4+3]);
-            }
-#endif
-        }
-    }
-
-    // Animations.
-    cgltf_animation* anim = NULL;
-    unsigned int frameCount = 1;
-    float anim_start = 0.f, anim_end = 0.f;
-    double fps = 30.0;
-    if (skin && data->animations_count > 0) {
-        anim = &data->animations[0];
-        anim_start = 1e30f;
-        anim_end   = -1e30f;
-        for (size_t i = 0; i < anim->samplers_count; i++) {
-            cgltf_accessor* input = anim->samplers[i].input;
-            if (input->count > 0) {
-                float tmin = input->min[0];
-                float tmax = input->max[0];
-                if (tmin < anim_start) anim_start = tmin;
-                if (tmax > anim_end)   anim_end   = tmax;
-            }
-        }
-        frameCount = (unsigned int)((anim_end - anim_start) * fps) + 1;
-        if (frameCount < 1) frameCount = 1;
-    }
-
-    // For each frame, compute final bone transforms.
-    float* boneFrames = NULL;
-    if (skin && usedBoneCount > 0) {
-        boneFrames = (float*)calloc(frameCount * MAX_BONES * 16, sizeof(float));
-        if (!boneFrames) {
+        if (!bake_animations(data, skin, &baker)) {
             printf("  [Error] Out of memory for bone frames\n");
-            free(corrected_invBind);
+            free_baker(&baker);
             free(indices);
             free(vertices);
             cgltf_free(data);
             return;
         }
-        float flipX[16] = {
-            -1, 0,  0, 0,
-             0, 1,  0, 0,
-             0, 0,  1, 0,
-             0, 0,  0, 1
-        };
-
-        for (unsigned int f = 0; f < frameCount; f++) {
-            float t = anim ? (anim_start + (float)f / (float)fps) : 0.0f;
-            for (unsigned int b = 0; b < MAX_BONES; b++) {
-                float finalBone[16];
-                if (b < usedBoneCount) {
-                    cgltf_node* bone_node = skin->joints[b];
-                    float G_current[16];
-                    compute_global_transform(bone_node, anim, t, G_current);
-                    float combined[16];
-                    multiply_matrix4x4(G_current, &corrected_invBind[b * 16], combined);
-                    memcpy(finalBone, combined, 16 * sizeof(float));
-#ifdef DEBUG_BONES
-                    if (f==0) {
-                        printf("Bone %u final transform (frame=0):\n", b);
-                        for (int rr = 0; rr < 4; rr++) {
-                            printf("  [ %f %f %f %f ]\n",
-                                   finalBone[rr*4+0], finalBone[rr*4+1],
-                                   finalBone[rr*4+2], finalBone[rr*4+3]);
-                        }
-                    }
-#endif
-                } else {
-                    for (int i = 0; i < 16; i++)
-                        finalBone[i] = (i%5==0) ? 1.0f : 0.0f;
-                }
-                memcpy(&boneFrames[(f * MAX_BONES + b) * 16], finalBone, 16*sizeof(float));
-            }
-        }
+        for (unsigned int c = 0; c < baker.clip_count; c++)
+            printf("  Clip %u: %s, %u frames\n", c, baker.clips[c].name, baker.clips[c].frame_count);
     }
+    float* boneFrames = baker.frames;
+    unsigned int frameCount = skin ? baker.frame_count : 1;
 
     // Build output filename.
     char out_filename[256];
@@ -678,48 +989,50 @@ static void process_file(const char* filename) {
     char bin_path[256];
     snprintf(bin_path, sizeof(bin_path), "bin/%s", out_filename);
 
-    FILE* out = fopen(bin_path, "wb");
-    if (!out) {
-        printf("  [Error] Failed to open output file: %s\n", bin_path);
-        free(corrected_invBind);
-        free(boneFrames);
-        free(indices);
-        free(vertices);
-        cgltf_free(data);
-        return;
+    // One submesh, only the first primitive is converted.
+    Submesh submesh;
+    memset(&submesh, 0, sizeof(submesh));
+    snprintf(submesh.name, sizeof(submesh.name), "%s", mesh->name ? mesh->name : "primitive 0");
+    submesh.indexCount = indexCount;
+    submesh.vertexCount = vertexCount;
+    if (boneFrames) skinned_bounds(&submesh.bounds, vertices, vertexCount, boneFrames, frameCount);
+    else bounds_of_vertices(&submesh.bounds, vertices, vertexCount, NULL, 0);
+
+    AnimationCurve* curves = NULL;
+    AnimationKey* keys = NULL;
+    size_t keyCount = 0;
+    if (boneFrames) {
+        reduce_animation(&baker, vertices, vertexCount, &curves, &keys, &keyCount);
+        if (curves)
+            printf("  Animation keys: %zu of %u frames * %d bones, %zu bytes for %zu bytes of bone frames\n", keyCount, frameCount, MAX_BONES,
+                   (size_t) baker.clip_count * MAX_BONES * sizeof(AnimationCurve) + keyCount * sizeof(AnimationKey), (size_t) frameCount * MAX_BONES * 16 * sizeof(float));
     }
 
-    // Write header.
-    AnimatedMeshHeader header;
-    memset(&header, 0, sizeof(header));
-    header.vertexCount            = vertexCount;
-    header.indexCount             = indexCount;
-    header.boneCount              = (boneFrames ? MAX_BONES : 0);
-    header.frameCount             = frameCount;
-
-    unsigned int headerSize       = (unsigned int)sizeof(AnimatedMeshHeader);
-    unsigned int vertexArraySize  = vertexCount * (unsigned int)sizeof(Vertex);
-    unsigned int indexArraySize   = indexCount  * (unsigned int)sizeof(unsigned int);
-    unsigned int boneFramesSize   = (boneFrames ? (frameCount*MAX_BONES*16*sizeof(float)) : 0);
-
-    header.vertexArrayOffset      = headerSize;
-    header.indexArrayOffset       = header.vertexArrayOffset + vertexArraySize;
-    header.boneFramesArrayOffset  = header.indexArrayOffset   + indexArraySize;
-
-    fwrite(&header, sizeof(header), 1, out);
-    fwrite(vertices, sizeof(Vertex), vertexCount, out);
-    if (indices && indexCount > 0) {
-        fwrite(indices, sizeof(unsigned int), indexCount, out);
+    AnimationClip* clips = (AnimationClip*)calloc(baker.clip_count ? baker.clip_count : 1, sizeof(AnimationClip));
+    for (unsigned int c = 0; clips && c < baker.clip_count; c++) {
+        memcpy(clips[c].name, baker.clips[c].name, sizeof(clips[c].name) - 1);
+        clips[c].firstFrame = baker.clips[c].first_frame;
+        clips[c].frameCount = baker.clips[c].frame_count;
     }
-    if (boneFrames && boneFramesSize > 0) {
-        fwrite(boneFrames, 1, boneFramesSize, out);
-    }
-
-    fclose(out);
-    printf("  Wrote output file: %s\n", bin_path);
 
-    free(corrected_invBind);
-    free(boneFrames);
+    MeshSections sections;
+    memset(&sections, 0, sizeof(sections));
+    sections.vertices = vertices; sections.vertexCount = vertexCount;
+    sections.vertexFormat = choose_vertex_format(vertices, vertexCount, skin != NULL);
+    sections.indices = indices; sections.indexCount = indexCount;
+    sections.boneFrames = boneFrames; sections.boneCount = MAX_BONES; sections.frameCount = frameCount;
+    sections.clips = clips; sections.clipCount = (boneFrames && clips) ? baker.clip_count : 0;
+    sections.curves = curves; sections.keys = keys; sections.keyCount = keyCount;
+    sections.submeshes = &submesh; sections.submeshCount = 1;
+    sections.bounds = submesh.bounds;
+    sections.compress = 1;
+    if (write_mesh_file(bin_path, &sections) == 0)
+        printf("  Wrote output file: %s (%zu bytes per vertex)\n", bin_path, VERTEX_FORMAT_SIZE[sections.vertexFormat]);
+
+    free(clips);
+    free(curves);
+    free(keys);
+    free_baker(&baker);
     free(indices);
     free(vertices);
     cgltf_free(data);
@@ -1,98 +1,101 @@
 // obj2bin.c
 // Compile with: cl /O2 obj2bin.c
+// Only the .obj files that changed since the last run are converted, in parallel (see ../cook.h).
+// Large files are parsed in parallel as well (see obj_parse.h), obj_benchmark.c compares that with a line by line parser.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#include <windows.h>
+#include <stddef.h>
 #include <math.h>
+#include "../cook.h"
+#include "optimize.h"
+#include "vertex.h"
+#include "obj_parse.h"
+#include "mesh_format.h"
 
-// The new target vertex struct. 48 bytes total.
-typedef struct {
-    unsigned int data[4];          // 16 bytes u32 // *info* raw data
-    float position[3];             // 12 bytes f32
-    char normal[4];                // 4 bytes n8 (signed normalized)
-    char tangent[4];               // 4 bytes n8 (signed normalized)
-    unsigned short uv[2];          // 4 bytes n16
-    unsigned char bone_weights[4]; // 4 bytes n8
-    unsigned char bone_indices[4]; // 4 bytes u8 // *info* max 256 bones
-} Vertex;
-
-// New MeshHeader definition.
-typedef struct {
-    uint32_t vertexCount;
-    uint32_t indexCount;
-    uint32_t boneCount;
-    uint32_t frameCount;
-    uint32_t vertexArrayOffset;
-    uint32_t indexArrayOffset;
-    uint32_t boneFramesArrayOffset;
-} MeshHeader;
-
-// Helper vector types for storing OBJ data.
-typedef struct {
-    float x, y, z;
-} Vec3;
-
-typedef struct {
-    float u, v;
-} Vec2;
+#define COOK_VERSION "models 9" // bump when the .bin output changes, so that every model is converted again
 
 // Dynamic array types.
 typedef struct {
-    Vec3 *data;
+    Vertex *data;
     size_t count;
     size_t capacity;
-} Vec3Array;
+} VertexArray;
 
 typedef struct {
-    Vec2 *data;
+    uint32_t *data;
     size_t count;
     size_t capacity;
-} Vec2Array;
+} IndexArray;
 
+// Open addressing hash table from the bytes of a vertex to its index in the VertexArray.
 typedef struct {
-    Vertex *data;
-    size_t count;
-    size_t capacity;
-} VertexArray;
+    uint32_t *slots; // index + 1, 0 is an empty slot
+    size_t capacity; // power of two, kept at most half full
+} VertexMap;
 
 // Push-back functions for our dynamic arrays.
-void push_back_Vec3(Vec3Array *arr, Vec3 v) {
+void push_back_Vertex(VertexArray *arr, Vertex v) {
     if(arr->count >= arr->capacity) {
         arr->capacity = arr->capacity ? arr->capacity * 2 : 8;
-        arr->data = realloc(arr->data, arr->capacity * sizeof(Vec3));
+        arr->data = realloc(arr->data, arr->capacity * sizeof(Vertex));
         if (!arr->data) {
-            fprintf(stderr, "Failed to allocate memory for Vec3Array\n");
+            fprintf(stderr, "Failed to allocate memory for VertexArray\n");
             exit(1);
         }
     }
     arr->data[arr->count++] = v;
 }
 
-void push_back_Vec2(Vec2Array *arr, Vec2 v) {
+void push_back_Index(IndexArray *arr, uint32_t i) {
     if(arr->count >= arr->capacity) {
         arr->capacity = arr->capacity ? arr->capacity * 2 : 8;
-        arr->data = realloc(arr->data, arr->capacity * sizeof(Vec2));
+        arr->data = realloc(arr->data, arr->capacity * sizeof(uint32_t));
         if (!arr->data) {
-            fprintf(stderr, "Failed to allocate memory for Vec2Array\n");
+            fprintf(stderr, "Failed to allocate memory for IndexArray\n");
             exit(1);
         }
     }
-    arr->data[arr->count++] = v;
+    arr->data[arr->count++] = i;
 }
 
-void push_back_Vertex(VertexArray *arr, Vertex v) {
-    if(arr->count >= arr->capacity) {
-        arr->capacity = arr->capacity ? arr->capacity * 2 : 8;
-        arr->data = realloc(arr->data, arr->capacity * sizeof(Vertex));
-        if (!arr->data) {
-            fprintf(stderr, "Failed to allocate memory for VertexArray\n");
+// 64 bit fnv1a over the bytes of the vertex, Vertex has no padding so equal vertices hash equal
+static uint64_t hash_vertex(const Vertex *v) {
+    const unsigned char *bytes = (const unsigned char *)v;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < sizeof(Vertex); i++) { hash ^= bytes[i]; hash *= 0x100000001b3ull; }
+    return hash;
+}
+
+static void map_insert(VertexMap *map, const VertexArray *vertices, uint32_t index) {
+    size_t slot = (size_t)hash_vertex(&vertices->data[index]) & (map->capacity - 1);
+    while (map->slots[slot]) slot = (slot + 1) & (map->capacity - 1);
+    map->slots[slot] = index + 1;
+}
+
+// Welding: a face corner that is identical to an earlier one (after quantization) reuses its index.
+static uint32_t weld_vertex(VertexArray *vertices, VertexMap *map, Vertex v) {
+    if ((vertices->count + 1) * 2 > map->capacity) {
+        free(map->slots);
+        map->capacity = map->capacity ? map->capacity * 2 : 1024;
+        map->slots = calloc(map->capacity, sizeof(uint32_t));
+        if (!map->slots) {
+            fprintf(stderr, "Failed to allocate memory for VertexMap\n");
             exit(1);
         }
+        for (size_t i = 0; i < vertices->count; i++) map_insert(map, vertices, (uint32_t)i);
     }
-    arr->data[arr->count++] = v;
+    size_t slot = (size_t)hash_vertex(&v) & (map->capacity - 1);
+    for (; map->slots[slot]; slot = (slot + 1) & (map->capacity - 1)) {
+        uint32_t index = map->slots[slot] - 1;
+        if (memcmp(&vertices->data[index], &v, sizeof(Vertex)) == 0) return index;
+    }
+    uint32_t index = (uint32_t)vertices->count;
+    push_back_Vertex(vertices, v);
+    map->slots[slot] = index + 1;
+    return index;
 }
 
 // Convert a float in [-1,1] to an 8-bit signed normalized value.
@@ -103,297 +106,182 @@ static char float_to_snorm8(float v) {
     return (char)n;
 }
 
-static unsigned short float_to_half(float f) {
-    uint32_t f32 = *(uint32_t *)&f;
-    uint32_t sign = f32 >> 31;
-    uint32_t exp = (f32 >> 23) & 0xFF;
-    uint32_t frac = f32 & 0x7FFFFF;
-    uint16_t f16;
-    if(exp == 255) { // Inf or NaN
-        f16 = (unsigned short)((sign << 15) | (0x1F << 10) | (frac ? 0x200 : 0));
-    } else if(exp > 142) { // overflow => Inf
-        f16 = (unsigned short)((sign << 15) | (0x1F << 10));
-    } else if(exp < 113) { // underflow => zero
-        f16 = (unsigned short)(sign << 15);
+// The vertex of a face corner, quantized to the full vertex format.
+static Vertex obj_vertex(const ObjData *obj, ObjCorner corner) {
+    Vertex vert;
+    // Initialize the new data field to zeros.
+    vert.data[0] = 0;
+    vert.data[1] = 0;
+    vert.data[2] = 0;
+    vert.data[3] = 0;
+
+    // Position: copy from positions array (OBJ indices are 1-based, 0 is missing or out of range)
+    if (corner.v != 0) {
+        const float *pos = &obj->positions[(corner.v - 1) * 3];
+        vert.position[0] = pos[0];
+        vert.position[1] = pos[1];
+        vert.position[2] = pos[2];
+    } else {
+        vert.position[0] = vert.position[1] = vert.position[2] = 0.0f;
+    }
+
+    // Normal: convert float normal to 8-bit per channel (signed).
+    if (corner.vn != 0) {
+        const float *norm = &obj->normals[(corner.vn - 1) * 3];
+        vert.normal[0] = float_to_snorm8(norm[0]);
+        vert.normal[1] = float_to_snorm8(norm[1]);
+        vert.normal[2] = float_to_snorm8(norm[2]);
+        vert.normal[3] = 127; // represents 1.0 in snorm8
+    } else {
+        // Default normal: (0, 0, 1)
+        vert.normal[0] = float_to_snorm8(0.0f);
+        vert.normal[1] = float_to_snorm8(0.0f);
+        vert.normal[2] = float_to_snorm8(1.0f);
+        vert.normal[3] = 127;
+    }
+
+    // Tangent: not provided by OBJ; use a default tangent.
+    vert.tangent[0] = float_to_snorm8(1.0f);
+    vert.tangent[1] = float_to_snorm8(0.0f);
+    vert.tangent[2] = float_to_snorm8(0.0f);
+    vert.tangent[3] = float_to_snorm8(1.0f);
+
+    // Texture coordinates.
+    if (corner.vt != 0) {
+        const float *uv = &obj->uvs[(corner.vt - 1) * 2];
+        float u = uv[0] < 0 ? 0 : (uv[0] > 1 ? 1 : uv[0]);
+        float v = uv[1] < 0 ? 0 : (uv[1] > 1 ? 1 : uv[1]);
+        // Optionally flip v if needed:
+        // v = 1.0f - v;
+        vert.uv[0] = (unsigned short)(u * 65535.0f);
+        vert.uv[1] = (unsigned short)(v * 65535.0f);
     } else {
-        uint16_t newExp = exp - 112; // (127-15)
-        uint16_t newFrac = frac >> 13;
-        f16 = (unsigned short)((sign << 15) | (newExp << 10) | newFrac);
+        vert.uv[0] = vert.uv[1] = 0;
     }
-    return f16;
+
+    // Bone weights: default full weight on bone 0.
+    vert.bone_weights[0] = 255;
+    vert.bone_weights[1] = 0;
+    vert.bone_weights[2] = 0;
+    vert.bone_weights[3] = 0;
+
+    // Bone indices: default to 0.
+    vert.bone_indices[0] = 0;
+    vert.bone_indices[1] = 0;
+    vert.bone_indices[2] = 0;
+    vert.bone_indices[3] = 0;
+    return vert;
+}
+
+static const char *obj_group_name(const ObjData *obj, size_t g) {
+    return g == 0 ? "default" : obj->groups[g - 1].name;
 }
 
 // Process one OBJ file, parse it, and write out a binary file with header, vertex and index arrays.
-void process_obj_file(const char *filepath) {
-    FILE *fp = fopen(filepath, "r");
-    if (!fp) {
-        printf("Failed to open %s\n", filepath);
-        return;
-    }
+// Returns 0 when the binary file was written.
+int process_obj_file(const char *filepath) {
+    printf("Processing: %s\n", filepath);
+    ObjData obj;
+    if (obj_parse_file(filepath, &obj) != 0) return -1;
     
-    // Dynamic arrays for positions, texture coordinates, normals, and our output vertices.
-    Vec3Array positions = {0};
-    Vec2Array uvs = {0};
-    Vec3Array normals = {0}; // using Vec3 for normals
+    // Dynamic arrays for our output vertices and indices.
     VertexArray vertices = {0};
+    IndexArray indices = {0};
+    Submesh *submeshes = calloc(obj.group_count + 1, sizeof(Submesh));
+    size_t submesh_count = 0;
+    size_t corner_count = obj.corner_count;
+    if (!submeshes) {
+        obj_free(&obj);
+        return -1;
+    }
     
-    char line[1024];
-    while(fgets(line, sizeof(line), fp)) {
-        // Skip comments or blank lines.
-        if(line[0]=='#' || line[0]=='\n')
-            continue;
+    // Every group is welded and optimized on its own, so that its triangles and vertices stay together as a submesh.
+    // The corners before the first group are the group "default", a group that comes back later in the file
+    // (the same name again) adds its faces to the first one.
+    for (size_t g = 0; g <= obj.group_count; g++) {
+        const char *name = obj_group_name(&obj, g);
+        int seen = 0;
+        for (size_t h = 0; h < g && !seen; h++) seen = strcmp(obj_group_name(&obj, h), name) == 0;
+        if (seen) continue;
+        VertexArray group_vertices = {0};
+        IndexArray group_indices = {0};
+        VertexMap vertex_map = {0};
         
-        // Process vertex positions.
-        if (strncmp(line, "v ", 2) == 0) {
-            Vec3 pos;
-            if (sscanf(line+2, "%f %f %f", &pos.x, &pos.y, &pos.z) == 3)
-                push_back_Vec3(&positions, pos);
-        }
-        // Process texture coordinates.
-        else if (strncmp(line, "vt ", 3) == 0) {
-            Vec2 uv;
-            if (sscanf(line+3, "%f %f", &uv.u, &uv.v) == 2)
-                push_back_Vec2(&uvs, uv);
-        }
-        // Process normals.
-        else if (strncmp(line, "vn ", 3) == 0) {
-            Vec3 norm;
-            if (sscanf(line+3, "%f %f %f", &norm.x, &norm.y, &norm.z) == 3)
-                push_back_Vec3(&normals, norm);
-        }
-        // Process faces.
-        else if (strncmp(line, "f ", 2) == 0) {
-            // Copy the face line (skip the "f ") into a buffer.
-            char *faceLine = line + 2;
-            // Tokenize the line (using space or tab as delimiter).
-            char *tokens[16]; // assume a maximum of 16 vertices per face.
-            int tokenCount = 0;
-            char *token = strtok(faceLine, " \t\r\n");
-            while(token && tokenCount < 16) {
-                tokens[tokenCount++] = token;
-                token = strtok(NULL, " \t\r\n");
-            }
-            if (tokenCount < 3)
-                continue; // not enough vertices for a face
-            
-            // Each token can be in these forms:
-            //   v
-            //   v/vt
-            //   v//vn
-            //   v/vt/vn
-            typedef struct {
-                int v;
-                int vt;
-                int vn;
-            } FaceIndices;
-            FaceIndices faceIndices[16] = {0};
-            
-            for (int i = 0; i < tokenCount; i++) {
-                int v = 0, vt = 0, vn = 0;
-                if (strchr(tokens[i], '/') == NULL) {
-                    // Only vertex index is provided.
-                    v = atoi(tokens[i]);
-                } else {
-                    // Count the number of slashes.
-                    int slashCount = 0;
-                    for (char *c = tokens[i]; *c; c++) {
-                        if (*c == '/')
-                            slashCount++;
-                    }
-                    if (slashCount == 1) {
-                        // Format: v/vt
-                        sscanf(tokens[i], "%d/%d", &v, &vt);
-                    } else if (slashCount == 2) {
-                        if (strstr(tokens[i], "//") != NULL) {
-                            // Format: v//vn (no uv)
-                            sscanf(tokens[i], "%d//%d", &v, &vn);
-                        } else {
-                            // Format: v/vt/vn
-                            sscanf(tokens[i], "%d/%d/%d", &v, &vt, &vn);
-                        }
-                    }
-                }
-                faceIndices[i].v  = v;
-                faceIndices[i].vt = vt;
-                faceIndices[i].vn = vn;
-            }
-            
-            // For faces with more than 3 vertices, use fan triangulation:
-            // To change from the current clockwise (CW) to counter-clockwise (CCW) winding order,
-            // we output triangles with vertices: index 0, i+1, i.
-            for (int i = 1; i < tokenCount - 1; i++) {
-                int idx[3] = { 0, i+1, i };
-                for (int j = 0; j < 3; j++) {
-                    int k = idx[j];
-                    Vertex vert;
-                    // Initialize the new data field to zeros.
-                    vert.data[0] = 0;
-                    vert.data[1] = 0;
-                    vert.data[2] = 0;
-                    vert.data[3] = 0;
-                    
-                    // Position: copy from positions array (OBJ indices are 1-based)
-                    if (faceIndices[k].v != 0 && faceIndices[k].v <= (int)positions.count) {
-                        Vec3 pos = positions.data[faceIndices[k].v - 1];
-                        vert.position[0] = pos.x;
-                        vert.position[1] = pos.y;
-                        vert.position[2] = pos.z;
-                    } else {
-                        vert.position[0] = vert.position[1] = vert.position[2] = 0.0f;
-                    }
-                    
-                    // Normal: convert float normal to 8-bit per channel (signed).
-                    if (faceIndices[k].vn != 0 && faceIndices[k].vn <= (int)normals.count) {
-                        Vec3 norm = normals.data[faceIndices[k].vn - 1];
-                        vert.normal[0] = float_to_snorm8(norm.x);
-                        vert.normal[1] = float_to_snorm8(norm.y);
-                        vert.normal[2] = float_to_snorm8(norm.z);
-                        vert.normal[3] = 127; // represents 1.0 in snorm8
-                    } else {
-                        // Default normal: (0, 0, 1)
-                        vert.normal[0] = float_to_snorm8(0.0f);
-                        vert.normal[1] = float_to_snorm8(0.0f);
-                        vert.normal[2] = float_to_snorm8(1.0f);
-                        vert.normal[3] = 127;
-                    }
-                    
-                    // Tangent: not provided by OBJ; use a default tangent.
-                    vert.tangent[0] = float_to_snorm8(1.0f);
-                    vert.tangent[1] = float_to_snorm8(0.0f);
-                    vert.tangent[2] = float_to_snorm8(0.0f);
-                    vert.tangent[3] = float_to_snorm8(1.0f);
-                    
-                    // Texture coordinates.
-                    if (faceIndices[k].vt != 0 && faceIndices[k].vt <= (int)uvs.count) {
-                        Vec2 uv = uvs.data[faceIndices[k].vt - 1];
-                        float u = uv.u < 0 ? 0 : (uv.u > 1 ? 1 : uv.u);
-                        float v = uv.v < 0 ? 0 : (uv.v > 1 ? 1 : uv.v);
-                        // Optionally flip v if needed:
-                        // v = 1.0f - v;
-                        vert.uv[0] = (unsigned short)(u * 65535.0f);
-                        vert.uv[1] = (unsigned short)(v * 65535.0f);
-                    } else {
-                        vert.uv[0] = vert.uv[1] = 0;
-                    }
-                    
-                    // Bone weights: default full weight on bone 0.
-                    vert.bone_weights[0] = 255;
-                    vert.bone_weights[1] = 0;
-                    vert.bone_weights[2] = 0;
-                    vert.bone_weights[3] = 0;
-                    
-                    // Bone indices: default to 0.
-                    vert.bone_indices[0] = 0;
-                    vert.bone_indices[1] = 0;
-                    vert.bone_indices[2] = 0;
-                    vert.bone_indices[3] = 0;
-                    
-                    push_back_Vertex(&vertices, vert);
-                }
+        // The triangles are in the winding of the file, clockwise (CW),
+        // to change to counter-clockwise (CCW) we output the corners of each triangle in the order 0, 2, 1.
+        for (size_t h = g; h <= obj.group_count; h++) {
+            if (strcmp(obj_group_name(&obj, h), name) != 0) continue;
+            size_t first = h == 0 ? 0 : obj.groups[h - 1].first_corner;
+            size_t last = h < obj.group_count ? obj.groups[h].first_corner : obj.corner_count;
+            for (size_t t = first; t + 2 < last; t += 3) {
+                const ObjCorner *triangle = &obj.corners[t];
+                int idx[3] = { 0, 2, 1 };
+                for (int j = 0; j < 3; j++)
+                    push_back_Index(&group_indices, weld_vertex(&group_vertices, &vertex_map, obj_vertex(&obj, triangle[idx[j]])));
             }
         }
-    } // end while reading file
-    fclose(fp);
+        free(vertex_map.slots);
+        if (group_indices.count == 0) continue;
+        
+        // Reorder for the post-transform cache, overdraw and vertex fetch (see optimize.h).
+        group_vertices.count = optimize_mesh(filepath, group_vertices.data, sizeof(Vertex), offsetof(Vertex, position), group_vertices.count, group_indices.data, group_indices.count);
+        
+        Submesh *submesh = &submeshes[submesh_count++];
+        snprintf(submesh->name, sizeof(submesh->name), "%s", name);
+        submesh->firstIndex = (uint32_t)indices.count;
+        submesh->indexCount = (uint32_t)group_indices.count;
+        submesh->firstVertex = (uint32_t)vertices.count;
+        submesh->vertexCount = (uint32_t)group_vertices.count;
+        bounds_of_vertices(&submesh->bounds, group_vertices.data, group_vertices.count, NULL, 0);
+        for (size_t v = 0; v < group_vertices.count; v++) push_back_Vertex(&vertices, group_vertices.data[v]);
+        for (size_t i = 0; i < group_indices.count; i++) push_back_Index(&indices, submesh->firstVertex + group_indices.data[i]);
+        free(group_vertices.data);
+        free(group_indices.data);
+    }
+    obj_free(&obj);
     
     // Create output folder "bin" is assumed to exist (or created by main)
-    // Build the output file name: "bin\<basename>.bin"
-    char outputPath[MAX_PATH];
-    const char *filename = strrchr(filepath, '\\');
-    if (!filename)
-        filename = strrchr(filepath, '/');
-    if (filename)
-        filename++; // skip the slash
-    else
-        filename = filepath;
+    // Build the output file name: "bin/<basename>.bin"
+    char outputPath[COOK_MAX_PATH];
     char basename[256];
-    strncpy(basename, filename, sizeof(basename));
-    basename[sizeof(basename)-1] = '\0';
-    char *dot = strrchr(basename, '.');
-    if (dot)
-        *dot = '\0';
-    
-    sprintf(outputPath, "bin\\%s.bin", basename);
+    cook_base_name(filepath, basename, sizeof(basename));
+    snprintf(outputPath, sizeof(outputPath), "bin/%s.bin", basename);
     
-    // Build a sequential index array.
-    uint32_t *indices = malloc(vertices.count * sizeof(uint32_t));
-    if (!indices) {
-        fprintf(stderr, "Failed to allocate memory for indices\n");
-        exit(1);
-    }
-    for (size_t i = 0; i < vertices.count; i++)
-        indices[i] = (uint32_t)i;
-    
-    // Prepare the header using the new MeshHeader structure.
-    MeshHeader header;
-    header.vertexCount = (uint32_t)vertices.count;
-    header.indexCount  = (uint32_t)vertices.count; // each vertex is an index
-    header.boneCount   = 0;  // OBJ files do not include bone data.
-    header.frameCount  = 0;  // OBJ files do not include animation frames.
-    header.vertexArrayOffset = sizeof(MeshHeader);
-    header.indexArrayOffset  = header.vertexArrayOffset + vertices.count * sizeof(Vertex);
-    header.boneFramesArrayOffset = header.indexArrayOffset + vertices.count * sizeof(uint32_t);
-    
-    // Write the binary file: first the header, then the vertices, then the indices.
-    FILE *out = fopen(outputPath, "wb");
-    if (!out) {
-        printf("Failed to open output file %s\n", outputPath);
-    } else {
-        fwrite(&header, sizeof(MeshHeader), 1, out);
-        fwrite(vertices.data, sizeof(Vertex), vertices.count, out);
-        fwrite(indices, sizeof(uint32_t), vertices.count, out);
-        fclose(out);
-        printf("Wrote %u vertices and %u indices to %s\n", header.vertexCount, header.indexCount, outputPath);
+    // OBJ files do not include bone data or animation frames.
+    MeshSections sections = {0};
+    sections.vertices = vertices.data;
+    sections.vertexCount = vertices.count;
+    sections.vertexFormat = choose_vertex_format(vertices.data, vertices.count, 0);
+    sections.indices = indices.data;
+    sections.indexCount = indices.count;
+    sections.submeshes = submeshes;
+    sections.submeshCount = submesh_count;
+    bounds_of_vertices(&sections.bounds, vertices.data, vertices.count, NULL, 0);
+    sections.compress = 1;
+    int failed = write_mesh_file(outputPath, &sections) != 0;
+    if (!failed) {
+        printf("Wrote %zu vertices (welded from %zu, %zu bytes each), %zu indices and %zu submeshes to %s\n", vertices.count, corner_count, VERTEX_FORMAT_SIZE[sections.vertexFormat], indices.count, submesh_count, outputPath);
     }
     
     // Clean up.
-    free(indices);
-    free(positions.data);
-    free(uvs.data);
-    free(normals.data);
+    free(submeshes);
+    free(indices.data);
     free(vertices.data);
+    return failed ? -1 : 0;
 }
 
-// Recursively search the given directory for .obj files.
-void search_directory(const char *basePath) {
-    char searchPath[MAX_PATH];
-    sprintf(searchPath, "%s\\*", basePath);
-    
-    WIN32_FIND_DATA findData;
-    HANDLE hFind = FindFirstFile(searchPath, &findData);
-    if(hFind == INVALID_HANDLE_VALUE)
-        return;
-    
-    do {
-        // Skip current and parent directory entries.
-        if (strcmp(findData.cFileName, ".") == 0 ||
-            strcmp(findData.cFileName, "..") == 0)
-            continue;
-        
-        char fullPath[MAX_PATH];
-        sprintf(fullPath, "%s\\%s", basePath, findData.cFileName);
-        
-        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            // Recursively search subdirectories.
-            search_directory(fullPath);
-        } else {
-            // Check if file extension is ".obj" (case-insensitive).
-            char *ext = strrchr(findData.cFileName, '.');
-            if (ext && (_stricmp(ext, ".obj") == 0)) {
-                printf("Processing: %s\n", fullPath);
-                process_obj_file(fullPath);
-            }
-        }
-    } while (FindNextFile(hFind, &findData));
-    
-    FindClose(hFind);
+static int obj_output_exists(const char *filepath) {
+    char basename[256], outputPath[COOK_MAX_PATH];
+    cook_base_name(filepath, basename, sizeof(basename));
+    snprintf(outputPath, sizeof(outputPath), "bin/%s.bin", basename);
+    return cook_file_exists(outputPath);
 }
 
 int main(void) {
     // Create "bin" folder if it does not exist.
-    CreateDirectory("bin", NULL);
-    
-    // Search the current directory and subdirectories.
-    search_directory(".");
+    cook_mkdir("bin");
     
-    return 0;
+    // Search the current directory and subdirectories, then convert what changed since the last run.
+    cook_scan(".", ".obj");
+    return cook("bin/cook.cache", COOK_VERSION, process_obj_file, obj_output_exists) ? 1 : 0;
 }
@@ -0,0 +1,152 @@
+// mesh_codec_benchmark.c
+// Compile with: cl /O2 mesh_codec_benchmark.c
+// Times the stream decoder of platform.h (MESH CODEC) against a plain byte by byte decoder of the same streams, on the
+// compressed meshes in bin/, each one decoded "mesh_codec_benchmark 200" times over (200 by default).
+// Both results are compared with each other, and the decoded mesh is compared with the bytes of the stream.
+
+#include "../../platform.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static const char *benchmark_files[] = {"bin/character-male-a.bin", "bin/pine.bin", "bin/cube.bin", "blender/bin/charA.bin", "blender/bin/sphere.bin"};
+
+static double benchmark_ms(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart * 1000.0 / (double) frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+#endif
+}
+
+static struct MappedMemory benchmark_map_file(const char *filename) {
+    struct MappedMemory mm = {0};
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return mm;
+    fseek(fp, 0, SEEK_END);
+    mm.size = (size_t) ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    mm.data = malloc(mm.size);
+    if (!mm.data || fread(mm.data, 1, mm.size, fp) != mm.size) { free(mm.data); mm.data = NULL; mm.size = 0; }
+    fclose(fp);
+    return mm;
+}
+
+static void benchmark_unmap_file(struct MappedMemory *mm) {
+    free(mm->data);
+}
+
+// one thread, so that the times are of the decoder and not of the cores
+static void benchmark_run_jobs(void (*job)(void *data, int index), void *data, int count) {
+    for (int i = 0; i < count; i++) job(data, i);
+}
+
+#pragma region REFERENCE
+// a lane a byte at a time, straight from the description in platform.h
+static const unsigned char *reference_lane(const unsigned char *data, unsigned char *lane, int group_count) {
+    const unsigned char *modes = data;
+    data += (group_count + 3) / 4;
+    for (int g = 0; g < group_count; g++) {
+        int mode = (modes[g >> 2] >> ((g & 3) * 2)) & 3;
+        for (int k = 0; k < MESH_CODEC_GROUP; k++) {
+            unsigned char x = 0;
+            if (mode == 1) x = (data[k / 4] >> (k % 4 * 2)) & 3;
+            else if (mode == 2) x = (data[k / 2] >> (k % 2 * 4)) & 15;
+            else if (mode == 3) x = data[k];
+            lane[g * MESH_CODEC_GROUP + k] = x;
+        }
+        data += mode ? 2 << mode : 0;
+    }
+    return data;
+}
+
+static void reference_stream(const unsigned char *stream, size_t count, int stride, int index_stream, unsigned char *out) {
+    unsigned int block_count = mesh_read32(stream);
+    int lanes = index_stream ? 4 : stride;
+    unsigned char lane[MESH_CODEC_MAX_LANES][MESH_CODEC_BLOCK];
+    for (unsigned int b = 0; b < block_count; b++) {
+        const unsigned char *data = stream + mesh_read32(stream + 4 + 4 * b);
+        size_t first = (size_t) b * MESH_CODEC_BLOCK;
+        int n = count - first < MESH_CODEC_BLOCK ? (int) (count - first) : MESH_CODEC_BLOCK;
+        for (int l = 0; l < lanes; l++) data = reference_lane(data, lane[l], (n + MESH_CODEC_GROUP - 1) / MESH_CODEC_GROUP);
+        unsigned int previous[MESH_CODEC_MAX_LANES] = {0};
+        for (int i = 0; i < n; i++) {
+            if (index_stream) {
+                unsigned int z = lane[0][i] | lane[1][i] << 8 | lane[2][i] << 16 | (unsigned int) lane[3][i] << 24;
+                previous[0] += (z >> 1) ^ (0u - (z & 1));
+                memcpy(out + (first + i) * 4, &previous[0], 4);
+            } else {
+                for (int l = 0; l < stride; l++) {
+                    unsigned char z = lane[l][i];
+                    previous[l] = (unsigned char) (previous[l] + ((z >> 1) ^ (0u - (z & 1))));
+                    out[(first + i) * stride + l] = (unsigned char) previous[l];
+                }
+            }
+        }
+    }
+}
+#pragma endregion
+
+int main(int argc, char **argv) {
+    int repeats = argc > 1 ? atoi(argv[1]) : 200;
+    if (repeats < 1) repeats = 1;
+    struct Platform p = {0};
+    p.map_file = benchmark_map_file;
+    p.unmap_file = benchmark_unmap_file;
+    p.run_jobs = benchmark_run_jobs;
+    int mismatches = 0;
+    double decoded_bytes = 0, stream_bytes = 0, simd_ms = 0, reference_ms = 0;
+    for (int f = 0; f < (int) (sizeof(benchmark_files) / sizeof(benchmark_files[0])); f++) {
+        struct MappedMemory file = map_asset(&p, benchmark_files[f]);
+        if (!file.data || validate_mesh(file.data, file.size, benchmark_files[f]) != 0) return 1;
+        const MeshHeader *header = (const MeshHeader *) file.data;
+        if (!(header->flags & MESH_FLAG_COMPRESSED)) {
+            printf("%s is not compressed, skipped\n", benchmark_files[f]);
+            unmap_asset(&p, &file);
+            continue;
+        }
+        size_t vertex_size = (size_t) header->vertexCount * header->vertexStride, index_size = (size_t) header->indexCount * 4;
+        unsigned char *reference = (unsigned char *) malloc(vertex_size + index_size);
+        double start = benchmark_ms();
+        for (int r = 0; r < repeats; r++) {
+            reference_stream((const unsigned char *) file.data + header->vertexArrayOffset, header->vertexCount, header->vertexStride, 0, reference);
+            reference_stream((const unsigned char *) file.data + header->indexArrayOffset, header->indexCount, 4, 1, reference + vertex_size);
+        }
+        reference_ms += benchmark_ms() - start;
+
+        // decode_mesh unmaps what it is given, so every repeat gets a copy, the copy is not timed
+        struct MappedMemory decoded = {0};
+        for (int r = 0; r < repeats; r++) {
+            struct MappedMemory copy = alloc_asset(file.size);
+            memcpy(copy.data, file.data, file.size);
+            unmap_asset(&p, &decoded);
+            start = benchmark_ms();
+            decoded = decode_mesh(&p, &copy, benchmark_files[f]);
+            simd_ms += benchmark_ms() - start;
+            if (!decoded.data) return 1;
+        }
+        const MeshHeader *out = (const MeshHeader *) decoded.data;
+        int match = memcmp((const unsigned char *) decoded.data + out->vertexArrayOffset, reference, vertex_size) == 0
+                 && memcmp((const unsigned char *) decoded.data + out->indexArrayOffset, reference + vertex_size, index_size) == 0
+                 && memcmp((const unsigned char *) decoded.data + out->boneFramesArrayOffset, (const unsigned char *) file.data + header->boneFramesArrayOffset, header->fileSize - header->boneFramesArrayOffset) == 0;
+        for (unsigned int i = 0; match && i < out->indexCount; i++) match = ((const unsigned int *) ((const unsigned char *) decoded.data + out->indexArrayOffset))[i] < out->vertexCount;
+        printf("%-26s %6zu bytes of streams for %6zu bytes, %s\n", benchmark_files[f], (size_t) header->vertexStreamSize + header->indexStreamSize, vertex_size + index_size, match ? "same result" : "DIFFERENT RESULT");
+        mismatches += !match;
+        decoded_bytes += (double) (vertex_size + index_size) * repeats;
+        stream_bytes += (double) (header->vertexStreamSize + header->indexStreamSize) * repeats;
+        free(reference);
+        unmap_asset(&p, &decoded);
+        unmap_asset(&p, &file);
+    }
+    if (decoded_bytes == 0) return 1;
+    printf("byte by byte: %8.1f ms, %6.2f GB/s decoded\n", reference_ms, decoded_bytes / 1e6 / reference_ms);
+    printf("%-12s  %8.1f ms, %6.2f GB/s decoded, %.1fx, streams are %.0f%% of the mesh\n", MESH_SIMD ":", simd_ms, decoded_bytes / 1e6 / simd_ms, reference_ms / simd_ms, 100.0 * stream_bytes / decoded_bytes);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,277 @@
+/*
+    mesh_format.h
+
+    Shared by the model converters: writing the .bin mesh file, version 3. The structs are those of platform.h.
+
+    header     MeshHeader, 156 bytes
+    sections   vertices, indices, bone frames, clips, submeshes, lods, meshlets, curves, keys, in that order, each one starting on a
+               multiple of MESH_ALIGNMENT with zeros in between, a section that is empty has its offset where it would start
+    crc        MeshHeader.crc is the crc32 of the whole file with the crc field as zero
+    streams    with MESH_FLAG_COMPRESSED the vertex and index sections are streams of vertexStreamSize and indexStreamSize
+               bytes, delta coded per byte lane, see MESH CODEC in platform.h for the layout, platform.h decodes them at load
+    keys       with MESH_FLAG_ANIMATION_KEYS the bone frames section is empty and the animation is an AnimationCurve per
+               clip per bone (clip major) with the AnimationKeys it keeps, the runtime keeps them and samples a pose every frame
+
+    The bounds are in model space, of the bind pose for a skinned mesh that is not animated, of every baked frame
+    for one that is. The lod and meshlet sections are optional, MESH_FLAG_LODS and MESH_FLAG_MESHLETS say when they are there.
+*/
+#ifndef MESH_FORMAT_H_
+#define MESH_FORMAT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "vertex.h"
+#include "../../platform.h" // the structs, MESH_FLAG_*, mesh_crc32 and MESH_CODEC_*, the runtime reads the files with the same definitions
+
+// the sections of a mesh file, the converter fills the counts, the offsets are filled in by write_mesh_file
+typedef struct {
+    const Vertex *vertices; size_t vertexCount; int vertexFormat;
+    const uint32_t *indices; size_t indexCount;
+    const float *boneFrames; size_t boneCount, frameCount; // boneCount * 16 floats per frame
+    const AnimationClip *clips; size_t clipCount;
+    const Submesh *submeshes; size_t submeshCount;
+    const MeshLod *lods; size_t lodCount;
+    const Meshlet *meshlets; size_t meshletCount;
+    const AnimationCurve *curves; const AnimationKey *keys; size_t keyCount; // instead of the bone frames when there are curves
+    MeshBounds bounds;
+    int compress; // write the vertices and indices as streams when that saves at least a quarter of them
+} MeshSections;
+
+#pragma region BOUNDS
+// *info* two passes over the same points: bounds_add_box for the aabb, then bounds_add_sphere for the radius around its center
+static void bounds_reset(MeshBounds *bounds) {
+    memset(bounds, 0, sizeof(*bounds));
+    for (int c = 0; c < 3; c++) { bounds->min[c] = FLT_MAX; bounds->max[c] = -FLT_MAX; }
+}
+
+static void bounds_add_box(MeshBounds *bounds, const float p[3]) {
+    for (int c = 0; c < 3; c++) {
+        if (p[c] < bounds->min[c]) bounds->min[c] = p[c];
+        if (p[c] > bounds->max[c]) bounds->max[c] = p[c];
+    }
+    for (int c = 0; c < 3; c++) bounds->center[c] = (bounds->min[c] + bounds->max[c]) * 0.5f;
+}
+
+static void bounds_add_sphere(MeshBounds *bounds, const float p[3]) {
+    float dx = p[0] - bounds->center[0], dy = p[1] - bounds->center[1], dz = p[2] - bounds->center[2];
+    float r = sqrtf(dx * dx + dy * dy + dz * dz);
+    if (r > bounds->radius) bounds->radius = r;
+}
+
+// an empty mesh gets zero bounds instead of an inverted box
+static void bounds_finish(MeshBounds *bounds) {
+    if (bounds->min[0] > bounds->max[0]) memset(bounds, 0, sizeof(*bounds));
+}
+
+// the bounds of the vertices that the indices use, all vertices without indices
+static void bounds_of_vertices(MeshBounds *bounds, const Vertex *vertices, size_t vertex_count, const uint32_t *indices, size_t index_count) {
+    bounds_reset(bounds);
+    size_t count = indices ? index_count : vertex_count;
+    for (size_t i = 0; i < count; i++) bounds_add_box(bounds, vertices[indices ? indices[i] : i].position);
+    for (size_t i = 0; i < count; i++) bounds_add_sphere(bounds, vertices[indices ? indices[i] : i].position);
+    bounds_finish(bounds);
+}
+#pragma endregion
+
+// the bone matrix between two keys of a curve, t from 0 at a to 1 at b, column-major like the bone frames
+// platform.h samples the keys with the same math, the converter checks its error with this one
+static inline void animation_key_matrix(const AnimationCurve *curve, const AnimationKey *a, const AnimationKey *b, float t, float out[16]) {
+    int dot = 0;
+    for (int i = 0; i < 4; i++) dot += a->rotation[i] * b->rotation[i];
+    float sign = dot < 0 ? -1.0f : 1.0f, q[4], length = 0, translation[3], scale[3];
+    for (int i = 0; i < 4; i++) {
+        q[i] = a->rotation[i] * (1.0f - t) + sign * b->rotation[i] * t;
+        length += q[i] * q[i];
+    }
+    length = length > 0 ? 1.0f / sqrtf(length) : 0;
+    for (int i = 0; i < 4; i++) q[i] *= length;
+    for (int c = 0; c < 3; c++) {
+        translation[c] = curve->translationMin[c] + curve->translationExtent[c] * ((a->translation[c] * (1.0f - t) + b->translation[c] * t) / 65535.0f);
+        scale[c] = curve->scaleMin[c] + curve->scaleExtent[c] * ((a->scale[c] * (1.0f - t) + b->scale[c] * t) / 65535.0f);
+    }
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+    float m[16] = {
+        (1 - 2*y*y - 2*z*z) * scale[0], (2*x*y + 2*z*w) * scale[0],     (2*x*z - 2*y*w) * scale[0],     0,
+        (2*x*y - 2*z*w) * scale[1],     (1 - 2*x*x - 2*z*z) * scale[1], (2*y*z + 2*x*w) * scale[1],     0,
+        (2*x*z + 2*y*w) * scale[2],     (2*y*z - 2*x*w) * scale[2],     (1 - 2*x*x - 2*y*y) * scale[2], 0,
+        translation[0],                 translation[1],                 translation[2],                 1
+    };
+    memcpy(out, m, sizeof(m));
+}
+
+#pragma region CODEC
+// the most a stream of count elements with lanes bytes each can take
+static size_t mesh_stream_bound(size_t count, int lanes) {
+    size_t blocks = (count + MESH_CODEC_BLOCK - 1) / MESH_CODEC_BLOCK;
+    size_t groups = MESH_CODEC_BLOCK / MESH_CODEC_GROUP;
+    return 4 + blocks * 4 + blocks * lanes * ((groups + 3) / 4 + groups * MESH_CODEC_GROUP);
+}
+
+// a 2 bit mode per group, then the groups in the fewest bits that hold their largest byte, returns the bytes written
+static size_t mesh_encode_lane(unsigned char *out, const unsigned char *lane, int group_count) {
+    size_t mode_bytes = (size_t) (group_count + 3) / 4;
+    memset(out, 0, mode_bytes);
+    unsigned char *data = out + mode_bytes;
+    for (int g = 0; g < group_count; g++) {
+        const unsigned char *x = lane + g * MESH_CODEC_GROUP;
+        unsigned char largest = 0;
+        for (int k = 0; k < MESH_CODEC_GROUP; k++) if (x[k] > largest) largest = x[k];
+        int mode = largest == 0 ? 0 : largest < 4 ? 1 : largest < 16 ? 2 : 3;
+        out[g >> 2] |= (unsigned char) (mode << ((g & 3) * 2));
+        if (mode == 1) {
+            for (int k = 0; k < 4; k++) data[k] = (unsigned char) (x[4 * k] | x[4 * k + 1] << 2 | x[4 * k + 2] << 4 | x[4 * k + 3] << 6);
+        } else if (mode == 2) {
+            for (int k = 0; k < 8; k++) data[k] = (unsigned char) (x[2 * k] | x[2 * k + 1] << 4);
+        } else if (mode == 3) {
+            memcpy(data, x, MESH_CODEC_GROUP);
+        }
+        data += mode ? 2 << mode : 0;
+    }
+    return (size_t) (data - out);
+}
+
+// vertices of stride bytes, or indices when index_stream, as a stream, out has mesh_stream_bound bytes, returns the bytes written
+static size_t mesh_encode_stream(unsigned char *out, const void *elements, size_t count, int stride, int index_stream) {
+    const unsigned char *vertices = (const unsigned char *) elements;
+    const uint32_t *indices = (const uint32_t *) elements;
+    int lanes = index_stream ? 4 : stride;
+    uint32_t block_count = (uint32_t) ((count + MESH_CODEC_BLOCK - 1) / MESH_CODEC_BLOCK);
+    memcpy(out, &block_count, 4);
+    size_t size = 4 + 4 * (size_t) block_count;
+    unsigned char lane[MESH_CODEC_BLOCK];
+    for (uint32_t b = 0; b < block_count; b++) {
+        uint32_t offset = (uint32_t) size;
+        memcpy(out + 4 + 4 * b, &offset, 4);
+        size_t first = (size_t) b * MESH_CODEC_BLOCK;
+        int n = count - first < MESH_CODEC_BLOCK ? (int) (count - first) : MESH_CODEC_BLOCK;
+        int groups = (n + MESH_CODEC_GROUP - 1) / MESH_CODEC_GROUP;
+        for (int l = 0; l < lanes; l++) {
+            memset(lane, 0, sizeof(lane));
+            uint32_t previous = 0;
+            for (int i = 0; i < n; i++) {
+                if (index_stream) { // zigzag of the difference with the index before, byte l of it
+                    uint32_t index = indices[first + i], d = index - previous;
+                    lane[i] = (unsigned char) (((d << 1) ^ (0u - (d >> 31))) >> (l * 8));
+                    previous = index;
+                } else { // zigzag of the difference with the same byte of the vertex before
+                    unsigned char byte = vertices[(first + i) * stride + l];
+                    unsigned char d = (unsigned char) (byte - previous);
+                    lane[i] = (unsigned char) ((d << 1) ^ (d & 0x80 ? 0xff : 0));
+                    previous = byte;
+                }
+            }
+            size += mesh_encode_lane(out + size, lane, groups);
+        }
+    }
+    return size;
+}
+#pragma endregion
+
+static uint32_t mesh_align(size_t offset) {
+    return (uint32_t)((offset + MESH_ALIGNMENT - 1) & ~(size_t)(MESH_ALIGNMENT - 1));
+}
+
+// builds the file in memory, so that the crc is known before anything is written, returns 0 when it was written
+static int write_mesh_file(const char *path, const MeshSections *s) {
+    size_t stride = VERTEX_FORMAT_SIZE[s->vertexFormat];
+    MeshHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MESH_MAGIC;
+    header.version = MESH_VERSION;
+    header.flags = (s->boneFrames ? MESH_FLAG_SKINNED : 0) | (s->lodCount ? MESH_FLAG_LODS : 0) | (s->meshletCount ? MESH_FLAG_MESHLETS : 0);
+    header.vertexFormat = (uint32_t) s->vertexFormat;
+    header.vertexStride = (uint32_t) stride;
+    header.vertexCount = (uint32_t) s->vertexCount;
+    header.indexCount = (uint32_t) s->indexCount;
+    header.boneCount = s->boneFrames ? (uint32_t) s->boneCount : 0;
+    header.frameCount = s->boneFrames ? (uint32_t) s->frameCount : 0;
+    size_t curve_count = 0;
+    if (s->boneFrames && s->curves) {
+        header.flags |= MESH_FLAG_ANIMATION_KEYS;
+        header.keyCount = (uint32_t) s->keyCount;
+        curve_count = s->clipCount * s->boneCount;
+    }
+    header.clipCount = (uint32_t) s->clipCount;
+    header.submeshCount = (uint32_t) s->submeshCount;
+    header.lodCount = (uint32_t) s->lodCount;
+    header.meshletCount = (uint32_t) s->meshletCount;
+    header.bounds = s->bounds;
+
+    // the vertices in their format, and the streams of them and the indices if those are small enough
+    size_t vertex_size = s->vertexCount * stride, index_size = s->indexCount * sizeof(uint32_t);
+    unsigned char *vertices = (unsigned char *) malloc(vertex_size ? vertex_size : 1);
+    unsigned char *vertex_stream = NULL, *index_stream = NULL;
+    if (!vertices) {
+        fprintf(stderr, "Out of memory writing %s\n", path);
+        return -1;
+    }
+    encode_vertices(vertices, s->vertices, s->vertexCount, s->vertexFormat);
+    if (s->compress && stride % 4 == 0 && vertex_size + index_size) {
+        vertex_stream = (unsigned char *) malloc(mesh_stream_bound(s->vertexCount, (int) stride));
+        index_stream = (unsigned char *) malloc(mesh_stream_bound(s->indexCount, 4));
+        if (vertex_stream && index_stream) {
+            size_t vertex_stream_size = mesh_encode_stream(vertex_stream, vertices, s->vertexCount, (int) stride, 0);
+            size_t index_stream_size = mesh_encode_stream(index_stream, s->indices, s->indexCount, 4, 1);
+            if ((vertex_stream_size + index_stream_size) * 4 <= (vertex_size + index_size) * 3) {
+                header.flags |= MESH_FLAG_COMPRESSED;
+                header.vertexStreamSize = (uint32_t) vertex_stream_size;
+                header.indexStreamSize = (uint32_t) index_stream_size;
+                vertex_size = vertex_stream_size;
+                index_size = index_stream_size;
+            }
+        }
+    }
+
+    size_t bone_frames_size = curve_count ? 0 : (size_t) header.frameCount * header.boneCount * 16 * sizeof(float);
+    header.vertexArrayOffset = mesh_align(sizeof(MeshHeader));
+    header.indexArrayOffset = mesh_align(header.vertexArrayOffset + vertex_size);
+    header.boneFramesArrayOffset = mesh_align(header.indexArrayOffset + index_size);
+    header.clipTableOffset = mesh_align(header.boneFramesArrayOffset + bone_frames_size);
+    header.submeshTableOffset = mesh_align(header.clipTableOffset + s->clipCount * sizeof(AnimationClip));
+    header.lodTableOffset = mesh_align(header.submeshTableOffset + s->submeshCount * sizeof(Submesh));
+    header.meshletTableOffset = mesh_align(header.lodTableOffset + s->lodCount * sizeof(MeshLod));
+    header.curveTableOffset = mesh_align(header.meshletTableOffset + s->meshletCount * sizeof(Meshlet));
+    header.keyTableOffset = mesh_align(header.curveTableOffset + curve_count * sizeof(AnimationCurve));
+    header.fileSize = mesh_align(header.keyTableOffset + header.keyCount * sizeof(AnimationKey));
+
+    unsigned char *file = (unsigned char *) calloc(header.fileSize, 1);
+    if (!file) {
+        fprintf(stderr, "Out of memory writing %s\n", path);
+        free(vertices); free(vertex_stream); free(index_stream);
+        return -1;
+    }
+    if (header.flags & MESH_FLAG_COMPRESSED) {
+        memcpy(file + header.vertexArrayOffset, vertex_stream, vertex_size);
+        memcpy(file + header.indexArrayOffset, index_stream, index_size);
+    } else {
+        memcpy(file + header.vertexArrayOffset, vertices, vertex_size);
+        if (s->indexCount) memcpy(file + header.indexArrayOffset, s->indices, index_size);
+    }
+    free(vertices); free(vertex_stream); free(index_stream);
+    if (bone_frames_size) memcpy(file + header.boneFramesArrayOffset, s->boneFrames, bone_frames_size);
+    if (s->clipCount) memcpy(file + header.clipTableOffset, s->clips, s->clipCount * sizeof(AnimationClip));
+    if (s->submeshCount) memcpy(file + header.submeshTableOffset, s->submeshes, s->submeshCount * sizeof(Submesh));
+    if (s->lodCount) memcpy(file + header.lodTableOffset, s->lods, s->lodCount * sizeof(MeshLod));
+    if (s->meshletCount) memcpy(file + header.meshletTableOffset, s->meshlets, s->meshletCount * sizeof(Meshlet));
+    if (curve_count) memcpy(file + header.curveTableOffset, s->curves, curve_count * sizeof(AnimationCurve));
+    if (header.keyCount) memcpy(file + header.keyTableOffset, s->keys, header.keyCount * sizeof(AnimationKey));
+    memcpy(file, &header, sizeof(header));
+    header.crc = mesh_crc32(0, file, header.fileSize);
+    memcpy(file, &header, sizeof(header));
+
+    FILE *out = fopen(path, "wb");
+    size_t written = out ? fwrite(file, 1, header.fileSize, out) : 0;
+    if (out) fclose(out);
+    free(file);
+    if (written != header.fileSize) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+#endif
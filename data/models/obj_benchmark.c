@@ -0,0 +1,166 @@
+// obj_benchmark.c
+// Compile with: cl /O2 obj_benchmark.c
+// Times obj_parse.h against the line by line parser the converter had before (fgets, sscanf), on character-male-a.obj
+// scaled up: copies of it next to each other in one file, "obj_benchmark 1000" writes 1000 copies (~60MB).
+// Both results are compared, the scaled file is deleted after.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "obj_parse.h"
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#define BENCHMARK_SOURCE "character-male-a.obj"
+#define BENCHMARK_FILE "obj_benchmark.obj"
+
+static double benchmark_ms(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart * 1000.0 / (double) frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+#endif
+}
+
+#pragma region REFERENCE
+static void reference_push(void **data, size_t *count, size_t *capacity, const void *element, size_t size) {
+    if (*count >= *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 1024;
+        *data = realloc(*data, *capacity * size);
+        if (!*data) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    }
+    memcpy((char *) *data + *count * size, element, size);
+    (*count)++;
+}
+
+// the parser of convert_to_binary.c before obj_parse.h, into the same ObjData
+static int reference_parse_file(const char *path, ObjData *obj) {
+    memset(obj, 0, sizeof(*obj));
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    size_t position_capacity = 0, uv_capacity = 0, normal_capacity = 0, corner_capacity = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (strncmp(line, "v ", 2) == 0) {
+            float xyz[3];
+            if (sscanf(line + 2, "%f %f %f", &xyz[0], &xyz[1], &xyz[2]) == 3) {
+                size_t count = obj->position_count * 3;
+                for (int i = 0; i < 3; i++) reference_push((void **) &obj->positions, &count, &position_capacity, &xyz[i], sizeof(float));
+                obj->position_count++;
+            }
+        } else if (strncmp(line, "vt ", 3) == 0) {
+            float uv[2];
+            if (sscanf(line + 3, "%f %f", &uv[0], &uv[1]) == 2) {
+                size_t count = obj->uv_count * 2;
+                for (int i = 0; i < 2; i++) reference_push((void **) &obj->uvs, &count, &uv_capacity, &uv[i], sizeof(float));
+                obj->uv_count++;
+            }
+        } else if (strncmp(line, "vn ", 3) == 0) {
+            float xyz[3];
+            if (sscanf(line + 3, "%f %f %f", &xyz[0], &xyz[1], &xyz[2]) == 3) {
+                size_t count = obj->normal_count * 3;
+                for (int i = 0; i < 3; i++) reference_push((void **) &obj->normals, &count, &normal_capacity, &xyz[i], sizeof(float));
+                obj->normal_count++;
+            }
+        } else if (strncmp(line, "f ", 2) == 0) {
+            char *tokens[16];
+            int token_count = 0;
+            for (char *c = line + 2; *c && token_count < 16;) {
+                while (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n') *c++ = '\0';
+                if (!*c) break;
+                tokens[token_count++] = c;
+                while (*c && *c != ' ' && *c != '\t' && *c != '\r' && *c != '\n') c++;
+            }
+            ObjCorner corners[16] = {0};
+            for (int i = 0; i < token_count; i++) {
+                int v = 0, vt = 0, vn = 0;
+                if (strchr(tokens[i], '/') == NULL) v = atoi(tokens[i]);
+                else if (strstr(tokens[i], "//")) sscanf(tokens[i], "%d//%d", &v, &vn);
+                else sscanf(tokens[i], "%d/%d/%d", &v, &vt, &vn);
+                // the old converter checked the range against the counts so far
+                corners[i] = (ObjCorner){v > 0 && v <= (int) obj->position_count ? v : 0, vt > 0 && vt <= (int) obj->uv_count ? vt : 0, vn > 0 && vn <= (int) obj->normal_count ? vn : 0};
+            }
+            for (int i = 2; i < token_count; i++) {
+                reference_push((void **) &obj->corners, &obj->corner_count, &corner_capacity, &corners[0], sizeof(ObjCorner));
+                reference_push((void **) &obj->corners, &obj->corner_count, &corner_capacity, &corners[i - 1], sizeof(ObjCorner));
+                reference_push((void **) &obj->corners, &obj->corner_count, &corner_capacity, &corners[i], sizeof(ObjCorner));
+            }
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+#pragma endregion
+
+// copies of the source next to each other, every copy one unit further along x
+static size_t write_scaled(const ObjData *source, int copies) {
+    FILE *out = fopen(BENCHMARK_FILE, "wb");
+    if (!out) return 0;
+    for (int k = 0; k < copies; k++) {
+        for (size_t i = 0; i < source->position_count; i++) {
+            const float *p = &source->positions[i * 3];
+            fprintf(out, "v %.6f %.6f %.6f\n", p[0] + (float) k, p[1], p[2]);
+        }
+        for (size_t i = 0; i < source->uv_count; i++) fprintf(out, "vt %.6f %.6f\n", source->uvs[i * 2], source->uvs[i * 2 + 1]);
+        for (size_t i = 0; i < source->normal_count; i++) {
+            const float *n = &source->normals[i * 3];
+            fprintf(out, "vn %.6f %.6f %.6f\n", n[0], n[1], n[2]);
+        }
+        size_t v = source->position_count * k, vt = source->uv_count * k, vn = source->normal_count * k;
+        for (size_t i = 0; i + 2 < source->corner_count; i += 3) {
+            const ObjCorner *c = &source->corners[i];
+            fprintf(out, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+                    c[0].v + v, c[0].vt + vt, c[0].vn + vn, c[1].v + v, c[1].vt + vt, c[1].vn + vn, c[2].v + v, c[2].vt + vt, c[2].vn + vn);
+        }
+    }
+    size_t size = (size_t) ftell(out);
+    fclose(out);
+    return size;
+}
+
+static int same(const ObjData *a, const ObjData *b) {
+    return a->position_count == b->position_count && a->uv_count == b->uv_count && a->normal_count == b->normal_count && a->corner_count == b->corner_count
+        && memcmp(a->positions, b->positions, a->position_count * 3 * sizeof(float)) == 0
+        && memcmp(a->uvs, b->uvs, a->uv_count * 2 * sizeof(float)) == 0
+        && memcmp(a->normals, b->normals, a->normal_count * 3 * sizeof(float)) == 0
+        && memcmp(a->corners, b->corners, a->corner_count * sizeof(ObjCorner)) == 0;
+}
+
+int main(int argc, char **argv) {
+    int copies = argc > 1 ? atoi(argv[1]) : 1000;
+    if (copies < 1) copies = 1;
+    ObjData source;
+    if (obj_parse_file(BENCHMARK_SOURCE, &source) != 0) return 1;
+    size_t size = write_scaled(&source, copies);
+    obj_free(&source);
+    if (!size) {
+        fprintf(stderr, "Failed to write %s\n", BENCHMARK_FILE);
+        return 1;
+    }
+    printf("%d copies of %s, %.1f MB\n", copies, BENCHMARK_SOURCE, size / (1024.0 * 1024.0));
+
+    ObjData reference, mapped;
+    double start = benchmark_ms();
+    reference_parse_file(BENCHMARK_FILE, &reference);
+    double reference_ms = benchmark_ms() - start;
+    start = benchmark_ms();
+    int failed = obj_parse_file(BENCHMARK_FILE, &mapped);
+    double mapped_ms = benchmark_ms() - start;
+    remove(BENCHMARK_FILE);
+    if (failed) return 1;
+
+    printf("line by line: %8.1f ms, %7.1f MB/s\n", reference_ms, size / (1024.0 * 1024.0) / (reference_ms / 1000.0));
+    printf("obj_parse.h:  %8.1f ms, %7.1f MB/s, %.1fx on %d cores\n", mapped_ms, size / (1024.0 * 1024.0) / (mapped_ms / 1000.0), reference_ms / mapped_ms, cook_cpu_count());
+    int match = same(&reference, &mapped);
+    printf("%zu positions, %zu triangles, %s\n", mapped.position_count, mapped.corner_count / 3, match ? "same result" : "DIFFERENT RESULT");
+    obj_free(&reference);
+    obj_free(&mapped);
+    return match ? 0 : 1;
+}
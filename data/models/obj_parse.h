@@ -0,0 +1,408 @@
+/*
+    obj_parse.h
+
+    The .obj parser of the model converter, made for scans and photogrammetry meshes of hundreds of MB:
+      1. the file is mapped, not read line by line
+      2. it is cut in chunks of OBJ_CHUNK_SIZE on line ends, and the chunks are parsed on all cores (cook_parallel in ../cook.h)
+      3. numbers are parsed by hand, 8 digits at a time while there are 8 digits in a row (SWAR, a u64 as 8 byte lanes)
+      4. the chunks are merged in file order, relative (negative) indices are resolved against the chunk before them
+
+    Only the v, vt, vn, f, g and o lines are read. Faces are fan triangulated in the winding of the file, indices that are
+    out of range become 0, which is what a missing vt or vn is as well. A g or o line starts a group, the converter makes
+    a submesh of every group that has faces.
+*/
+#ifndef OBJ_PARSE_H_
+#define OBJ_PARSE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "../cook.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#ifndef OBJ_CHUNK_SIZE
+#define OBJ_CHUNK_SIZE (4 << 20) // bytes of the file per job
+#endif
+
+typedef struct { int v, vt, vn; } ObjCorner; // 1-based like the file, 0 if missing
+
+typedef struct {
+    char name[32];
+    size_t first_corner; // the group runs until the next one starts
+} ObjGroup;
+
+typedef struct {
+    float *positions; size_t position_count; // xyz
+    float *uvs;       size_t uv_count;       // uv
+    float *normals;   size_t normal_count;   // xyz
+    ObjCorner *corners; size_t corner_count; // 3 per triangle
+    ObjGroup *groups; size_t group_count;    // in file order, the corners before the first group have none
+} ObjData;
+
+struct ObjChunk {
+    const char *begin, *end;
+    ObjData data;
+    size_t position_capacity, uv_capacity, normal_capacity, corner_capacity, group_capacity;
+    unsigned char *relative; // per corner, bit 0 v, bit 1 vt, bit 2 vn: counted from the start of the chunk, rebased in the merge
+    int failed;
+};
+
+#pragma region NUMBERS
+// *info* the lanes are read little endian, which is every platform we convert on
+static int obj_eight_digits(const char *c) {
+    uint64_t lanes;
+    memcpy(&lanes, c, 8);
+    return (((lanes & 0xF0F0F0F0F0F0F0F0ull) | (((lanes + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull);
+}
+
+static uint32_t obj_eight_digits_value(const char *c) {
+    uint64_t lanes;
+    memcpy(&lanes, c, 8);
+    lanes -= 0x3030303030303030ull;
+    lanes = (lanes * 10) + (lanes >> 8); // pairs of digits
+    return (uint32_t)((((lanes & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+                       (((lanes >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32);
+}
+
+// adds the digits at c to the mantissa while it has room for them (~19 significant digits), all of them to the count, returns the end of the digits
+static const char *obj_parse_digits(const char *c, const char *end, uint64_t *mantissa, int *kept, int *count) {
+    while (end - c >= 8 && *mantissa < 100000000000ull && obj_eight_digits(c)) {
+        *mantissa = *mantissa * 100000000ull + obj_eight_digits_value(c);
+        *kept += 8; *count += 8; c += 8;
+    }
+    for (; c < end && (unsigned)(*c - '0') < 10; c++, (*count)++) {
+        if (*mantissa < 1000000000000000000ull) { *mantissa = *mantissa * 10 + (uint64_t)(*c - '0'); (*kept)++; }
+    }
+    return c;
+}
+
+static const char *obj_skip_blanks(const char *c, const char *end) {
+    while (c < end && (*c == ' ' || *c == '\t')) c++;
+    return c;
+}
+
+// NULL if there is no number at c
+static const char *obj_parse_float(const char *c, const char *end, float *out) {
+    static const double powers[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    c = obj_skip_blanks(c, end);
+    int negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+')) c++;
+    uint64_t mantissa = 0;
+    int kept = 0, count = 0;
+    c = obj_parse_digits(c, end, &mantissa, &kept, &count);
+    int exponent = count - kept; // integer digits that did not fit
+    if (c < end && *c == '.') {
+        int fraction_kept = kept;
+        c = obj_parse_digits(c + 1, end, &mantissa, &kept, &count);
+        exponent -= kept - fraction_kept;
+    }
+    if (count == 0) return NULL;
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        const char *e = c + 1;
+        int exponent_negative = e < end && *e == '-';
+        if (e < end && (*e == '-' || *e == '+')) e++;
+        int value = 0, digits = 0;
+        for (; e < end && (unsigned)(*e - '0') < 10; e++, digits++) if (value < 100000) value = value * 10 + (*e - '0');
+        if (digits) { exponent += exponent_negative ? -value : value; c = e; }
+    }
+    // *info* exact when the mantissa fits a double and the power of ten is exact, rounded once more to float
+    double value = (double)mantissa;
+    if (exponent >= 0 && exponent <= 22) value *= powers[exponent];
+    else if (exponent < 0 && exponent >= -22) value /= powers[-exponent];
+    else value *= pow(10.0, exponent);
+    *out = (float)(negative ? -value : value);
+    return c;
+}
+
+// NULL if there is no integer at c
+static const char *obj_parse_int(const char *c, const char *end, int *out) {
+    int negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+')) c++;
+    uint64_t value = 0;
+    int kept = 0, count = 0;
+    c = obj_parse_digits(c, end, &value, &kept, &count);
+    if (count == 0) return NULL;
+    if (count != kept || value > 0x7FFFFFFF) value = 0x7FFFFFFF; // out of range either way
+    *out = negative ? -(int)value : (int)value;
+    return c;
+}
+#pragma endregion
+
+#pragma region CHUNKS
+static int obj_reserve(void **data, size_t *capacity, size_t needed, size_t element_size) {
+    if (needed <= *capacity) return 1;
+    size_t grown = *capacity ? *capacity * 2 : 1024;
+    while (grown < needed) grown *= 2;
+    void *moved = realloc(*data, grown * element_size);
+    if (!moved) return 0;
+    *data = moved;
+    *capacity = grown;
+    return 1;
+}
+
+static const char *obj_parse_floats(const char *c, const char *end, float *out, int count) {
+    for (int i = 0; i < count && c; i++) c = obj_parse_float(c, end, &out[i]);
+    return c;
+}
+
+// a corner of a face, v, v/vt, v//vn or v/vt/vn, the relative indices are made relative to the start of the chunk
+static const char *obj_parse_corner(const char *c, const char *end, const struct ObjChunk *chunk, ObjCorner *corner, unsigned char *relative) {
+    int value[3] = {0, 0, 0};
+    size_t counts[3] = {chunk->data.position_count, chunk->data.uv_count, chunk->data.normal_count};
+    c = obj_parse_int(c, end, &value[0]);
+    if (!c) return NULL;
+    for (int i = 1; i < 3 && c < end && *c == '/'; i++) {
+        c++;
+        if (c < end && *c != '/' && *c != ' ' && *c != '\t' && *c != '\r') {
+            c = obj_parse_int(c, end, &value[i]);
+            if (!c) return NULL;
+        }
+    }
+    *relative = 0;
+    for (int i = 0; i < 3; i++) {
+        if (value[i] < 0) {
+            value[i] = (int)counts[i] + value[i] + 1; // may reach into the chunks before, the merge adds their counts
+            *relative |= (unsigned char)(1 << i);
+        }
+    }
+    *corner = (ObjCorner){value[0], value[1], value[2]};
+    return c;
+}
+
+static int obj_push_corner(struct ObjChunk *chunk, ObjCorner corner, unsigned char relative) {
+    size_t capacity = chunk->corner_capacity;
+    if (!obj_reserve((void **) &chunk->data.corners, &chunk->corner_capacity, chunk->data.corner_count + 1, sizeof(ObjCorner))) return 0;
+    if (chunk->corner_capacity != capacity) {
+        unsigned char *moved = realloc(chunk->relative, chunk->corner_capacity);
+        if (!moved) return 0;
+        chunk->relative = moved;
+    }
+    chunk->data.corners[chunk->data.corner_count] = corner;
+    chunk->relative[chunk->data.corner_count++] = relative;
+    return 1;
+}
+
+static int obj_parse_line(struct ObjChunk *chunk, const char *c, const char *end) {
+    ObjData *data = &chunk->data;
+    c = obj_skip_blanks(c, end);
+    if (end - c < 2) return 1;
+    if (c[0] == 'v' && (c[1] == ' ' || c[1] == '\t')) {
+        float xyz[3];
+        if (!obj_parse_floats(c + 2, end, xyz, 3)) return 1; // malformed lines are skipped
+        if (!obj_reserve((void **) &data->positions, &chunk->position_capacity, (data->position_count + 1) * 3, sizeof(float))) return 0;
+        memcpy(&data->positions[data->position_count++ * 3], xyz, sizeof(xyz));
+    } else if (c[0] == 'v' && c[1] == 't' && end - c > 2 && (c[2] == ' ' || c[2] == '\t')) {
+        float uv[2];
+        if (!obj_parse_floats(c + 3, end, uv, 2)) return 1;
+        if (!obj_reserve((void **) &data->uvs, &chunk->uv_capacity, (data->uv_count + 1) * 2, sizeof(float))) return 0;
+        memcpy(&data->uvs[data->uv_count++ * 2], uv, sizeof(uv));
+    } else if (c[0] == 'v' && c[1] == 'n' && end - c > 2 && (c[2] == ' ' || c[2] == '\t')) {
+        float xyz[3];
+        if (!obj_parse_floats(c + 3, end, xyz, 3)) return 1;
+        if (!obj_reserve((void **) &data->normals, &chunk->normal_capacity, (data->normal_count + 1) * 3, sizeof(float))) return 0;
+        memcpy(&data->normals[data->normal_count++ * 3], xyz, sizeof(xyz));
+    } else if (c[0] == 'f' && (c[1] == ' ' || c[1] == '\t')) {
+        // fan triangulation: 0, i - 1, i
+        ObjCorner first, previous, corner;
+        unsigned char first_relative = 0, previous_relative = 0, relative;
+        int corner_count = 0;
+        for (c = obj_skip_blanks(c + 2, end); c < end && *c != '\r'; c = obj_skip_blanks(c, end)) {
+            c = obj_parse_corner(c, end, chunk, &corner, &relative);
+            if (!c) return 1;
+            if (corner_count >= 2) {
+                if (!obj_push_corner(chunk, first, first_relative) || !obj_push_corner(chunk, previous, previous_relative) || !obj_push_corner(chunk, corner, relative)) return 0;
+            }
+            if (corner_count == 0) { first = corner; first_relative = relative; }
+            previous = corner; previous_relative = relative;
+            corner_count++;
+        }
+    } else if ((c[0] == 'g' || c[0] == 'o') && (c[1] == ' ' || c[1] == '\t')) {
+        // a group without faces is replaced by the next one
+        if (!data->group_count || data->groups[data->group_count - 1].first_corner != data->corner_count) {
+            if (!obj_reserve((void **) &data->groups, &chunk->group_capacity, data->group_count + 1, sizeof(ObjGroup))) return 0;
+            data->group_count++;
+        }
+        ObjGroup *group = &data->groups[data->group_count - 1];
+        const char *name = obj_skip_blanks(c + 2, end), *name_end = end;
+        while (name_end > name && (name_end[-1] == '\r' || name_end[-1] == ' ' || name_end[-1] == '\t')) name_end--;
+        size_t length = (size_t)(name_end - name) < sizeof(group->name) - 1 ? (size_t)(name_end - name) : sizeof(group->name) - 1;
+        memcpy(group->name, name, length);
+        group->name[length] = '\0';
+        group->first_corner = data->corner_count;
+    }
+    return 1;
+}
+
+static void obj_parse_chunk(void *data, int index) {
+    struct ObjChunk *chunk = &((struct ObjChunk *) data)[index];
+    for (const char *c = chunk->begin; c < chunk->end;) {
+        const char *line_end = memchr(c, '\n', (size_t)(chunk->end - c));
+        if (!line_end) line_end = chunk->end;
+        if (*c != '#' && !obj_parse_line(chunk, c, line_end)) { chunk->failed = 1; return; }
+        c = line_end + 1;
+    }
+}
+#pragma endregion
+
+#pragma region FILE
+struct ObjMapping {
+    const char *data; size_t size;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#else
+    int file;
+#endif
+};
+
+static int obj_map(const char *path, struct ObjMapping *map) {
+    memset(map, 0, sizeof(*map));
+#ifdef _WIN32
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER size;
+    GetFileSizeEx(map->file, &size);
+    map->size = (size_t) size.QuadPart;
+    if (map->size == 0) return 1;
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map->mapping) map->data = (const char *) MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!map->data) { if (map->mapping) CloseHandle(map->mapping); CloseHandle(map->file); return 0; }
+#else
+    map->file = open(path, O_RDONLY);
+    if (map->file < 0) return 0;
+    struct stat st;
+    fstat(map->file, &st);
+    map->size = (size_t) st.st_size;
+    if (map->size == 0) return 1;
+    void *data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, map->file, 0);
+    if (data == MAP_FAILED) { close(map->file); return 0; }
+    madvise(data, map->size, MADV_SEQUENTIAL);
+    map->data = (const char *) data;
+#endif
+    return 1;
+}
+
+static void obj_unmap(struct ObjMapping *map) {
+#ifdef _WIN32
+    if (map->data) UnmapViewOfFile(map->data);
+    if (map->mapping) CloseHandle(map->mapping);
+    CloseHandle(map->file);
+#else
+    if (map->data) munmap((void *) map->data, map->size);
+    close(map->file);
+#endif
+}
+
+static void obj_free(ObjData *obj) {
+    free(obj->positions);
+    free(obj->uvs);
+    free(obj->normals);
+    free(obj->corners);
+    free(obj->groups);
+    memset(obj, 0, sizeof(*obj));
+}
+
+static void obj_free_chunks(struct ObjChunk *chunks, int chunk_count) {
+    for (int i = 0; i < chunk_count; i++) {
+        obj_free(&chunks[i].data);
+        free(chunks[i].relative);
+    }
+    free(chunks);
+}
+
+// 0 when missing or out of range
+static int obj_resolve(int index, int is_relative, size_t base, size_t count) {
+    long long resolved = (long long) index + (is_relative ? (long long) base : 0);
+    return resolved > 0 && resolved <= (long long) count ? (int) resolved : 0;
+}
+
+// the chunks one after the other, the indices of the faces rebased on the chunks before them
+static int obj_merge(struct ObjChunk *chunks, int chunk_count, ObjData *obj) {
+    ObjData total = {0};
+    for (int i = 0; i < chunk_count; i++) {
+        total.position_count += chunks[i].data.position_count;
+        total.uv_count += chunks[i].data.uv_count;
+        total.normal_count += chunks[i].data.normal_count;
+        total.corner_count += chunks[i].data.corner_count;
+        total.group_count += chunks[i].data.group_count;
+    }
+    obj->positions = malloc(total.position_count * 3 * sizeof(float) + 1);
+    obj->uvs = malloc(total.uv_count * 2 * sizeof(float) + 1);
+    obj->normals = malloc(total.normal_count * 3 * sizeof(float) + 1);
+    obj->corners = malloc(total.corner_count * sizeof(ObjCorner) + 1);
+    obj->groups = malloc(total.group_count * sizeof(ObjGroup) + 1);
+    if (!obj->positions || !obj->uvs || !obj->normals || !obj->corners || !obj->groups) return 0;
+    for (int i = 0; i < chunk_count; i++) {
+        const ObjData *data = &chunks[i].data;
+        memcpy(&obj->positions[obj->position_count * 3], data->positions, data->position_count * 3 * sizeof(float));
+        memcpy(&obj->uvs[obj->uv_count * 2], data->uvs, data->uv_count * 2 * sizeof(float));
+        memcpy(&obj->normals[obj->normal_count * 3], data->normals, data->normal_count * 3 * sizeof(float));
+        for (size_t k = 0; k < data->corner_count; k++) {
+            ObjCorner corner = data->corners[k];
+            unsigned char relative = chunks[i].relative[k];
+            obj->corners[obj->corner_count + k] = (ObjCorner){
+                obj_resolve(corner.v, relative & 1, obj->position_count, total.position_count),
+                obj_resolve(corner.vt, relative & 2, obj->uv_count, total.uv_count),
+                obj_resolve(corner.vn, relative & 4, obj->normal_count, total.normal_count)};
+        }
+        for (size_t k = 0; k < data->group_count; k++) {
+            ObjGroup group = data->groups[k];
+            group.first_corner += obj->corner_count;
+            // the last group of the chunk before had no faces when this one starts where it starts
+            if (obj->group_count && obj->groups[obj->group_count - 1].first_corner == group.first_corner) obj->group_count--;
+            obj->groups[obj->group_count++] = group;
+        }
+        obj->position_count += data->position_count;
+        obj->uv_count += data->uv_count;
+        obj->normal_count += data->normal_count;
+        obj->corner_count += data->corner_count;
+    }
+    return 1;
+}
+
+// parses the file into obj, 0 on success, obj_free it after
+static int obj_parse_file(const char *path, ObjData *obj) {
+    memset(obj, 0, sizeof(*obj));
+    struct ObjMapping map;
+    if (!obj_map(path, &map)) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return -1;
+    }
+    int chunk_count = (int)(map.size / OBJ_CHUNK_SIZE) + 1;
+    struct ObjChunk *chunks = calloc((size_t) chunk_count, sizeof(struct ObjChunk));
+    if (!chunks) {
+        obj_unmap(&map);
+        return -1;
+    }
+    // every chunk starts after the first line end at or after its share of the file
+    const char *end = map.data + map.size;
+    for (int i = 0; i < chunk_count; i++) {
+        const char *begin = map.data + map.size * (size_t) i / (size_t) chunk_count;
+        if (i > 0) {
+            const char *line_end = memchr(begin - 1, '\n', (size_t)(end - begin + 1));
+            begin = line_end ? line_end + 1 : end;
+        }
+        chunks[i].begin = begin;
+        if (i > 0) chunks[i - 1].end = begin;
+    }
+    chunks[chunk_count - 1].end = end;
+    cook_parallel(obj_parse_chunk, chunks, chunk_count);
+    int failed = 0;
+    for (int i = 0; i < chunk_count; i++) failed |= chunks[i].failed;
+    if (!failed && !obj_merge(chunks, chunk_count, obj)) failed = 1;
+    obj_free_chunks(chunks, chunk_count);
+    obj_unmap(&map);
+    if (failed) {
+        fprintf(stderr, "Out of memory parsing %s\n", path);
+        obj_free(obj);
+        return -1;
+    }
+    return 0;
+}
+#pragma endregion
+
+#endif
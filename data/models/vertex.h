@@ -0,0 +1,161 @@
+/*
+    vertex.h
+
+    Shared by the model converters: the vertex that they build the meshes in, and the compact vertex formats
+    that a mesh is written in when it fits them. Keep the structs and formats in sync with graphics.h.
+
+    VERTEX_FORMAT_FULL     48 bytes, f32 positions, everything
+    VERTEX_FORMAT_STATIC   24 bytes, f16 positions, octahedral n16 normal, no bones
+    VERTEX_FORMAT_SKINNED  32 bytes, the static vertex with the bone weights and indices
+
+    A mesh gets a compact format when no position moves more than VERTEX_POSITION_TOLERANCE by the f16 rounding,
+    which is up to about 8 units from the origin of the model. The format goes in MeshHeader.vertexFormat (mesh_format.h).
+*/
+#ifndef VERTEX_H_
+#define VERTEX_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define VERTEX_FORMAT_FULL 0
+#define VERTEX_FORMAT_STATIC 1
+#define VERTEX_FORMAT_SKINNED 2
+#define VERTEX_POSITION_TOLERANCE 0.004f // in model units, the half of the f16 step at 8 units is 0.0039
+
+// The vertex the converters build, and the full vertex format. 48 bytes total.
+typedef struct {
+    unsigned int data[4];          // 16 bytes u32 // *info* raw data
+    float position[3];             // 12 bytes f32
+    char normal[4];                // 4 bytes n8 (signed normalized)
+    char tangent[4];               // 4 bytes n8 (signed normalized)
+    unsigned short uv[2];          // 4 bytes n16
+    unsigned char bone_weights[4]; // 4 bytes n8
+    unsigned char bone_indices[4]; // 4 bytes u8 // *info* max 256 bones
+} Vertex;
+
+typedef struct { // 24 bytes
+    unsigned short position[4];    // 8 bytes f16 // *info* w is unused
+    short normal[2];               // 4 bytes n16 // *info* octahedral
+    char tangent[4];               // 4 bytes n8
+    unsigned short uv[2];          // 4 bytes n16
+    unsigned int data;             // 4 bytes u32 // *info* data[0] of the full vertex
+} StaticVertex;
+
+typedef struct { // 32 bytes
+    unsigned short position[4];    // 8 bytes f16 // *info* w is unused
+    short normal[2];               // 4 bytes n16 // *info* octahedral
+    char tangent[4];               // 4 bytes n8
+    unsigned short uv[2];          // 4 bytes n16
+    unsigned char bone_weights[4]; // 4 bytes n8
+    unsigned char bone_indices[4]; // 4 bytes u8
+    unsigned int data;             // 4 bytes u32 // *info* data[0] of the full vertex
+} SkinnedVertex;
+
+static const size_t VERTEX_FORMAT_SIZE[3] = {sizeof(Vertex), sizeof(StaticVertex), sizeof(SkinnedVertex)};
+
+// f32 to f16, rounded to nearest even, with denormals, too large is inf
+static unsigned short float_to_half(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t exp = (x >> 23) & 0xFF;
+    uint32_t frac = x & 0x7FFFFF;
+    if (exp == 255) return (unsigned short)(sign | 0x7C00 | (frac ? 0x200 : 0)); // inf or nan
+    int e = (int)exp - 127 + 15;
+    if (e >= 31) return (unsigned short)(sign | 0x7C00);
+    if (e <= 0) { // denormal or zero
+        if (e < -10) return (unsigned short)sign;
+        frac |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - e);
+        uint32_t half = frac >> shift;
+        uint32_t rest = frac & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return (unsigned short)(sign | half);
+    }
+    uint32_t half = ((uint32_t)e << 10) | (frac >> 13);
+    uint32_t rest = frac & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++; // a carry into the exponent is still right
+    return (unsigned short)(sign | half);
+}
+
+static float half_to_float(unsigned short h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F, frac = h & 0x3FF;
+    float f;
+    if (exp == 0) {
+        f = ldexpf((float)frac, -24);
+        return sign ? -f : f;
+    }
+    uint32_t x = sign | (exp == 31 ? 0x7F800000 | (frac << 13) : ((exp + 112) << 23) | (frac << 13));
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static short float_to_snorm16(float v) {
+    int n = (int)roundf(v * 32767.0f);
+    if (n < -32767) n = -32767;
+    if (n > 32767) n = 32767;
+    return (short)n;
+}
+
+// the normal projected on the octahedron and its lower half folded over the upper, decoded by octahedral_decode in shader.wgsl
+static void octahedral_encode(const char normal[4], short out[2]) {
+    float x = normal[0] / 127.0f, y = normal[1] / 127.0f, z = normal[2] / 127.0f;
+    float sum = fabsf(x) + fabsf(y) + fabsf(z);
+    if (sum == 0.0f) { out[0] = 0; out[1] = 0; return; } // no normal, decodes to +z
+    x /= sum; y /= sum; z /= sum;
+    if (z < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx; y = fy;
+    }
+    out[0] = float_to_snorm16(x);
+    out[1] = float_to_snorm16(y);
+}
+
+// the smallest format that keeps the mesh, skinned meshes never lose their bones
+static int choose_vertex_format(const Vertex *vertices, size_t count, int skinned) {
+    for (size_t i = 0; i < count; i++) {
+        for (int c = 0; c < 3; c++) {
+            float p = vertices[i].position[c];
+            if (fabsf(half_to_float(float_to_half(p)) - p) > VERTEX_POSITION_TOLERANCE) return VERTEX_FORMAT_FULL;
+        }
+    }
+    return skinned ? VERTEX_FORMAT_SKINNED : VERTEX_FORMAT_STATIC;
+}
+
+// the vertices in the format, out has room for count * VERTEX_FORMAT_SIZE[format] bytes, returns the bytes written
+static size_t encode_vertices(unsigned char *out, const Vertex *vertices, size_t count, int format) {
+    if (format == VERTEX_FORMAT_FULL) {
+        memcpy(out, vertices, count * sizeof(Vertex));
+        return count * sizeof(Vertex);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const Vertex *v = &vertices[i];
+        unsigned short position[4] = {float_to_half(v->position[0]), float_to_half(v->position[1]), float_to_half(v->position[2]), 0};
+        if (format == VERTEX_FORMAT_STATIC) {
+            StaticVertex s = {0};
+            memcpy(s.position, position, sizeof(position));
+            octahedral_encode(v->normal, s.normal);
+            memcpy(s.tangent, v->tangent, sizeof(s.tangent));
+            memcpy(s.uv, v->uv, sizeof(s.uv));
+            s.data = v->data[0];
+            memcpy(out + i * sizeof(s), &s, sizeof(s));
+        } else {
+            SkinnedVertex s = {0};
+            memcpy(s.position, position, sizeof(position));
+            octahedral_encode(v->normal, s.normal);
+            memcpy(s.tangent, v->tangent, sizeof(s.tangent));
+            memcpy(s.uv, v->uv, sizeof(s.uv));
+            memcpy(s.bone_weights, v->bone_weights, sizeof(s.bone_weights));
+            memcpy(s.bone_indices, v->bone_indices, sizeof(s.bone_indices));
+            s.data = v->data[0];
+            memcpy(out + i * sizeof(s), &s, sizeof(s));
+        }
+    }
+    return count * VERTEX_FORMAT_SIZE[format];
+}
+
+#endif
@@ -0,0 +1,5 @@
+@echo off
+REM run from anywhere, the paths in pack.txt are relative to the root of the repo
+pushd %~dp0..
+tcc data/pack.c -run data/pack.txt data/assets.pack
+popd
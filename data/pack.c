@@ -0,0 +1,140 @@
+/*
+    pack.c
+
+    Puts every file the game loads into one asset pack (data/assets.pack), so that the game maps a single file
+    and the browser version preloads a single file. Run from the root of the repo, see pack.bat:
+        pack <list> <pack>
+    The list has one path per line, as the game asks for it (eg. data/models/bin/cube.bin), # starts a comment.
+    A path prefixed with "store " is never compressed, the game reads it straight out of the mapped pack.
+    Other files are LZ compressed when that saves at least a quarter, they cost a decompress at load instead.
+    Missing files are skipped with a warning, the game falls back to the loose file for anything not in the pack.
+
+    Layout (see ASSET PACK in platform.h): PackHeader, the toc as a hash table of PackEntry, the paths,
+    then the data of every entry starting on a PACK_ALIGNMENT boundary.
+*/
+
+#include "../platform.h"
+#include "lz.h"
+
+#define MAX_ENTRIES 4096
+#define MAX_PATH_LENGTH 256
+
+struct InputFile {
+    char path[MAX_PATH_LENGTH];
+    unsigned char *data; // what goes in the pack, compressed or not
+    unsigned int size, stored_size, flags;
+};
+static struct InputFile files[MAX_ENTRIES];
+
+static unsigned char *read_file(const char *path, unsigned int *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = malloc(length > 0 ? length : 1);
+    if (fread(data, 1, length, f) != (size_t) length) { free(data); fclose(f); return NULL; }
+    fclose(f);
+    *size = (unsigned int) length;
+    return data;
+}
+
+static size_t align_up(size_t offset) {
+    return (offset + PACK_ALIGNMENT - 1) & ~(size_t) (PACK_ALIGNMENT - 1);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: pack <list> <pack>\n");
+        return 1;
+    }
+    FILE *list = fopen(argv[1], "r");
+    if (!list) {
+        fprintf(stderr, "Failed to open list: %s\n", argv[1]);
+        return 1;
+    }
+
+    // READ AND COMPRESS
+    int count = 0;
+    char line[MAX_PATH_LENGTH + 16];
+    while (fgets(line, sizeof(line), list)) {
+        line[strcspn(line, "\r\n#")] = 0;
+        char *path = line;
+        int store = strncmp(path, "store ", 6) == 0;
+        if (store) path += 6;
+        while (*path == ' ' || *path == '\t') path++;
+        for (char *end = path + strlen(path); end > path && (end[-1] == ' ' || end[-1] == '\t'); end--) end[-1] = 0;
+        if (!*path) continue;
+        if (count >= MAX_ENTRIES) {
+            fprintf(stderr, "More than %d files in the list\n", MAX_ENTRIES);
+            return 1;
+        }
+        struct InputFile *file = &files[count];
+        snprintf(file->path, sizeof(file->path), "%s", path);
+        unsigned char *data = read_file(path, &file->size);
+        if (!data) {
+            fprintf(stderr, "Skipping missing file: %s\n", path);
+            continue;
+        }
+        file->data = data;
+        file->stored_size = file->size;
+        if (!store) {
+            unsigned char *compressed = malloc(file->size + file->size / 255 + 16);
+            int compressed_size = lz_compress(data, (int) file->size, compressed);
+            if (compressed_size < (int) (file->size - file->size / 4)) {
+                file->data = compressed;
+                file->stored_size = compressed_size;
+                file->flags |= PACK_COMPRESSED;
+                free(data);
+            } else {
+                free(compressed);
+            }
+        }
+        printf("%-48s %10u -> %10u bytes%s\n", file->path, file->size, file->stored_size, file->flags & PACK_COMPRESSED ? " (lz)" : "");
+        count++;
+    }
+    fclose(list);
+
+    // LAYOUT
+    unsigned int slot_count = 16;
+    while (slot_count < 2 * (unsigned int) count) slot_count *= 2; // at most half full
+    size_t toc_size = sizeof(PackHeader) + slot_count * sizeof(PackEntry);
+    size_t names_size = 0;
+    for (int i = 0; i < count; i++) names_size += strlen(files[i].path) + 1;
+    size_t size = align_up(toc_size + names_size);
+    size_t data_offset = size;
+    for (int i = 0; i < count; i++) size = align_up(size + files[i].stored_size);
+
+    unsigned char *pack = calloc(1, size);
+    PackHeader *header = (PackHeader *) pack;
+    *header = (PackHeader){PACK_MAGIC, PACK_VERSION, slot_count, (unsigned int) count};
+    PackEntry *entries = (PackEntry *) (header + 1);
+    size_t name_offset = toc_size, offset = data_offset;
+    for (int i = 0; i < count; i++) {
+        struct InputFile *file = &files[i];
+        unsigned long long hash = pack_hash(file->path, strlen(file->path));
+        unsigned int slot = (unsigned int) hash & (slot_count - 1);
+        for (; entries[slot].hash; slot = (slot + 1) & (slot_count - 1)) {
+            if (entries[slot].hash == hash) {
+                fprintf(stderr, "%s is in the list twice, or collides with %s\n", file->path, (char *) pack + entries[slot].name_offset);
+                return 1;
+            }
+        }
+        entries[slot] = (PackEntry){hash, offset, file->size, file->stored_size, file->flags, (unsigned int) name_offset};
+        memcpy(pack + name_offset, file->path, strlen(file->path) + 1);
+        name_offset += strlen(file->path) + 1;
+        memcpy(pack + offset, file->data, file->stored_size);
+        offset = align_up(offset + file->stored_size);
+        free(file->data);
+    }
+
+    FILE *out = fopen(argv[2], "wb");
+    if (!out || fwrite(pack, 1, size, out) != size) {
+        fprintf(stderr, "Failed to write pack: %s\n", argv[2]);
+        return 1;
+    }
+    fclose(out);
+    free(pack);
+    printf("Packed %d files into %s, %zu bytes\n", count, argv[2], size);
+    return 0;
+}
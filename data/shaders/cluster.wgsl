@@ -0,0 +1,84 @@
+// todo: duplicated from main shader
+struct GlobalUniforms {
+    time: f32,
+    brightness: f32,
+    shadows: u32,
+    camera_world_space: vec4<f32>,
+    view: mat4x4<f32>,  // View matrix
+    projection: mat4x4<f32>,    // Projection matrix
+    light_view_proj: mat4x4<f32>,
+    light_count: u32,
+    cluster_near: f32,
+    cluster_far: f32,
+    viewport: vec4<f32>, // offset x, offset y, width, height
+};
+struct Light {
+    position: vec3<f32>,
+    range: f32,
+    color: vec3<f32>,
+    spot_cos: f32,
+    direction: vec3<f32>,
+    padding: f32,
+};
+const CLUSTER_X: u32 = 16;
+const CLUSTER_Y: u32 = 9;
+const CLUSTER_Z: u32 = 24;
+const MAX_LIGHTS_PER_CLUSTER: u32 = 63;
+struct ClusterLights { // 256 bytes
+    count: u32,
+    indices: array<u32, MAX_LIGHTS_PER_CLUSTER>,
+};
+
+@group(0) @binding(0) var<uniform> global_uniforms: GlobalUniforms;
+@group(0) @binding(1) var<storage, read> lights: array<Light>;
+@group(0) @binding(2) var<storage, read_write> clusters: array<ClusterLights>;
+
+// exponential depth slices, so clusters near the camera are not stretched out
+fn slice_depth(slice: u32) -> f32 {
+    let near = global_uniforms.cluster_near;
+    let far = global_uniforms.cluster_far;
+    return near * pow(far / near, f32(slice) / f32(CLUSTER_Z));
+}
+
+// one thread per cluster: build the view space bounds of the froxel and gather the lights that touch it
+@compute @workgroup_size(64)
+fn cs_main(@builtin(global_invocation_id) id: vec3<u32>) {
+    let cluster = id.x;
+    if (cluster >= CLUSTER_X * CLUSTER_Y * CLUSTER_Z) {
+        return;
+    }
+    let x = cluster % CLUSTER_X;
+    let y = (cluster / CLUSTER_X) % CLUSTER_Y;
+    let z = cluster / (CLUSTER_X * CLUSTER_Y);
+
+    // tile extent in NDC, y = 0 is the top row of the screen
+    let ndc_min = vec2<f32>(-1.0 + 2.0 * f32(x) / f32(CLUSTER_X), 1.0 - 2.0 * f32(y + 1) / f32(CLUSTER_Y));
+    let ndc_max = vec2<f32>(-1.0 + 2.0 * f32(x + 1) / f32(CLUSTER_X), 1.0 - 2.0 * f32(y) / f32(CLUSTER_Y));
+    let z_near = slice_depth(z);
+    let z_far = slice_depth(z + 1);
+    // perspective projection: view xy = ndc xy * view z / focal length
+    let focal = vec2<f32>(global_uniforms.projection[0][0], global_uniforms.projection[1][1]);
+    let near_min = ndc_min * z_near / focal;
+    let near_max = ndc_max * z_near / focal;
+    let far_min = ndc_min * z_far / focal;
+    let far_max = ndc_max * z_far / focal;
+    let aabb_min = vec3<f32>(min(near_min, far_min), z_near);
+    let aabb_max = vec3<f32>(max(near_max, far_max), z_far);
+
+    var count: u32 = 0;
+    for (var i: u32 = 0; i < global_uniforms.light_count; i = i + 1) {
+        let light = lights[i];
+        let center = (global_uniforms.view * vec4<f32>(light.position, 1.0)).xyz;
+        // sphere vs aabb: squared distance from the light to the closest point in the cluster
+        let closest = clamp(center, aabb_min, aabb_max);
+        let d = closest - center;
+        if (dot(d, d) <= light.range * light.range) {
+            clusters[cluster].indices[count] = i;
+            count = count + 1;
+            if (count == MAX_LIGHTS_PER_CLUSTER) {
+                break;
+            }
+        }
+    }
+    clusters[cluster].count = count;
+}
@@ -0,0 +1,86 @@
+// one-time GGX prefilter of the env cubemap, run by set_env_cube after uploading mip 0
+// mip n is filtered from mip 0 with the lobe of roughness n / (ENV_MIP_LEVELS - 1), the reflection shader picks the mip from material.roughness
+// *info* every sample reads the source at the mip whose texels cover about as much of the sphere as the sample does, so the
+// source is a plain box filtered copy of mip 0 with its own mips, those are made first by passes with a roughness of 0
+struct Params {
+    roughness: f32, // 0 to box filter the source mip above into the mip that is written
+    size: u32, // of the mip that is written
+    source_size: u32, // of mip 0 of the source
+    padding: u32,
+};
+
+@group(0) @binding(0) var source_sampler: sampler;
+@group(0) @binding(1) var source: texture_cube<f32>; // every mip of the source, or only the mip above when box filtering
+@group(0) @binding(2) var destination: texture_storage_2d_array<rgba8unorm, write>; // the 6 faces of the mip that is written
+@group(0) @binding(3) var<uniform> params: Params;
+
+const SAMPLE_COUNT: u32 = 64;
+const PI: f32 = 3.14159265;
+
+// direction through the texel of a face, uv in (-1, 1) with v pointing down
+fn face_direction(face: u32, uv: vec2<f32>) -> vec3<f32> {
+    switch (face) {
+        case 0u: { return vec3<f32>(1.0, -uv.y, -uv.x); }
+        case 1u: { return vec3<f32>(-1.0, -uv.y, uv.x); }
+        case 2u: { return vec3<f32>(uv.x, 1.0, uv.y); }
+        case 3u: { return vec3<f32>(uv.x, -1.0, -uv.y); }
+        case 4u: { return vec3<f32>(uv.x, -uv.y, 1.0); }
+        default: { return vec3<f32>(-uv.x, -uv.y, -1.0); }
+    }
+}
+
+fn hammersley(i: u32, n: u32) -> vec2<f32> {
+    return vec2<f32>(f32(i) / f32(n), f32(reverseBits(i)) * 2.3283064365386963e-10);
+}
+
+// half vector around n, distributed like the GGX normal distribution
+fn importance_sample_ggx(xi: vec2<f32>, n: vec3<f32>, roughness: f32) -> vec3<f32> {
+    let a = roughness * roughness;
+    let phi = 2.0 * PI * xi.x;
+    let cos_theta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+    let sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+    let h = vec3<f32>(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
+    let up = select(vec3<f32>(1.0, 0.0, 0.0), vec3<f32>(0.0, 0.0, 1.0), abs(n.z) < 0.999);
+    let tangent_x = normalize(cross(up, n));
+    let tangent_y = cross(n, tangent_x);
+    return normalize(tangent_x * h.x + tangent_y * h.y + n * h.z);
+}
+
+// GGX normal distribution
+fn d_ggx(n_dot_h: f32, roughness: f32) -> f32 {
+    let a = roughness * roughness;
+    let d = n_dot_h * n_dot_h * (a * a - 1.0) + 1.0;
+    return a * a / (PI * d * d);
+}
+
+@compute @workgroup_size(8, 8, 1)
+fn cs_main(@builtin(global_invocation_id) id: vec3<u32>) {
+    if (id.x >= params.size || id.y >= params.size) {
+        return;
+    }
+    let uv = (vec2<f32>(id.xy) + 0.5) / f32(params.size) * 2.0 - 1.0;
+    // the view direction is assumed to be the normal (n = v = r), the usual split sum approximation
+    let n = normalize(face_direction(id.z, uv));
+    if (params.roughness == 0.0) {
+        // the center of a texel is the corner of 4 texels of the mip above, so one bilinear sample averages them
+        textureStore(destination, vec2<i32>(id.xy), i32(id.z), textureSampleLevel(source, source_sampler, n, 0.0));
+        return;
+    }
+    let texel_solid_angle = 4.0 * PI / (6.0 * f32(params.source_size * params.source_size));
+    var color = vec3<f32>(0.0);
+    var weight = 0.0;
+    for (var i = 0u; i < SAMPLE_COUNT; i++) {
+        let h = importance_sample_ggx(hammersley(i, SAMPLE_COUNT), n, params.roughness);
+        let l = 2.0 * dot(n, h) * h - n;
+        let n_dot_l = dot(n, l);
+        if (n_dot_l > 0.0) {
+            // with n = v the pdf of l is D(n.h) / 4, a sample stands for 1 / (SAMPLE_COUNT * pdf) of the sphere
+            let pdf = d_ggx(max(dot(n, h), 0.0), params.roughness) * 0.25;
+            let sample_solid_angle = 1.0 / (f32(SAMPLE_COUNT) * pdf + 0.0001);
+            let lod = max(0.5 * log2(sample_solid_angle / texel_solid_angle) + 1.0, 0.0);
+            color += textureSampleLevel(source, source_sampler, l, lod).rgb * n_dot_l;
+            weight += n_dot_l;
+        }
+    }
+    textureStore(destination, vec2<i32>(id.xy), i32(id.z), vec4<f32>(color / max(weight, 0.0001), 1.0));
+}
@@ -6,12 +6,17 @@ struct GlobalUniforms {
     view: mat4x4<f32>,  // View matrix
     projection: mat4x4<f32>,    // Projection matrix
     light_view_proj: mat4x4<f32>,
+    light_count: u32,
+    cluster_near: f32,
+    cluster_far: f32,
+    viewport: vec4<f32>, // offset x, offset y, width, height
+    probe_world_space: vec4<f32>, // xyz center of the reflection probe, w how much it is blended over the env cube
 };
 struct MaterialUniforms {
     shader: u32,
     reflective: f32,
     animated: u32,
-    padding_2: u32,
+    roughness: f32,
     padding_3: mat4x4<f32>, // 64 bytes
     padding_3: mat4x4<f32>, // 64 bytes
     padding_3: mat4x4<f32>, // 64 bytes
@@ -30,6 +35,30 @@ struct MaterialUniforms {
 @group(0) @binding(7) var shadow_sampler: sampler_comparison;
 @group(0) @binding(8) var cubemap: texture_cube<f32>;
 @group(0) @binding(9) var cubemap_sampler: sampler;
+@group(0) @binding(10) var<storage, read> lights: array<Light>;
+@group(0) @binding(11) var<storage, read> clusters: array<ClusterLights>; // filled by the compute pass in cluster.wgsl
+@group(0) @binding(12) var texture_tail: texture_2d_array<f32>; // the small mips of every page, always resident
+@group(0) @binding(13) var<storage, read> texture_pages: array<u32>; // slot in 'textures' of every page
+@group(0) @binding(14) var<storage, read_write> texture_feedback: array<atomic<u32>>; // TEXTURE_MIP_LEVELS - finest mip wanted per page, read back by the cpu
+@group(0) @binding(15) var probe_cube: texture_cube<f32>; // rendered around probe_world_space, one face per frame (the env cube in the probe pass itself)
+
+// todo: duplicated in cluster.wgsl
+struct Light {
+    position: vec3<f32>,
+    range: f32,
+    color: vec3<f32>,
+    spot_cos: f32, // cosine of the cone half angle, -1 for point lights
+    direction: vec3<f32>,
+    padding: f32,
+};
+const CLUSTER_X: u32 = 16;
+const CLUSTER_Y: u32 = 9;
+const CLUSTER_Z: u32 = 24;
+const MAX_LIGHTS_PER_CLUSTER: u32 = 63;
+struct ClusterLights {
+    count: u32,
+    indices: array<u32, MAX_LIGHTS_PER_CLUSTER>,
+};
 
 struct VertexInput {
     // Vertex
@@ -46,7 +75,25 @@ struct VertexInput {
     @location(10) i_pos_3: vec4<f32>, // instance transform row 3
     @location(11) i_data: vec3<u32>,
     @location(12) i_norms: vec4<f32>,
-    @location(13) i_animation: u32,
+    @location(13) i_animation: vec2<u32>, // row of the pose in animation_texture + unused
+    @location(14) i_frame: f32,
+    @location(15) i_atlas_uv: vec2<f32>,
+};
+// the vertex of the static vertex format has no bones, the instance is the same
+struct StaticVertexInput {
+    // Vertex
+    @location(1) position: vec3<f32>,
+    @location(2) normal: vec2<f32>, // octahedral
+    @location(3) tangent: vec4<f32>,
+    @location(4) uv: vec2<f32>,
+    // Instance
+    @location(7) i_pos_0: vec4<f32>,
+    @location(8) i_pos_1: vec4<f32>,
+    @location(9) i_pos_2: vec4<f32>,
+    @location(10) i_pos_3: vec4<f32>,
+    @location(11) i_data: vec3<u32>,
+    @location(12) i_norms: vec4<f32>,
+    @location(13) i_animation: vec2<u32>,
     @location(14) i_frame: f32,
     @location(15) i_atlas_uv: vec2<f32>,
 };
@@ -56,17 +103,76 @@ const HUD_SHADER: u32 = 1;
 const SHADOW_MESH_SHADER: u32 = 2;
 const REFLECTION_SHADER: u32 = 3;
 const ENV_CUBE_SHADER: u32 = 4;
+// set per pipeline by create_main_pipeline, every branch on it is resolved when the pipeline is compiled
+override SHADER: u32 = BASE_SHADER;
+
+const ATLAS_UNIT: f32 = 8.0; // texels per unit of the packed size in i_norms[3], keep in sync with graphics.h
+const TEXTURE_SIZE: f32 = 512.0;
+const TEXTURE_MIP_LEVELS: u32 = 10;
+const TEXTURE_STREAMED_MIPS: u32 = 2; // mips of a page that live in 'textures' while it is resident, the others in 'texture_tail'
+const TEXTURE_NOT_RESIDENT: u32 = 0xffffffffu;
+const ENV_MIP_LEVELS: u32 = 8; // mip n of the env cube is prefiltered for roughness n / (ENV_MIP_LEVELS - 1)
+
+const bone_size: u32 = 4; // pixels (1 pixel is one vec4 of the bone matrix)
+
+// [64 x [p1,p2,p3,p4] ] == 256 pixels, a row per animated instance with its pose of this frame, sampled on the cpu
+fn load_bone(row: u32, bone: u32) -> mat4x4<f32> {
+    let start = bone * bone_size;
+    return mat4x4<f32>(textureLoad(animation_texture, vec2<u32>(start, row), 0),
+                       textureLoad(animation_texture, vec2<u32>(start + 1, row), 0),
+                       textureLoad(animation_texture, vec2<u32>(start + 2, row), 0),
+                       textureLoad(animation_texture, vec2<u32>(start + 3, row), 0));
+}
 
-const animation_size: u32 = 8192; // nr of pixels per animation (is also the width of the texture -> 1 height per animation)
-const frame_size: u32 = 64 * 4; // pixels (1 pixel is one vec4 in the bone, 64 bones in a frame/skeleton)
-const bone_size: u32 = 4;
+// the compact vertex formats store the normal as the octahedral projection of it, see data/models/vertex.h
+fn octahedral_decode(e: vec2<f32>) -> vec3<f32> {
+    var n = vec3<f32>(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        let xy = (1.0 - abs(n.yx)) * select(vec2<f32>(-1.0), vec2<f32>(1.0), n.xy >= vec2<f32>(0.0));
+        n = vec3<f32>(xy, n.z);
+    }
+    return normalize(n);
+}
 
+// *info* one entry point per vertex format (VERTEX_ENTRY_POINTS in webgpu.c), they all end up in vertex_main
 @vertex
 fn vs_main(input: VertexInput, @builtin(vertex_index) vertex_index: u32) -> VertexOutput {
+    return vertex_main(input, vertex_index);
+}
+
+@vertex
+fn vs_skinned(input: VertexInput, @builtin(vertex_index) vertex_index: u32) -> VertexOutput {
+    var vertex = input;
+    vertex.normal = vec4<f32>(octahedral_decode(input.normal.xy), 0.0);
+    return vertex_main(vertex, vertex_index);
+}
+
+// *info* the converters only pick the static format for meshes without a skin, so the bones are never read
+@vertex
+fn vs_static(input: StaticVertexInput, @builtin(vertex_index) vertex_index: u32) -> VertexOutput {
+    var vertex: VertexInput;
+    vertex.position = input.position;
+    vertex.normal = vec4<f32>(octahedral_decode(input.normal), 0.0);
+    vertex.tangent = input.tangent;
+    vertex.uv = input.uv;
+    vertex.bone_weights = vec4<f32>(1.0, 0.0, 0.0, 0.0);
+    vertex.bone_indices = vec4<u32>(0u);
+    vertex.i_pos_0 = input.i_pos_0;
+    vertex.i_pos_1 = input.i_pos_1;
+    vertex.i_pos_2 = input.i_pos_2;
+    vertex.i_pos_3 = input.i_pos_3;
+    vertex.i_data = input.i_data;
+    vertex.i_norms = input.i_norms;
+    vertex.i_animation = input.i_animation;
+    vertex.i_frame = input.i_frame;
+    vertex.i_atlas_uv = input.i_atlas_uv;
+    return vertex_main(vertex, vertex_index);
+}
+
+fn vertex_main(input: VertexInput, vertex_index: u32) -> VertexOutput {
     var output: VertexOutput;
     var i_transform = mat4x4<f32>(input.i_pos_0, input.i_pos_1,input.i_pos_2,input.i_pos_3);
     var vertex_position = vec4<f32>(input.position, 1.0);
-    let shader = input.i_data[1]; // todo: put shader id in material instead
     let material = material_uniform_array[input.i_data[2]];
     var skin_matrix = mat4x4<f32>(    
         1.0, 0.0, 0.0, 0.0,
@@ -74,40 +180,20 @@ fn vs_main(input: VertexInput, @builtin(vertex_index) vertex_index: u32) -> Vert
         0.0, 0.0, 1.0, 0.0,
         0.0, 0.0, 0.0, 1.0
     );
-    if (input.i_atlas_uv.x == 0.0) {
+    if (SHADER != HUD_SHADER) {
         if (material.animated == 1) {
-            let frame = u32(input.i_frame); // [32 x [64 x [p1,p2,p3,p4] ] ] == 8192 pixels
-            let frame_start = frame * frame_size;
-            let bone_0 = frame_start + (input.bone_indices[0] * bone_size);
-            let bone_1 = frame_start + (input.bone_indices[1] * bone_size);
-            let bone_2 = frame_start + (input.bone_indices[2] * bone_size);
-            let bone_3 = frame_start + (input.bone_indices[3] * bone_size);
-            skin_matrix = mat4x4<f32>(textureLoad(animation_texture, vec2<u32>(bone_0, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_0 + 1, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_0 + 2, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_0 + 3, input.i_animation), 0))
-                        * input.bone_weights[0]
-                        + mat4x4<f32>(textureLoad(animation_texture, vec2<u32>(bone_1, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_1 + 1, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_1 + 2, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_1 + 3, input.i_animation), 0))
-                        * input.bone_weights[1]
-                        + mat4x4<f32>(textureLoad(animation_texture, vec2<u32>(bone_2, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_2 + 1, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_2 + 2, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_2 + 3, input.i_animation), 0))
-                        * input.bone_weights[2]
-                        + mat4x4<f32>(textureLoad(animation_texture, vec2<u32>(bone_3, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_3 + 1, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_3 + 2, input.i_animation), 0),
-                                      textureLoad(animation_texture, vec2<u32>(bone_3 + 3, input.i_animation), 0))
-                        * input.bone_weights[3];
+            // the clips are already blended into the pose, i_animation[0] is its row
+            let row = input.i_animation[0];
+            skin_matrix = load_bone(row, input.bone_indices[0]) * input.bone_weights[0]
+                        + load_bone(row, input.bone_indices[1]) * input.bone_weights[1]
+                        + load_bone(row, input.bone_indices[2]) * input.bone_weights[2]
+                        + load_bone(row, input.bone_indices[3]) * input.bone_weights[3];
         }
 
         var world_space = i_transform * skin_matrix * vertex_position;
 
         // projected shadow mesh
-        if (material.shader == SHADOW_MESH_SHADER) {
+        if (SHADER == SHADOW_MESH_SHADER) {
             let above = 0.01;
             let distance = -(world_space.y - above) / vec3(0.5, -0.8, 0.5).y;
             let projected_pos = world_space.xyz + (distance * vec3(0.5, -0.8, 0.5));
@@ -125,7 +211,6 @@ fn vs_main(input: VertexInput, @builtin(vertex_index) vertex_index: u32) -> Vert
         // REFLECTIONS
         // todo: mirrored mesh: fade with depth underwater, distort the mesh/texture itself, transparent water to see (?)
         // todo: pass simult. with shadowmap pass -> planar reflection
-        // todo: passes simult. with shadowmap pass -> low res (64-128px) cubemaps for distorted real-time environment reflections
         // todo: shadow mesh projection -> could use dithering, OR, for normal shadow, draw transparent things last, as supposed
         // todo: emscripten (!)
 
@@ -145,8 +230,13 @@ fn vs_main(input: VertexInput, @builtin(vertex_index) vertex_index: u32) -> Vert
         }
         // UV
         let uv_scale = 1.0 / (1. - input.i_norms[0]);
-        output.uv = input.i_atlas_uv + input.uv * uv_scale; // texture scaling
-    } else if (input.i_atlas_uv.x != 0.0) {
+        output.uv = input.uv * uv_scale; // texture scaling, wrapped inside the atlas rect by the fragment shader
+        // i_norms[3] is the mips that are cut off << 12 | width % 64 << 6 | height % 64, 0 is a texture that has the whole page
+        let atlas_size = u32(round(input.i_norms[3] * 65535.0));
+        let atlas_units = (vec2<u32>(atlas_size >> 6u, atlas_size) + 63u) % 64u + 1u;
+        output.atlas_rect = vec4<f32>(input.i_atlas_uv, vec2<f32>(atlas_units) * ATLAS_UNIT / TEXTURE_SIZE);
+        output.atlas_max_lod = f32(TEXTURE_MIP_LEVELS - 1u - (atlas_size >> 12u));
+    } else {
         // HUD SHADER
         // let i = vertex_index % 3u;
         // output.color = vec3<f32>(select(0.0, 1.0, i == 0u), select(0.0, 1.0, i == 1u), select(0.0, 1.0, i == 2u)); // barycentric coords
@@ -170,19 +260,49 @@ struct VertexOutput {
     @location(5) world_space: vec4<f32>, // World-space normal for debugging
     @location(6) center_pos: vec4<f32>, // World-space normal for debugging
     @location(7) shadow_depth: f32,
-    @location(8) i_data: vec3<u32>
+    @location(8) i_data: vec3<u32>,
+    @location(9) atlas_rect: vec4<f32>, // offset + scale of the texture in its atlas page
+    @location(10) @interpolate(flat) atlas_max_lod: f32 // the smaller mips of the texture would be shared with its neighbours
 };
 
+fn texture_lod(ddx: vec2<f32>, ddy: vec2<f32>) -> f32 {
+    return max(log2(max(length(ddx), length(ddy)) * TEXTURE_SIZE), 0.0);
+}
+
+// sample a page from its slot in the texture array while it is resident, otherwise from its tail
+// every 8x8th fragment reports the mip it wanted, the cpu streams the full resolution mips of the page in when they are asked for
+fn sample_page(atlas_uv: vec2<f32>, page: u32, lod: f32, pos: vec4<f32>) -> vec4<f32> {
+    if ((u32(pos.x) & 7u) == 0u && (u32(pos.y) & 7u) == 0u) {
+        atomicMax(&texture_feedback[page], TEXTURE_MIP_LEVELS - min(u32(lod), TEXTURE_MIP_LEVELS - 1u));
+    }
+    let slot = texture_pages[page];
+    if (slot != TEXTURE_NOT_RESIDENT && lod < f32(TEXTURE_STREAMED_MIPS)) {
+        return textureSampleLevel(textures, texture_sampler, atlas_uv, slot, lod);
+    }
+    return textureSampleLevel(texture_tail, texture_sampler, atlas_uv, page, max(lod - f32(TEXTURE_STREAMED_MIPS), 0.0));
+}
+
+// repeat the uv inside the rect of the texture in its atlas page, the gradients of the unwrapped uv keep the mip selection smooth over the seams
+// a texture that shares its page is kept half a texel away from its edges so that its neighbours don't bleed in
+// and its lod stops at the last mip that is still a rect of its own (TextureRegion.mip_count)
+fn sample_atlas(uv: vec2<f32>, rect: vec4<f32>, max_lod: f32, page: u32, pos: vec4<f32>) -> vec4<f32> {
+    let lod = min(texture_lod(dpdx(uv) * rect.zw, dpdy(uv) * rect.zw), max_lod);
+    let half_texel = min(vec2<f32>(0.5 * exp2(ceil(lod)) / TEXTURE_SIZE), rect.zw * 0.5);
+    let inset = select(vec2<f32>(0.0), half_texel, rect.zw < vec2<f32>(1.0));
+    let atlas_uv = rect.xy + clamp(fract(uv) * rect.zw, inset, rect.zw - inset);
+    return sample_page(atlas_uv, page, lod, pos);
+}
+
 @fragment
 fn fs_main(input: VertexOutput) -> @location(0) vec4<f32> {
-    let shader = input.i_data[1]; // todo: put shader id in material instead
+    let shader = SHADER;
     let material = material_uniform_array[input.i_data[2]];
     // ENVIRONMENT CUBE
     if (shader == ENV_CUBE_SHADER) {
-        return textureSample(cubemap, cubemap_sampler, normalize(input.world_space.xyz));
+        return textureSampleLevel(cubemap, cubemap_sampler, normalize(input.world_space.xyz), 0.0);
     }
     if (shader == HUD_SHADER) {
-        let color = textureSample(textures, texture_sampler, input.uv, input.i_data[0]);
+        let color = sample_page(input.uv, input.i_data[0], texture_lod(dpdx(input.uv), dpdy(input.uv)), input.pos);
         if (color.a < 0.49) {
             discard;
         }
@@ -191,7 +311,7 @@ fn fs_main(input: VertexOutput) -> @location(0) vec4<f32> {
 
     let depth = (input.pos.z / input.pos.w);
     let texture_id = input.i_data[0];
-    var tex_color = textureSample(textures, texture_sampler, input.uv, texture_id);
+    var tex_color = sample_atlas(input.uv, input.atlas_rect, input.atlas_max_lod, texture_id, input.pos);
     
     var color = tex_color.rgb;
     var alpha = tex_color.a;
@@ -212,7 +332,17 @@ fn fs_main(input: VertexOutput) -> @location(0) vec4<f32> {
         // If t is negative, the ray missed the sphere; in a well-set scene this shouldn't happen.
         let sampleDir = normalize((P + r * t) - probeCenter);
 
-        color = ((1.0 - material.reflective) * color) + (material.reflective * textureSample(cubemap, cubemap_sampler, sampleDir).rgb);
+        // rough materials read the small, prefiltered mips
+        let env_lod = material.roughness * f32(ENV_MIP_LEVELS - 1);
+        var reflection = textureSampleLevel(cubemap, cubemap_sampler, sampleDir, env_lod).rgb;
+        // the probe has the scene around it, but only a single sharp mip, so rough materials lean on the env cube
+        // it is rendered at probe_world_space, the same parallax correction goes from there instead of from the origin
+        let probeWorld = global_uniforms.probe_world_space.xyz;
+        let probeT = intersectSphere(P, r, probeWorld, probeRadius);
+        let probeDir = normalize((P + r * max(probeT, 0.0)) - probeWorld);
+        let probe = textureSampleLevel(probe_cube, cubemap_sampler, probeDir, 0.0).rgb;
+        reflection = mix(reflection, probe, global_uniforms.probe_world_space.w * (1.0 - material.roughness));
+        color = ((1.0 - material.reflective) * color) + (material.reflective * reflection);
 
         if (t < 0.) {
             color = vec3(1.,0.,1.);
@@ -242,7 +372,8 @@ fn fs_main(input: VertexOutput) -> @location(0) vec4<f32> {
         let ambient_light = 0.6;
         let ambient_light_color = vec3(.33, .33, 1.) * ambient_light;
         let dir_light_color = vec3(1.,1.,.5) * input.light * shadow;
-        color = color * (ambient_light_color + dir_light_color);
+        let point_light_color = clustered_lights(input);
+        color = color * (ambient_light_color + dir_light_color + point_light_color);
         // color = color / (color + vec3(1.0/2.2)); // gamma (needed for 16bit output only)
         // color = pow(color, vec3(1.0 / 2.2)); // gamma (needed for 16bit output only)
     }
@@ -335,6 +466,40 @@ fn intersectSphere(origin: vec3<f32>, dir: vec3<f32>, center: vec3<f32>, radius:
     return t;
 }
 
+// point and spot lights: only loop over the lights that were binned into the cluster of this fragment
+fn clustered_lights(input: VertexOutput) -> vec3<f32> {
+    if (global_uniforms.light_count == 0) {
+        return vec3(0.);
+    }
+    let screen = clamp((input.pos.xy - global_uniforms.viewport.xy) / global_uniforms.viewport.zw, vec2(0.), vec2(0.9999));
+    let view_z = (global_uniforms.view * input.world_space).z;
+    // inverse of the exponential slice distribution in cluster.wgsl
+    let slices = log(max(view_z, global_uniforms.cluster_near) / global_uniforms.cluster_near) / log(global_uniforms.cluster_far / global_uniforms.cluster_near);
+    let z = min(u32(slices * f32(CLUSTER_Z)), CLUSTER_Z - 1);
+    let x = u32(screen.x * f32(CLUSTER_X));
+    let y = u32(screen.y * f32(CLUSTER_Y));
+    let cluster = x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y;
+
+    let P = input.world_space.xyz;
+    let N = normalize(input.world_normal);
+    var result = vec3(0.);
+    let count = clusters[cluster].count;
+    for (var i: u32 = 0; i < count; i = i + 1) {
+        let light = lights[clusters[cluster].indices[i]];
+        let to_light = light.position - P;
+        let distance = length(to_light);
+        let L = to_light / max(distance, 0.0001);
+        // smooth falloff that reaches zero at the range used for binning
+        let falloff = clamp(1.0 - pow(distance / light.range, 4.0), 0.0, 1.0);
+        var attenuation = (falloff * falloff) / (distance * distance + 1.0);
+        // spot cone with a small soft edge
+        let cone = dot(-L, normalize(light.direction));
+        attenuation = attenuation * select(1.0, smoothstep(light.spot_cos, light.spot_cos + 0.05, cone), light.spot_cos > -1.0);
+        result = result + light.color * max(dot(N, L), 0.0) * attenuation;
+    }
+    return result;
+}
+
 fn bayer_dither(pos: vec2<i32>) -> f32 {
     var m: array<f32, 16> = array<f32, 16>(
         0.0,    0.5,    0.125,  0.625,
@@ -11,8 +11,8 @@ struct GlobalUniforms {
 struct MaterialUniforms {
     shader: u32,
     reflective: f32,
-    padding_1: u32,
-    padding_2: u32,
+    animated: u32,
+    roughness: f32,
 };
 
 @group(0) @binding(0)
@@ -25,11 +25,9 @@ var animation_texture: texture_2d<f32>;
 var<uniform> material_uniform_array: array<MaterialUniforms, 256>; // hardcoded: 65536 / 256 (size of MaterialUniforms)
 
 // Vertex input includes the vertex position and the per-instance transform.
+// *info* only attributes that every vertex format has, the same shader runs for all of them
 struct VertexInput {
     @location(1) position: vec3<f32>,
-    @location(2) normal: vec4<f32>,
-    @location(5) bone_weights: vec4<f32>, // weights (assumed normalized)
-    @location(6) bone_indices: vec4<u32>,  // indices into bone_uniforms.bones
     @location(7) i_pos_0: vec4<f32>,
     @location(8) i_pos_1: vec4<f32>,
     @location(9) i_pos_2: vec4<f32>,
@@ -2,10 +2,14 @@
     main.c
 
     This program recursively scans the current folder and all subfolders for PNG files.
+    Only the PNGs that changed since the last run are converted, in parallel (see ../cook.h).
     For each PNG, it loads the image as RGBA (forcing 4 channels using stb_image),
-    then writes a binary file with a header (storing width and height) followed by the raw
-    RGBA pixel data. The output files are saved in a folder called "bin" (created if needed),
-    and any existing files are overwritten.
+    then writes a binary file with a header (storing width, height and mip count) followed by the raw
+    RGBA pixel data of the full mip chain, largest level first, down to 1x1. The mips are made with a
+    gamma-correct 2x2 box filter. The output files are saved in a folder called "bin" (created if needed),
+    and any existing files are overwritten. A universal copy of every image is saved in "tex":
+    the mip chain BC1 compressed, in bands of block rows that are each LZ compressed, so the game
+    can decompress them in parallel and either upload the BC1 blocks or transcode them to RGBA.
 
     This example uses both stb_image and stb_image_write (the latter is included as per request,
     even though it isn’t used in this code).
@@ -14,8 +18,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <windows.h>
-#include <direct.h>  // for _mkdir
+#include <math.h>
+#include "../cook.h"
+#include "../lz.h"
 
 // Include stb_image and stb_image_write implementations.
 #define STBI_NO_SIMD  // Disable SSE/AVX intrinsics (doesn't work with TCC)
@@ -26,119 +31,400 @@
 #include "stb_image_write.h"
 
 // Define the header to be written at the start of each .bin file.
+// *info* keep in sync with ImageHeader in platform.h
 typedef struct {
     int width;
     int height;
+    int mip_count;
+    int pixel_offset; // offset of the first mip level from the start of the file
 } ImageHeader;
 
+#define MAX_MIPS 16
+#define COOK_VERSION "textures 1" // bump when the .bin or .tex output changes, so that every texture is converted again
+
+static float srgb_to_linear_table[256];
+
+static void init_srgb_table(void) {
+    for (int i = 0; i < 256; i++) {
+        float c = i / 255.0f;
+        srgb_to_linear_table[i] = c <= 0.04045f ? c / 12.92f : (float) pow((c + 0.055f) / 1.055f, 2.4);
+    }
+}
+
+static unsigned char linear_to_srgb(float c) {
+    c = c <= 0.0031308f ? c * 12.92f : 1.055f * (float) pow(c, 1.0 / 2.4) - 0.055f;
+    int v = (int)(c * 255.0f + 0.5f);
+    return (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+/*
+    downsample
+    ----------
+    Halves an RGBA image with a 2x2 box filter. The color is averaged in linear space so
+    distant textures don't get darker, alpha is averaged as is. Odd sizes clamp at the edge.
+*/
+static void downsample(const unsigned char *src, int w, int h, unsigned char *dst, int dw, int dh) {
+    for (int y = 0; y < dh; y++) {
+        for (int x = 0; x < dw; x++) {
+            int x0 = x * 2, y0 = y * 2;
+            int x1 = x0 + 1 < w ? x0 + 1 : x0;
+            int y1 = y0 + 1 < h ? y0 + 1 : y0;
+            const unsigned char *p[4] = {
+                src + (y0 * w + x0) * 4, src + (y0 * w + x1) * 4,
+                src + (y1 * w + x0) * 4, src + (y1 * w + x1) * 4,
+            };
+            unsigned char *out = dst + (y * dw + x) * 4;
+            for (int c = 0; c < 3; c++) {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++) sum += srgb_to_linear_table[p[k][c]];
+                out[c] = linear_to_srgb(sum * 0.25f);
+            }
+            out[3] = (unsigned char)((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+        }
+    }
+}
+
+/*
+    BC1 encoder
+    -----------
+    Every 4x4 block gets two RGB565 endpoints and a 2 bit index per pixel. The endpoints are the
+    extremes of the block's colors along their principal axis, refined once with least squares.
+    Blocks with transparent pixels use the 3 color mode, where index 3 is transparent black,
+    which keeps the alpha test in the shader working.
+    todo: BC7 for textures with smooth alpha, ASTC for mobile
+*/
+static size_t bc1_size(int w, int h) {
+    return (size_t) ((w + 3) / 4) * ((h + 3) / 4) * 8;
+}
+
+static unsigned short pack_565(const float c[3]) {
+    int r = (int)(c[0] * 31.0f / 255.0f + 0.5f), g = (int)(c[1] * 63.0f / 255.0f + 0.5f), b = (int)(c[2] * 31.0f / 255.0f + 0.5f);
+    r = r < 0 ? 0 : r > 31 ? 31 : r; g = g < 0 ? 0 : g > 63 ? 63 : g; b = b < 0 ? 0 : b > 31 ? 31 : b;
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(unsigned short v, float c[3]) {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (float)((r << 3) | (r >> 2)); c[1] = (float)((g << 2) | (g >> 4)); c[2] = (float)((b << 3) | (b >> 2));
+}
+
+// palette of the block and the index of the closest entry for every opaque pixel, returns the squared error
+static float bc1_fit_indices(const float px[16][3], const int opaque[16], unsigned short c0, unsigned short c1, int three_color, int idx[16]) {
+    float pal[4][3];
+    unpack_565(c0, pal[0]); unpack_565(c1, pal[1]);
+    for (int k = 0; k < 3; k++) {
+        if (three_color) {
+            pal[2][k] = (pal[0][k] + pal[1][k]) * 0.5f;
+            pal[3][k] = 0.0f;
+        } else {
+            pal[2][k] = (2.0f * pal[0][k] + pal[1][k]) / 3.0f;
+            pal[3][k] = (pal[0][k] + 2.0f * pal[1][k]) / 3.0f;
+        }
+    }
+    float error = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        if (!opaque[i]) { idx[i] = 3; continue; }
+        float best = 1e30f; int best_k = 0;
+        for (int k = 0; k < (three_color ? 3 : 4); k++) {
+            float dr = px[i][0] - pal[k][0], dg = px[i][1] - pal[k][1], db = px[i][2] - pal[k][2];
+            float d = dr * dr + dg * dg + db * db;
+            if (d < best) { best = d; best_k = k; }
+        }
+        idx[i] = best_k; error += best;
+    }
+    return error;
+}
+
+static void encode_bc1_block(const float px[16][3], const int opaque[16], int transparent, unsigned char out[8]) {
+    // mean and covariance of the opaque colors
+    float mean[3] = {0}; int n = 0;
+    for (int i = 0; i < 16; i++) if (opaque[i]) { for (int k = 0; k < 3; k++) mean[k] += px[i][k]; n++; }
+    unsigned short c0 = 0, c1 = 0;
+    int idx[16];
+    if (n > 0) {
+        for (int k = 0; k < 3; k++) mean[k] /= n;
+        float cov[6] = {0};
+        for (int i = 0; i < 16; i++) {
+            if (!opaque[i]) continue;
+            float d[3] = {px[i][0] - mean[0], px[i][1] - mean[1], px[i][2] - mean[2]};
+            cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+            cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+        }
+        // principal axis with a few power iterations
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for (int it = 0; it < 8; it++) {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float len = (float) sqrt(x * x + y * y + z * z);
+            if (len < 1e-6f) break;
+            axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+        }
+        float lo = 1e30f, hi = -1e30f;
+        for (int i = 0; i < 16; i++) {
+            if (!opaque[i]) continue;
+            float t = (px[i][0] - mean[0]) * axis[0] + (px[i][1] - mean[1]) * axis[1] + (px[i][2] - mean[2]) * axis[2];
+            if (t < lo) lo = t;
+            if (t > hi) hi = t;
+        }
+        float e0[3], e1[3];
+        for (int k = 0; k < 3; k++) { e0[k] = mean[k] + axis[k] * hi; e1[k] = mean[k] + axis[k] * lo; }
+        c0 = pack_565(e0); c1 = pack_565(e1);
+        float error = bc1_fit_indices(px, opaque, c0, c1, transparent, idx);
+
+        // least squares refinement of the endpoints for the chosen indices
+        {
+            static const float w4[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+            static const float w3[4] = {1.0f, 0.0f, 0.5f, 0.0f};
+            const float *wt = transparent ? w3 : w4;
+            float aa = 0, bb = 0, ab = 0, ax[3] = {0}, bx[3] = {0};
+            for (int i = 0; i < 16; i++) {
+                if (!opaque[i]) continue;
+                float a = wt[idx[i]], b = 1.0f - a;
+                aa += a * a; bb += b * b; ab += a * b;
+                for (int k = 0; k < 3; k++) { ax[k] += a * px[i][k]; bx[k] += b * px[i][k]; }
+            }
+            float det = aa * bb - ab * ab;
+            if (fabs(det) > 1e-6) {
+                float r0[3], r1[3];
+                for (int k = 0; k < 3; k++) {
+                    r0[k] = (ax[k] * bb - bx[k] * ab) / det;
+                    r1[k] = (bx[k] * aa - ax[k] * ab) / det;
+                }
+                unsigned short n0 = pack_565(r0), n1 = pack_565(r1);
+                int refined[16];
+                float refined_error = bc1_fit_indices(px, opaque, n0, n1, transparent, refined);
+                if (refined_error < error) {
+                    c0 = n0; c1 = n1; error = refined_error;
+                    memcpy(idx, refined, sizeof(idx));
+                }
+            }
+        }
+    }
+    // the order of the endpoints selects the mode: c0 > c1 is 4 colors, c0 <= c1 is 3 colors + transparent
+    if (transparent ? c0 > c1 : c0 < c1) {
+        unsigned short t = c0; c0 = c1; c1 = t;
+    }
+    if (!transparent && c0 == c1) {
+        // a flat block: all pixels use c0, both modes decode index 0 the same way
+        for (int i = 0; i < 16; i++) idx[i] = 0;
+    } else {
+        bc1_fit_indices(px, opaque, c0, c1, transparent, idx);
+    }
+    unsigned int bits = 0;
+    for (int i = 0; i < 16; i++) bits |= (unsigned int) idx[i] << (i * 2);
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    out[4] = bits & 0xFF; out[5] = (bits >> 8) & 0xFF; out[6] = (bits >> 16) & 0xFF; out[7] = bits >> 24;
+}
+
+#define BC1_BAND_ROWS 8 // rows of blocks per job
+typedef struct {
+    const unsigned char *rgba; int w, h;
+    unsigned char *out;
+} BC1Job;
+
+static void encode_bc1_rows(void *data, int band) {
+    BC1Job *job = (BC1Job *) data;
+    int blocks_x = (job->w + 3) / 4, blocks_y = (job->h + 3) / 4;
+    int last_row = (band + 1) * BC1_BAND_ROWS < blocks_y ? (band + 1) * BC1_BAND_ROWS : blocks_y;
+    for (int by = band * BC1_BAND_ROWS; by < last_row; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            float px[16][3]; int opaque[16]; int transparent = 0;
+            for (int i = 0; i < 16; i++) {
+                // pixels outside of small mips repeat the edge
+                int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+                x = x < job->w ? x : job->w - 1;
+                y = y < job->h ? y : job->h - 1;
+                const unsigned char *p = job->rgba + ((size_t) y * job->w + x) * 4;
+                px[i][0] = p[0]; px[i][1] = p[1]; px[i][2] = p[2];
+                opaque[i] = p[3] >= 128;
+                transparent |= !opaque[i];
+            }
+            encode_bc1_block(px, opaque, transparent, job->out + ((size_t) by * blocks_x + bx) * 8);
+        }
+    }
+}
+
+// split the block rows over all cores, a large texture still converts fast when it is the only one that changed
+static void encode_bc1(const unsigned char *rgba, int w, int h, unsigned char *out) {
+    BC1Job job = {rgba, w, h, out};
+    int blocks_y = (h + 3) / 4;
+    cook_parallel(encode_bc1_rows, &job, (blocks_y + BC1_BAND_ROWS - 1) / BC1_BAND_ROWS);
+}
+
+/*
+    Universal texture container (.tex), keep in sync with platform.h
+*/
+#define TEX_MAGIC 0x58455455 // "UTEX"
+#define TEX_VERSION 1
+#define TEX_BAND_ROWS 16 // rows of 4x4 blocks per chunk
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    int width;
+    int height;
+    int mip_count;
+    int chunk_count; // TextureChunk[chunk_count] follows the header, then the compressed data
+} TextureFileHeader;
+typedef struct {
+    int mip;
+    int first_row; // in blocks
+    int row_count; // in blocks
+    unsigned int offset; // from the start of the file
+    unsigned int compressed_size;
+    unsigned int size; // BC1 bytes after decompression
+} TextureChunk;
+
+// BC1 levels split in bands of block rows, every band compressed on its own
+static int write_universal(const char *out_filename, unsigned char **blocks, const int *level_w, const int *level_h, int mip_count) {
+    FILE *fp = fopen(out_filename, "wb");
+    if (!fp) {
+        printf("Failed to open output file: %s\n", out_filename);
+        return -1;
+    }
+    TextureChunk chunks[256];
+    int chunk_count = 0;
+    for (int mip = 0; mip < mip_count; mip++) {
+        int blocks_y = (level_h[mip] + 3) / 4;
+        for (int row = 0; row < blocks_y && chunk_count < 256; row += TEX_BAND_ROWS) {
+            chunks[chunk_count].mip = mip;
+            chunks[chunk_count].first_row = row;
+            chunks[chunk_count].row_count = blocks_y - row < TEX_BAND_ROWS ? blocks_y - row : TEX_BAND_ROWS;
+            chunk_count++;
+        }
+    }
+    TextureFileHeader header = {TEX_MAGIC, TEX_VERSION, level_w[0], level_h[0], mip_count, chunk_count};
+    unsigned int offset = sizeof(TextureFileHeader) + chunk_count * sizeof(TextureChunk);
+    fseek(fp, offset, SEEK_SET);
+    for (int c = 0; c < chunk_count; c++) {
+        TextureChunk *chunk = &chunks[c];
+        int row_size = ((level_w[chunk->mip] + 3) / 4) * 8;
+        const unsigned char *src = blocks[chunk->mip] + (size_t) chunk->first_row * row_size;
+        int size = chunk->row_count * row_size;
+        unsigned char *compressed = malloc(size + size / 255 + 16);
+        chunk->offset = offset;
+        chunk->size = size;
+        chunk->compressed_size = lz_compress(src, size, compressed);
+        fwrite(compressed, 1, chunk->compressed_size, fp);
+        offset += chunk->compressed_size;
+        free(compressed);
+    }
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(chunks, sizeof(TextureChunk), chunk_count, fp);
+    fclose(fp);
+    return 0;
+}
+
+// header + every level after each other, largest first
+static int write_levels(const char *out_filename, unsigned char **levels, const int *level_w, const int *level_h, int mip_count) {
+    FILE *fp = fopen(out_filename, "wb");
+    if (!fp) {
+        printf("Failed to open output file: %s\n", out_filename);
+        return -1;
+    }
+    ImageHeader header;
+    header.width = level_w[0];
+    header.height = level_h[0];
+    header.mip_count = mip_count;
+    header.pixel_offset = sizeof(ImageHeader);
+    if (fwrite(&header, sizeof(ImageHeader), 1, fp) != 1) {
+        printf("Failed to write header to file: %s\n", out_filename);
+        fclose(fp);
+        return -1;
+    }
+    for (int mip = 0; mip < mip_count; mip++) {
+        size_t data_size = (size_t) level_w[mip] * level_h[mip] * 4;
+        if (fwrite(levels[mip], sizeof(unsigned char), data_size, fp) != data_size) {
+            printf("Failed to write image data to file: %s\n", out_filename);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
 /*
     process_image
     -------------
     Loads a PNG image from 'full_path' (forcing conversion to RGBA),
     then writes a binary file in the "bin" folder. The binary file begins
-    with an ImageHeader (width and height), followed by the raw pixel data.
+    with an ImageHeader, followed by the raw pixel data of every mip level.
+    Returns 0 when both outputs were written.
 */
-void process_image(const char *full_path, const char *file_name) {
+int process_image(const char *full_path) {
     int width, height, channels;
     // Force loading as 4 channels (RGBA). If the PNG lacks an alpha channel, 255 is used.
     unsigned char *data = stbi_load(full_path, &width, &height, &channels, 4);
     if (!data) {
         printf("Failed to load image: %s\n", full_path);
-        return;
+        return -1;
     }
     
     // Build the output file name.
-    // Strip the extension from the original file name and replace it with .bin.
+    // Strip the folders and the extension from the original file name and replace it with .bin.
     char base_name[256];
-    strncpy(base_name, file_name, sizeof(base_name)-1);
-    base_name[sizeof(base_name)-1] = '\0';
-    char *dot = strrchr(base_name, '.');
-    if (dot) {
-        *dot = '\0'; // Remove extension.
-    }
+    cook_base_name(full_path, base_name, sizeof(base_name));
     
-    char out_filename[512];
-    snprintf(out_filename, sizeof(out_filename), "bin\\%s.bin", base_name);
-    
-    FILE *fp = fopen(out_filename, "wb");
-    if (!fp) {
-        printf("Failed to open output file: %s\n", out_filename);
-        stbi_image_free(data);
-        return;
+    // Build the full mip chain, each level is made from the previous one.
+    unsigned char *levels[MAX_MIPS] = {data};
+    int level_w[MAX_MIPS] = {width}, level_h[MAX_MIPS] = {height};
+    int mip_count = 1;
+    while ((level_w[mip_count - 1] > 1 || level_h[mip_count - 1] > 1) && mip_count < MAX_MIPS) {
+        int lw = level_w[mip_count - 1], lh = level_h[mip_count - 1];
+        int nw = lw > 1 ? lw / 2 : 1;
+        int nh = lh > 1 ? lh / 2 : 1;
+        levels[mip_count] = malloc((size_t) nw * nh * 4);
+        downsample(levels[mip_count - 1], lw, lh, levels[mip_count], nw, nh);
+        level_w[mip_count] = nw; level_h[mip_count] = nh;
+        mip_count++;
     }
-    
-    // Write the header (width and height).
-    ImageHeader header;
-    header.width = width;
-    header.height = height;
-    if (fwrite(&header, sizeof(ImageHeader), 1, fp) != 1) {
-        printf("Failed to write header to file: %s\n", out_filename);
-        fclose(fp);
-        stbi_image_free(data);
-        return;
+
+    // Raw RGBA, the fallback for gpus without block compression
+    char out_filename[512];
+    snprintf(out_filename, sizeof(out_filename), "bin/%s.bin", base_name);
+    int failed = write_levels(out_filename, levels, level_w, level_h, mip_count);
+
+    // Universal: BC1, 8 bytes per 4x4 block, LZ compressed
+    char tex_filename[512];
+    snprintf(tex_filename, sizeof(tex_filename), "tex/%s.tex", base_name);
+    unsigned char *blocks[MAX_MIPS];
+    for (int mip = 0; mip < mip_count; mip++) {
+        blocks[mip] = malloc(bc1_size(level_w[mip], level_h[mip]));
+        encode_bc1(levels[mip], level_w[mip], level_h[mip], blocks[mip]);
     }
-    
-    // Write the raw RGBA data.
-    size_t data_size = (size_t) width * height * 4;
-    if (fwrite(data, sizeof(unsigned char), data_size, fp) != data_size) {
-        printf("Failed to write image data to file: %s\n", out_filename);
+    failed |= write_universal(tex_filename, blocks, level_w, level_h, mip_count);
+
+    for (int mip = 0; mip < mip_count; mip++) {
+        if (mip > 0) free(levels[mip]);
+        free(blocks[mip]);
     }
-    
-    fclose(fp);
     stbi_image_free(data);
     
-    printf("Processed: %s -> %s (Width: %d, Height: %d)\n", full_path, out_filename, width, height);
+    printf("Processed: %s -> %s + %s (Width: %d, Height: %d, Mips: %d)\n", full_path, out_filename, tex_filename, width, height, mip_count);
+    return failed;
 }
 
-/*
-    scan_directory
-    --------------
-    Recursively scans the directory specified by 'directory'. For every file with a
-    ".png" extension (case-insensitive), it calls process_image().
-    
-    This function uses the Windows API (FindFirstFile/FindNextFile) for directory traversal.
-*/
-void scan_directory(const char *directory) {
-    char search_path[512];
-    snprintf(search_path, sizeof(search_path), "%s\\*", directory);
-    
-    WIN32_FIND_DATA find_data;
-    HANDLE hFind = FindFirstFile(search_path, &find_data);
-    if (hFind == INVALID_HANDLE_VALUE) {
-        return;
-    }
-    
-    do {
-        // Skip the special directories "." and ".."
-        if (strcmp(find_data.cFileName, ".") == 0 || strcmp(find_data.cFileName, "..") == 0)
-            continue;
-        
-        char full_path[512];
-        snprintf(full_path, sizeof(full_path), "%s\\%s", directory, find_data.cFileName);
-        
-        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            // Recursively scan subdirectories.
-            scan_directory(full_path);
-        } else {
-            // Check if the file extension is ".png" (case-insensitive).
-            const char *ext = strrchr(find_data.cFileName, '.');
-            if (ext && (_stricmp(ext, ".png") == 0)) {
-                process_image(full_path, find_data.cFileName);
-            }
-        }
-    } while (FindNextFile(hFind, &find_data));
-    
-    FindClose(hFind);
+// both outputs have to be there, otherwise the image is converted again even if it did not change
+static int image_outputs_exist(const char *full_path) {
+    char base_name[256], path[512];
+    cook_base_name(full_path, base_name, sizeof(base_name));
+    snprintf(path, sizeof(path), "bin/%s.bin", base_name);
+    if (!cook_file_exists(path)) return 0;
+    snprintf(path, sizeof(path), "tex/%s.tex", base_name);
+    return cook_file_exists(path);
 }
 
 int main(void) {
-    // Create the "bin" folder if it does not already exist.
-    if (_mkdir("bin") != 0) {
-        // You can check errno here; if the folder already exists, it's acceptable.
-    }
-    
-    // Begin scanning from the current directory.
-    scan_directory(".");
+    init_srgb_table();
+
+    // Create the "bin" and "tex" folders if they do not already exist.
+    cook_mkdir("bin");
+    cook_mkdir("tex");
     
-    return 0;
+    // Begin scanning from the current directory, then convert what changed since the last run.
+    cook_scan(".", ".png");
+    return cook("bin/cook.cache", COOK_VERSION, process_image, image_outputs_exist) ? 1 : 0;
 }
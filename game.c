@@ -36,9 +36,10 @@ struct GameObject {
     struct Speed velocity;
 };
 
+#define MAX_OBJECTS 256
 struct GameState {
     struct GameObject player;
-    struct GameObject objects[256];
+    struct GameObject objects[MAX_OBJECTS];
     int object_count;
 };
 struct GameState gameState = {
@@ -60,7 +61,7 @@ struct GameState gameState = {
             },
             .data = {0},
             .norms = {0},
-            .animation = 0,
+            .animation = {0},
             .frame = 0.0f,
             .atlas_uv = {0}
         },
@@ -471,8 +472,8 @@ void collisionDetectionCamera(struct Rigid_Body cubeCollisionBox) { // nu enkel
     print_on_screen(output_string2);
 }
 
-void collision(struct GameObject *mover, struct GameObject *stator) {
-    struct Vector3 separation = detectCollision(mover->collisionBox, stator->collisionBox);
+// moves the mover back by the separation and stops it
+void separate(struct GameObject *mover, struct Vector3 separation) {
     if (separation.x != 0.0f || separation.y != 0.0f || separation.z != 0.0f) { // if collision
         mover->instance->transform[12] += separation.x; // undo movement
         mover->instance->transform[13] += separation.y;
@@ -487,6 +488,377 @@ void collision(struct GameObject *mover, struct GameObject *stator) {
     }
 }
 
+void collision(struct GameObject *mover, struct GameObject *stator) {
+    separate(mover, detectCollision(mover->collisionBox, stator->collisionBox));
+}
+
+// *info* narrowphase: the collision boxes as oriented boxes in structure of arrays, one box per lane, and the separating
+// axis test on all 15 axes (the 3 faces of each box and the 9 cross products of their edges) for 4 pairs at a time
+// the result per pair is the axis with the least overlap: the contact normal from the mover to the other box and the depth
+// without sse, neon or wasm simd (tcc) the same test runs a pair at a time
+struct OBBs {
+    float cx[MAX_OBJECTS], cy[MAX_OBJECTS], cz[MAX_OBJECTS]; // center
+    float ax[3][MAX_OBJECTS], ay[3][MAX_OBJECTS], az[3][MAX_OBJECTS]; // unit axes
+    float e[3][MAX_OBJECTS]; // half extents along the axes
+};
+struct Contacts {
+    float nx[MAX_OBJECTS], ny[MAX_OBJECTS], nz[MAX_OBJECTS]; // from the first box to the second
+    float depth[MAX_OBJECTS]; // 0 when they do not touch
+};
+struct OBBs colliders = {0}; // of gameState.objects, filled by updateBroadphase
+struct OBBs pairA = {0}, pairB = {0}; // the pairs collideNearby tests
+struct Contacts contacts = {0};
+#define SAT_EPSILON 1e-5f // added to the rotation between the boxes, so that parallel edges do not give a zero axis
+#define SAT_CROSS_BIAS 0.95f // an edge axis has to be this much shallower than the best face axis, so that resting boxes do not jitter
+
+// the box around the vertices of a body along its normals, the world axes for normals it does not have
+void obbFromBody(const struct Rigid_Body *body, struct OBBs *obbs, int lane) {
+    struct Vector3 axes[3] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    for (int a = 0; a < 3 && a < body->normal_count; a++) axes[a] = normalise(body->normals[a]);
+    struct Vector3 center = body->position;
+    for (int a = 0; a < 3; a++) {
+        float smallest = 0.0f, largest = 0.0f;
+        for (int v = 0; v < body->vertex_count; v++) {
+            float projection = dot(body->vertices[v], axes[a]);
+            if (v == 0 || projection < smallest) smallest = projection;
+            if (v == 0 || projection > largest) largest = projection;
+        }
+        float middle = (smallest + largest) * 0.5f;
+        center.x += axes[a].x * middle; center.y += axes[a].y * middle; center.z += axes[a].z * middle;
+        obbs->ax[a][lane] = axes[a].x; obbs->ay[a][lane] = axes[a].y; obbs->az[a][lane] = axes[a].z;
+        obbs->e[a][lane] = (largest - smallest) * 0.5f;
+    }
+    obbs->cx[lane] = center.x; obbs->cy[lane] = center.y; obbs->cz[lane] = center.z;
+}
+
+void copyOBB(const struct OBBs *from, int from_lane, struct OBBs *to, int to_lane) {
+    to->cx[to_lane] = from->cx[from_lane]; to->cy[to_lane] = from->cy[from_lane]; to->cz[to_lane] = from->cz[from_lane];
+    for (int a = 0; a < 3; a++) {
+        to->ax[a][to_lane] = from->ax[a][from_lane]; to->ay[a][to_lane] = from->ay[a][from_lane]; to->az[a][to_lane] = from->az[a][from_lane];
+        to->e[a][to_lane] = from->e[a][from_lane];
+    }
+}
+
+// one pair, lane i of a against lane i of b
+void satPair(const struct OBBs *a, const struct OBBs *b, int i, struct Contacts *out) {
+    float R[3][3], absR[3][3], T[3];
+    float t[3] = {b->cx[i] - a->cx[i], b->cy[i] - a->cy[i], b->cz[i] - a->cz[i]};
+    for (int r = 0; r < 3; r++) {
+        T[r] = t[0] * a->ax[r][i] + t[1] * a->ay[r][i] + t[2] * a->az[r][i];
+        for (int c = 0; c < 3; c++) {
+            R[r][c] = a->ax[r][i] * b->ax[c][i] + a->ay[r][i] * b->ay[c][i] + a->az[r][i] * b->az[c][i];
+            absR[r][c] = (float) fabs(R[r][c]) + SAT_EPSILON;
+        }
+    }
+    float best = 1e30f, n[3] = {0.0f, 0.0f, 0.0f};
+    out->depth[i] = 0.0f;
+    for (int r = 0; r < 3; r++) { // the faces of a
+        float overlap = a->e[r][i] + b->e[0][i] * absR[r][0] + b->e[1][i] * absR[r][1] + b->e[2][i] * absR[r][2] - (float) fabs(T[r]);
+        if (overlap < 0.0f) return;
+        if (overlap < best) {
+            float sign = T[r] < 0.0f ? -1.0f : 1.0f;
+            best = overlap; n[0] = a->ax[r][i] * sign; n[1] = a->ay[r][i] * sign; n[2] = a->az[r][i] * sign;
+        }
+    }
+    for (int c = 0; c < 3; c++) { // the faces of b
+        float distance = T[0] * R[0][c] + T[1] * R[1][c] + T[2] * R[2][c];
+        float overlap = a->e[0][i] * absR[0][c] + a->e[1][i] * absR[1][c] + a->e[2][i] * absR[2][c] + b->e[c][i] - (float) fabs(distance);
+        if (overlap < 0.0f) return;
+        if (overlap < best) {
+            float sign = distance < 0.0f ? -1.0f : 1.0f;
+            best = overlap; n[0] = b->ax[c][i] * sign; n[1] = b->ay[c][i] * sign; n[2] = b->az[c][i] * sign;
+        }
+    }
+    float faces = best;
+    for (int r = 0; r < 3; r++) { // the edges of a crossed with the edges of b
+        int r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+        for (int c = 0; c < 3; c++) {
+            int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+            float distance = T[r2] * R[r1][c] - T[r1] * R[r2][c];
+            float overlap = a->e[r1][i] * absR[r2][c] + a->e[r2][i] * absR[r1][c] + b->e[c1][i] * absR[r][c2] + b->e[c2][i] * absR[r][c1] - (float) fabs(distance);
+            if (overlap < 0.0f) return;
+            float length2 = 1.0f - R[r][c] * R[r][c];
+            if (length2 < 1e-6f) continue; // parallel edges, the faces cover it
+            float length = (float) sqrt(length2);
+            overlap /= length;
+            if (overlap < best && overlap < faces * SAT_CROSS_BIAS) {
+                float sign = distance < 0.0f ? -1.0f : 1.0f;
+                struct Vector3 edgeA = {a->ax[r][i], a->ay[r][i], a->az[r][i]}, edgeB = {b->ax[c][i], b->ay[c][i], b->az[c][i]};
+                best = overlap;
+                n[0] = (edgeA.y * edgeB.z - edgeA.z * edgeB.y) * sign / length;
+                n[1] = (edgeA.z * edgeB.x - edgeA.x * edgeB.z) * sign / length;
+                n[2] = (edgeA.x * edgeB.y - edgeA.y * edgeB.x) * sign / length;
+            }
+        }
+    }
+    out->nx[i] = n[0]; out->ny[i] = n[1]; out->nz[i] = n[2];
+    out->depth[i] = best;
+}
+
+#if (defined(__SSE__) || (defined(_MSC_VER) && (defined(_M_X64) || _M_IX86_FP >= 1))) && !defined(__TINYC__)
+#include <xmmintrin.h>
+#define SAT_SIMD "sse"
+typedef __m128 f4;
+typedef __m128 f4mask;
+#define f4_load(p) _mm_loadu_ps(p)
+#define f4_store(p, x) _mm_storeu_ps(p, x)
+#define f4_set(x) _mm_set1_ps(x)
+#define f4_add(a, b) _mm_add_ps(a, b)
+#define f4_sub(a, b) _mm_sub_ps(a, b)
+#define f4_mul(a, b) _mm_mul_ps(a, b)
+#define f4_div(a, b) _mm_div_ps(a, b)
+#define f4_sqrt(x) _mm_sqrt_ps(x)
+#define f4_abs(x) _mm_andnot_ps(_mm_set1_ps(-0.0f), x)
+#define f4_sign_of(x, s) _mm_xor_ps(x, _mm_and_ps(s, _mm_set1_ps(-0.0f))) // x with its sign flipped where s is negative
+#define f4_lt(a, b) _mm_cmplt_ps(a, b)
+#define f4_and_mask(a, b) _mm_and_ps(a, b)
+#define f4_or_mask(a, b) _mm_or_ps(a, b)
+#define f4_select(m, a, b) _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)) // a where m is set
+#define f4_all(m) (_mm_movemask_ps(m) == 15)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SAT_SIMD "neon"
+typedef float32x4_t f4;
+typedef uint32x4_t f4mask;
+#define f4_load(p) vld1q_f32(p)
+#define f4_store(p, x) vst1q_f32(p, x)
+#define f4_set(x) vdupq_n_f32(x)
+#define f4_add(a, b) vaddq_f32(a, b)
+#define f4_sub(a, b) vsubq_f32(a, b)
+#define f4_mul(a, b) vmulq_f32(a, b)
+#define f4_div(a, b) vdivq_f32(a, b)
+#define f4_sqrt(x) vsqrtq_f32(x)
+#define f4_abs(x) vabsq_f32(x)
+#define f4_sign_of(x, s) vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(x), vandq_u32(vreinterpretq_u32_f32(s), vdupq_n_u32(0x80000000u))))
+#define f4_lt(a, b) vcltq_f32(a, b)
+#define f4_and_mask(a, b) vandq_u32(a, b)
+#define f4_or_mask(a, b) vorrq_u32(a, b)
+#define f4_select(m, a, b) vbslq_f32(m, a, b)
+#define f4_all(m) (vminvq_u32(m) != 0)
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define SAT_SIMD "simd128"
+typedef v128_t f4;
+typedef v128_t f4mask;
+#define f4_load(p) wasm_v128_load(p)
+#define f4_store(p, x) wasm_v128_store(p, x)
+#define f4_set(x) wasm_f32x4_splat(x)
+#define f4_add(a, b) wasm_f32x4_add(a, b)
+#define f4_sub(a, b) wasm_f32x4_sub(a, b)
+#define f4_mul(a, b) wasm_f32x4_mul(a, b)
+#define f4_div(a, b) wasm_f32x4_div(a, b)
+#define f4_sqrt(x) wasm_f32x4_sqrt(x)
+#define f4_abs(x) wasm_f32x4_abs(x)
+#define f4_sign_of(x, s) wasm_v128_xor(x, wasm_v128_and(s, wasm_f32x4_splat(-0.0f)))
+#define f4_lt(a, b) wasm_f32x4_lt(a, b)
+#define f4_and_mask(a, b) wasm_v128_and(a, b)
+#define f4_or_mask(a, b) wasm_v128_or(a, b)
+#define f4_select(m, a, b) wasm_v128_bitselect(a, b, m)
+#define f4_all(m) wasm_i32x4_all_true(m)
+#endif
+
+#ifdef SAT_SIMD
+// takes the axis (x, y, z) when its overlap is the least so far, and marks the lanes where it separates the boxes
+#define SAT_TAKE(overlap, x, y, z) { \
+    f4mask better = f4_lt(overlap, best); \
+    separated = f4_or_mask(separated, f4_lt(overlap, zero)); \
+    best = f4_select(better, overlap, best); \
+    nx = f4_select(better, x, nx); ny = f4_select(better, y, ny); nz = f4_select(better, z, nz); \
+}
+
+// the pairs of lanes 0 up to count of a and b, 4 at a time, the arrays have room up to the next multiple of 4
+void satPairs(const struct OBBs *a, const struct OBBs *b, int count, struct Contacts *out) {
+    f4 zero = f4_set(0.0f), epsilon = f4_set(SAT_EPSILON), one = f4_set(1.0f), bias = f4_set(SAT_CROSS_BIAS), parallel = f4_set(1e-6f);
+    for (int i = 0; i < count; i += 4) {
+        f4 aax[3], aay[3], aaz[3], ae[3], bax[3], bay[3], baz[3], be[3], R[3][3], absR[3][3], T[3];
+        for (int k = 0; k < 3; k++) {
+            aax[k] = f4_load(&a->ax[k][i]); aay[k] = f4_load(&a->ay[k][i]); aaz[k] = f4_load(&a->az[k][i]); ae[k] = f4_load(&a->e[k][i]);
+            bax[k] = f4_load(&b->ax[k][i]); bay[k] = f4_load(&b->ay[k][i]); baz[k] = f4_load(&b->az[k][i]); be[k] = f4_load(&b->e[k][i]);
+        }
+        f4 tx = f4_sub(f4_load(&b->cx[i]), f4_load(&a->cx[i]));
+        f4 ty = f4_sub(f4_load(&b->cy[i]), f4_load(&a->cy[i]));
+        f4 tz = f4_sub(f4_load(&b->cz[i]), f4_load(&a->cz[i]));
+        for (int r = 0; r < 3; r++) {
+            T[r] = f4_add(f4_add(f4_mul(tx, aax[r]), f4_mul(ty, aay[r])), f4_mul(tz, aaz[r]));
+            for (int c = 0; c < 3; c++) {
+                R[r][c] = f4_add(f4_add(f4_mul(aax[r], bax[c]), f4_mul(aay[r], bay[c])), f4_mul(aaz[r], baz[c]));
+                absR[r][c] = f4_add(f4_abs(R[r][c]), epsilon);
+            }
+        }
+        f4 best = f4_set(1e30f), nx = zero, ny = zero, nz = zero;
+        f4mask separated = f4_lt(one, zero);
+        for (int r = 0; r < 3; r++) { // the faces of a
+            f4 overlap = f4_sub(f4_add(ae[r], f4_add(f4_add(f4_mul(be[0], absR[r][0]), f4_mul(be[1], absR[r][1])), f4_mul(be[2], absR[r][2]))), f4_abs(T[r]));
+            SAT_TAKE(overlap, f4_sign_of(aax[r], T[r]), f4_sign_of(aay[r], T[r]), f4_sign_of(aaz[r], T[r]));
+        }
+        for (int c = 0; c < 3; c++) { // the faces of b
+            f4 distance = f4_add(f4_add(f4_mul(T[0], R[0][c]), f4_mul(T[1], R[1][c])), f4_mul(T[2], R[2][c]));
+            f4 overlap = f4_sub(f4_add(f4_add(f4_add(f4_mul(ae[0], absR[0][c]), f4_mul(ae[1], absR[1][c])), f4_mul(ae[2], absR[2][c])), be[c]), f4_abs(distance));
+            SAT_TAKE(overlap, f4_sign_of(bax[c], distance), f4_sign_of(bay[c], distance), f4_sign_of(baz[c], distance));
+        }
+        f4 faces = f4_mul(best, bias);
+        for (int r = 0; r < 3 && !f4_all(separated); r++) { // the edges of a crossed with the edges of b
+            int r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+            for (int c = 0; c < 3; c++) {
+                int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+                f4 distance = f4_sub(f4_mul(T[r2], R[r1][c]), f4_mul(T[r1], R[r2][c]));
+                f4 overlap = f4_sub(f4_add(f4_add(f4_mul(ae[r1], absR[r2][c]), f4_mul(ae[r2], absR[r1][c])),
+                                           f4_add(f4_mul(be[c1], absR[r][c2]), f4_mul(be[c2], absR[r][c1]))), f4_abs(distance));
+                separated = f4_or_mask(separated, f4_lt(overlap, zero));
+                f4 length2 = f4_sub(one, f4_mul(R[r][c], R[r][c]));
+                f4mask usable = f4_lt(parallel, length2);
+                f4 inverse = f4_div(one, f4_sqrt(f4_select(usable, length2, one)));
+                overlap = f4_mul(overlap, inverse);
+                f4mask better = f4_and_mask(usable, f4_and_mask(f4_lt(overlap, best), f4_lt(overlap, faces)));
+                f4 x = f4_sub(f4_mul(aay[r], baz[c]), f4_mul(aaz[r], bay[c]));
+                f4 y = f4_sub(f4_mul(aaz[r], bax[c]), f4_mul(aax[r], baz[c]));
+                f4 z = f4_sub(f4_mul(aax[r], bay[c]), f4_mul(aay[r], bax[c]));
+                best = f4_select(better, overlap, best);
+                nx = f4_select(better, f4_sign_of(f4_mul(x, inverse), distance), nx);
+                ny = f4_select(better, f4_sign_of(f4_mul(y, inverse), distance), ny);
+                nz = f4_select(better, f4_sign_of(f4_mul(z, inverse), distance), nz);
+            }
+        }
+        f4_store(&out->nx[i], nx); f4_store(&out->ny[i], ny); f4_store(&out->nz[i], nz);
+        f4_store(&out->depth[i], f4_select(separated, zero, best));
+    }
+}
+#undef SAT_TAKE
+#else
+#define SAT_SIMD "scalar"
+void satPairs(const struct OBBs *a, const struct OBBs *b, int count, struct Contacts *out) {
+    for (int i = 0; i < count; i++) satPair(a, b, i, out);
+}
+#endif
+
+// *info* broadphase: a uniform grid hashed into buckets, rebuilt every frame from the world aabb of every object
+// an object goes in the bucket of every cell its aabb touches, a mover only runs the SAT against the objects in the cells
+// of its own aabb whose aabb overlaps it, so the cost goes with what is near and not with the number of objects
+#define BROADPHASE_CELL 4.0f      // in world units, about the size of the objects
+#define BROADPHASE_BUCKETS 1024   // power of two
+#define BROADPHASE_MAX_SPAN 4     // an object over more cells than this per axis is tested against every mover instead
+struct AABB {
+    struct Vector3 min, max;
+};
+struct Broadphase {
+    struct AABB bounds[MAX_OBJECTS];
+    int bucket_start[BROADPHASE_BUCKETS + 1]; // the objects of bucket b are entries[bucket_start[b]] up to entries[bucket_start[b + 1]]
+    int entries[MAX_OBJECTS * BROADPHASE_MAX_SPAN * BROADPHASE_MAX_SPAN * BROADPHASE_MAX_SPAN];
+    int large[MAX_OBJECTS]; // the objects that are too large for the grid
+    int large_count;
+    int seen[MAX_OBJECTS]; // the query that last reported the object, so that an object in several cells comes once
+    int query;
+};
+struct Broadphase broadphase = {0};
+
+struct AABB bodyBounds(const struct Rigid_Body *body) {
+    struct AABB box = {body->position, body->position};
+    for (int v = 0; v < body->vertex_count; v++) {
+        struct Vector3 vertex = add(body->vertices[v], body->position);
+        if (vertex.x < box.min.x) box.min.x = vertex.x; else if (vertex.x > box.max.x) box.max.x = vertex.x;
+        if (vertex.y < box.min.y) box.min.y = vertex.y; else if (vertex.y > box.max.y) box.max.y = vertex.y;
+        if (vertex.z < box.min.z) box.min.z = vertex.z; else if (vertex.z > box.max.z) box.max.z = vertex.z;
+    }
+    return box;
+}
+
+int overlapBounds(struct AABB a, struct AABB b) { // returns boolean
+    return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y && a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+unsigned int cellBucket(int x, int y, int z) {
+    return ((unsigned int) x * 73856093u ^ (unsigned int) y * 19349663u ^ (unsigned int) z * 83492791u) & (BROADPHASE_BUCKETS - 1);
+}
+
+// the cells of a box, false when it spans more than BROADPHASE_MAX_SPAN of them on an axis
+int boundsCells(struct AABB box, int low[3], int high[3]) {
+    float min[3] = {box.min.x, box.min.y, box.min.z}, max[3] = {box.max.x, box.max.y, box.max.z};
+    for (int a = 0; a < 3; a++) {
+        low[a] = (int) floor(min[a] / BROADPHASE_CELL);
+        high[a] = (int) floor(max[a] / BROADPHASE_CELL);
+        if (high[a] - low[a] >= BROADPHASE_MAX_SPAN) return 0;
+    }
+    return 1;
+}
+
+// counts the objects per bucket, then puts them in, objects in the same bucket stay in the order of gameState.objects
+void updateBroadphase(struct GameState *gameState) {
+    struct Broadphase *bp = &broadphase;
+    int low[3], high[3];
+    memset(bp->bucket_start, 0, sizeof(bp->bucket_start));
+    bp->large_count = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < gameState->object_count; i++) {
+            if (pass == 0) {
+                bp->bounds[i] = bodyBounds(&gameState->objects[i].collisionBox);
+                obbFromBody(&gameState->objects[i].collisionBox, &colliders, i);
+            }
+            if (!boundsCells(bp->bounds[i], low, high)) {
+                if (pass == 0) bp->large[bp->large_count++] = i;
+                continue;
+            }
+            for (int x = low[0]; x <= high[0]; x++)
+                for (int y = low[1]; y <= high[1]; y++)
+                    for (int z = low[2]; z <= high[2]; z++) {
+                        unsigned int bucket = cellBucket(x, y, z);
+                        if (pass == 0) bp->bucket_start[bucket + 1]++;
+                        else bp->entries[bp->bucket_start[bucket]++] = i;
+                    }
+        }
+        if (pass == 0) for (int b = 0; b < BROADPHASE_BUCKETS; b++) bp->bucket_start[b + 1] += bp->bucket_start[b];
+        else for (int b = BROADPHASE_BUCKETS; b > 0; b--) bp->bucket_start[b] = bp->bucket_start[b - 1]; // the fill moved every start to the next one
+    }
+    bp->bucket_start[0] = 0;
+}
+
+// the objects whose aabb overlaps the box, each once, returns how many went in candidates (room for MAX_OBJECTS)
+int queryBroadphase(struct AABB box, int *candidates) {
+    struct Broadphase *bp = &broadphase;
+    int count = 0, low[3], high[3];
+    if (++bp->query == 0) { memset(bp->seen, 0, sizeof(bp->seen)); bp->query = 1; }
+    #define BROADPHASE_CANDIDATE(object) \
+        if (bp->seen[object] != bp->query && overlapBounds(box, bp->bounds[object])) { bp->seen[object] = bp->query; candidates[count++] = object; }
+    for (int l = 0; l < bp->large_count; l++) BROADPHASE_CANDIDATE(bp->large[l]);
+    if (!boundsCells(box, low, high)) { // a large mover looks at every object
+        for (int i = 0; i < gameState.object_count; i++) BROADPHASE_CANDIDATE(i);
+        return count;
+    }
+    for (int x = low[0]; x <= high[0]; x++)
+        for (int y = low[1]; y <= high[1]; y++)
+            for (int z = low[2]; z <= high[2]; z++) {
+                unsigned int bucket = cellBucket(x, y, z);
+                for (int e = bp->bucket_start[bucket]; e < bp->bucket_start[bucket + 1]; e++) BROADPHASE_CANDIDATE(bp->entries[e]);
+            }
+    #undef BROADPHASE_CANDIDATE
+    return count;
+}
+
+// a mover against the objects near it, self is its index in gameState.objects or -1, the narrowphase only runs on overlapping aabbs
+// all pairs are tested at once, after the mover is pushed out of one box the ones after it are tested again from where it is now
+void collideNearby(struct GameObject *mover, int self) {
+    int candidates[MAX_OBJECTS], pairs = 0, pushed = 0;
+    int count = queryBroadphase(bodyBounds(&mover->collisionBox), candidates);
+    obbFromBody(&mover->collisionBox, &pairA, 0);
+    for (int c = 0; c < count; c++) {
+        if (candidates[c] == self) continue;
+        copyOBB(&pairA, 0, &pairA, pairs);
+        copyOBB(&colliders, candidates[c], &pairB, pairs);
+        pairs++;
+    }
+    satPairs(&pairA, &pairB, pairs, &contacts);
+    for (int i = 0; i < pairs; i++) {
+        if (contacts.depth[i] <= 0.0f) continue;
+        if (pushed) {
+            obbFromBody(&mover->collisionBox, &pairA, i);
+            satPair(&pairA, &pairB, i, &contacts);
+            if (contacts.depth[i] <= 0.0f) continue;
+        }
+        float depth = contacts.depth[i];
+        separate(mover, (struct Vector3){-contacts.nx[i] * depth, -contacts.ny[i] * depth, -contacts.nz[i] * depth});
+        pushed = 1;
+    }
+}
+
 void cameraMovement(float *view, float speed, float ms) { // unused
     cameraSpeed.x = speed * (buttonState.right - buttonState.left);
     cameraSpeed.z = speed * (buttonState.forward - buttonState.backward);
@@ -556,9 +928,7 @@ void playerMovement(float speed, float ms, struct GameObject *player) {
         player->instance->transform[10] = cos(charRot);
     }
     
-    for (int i = 0; i < gameState.object_count; i++) {
-        collision(player, &gameState.objects[i]);
-    }
+    collideNearby(player, -1);
     char output_string2[256];
     snprintf(output_string2, sizeof(output_string2), "%4.2f,%4.2f,%4.2f\n", player->instance->transform[12], player->instance->transform[13], player->instance->transform[14]);
     print_on_screen(output_string2);
@@ -617,6 +987,7 @@ void initGamestate(struct GameState *gameState) {
 };
 
 void addGameObject(struct GameState *gameState, struct GameObject *gameObject) {
+    if (gameState->object_count >= MAX_OBJECTS) return;
     gameState->objects[gameState->object_count] = *gameObject;
     gameState->object_count++;
 }
@@ -762,7 +1133,7 @@ void generateCubemapViews(const float pos[3], float views[6][16]) {
         { 0, 1, 0 }, // +X
         { 0, 1, 0 }, // -X
         { 0, 0, -1 }, // +Y
-        { 0, 0, -1 }, // -Y
+        { 0, 0, 1 }, // -Y
         { 0, 1, 0 }, // +Z
         { 0, 1, 0 }  // -Z
     };
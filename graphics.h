@@ -9,24 +9,44 @@ static const int SHADOWS_ENABLED = 1;
 static const int POST_PROCESSING_ENABLED = 0;
 
 #define TEXTURE_SIZE 512
+#define TEXTURE_MIP_LEVELS 10 // log2(TEXTURE_SIZE) + 1
+#define TEXTURE_LIMIT 256 // layers of the texture array, every layer is an atlas page that smaller textures share
+#define ATLAS_GRANULARITY 16 // textures are packed on a 16 texel grid, keeps the first mips on BC1 block boundaries, the mips below that are clamped off (TextureRegion.mip_count)
+#define ATLAS_COLUMNS (TEXTURE_SIZE / ATLAS_GRANULARITY)
+#define TEXTURE_STREAMED_MIPS 2 // the mips of a page above its tail, only resident while the texture feedback asks for them, keep in sync with shader.wgsl
+#define TEXTURE_RESIDENT_BUDGET (32 * 1024 * 1024) // bytes of texture array for the streamed mips, decides how many pages can be resident at full resolution
+#define TEXTURE_NOT_RESIDENT 0xffffffffu
+#define ATLAS_UNIT 8 // Instance.norms[3] stores the packed size in 8 texel units, keep in sync with shader.wgsl
 #define ENV_TEXTURE_SIZE 1024
+#define ENV_MIP_LEVELS 8 // 1024 down to 8, mip n is GGX prefiltered for roughness n / (ENV_MIP_LEVELS - 1), keep in sync with shader.wgsl
+#define PROBE_SIZE 128 // faces of the real-time reflection probe, one face is rendered per frame
+#define STAGING_BUFFER_SIZE (4 * 1024 * 1024) // one env cube face, files are read into mapped staging buffers in pieces of at most this size
+#define STAGING_BUFFER_COUNT 4 // bounds the memory of the uploads in flight, a staging buffer is reused once the gpu has copied out of it
+#define STAGING_ALIGNMENT 256 // every copy out of a staging buffer starts on this, texture rows are a multiple of it
 #define GLOBAL_UNIFORM_CAPACITY 1024  // bytes per pipeline uniform buffer
 #define UNIFORM_BUFFER_MAX_SIZE 65536 // this cannot be bigger than 65536 bytes
-#define MAX_PIPELINES 2 // todo: remove, only one pipeline
+#define MAX_PIPELINES 15 // one main pipeline per shader variant (SHADER_COUNT in present.c) and vertex format, also sizes the probe pipelines
 #define MAX_MESHES 1024
 #define MAX_MATERIALS (UNIFORM_BUFFER_MAX_SIZE / sizeof(struct MaterialUniforms)) // 256 bytes x 256 materials limit -> reuse material for different mesh by using atlas for textures + instance atlas uv
 #define MAX_BONES 64
-#define MAX_FRAMES 32
+#define ANIMATION_LIMIT 200 // rows in the animation texture, one row per animated instance with its pose of this frame
+#define ANIMATION_FPS 30.0f // fps the clips are baked at by gltf_to_binary.c, the pose is interpolated between frames
+#define MAX_LIGHTS 1024
+#define CLUSTER_X 16 // froxel grid used to bin the lights, keep in sync with cluster.wgsl and shader.wgsl
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define MAX_LIGHTS_PER_CLUSTER 63 // + 1 count -> 256 bytes per cluster
 #define SKELETON_SIZE (MAX_BONES * 64) // 4096 bytes (16 byte rgba32 -> 256 pixels)
-#define ANIMATION_SIZE (SKELETON_SIZE * MAX_FRAMES) // 131k bytes (16 byte rgba32 -> 8192 pixels)
-#define ANIMATION_TEXTURE_WIDTH (ANIMATION_SIZE / 16)
+#define ANIMATION_TEXTURE_WIDTH (SKELETON_SIZE / 16)
 
 struct MaterialUniforms { // 256 bytes (is ideal offset for uniforms)
     // 16+ byte elements must align to 16 byte offsets (!) 
-    unsigned int shader; // 0-4
+    unsigned int shader; // 0-4 // todo: unused, the shader is picked by the pipeline of the mesh
     float reflective; // 4-8
     unsigned int animated; // 8-12
-    unsigned char padding[244]; // 12-256
+    float roughness; // 12-16 // *info* picks the mip of the prefiltered env cube for reflections
+    unsigned char padding[240]; // 16-256
 };
 struct GlobalUniforms { // 1024 bytes
     // 16+ byte elements must align to 16 byte offsets (!)
@@ -38,7 +58,22 @@ struct GlobalUniforms { // 1024 bytes
     float view[16]; // 32-96
     float projection[16]; // 96-160
     float light_view_proj[16]; // 160-224
-    unsigned char padding[800]; // 224-1024
+    unsigned int light_count; // 224-228
+    float cluster_near; // 228-232
+    float cluster_far; // 232-236
+    float pad_viewport; // 236-240
+    float viewport[4]; // 240-256 offset x + offset y + width + height
+    float probe_world_space[4]; // 256-272 xyz where the reflection probe is rendered, w blends it over the env cube (0 until every face is rendered once)
+    unsigned char padding[752]; // 272-1024
+};
+
+struct Light { // 48 bytes
+    float position[3]; // 12 bytes f32 // *info* world space
+    float range; // 4 bytes f32 // *info* no influence beyond this distance
+    float color[3]; // 12 bytes f32 // *info* color * intensity
+    float spot_cos; // 4 bytes f32 // *info* cosine of the spot cone half-angle, -1 for a point light
+    float direction[3]; // 12 bytes f32 // *info* spot direction
+    float padding; // 4 bytes
 };
 
 enum MeshFlags {
@@ -46,13 +81,41 @@ enum MeshFlags {
     MESH_CAST_SHADOWS = 1 << 1
 };
 
+struct TextureRegion { // where createGPUTexture packed a texture, copied into the instances that use it
+    int layer; // Instance.data[0], -1 if the texture could not be packed
+    unsigned short x, y; // texel origin in the page
+    unsigned short atlas_uv[2]; // Instance.atlas_uv, offset in the page
+    unsigned short atlas_size; // Instance.norms[3], (TEXTURE_MIP_LEVELS - mip_count) << 12 | width % 64 << 6 | height % 64 in ATLAS_UNIT texels, 0 is the whole page with every mip
+    unsigned char mip_count; // written in the region, a smaller mip would be shared with its neighbours, the shader clamps the lod to the last one
+};
+
+enum UploadTarget { // where copyGPUStaging copies to
+    UPLOAD_VERTICES, // the vertices of a mesh, target offset in bytes from its first vertex
+    UPLOAD_INDICES,  // the indices of a mesh, target offset in bytes from its first index
+    UPLOAD_ENV_CUBE  // a face of mip 0 of the env cube, target offset in bytes from the start of the face, whole rows only
+};
+
+enum VertexFormat { // picked per mesh by the converters, MeshHeader.vertexFormat, every format has its own pipelines
+    VERTEX_FORMAT_FULL = 0,    // struct Vertex, 48 bytes
+    VERTEX_FORMAT_STATIC = 1,  // struct StaticVertex, 24 bytes, no bones
+    VERTEX_FORMAT_SKINNED = 2, // struct SkinnedVertex, 32 bytes
+    VERTEX_FORMAT_COUNT
+};
+
+enum TextureFormat {
+    TEXTURE_FORMAT_RGBA8 = 0, // transcoded from data/textures/tex
+    TEXTURE_FORMAT_BC1 = 1    // blocks copied straight out of data/textures/tex
+};
+
 struct draw_result {
     int surface_not_available;
     double present_wait_ms;
     double get_surface_ms;
     double write_buffer_ms;
     double setup_ms;
+    double light_cluster_ms;
     double shadowmap_ms;
+    double probe_ms;
     double main_pass_ms;
     double submit_ms;
     double cpu_ms;
@@ -66,14 +129,26 @@ void *createGPUContext(void (*callback)(), int width, int height, int viewport_w
 #else
 void *createGPUContext(void *hInstance, void *hwnd, int width, int height, int viewport_width, int viewport_height);
 #endif
-int   create_main_pipeline(void *context, const char *shader);
+int   create_main_pipeline(void *context, const char *shader, unsigned int variant, enum VertexFormat format); // the meshes of the pipeline have vertices in this format
+void  create_probe_pipeline(void *context, int pipeline_id, const char *shader, unsigned int variant); // only pipelines with a probe variant are drawn into the reflection probe
 void  create_shadow_pipeline(void *context);
+void  create_light_cluster_pipeline(void *context);
 void  create_postprocessing_pipeline(void *context, int viewport_width, int viewport_height);
 int   set_env_cube(void *context_ptr, void *data[6], int face_size);
-int   createGPUMesh(void *context, int material_id, enum MeshFlags flags, void *v, int vc, void *i, int ic, void *ii, int iic);
-void  setGPUMeshBoneData(void *context_ptr, int mesh_id, float *bf[MAX_BONES][16], int bc, int fc);
-int   createGPUTexture(void *context, int mesh_id, void *data, int w, int h);
+int   createGPUMesh(void *context, int material_id, enum MeshFlags flags, void *v, int vc, void *i, int ic, void *ii, int iic); // v and i can be NULL, then they are copied in with copyGPUStaging
+int   acquireGPUStaging(void *context, void **data);
+void  copyGPUStaging(void *context, int staging, unsigned long long offset, unsigned long long size, enum UploadTarget target, int index, unsigned long long target_offset);
+void  submitGPUStaging(void *context, int staging);
+int   setGPUMeshBoneData(void *context_ptr, int mesh_id, int row, float *bones, int bc); // the pose of an instance, row -1 takes a new row, returns the row
+struct TextureRegion createGPUTexture(void *context, int mesh_id, void *data, int w, int h, int mip_count);
+void  streamGPUTexture(void *context, struct TextureRegion region, int slot, void *data, int w, int h, int mip_count);
+void  setGPUPageResidency(void *context, int page, int slot);
+int   getGPUTextureSlots(void *context);
+int   getGPUTextureFeedback(void *context, unsigned char requested_mip[TEXTURE_LIMIT]);
+enum TextureFormat getGPUTextureFormat(void *context);
 void  setGPUInstanceBuffer(void *context, int mesh_id, void* ii, int iic);
+void  setGPULights(void *context, struct Light *lights, int light_count);
+void  setGPUReflectionProbe(void *context, int face, struct GlobalUniforms *probe_uniforms); // the face is rendered in the next drawGPUFrame
 struct draw_result drawGPUFrame(void *context, struct Platform *p, int offset_x, int offset_y, int viewport_width, int viewport_height, int save_to_disk, char *filename,struct GlobalUniforms *global_uniforms, struct MaterialUniforms material_uniforms[MAX_MATERIALS]);
 double block_on_gpu_queue(void *context, struct Platform *p);
 
@@ -86,13 +161,31 @@ struct Vertex { // 48 bytes
     unsigned char bone_weights[4]; // 4 bytes n8
     unsigned char bone_indices[4]; // 4 bytes u8 // *info* max 256 bones
 };
+// *info* the compact formats have half float positions, the converters only pick them for meshes that are small enough
+struct StaticVertex { // 24 bytes
+    unsigned short position[4]; // 8 bytes f16 // *info* w is unused
+    short normal[2]; // 4 bytes n16 // *info* octahedral
+    char tangent[4]; // 4 bytes n8
+    unsigned short uv[2]; // 4 bytes n16
+    unsigned int data; // 4 bytes u32 // *info* raw data
+};
+struct SkinnedVertex { // 32 bytes
+    unsigned short position[4]; // 8 bytes f16 // *info* w is unused
+    short normal[2]; // 4 bytes n16 // *info* octahedral
+    char tangent[4]; // 4 bytes n8
+    unsigned short uv[2]; // 4 bytes n16
+    unsigned char bone_weights[4]; // 4 bytes n8
+    unsigned char bone_indices[4]; // 4 bytes u8
+    unsigned int data; // 4 bytes u32 // *info* raw data
+};
+static const int VERTEX_SIZE[VERTEX_FORMAT_COUNT] = {sizeof(struct Vertex), sizeof(struct StaticVertex), sizeof(struct SkinnedVertex)};
 struct Instance { // 96 bytes
     float transform[16]; // 64 bytes f32 // *info* translation + rotation + scale
-    unsigned int data[3]; // 12 bytes u32 // *info* texture + shader + material
-    unsigned short norms[4]; // 8 bytes n16 // *info* (?) + (?) + (?) + (?)
-    unsigned int animation; // 4 bytes u32
-    float frame; // 4 bytes f32
-    unsigned short atlas_uv[2]; // 4 bytes n16 // *info* the texture index is a per-mesh uniform, and this picks within that texture for atlases
+    unsigned int data[3]; // 12 bytes u32 // *info* texture + shader (unused, the pipeline of the mesh picks the shader) + material
+    unsigned short norms[4]; // 8 bytes n16 // *info* uv scale + unused + unused + atlas size (see TextureRegion)
+    unsigned short animation[2]; // 4 bytes u16 // *info* row of the pose in the animation texture + unused, the cpu blends the clips into the pose
+    float frame; // 4 bytes f32 // *info* unused
+    unsigned short atlas_uv[2]; // 4 bytes n16 // *info* offset of the texture in its atlas page (data[0]), or of the glyph for the hud
 };
 
 
@@ -40,6 +40,8 @@ struct MappedMemory map_file(const char *filename) {
         fprintf(stderr, "Failed to open file: %s\n", filename);
         return mm;
     }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size)) size.QuadPart = 0;
     HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
     CloseHandle(hFile); // File handle can be closed once mapping is created.
     if (!hMapping) {
@@ -54,8 +56,25 @@ struct MappedMemory map_file(const char *filename) {
     }
     mm.data = base;
     mm.mapping = (void*)hMapping;
+    mm.size = (size_t)size.QuadPart;
     return mm;
 }
+// no mapping and no intermediate copy, the range goes straight into dst (eg. a mapped gpu staging buffer)
+int read_file(const char *filename, size_t offset, void *dst, int size) {
+    HANDLE hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to open file: %s\n", filename);
+        return -1;
+    }
+    OVERLAPPED overlapped = {0}; // only for the offset, the read is synchronous
+    overlapped.Offset = (DWORD) offset;
+    overlapped.OffsetHigh = (DWORD) ((unsigned long long) offset >> 32);
+    DWORD read = 0;
+    BOOL ok = ReadFile(hFile, dst, (DWORD) size, &read, &overlapped);
+    CloseHandle(hFile);
+    return ok || GetLastError() == ERROR_HANDLE_EOF ? (int) read : -1;
+}
 void unmap_file(struct MappedMemory *mm) {
     if (mm->data) {
         UnmapViewOfFile(mm->data);
@@ -65,6 +84,79 @@ void unmap_file(struct MappedMemory *mm) {
     }
     mm->data = NULL;
     mm->mapping = NULL;
+    mm->size = 0;
+}
+#pragma endregion
+
+#pragma region JOBS
+#define MAX_WORKERS 16
+struct JobBatch {
+    void (*job)(void *data, int index);
+    void *data;
+    int count;
+    volatile LONG next;
+};
+static DWORD WINAPI job_worker(LPVOID param) {
+    struct JobBatch *batch = (struct JobBatch *) param;
+    for (LONG i = InterlockedIncrement(&batch->next) - 1; i < batch->count; i = InterlockedIncrement(&batch->next) - 1) {
+        batch->job(batch->data, (int) i);
+    }
+    return 0;
+}
+// the calling thread works along with the workers, and returns when every job is done
+void run_jobs(void (*job)(void *data, int index), void *data, int count) {
+    struct JobBatch batch = {job, data, count, 0};
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int worker_count = (int) info.dwNumberOfProcessors - 1;
+    if (worker_count > MAX_WORKERS) worker_count = MAX_WORKERS;
+    if (worker_count > count - 1) worker_count = count - 1;
+    HANDLE workers[MAX_WORKERS];
+    int started = 0;
+    for (int i = 0; i < worker_count; i++) {
+        workers[started] = CreateThread(NULL, 0, job_worker, &batch, 0, NULL);
+        if (workers[started]) started++;
+    }
+    job_worker(&batch);
+    if (started) WaitForMultipleObjects(started, workers, TRUE, INFINITE);
+    for (int i = 0; i < started; i++) CloseHandle(workers[i]);
+}
+
+#define BACKGROUND_WORKERS 2 // few, the jobs mostly wait on the disk and can use run_jobs themselves
+struct BackgroundBatch {
+    void (*job)(void *data, int index);
+    void *data;
+    int count;
+    volatile LONG next;
+    volatile LONG running;
+    volatile int *finished;
+};
+static DWORD WINAPI background_worker(LPVOID param) {
+    struct BackgroundBatch *batch = (struct BackgroundBatch *) param;
+    for (LONG i = InterlockedIncrement(&batch->next) - 1; i < batch->count; i = InterlockedIncrement(&batch->next) - 1) {
+        batch->job(batch->data, (int) i);
+        InterlockedExchange((volatile LONG *) &batch->finished[i], 1); // full barrier, the results of the job are visible before the flag
+    }
+    if (InterlockedDecrement(&batch->running) == 0) free(batch);
+    return 0;
+}
+// the batch outlives this call, the last worker to finish frees it
+void start_jobs(void (*job)(void *data, int index), void *data, int count, volatile int *finished) {
+    struct BackgroundBatch *batch = malloc(sizeof(struct BackgroundBatch));
+    *batch = (struct BackgroundBatch){job, data, count, 0, 0, finished};
+    // the workers start suspended, so that the count of running workers is known before any of them can finish
+    HANDLE workers[BACKGROUND_WORKERS];
+    int started = 0;
+    for (int i = 0; i < BACKGROUND_WORKERS; i++) {
+        workers[started] = CreateThread(NULL, 0, background_worker, batch, CREATE_SUSPENDED, NULL);
+        if (workers[started]) started++;
+    }
+    batch->running = started ? started : 1;
+    for (int i = 0; i < started; i++) {
+        ResumeThread(workers[i]);
+        CloseHandle(workers[i]);
+    }
+    if (!started) background_worker(batch); // no threads at all, do the jobs right here
 }
 #pragma endregion
 
@@ -488,16 +580,17 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         .current_time_ms = current_time_ms,
         .map_file = map_file,
         .unmap_file = unmap_file,
+        .read_file = read_file,
         .sleep_ms = sleep_ms,
-        .poll_inputs = poll_inputs
+        .poll_inputs = poll_inputs,
+        .run_jobs = run_jobs,
+        .start_jobs = start_jobs
     };
 
     /* MAIN LOOP */
     // todo: put present.c in a dll so we can reload it here -> also present.h file
     // todo: put game.c in a dll so we can reload it here -> also a game.h file
-    // todo: put all the binary outputs from /data in a single /bin
-    // todo: put all the /bin and /shaders and everything needed to run together
-        // -> then we can fetch it all at once in browser version
+    // todo: put the shaders in data/assets.pack too, webgpu.c still reads them from data/shaders
         // -> then we can take all of that and put it into one big executable later
     // todo: put all the stb headers used by scripts in /data in a single /lib folder
     // todo: put all the /data bat files higher together (maybe in root with run.bat)
@@ -1,29 +1,708 @@
 #ifndef PLATFORM_H_
 #define PLATFORM_H_
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
 struct MappedMemory {
     void *data;     // Base pointer to mapped file data
     void *mapping;  // Opaque handle for the mapping (ex. Windows HANDLE)
+    size_t size;    // Bytes of the file
 };
 struct Platform {
     struct MappedMemory (*map_file)(const char *filename);
     void (*unmap_file)(struct MappedMemory *mm);
+    int (*read_file)(const char *filename, size_t offset, void *dst, int size); // reads a range of the file straight into dst, returns the bytes read or -1
     double (*current_time_ms)();
     void (*sleep_ms)(double ms);
     void (*poll_inputs)();
+    void (*run_jobs)(void (*job)(void *data, int index), void *data, int count); // runs job(data, 0..count-1) on worker threads, returns when all are done
+    void (*start_jobs)(void (*job)(void *data, int index), void *data, int count, volatile int *finished); // same on background threads, returns right away, finished[index] becomes 1 when a job is done
 };
+// reads the file out of the asset pack when one is open, otherwise maps the loose file, see ASSET PACK below
+static struct MappedMemory map_asset(struct Platform *p, const char *filename);
+static void unmap_asset(struct Platform *p, struct MappedMemory *mm);
+static struct MappedMemory alloc_asset(size_t size); // memory that unmap_asset frees, for what is decoded at load
 /* MEMORY MAPPING MESH */
-typedef struct {
+// *info* written by data/models/mesh_format.h: the header, then the sections on MESH_ALIGNMENT in the order of their offsets
+// a mesh is checked whole against the crc before anything is read out of it, also when it is staged
+// *info* the bounds are written by the converters but nothing culls against them yet, the shadow, probe and main passes
+// draw the same instances out of one instance buffer, so culling for the camera would take them out of the other passes too
+#define MESH_MAGIC 0x4853454d // "MESH"
+#define MESH_VERSION 3
+#define MESH_ALIGNMENT 16
+#define MESH_FLAG_SKINNED 1
+#define MESH_FLAG_LODS 2
+#define MESH_FLAG_MESHLETS 4
+#define MESH_FLAG_COMPRESSED 8 // the vertices and indices are streams, see MESH CODEC
+#define MESH_FLAG_ANIMATION_KEYS 16 // the bone frames are curves of keys, see ANIMATION
+typedef struct { // 48 bytes, model space, of the bind pose for a skinned mesh that is not animated, of every baked frame for one that is
+    float min[3], max[3]; // aabb
+    float center[3], radius; // sphere around the aabb center
+} MeshBounds;
+typedef struct { // 96 bytes
+    char name[32]; // the group of the .obj, the primitive of the .glb
+    unsigned int firstIndex, indexCount;
+    unsigned int firstVertex, vertexCount; // the vertices only its indices use, indices are into the whole vertex array
+    MeshBounds bounds;
+} Submesh;
+typedef struct { // 16 bytes
+    unsigned int submesh;
+    unsigned int firstIndex, indexCount; // into the index array, a lod uses the vertices of its submesh
+    float error; // in model units
+} MeshLod;
+typedef struct { // 48 bytes
+    unsigned int submesh;
+    unsigned int firstIndex, triangleCount; // into the index array, the triangles of a meshlet follow each other
+    unsigned int reserved;
+    float center[3], radius;
+    float coneAxis[3], coneCutoff; // backface cone, cutoff is the cosine, 1 or more means never culled
+} Meshlet;
+typedef struct { // 32 bytes
+    char name[24];
+    unsigned int firstFrame; // in the bone frames, the clips follow each other
+    unsigned int frameCount;
+} AnimationClip;
+typedef struct { // 24 bytes
+    unsigned short frame; // in the clip, the first key of a curve is at 0
+    short rotation[4]; // n16 quaternion xyzw
+    unsigned short translation[3], scale[3]; // u16 in the range of the curve
+    unsigned short reserved;
+} AnimationKey;
+typedef struct { // 56 bytes
+    unsigned int firstKey, keyCount; // the frames between two keys are interpolated, after the last key it is held
+    float translationMin[3], translationExtent[3];
+    float scaleMin[3], scaleExtent[3];
+} AnimationCurve;
+typedef struct { // 156 bytes
+    unsigned int magic;
+    unsigned int version;
+    unsigned int flags; // MESH_FLAG_*
+    unsigned int fileSize;
+    unsigned int crc; // of the whole file with this field as zero
+    unsigned int vertexFormat; // enum VertexFormat in graphics.h, the converters pick it per mesh
+    unsigned int vertexStride; // bytes of a vertex in that format
     unsigned int vertexCount;
     unsigned int indexCount;
-    unsigned int boneCount;
-    unsigned int frameCount;
+    unsigned int boneCount; // MAX_BONES if the mesh is skinned
+    unsigned int frameCount; // of all clips together
+    unsigned int clipCount;
+    unsigned int submeshCount;
+    unsigned int lodCount;
+    unsigned int meshletCount;
+    unsigned int vertexStreamSize; // bytes of the vertex section when MESH_FLAG_COMPRESSED
     unsigned int vertexArrayOffset;
     unsigned int indexArrayOffset;
     unsigned int boneFramesArrayOffset;
+    unsigned int clipTableOffset;
+    unsigned int submeshTableOffset;
+    unsigned int lodTableOffset;
+    unsigned int meshletTableOffset;
+    unsigned int indexStreamSize; // bytes of the index section when MESH_FLAG_COMPRESSED
+    unsigned int curveTableOffset; // clipCount * boneCount curves when MESH_FLAG_ANIMATION_KEYS
+    unsigned int keyTableOffset;
+    unsigned int keyCount;
+    MeshBounds bounds;
 } MeshHeader;
-static struct MappedMemory load_mesh(struct Platform *p, const char *filename, void** v, int *vc, void** i, int *ic) {
-    struct MappedMemory mm = p->map_file(filename);
+
+// crc32 (the zlib one), a nibble at a time so that the table stays small
+static unsigned int mesh_crc32(unsigned int crc, const void *data, size_t size) {
+    static const unsigned int table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    const unsigned char *bytes = (const unsigned char *) data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ table[crc & 15];
+        crc = (crc >> 4) ^ table[crc & 15];
+    }
+    return ~crc;
+}
+
+static int mesh_section_fits(const MeshHeader *header, unsigned int offset, unsigned long long count, unsigned long long element_size) {
+    return offset % MESH_ALIGNMENT == 0 && offset >= sizeof(MeshHeader) && offset <= header->fileSize && count * element_size <= header->fileSize - offset;
+}
+
+// the header and where its sections go, file_size is what there is of the file, 0 if that is not known
+static int validate_mesh_header(const MeshHeader *header, size_t file_size, const char *filename) {
+    const char *problem = NULL;
+    int compressed = (header->flags & MESH_FLAG_COMPRESSED) != 0;
+    int keys = (header->flags & MESH_FLAG_ANIMATION_KEYS) != 0;
+    if (header->magic != MESH_MAGIC) problem = "not a mesh";
+    else if (header->version != MESH_VERSION) problem = "wrong version, convert it again";
+    else if (file_size && header->fileSize > file_size) problem = "truncated";
+    else if (header->fileSize < sizeof(MeshHeader)) problem = "too small";
+    else if (header->vertexFormat >= 3 || header->vertexStride == 0) problem = "unknown vertex format"; // VERTEX_FORMAT_COUNT in graphics.h
+    else if (header->frameCount && header->boneCount != 64) problem = "bone count is not MAX_BONES"; // a frame is uploaded as SKELETON_SIZE bytes
+    else if (!mesh_section_fits(header, header->vertexArrayOffset, compressed ? header->vertexStreamSize : header->vertexCount, compressed ? 1 : header->vertexStride)
+          || !mesh_section_fits(header, header->indexArrayOffset, compressed ? header->indexStreamSize : header->indexCount, compressed ? 1 : sizeof(unsigned int))
+          || !mesh_section_fits(header, header->boneFramesArrayOffset, keys ? 0 : (unsigned long long) header->frameCount * header->boneCount, 16 * sizeof(float))
+          || !mesh_section_fits(header, header->clipTableOffset, header->clipCount, sizeof(AnimationClip))
+          || !mesh_section_fits(header, header->submeshTableOffset, header->submeshCount, sizeof(Submesh))
+          || !mesh_section_fits(header, header->lodTableOffset, header->lodCount, sizeof(MeshLod))
+          || !mesh_section_fits(header, header->meshletTableOffset, header->meshletCount, sizeof(Meshlet))
+          || !mesh_section_fits(header, header->curveTableOffset, keys ? (unsigned long long) header->clipCount * header->boneCount : 0, sizeof(AnimationCurve))
+          || !mesh_section_fits(header, header->keyTableOffset, header->keyCount, sizeof(AnimationKey))) problem = "a section is out of the file";
+    if (!problem) return 0;
+    fprintf(stderr, "[platform.h] Corrupt mesh %s: %s\n", filename, problem);
+    return -1;
+}
+
+// the header, the clips and the crc of a mapped mesh
+static int validate_mesh(const void *data, size_t size, const char *filename) {
+    const MeshHeader *header = (const MeshHeader *) data;
+    if (size < sizeof(MeshHeader)) {
+        fprintf(stderr, "[platform.h] Corrupt mesh %s: too small\n", filename);
+        return -1;
+    }
+    if (validate_mesh_header(header, size, filename) != 0) return -1;
+    const AnimationClip *clips = (const AnimationClip *) ((const unsigned char *) data + header->clipTableOffset);
+    for (unsigned int c = 0; c < header->clipCount; c++) {
+        if (clips[c].firstFrame > header->frameCount || clips[c].frameCount > header->frameCount - clips[c].firstFrame) {
+            fprintf(stderr, "[platform.h] Corrupt mesh %s: clip %u is out of the bone frames\n", filename, c);
+            return -1;
+        }
+    }
+    const Submesh *submeshes = (const Submesh *) ((const unsigned char *) data + header->submeshTableOffset);
+    for (unsigned int s = 0; s < header->submeshCount; s++) {
+        if (submeshes[s].firstIndex > header->indexCount || submeshes[s].indexCount > header->indexCount - submeshes[s].firstIndex
+            || submeshes[s].firstVertex > header->vertexCount || submeshes[s].vertexCount > header->vertexCount - submeshes[s].firstVertex) {
+            fprintf(stderr, "[platform.h] Corrupt mesh %s: submesh %u is out of the vertices or indices\n", filename, s);
+            return -1;
+        }
+    }
+    const AnimationCurve *curves = (const AnimationCurve *) ((const unsigned char *) data + header->curveTableOffset);
+    const AnimationKey *keys = (const AnimationKey *) ((const unsigned char *) data + header->keyTableOffset);
+    for (unsigned int c = 0; (header->flags & MESH_FLAG_ANIMATION_KEYS) && c < header->clipCount * header->boneCount; c++) {
+        int broken = curves[c].keyCount == 0 || curves[c].firstKey > header->keyCount || curves[c].keyCount > header->keyCount - curves[c].firstKey;
+        for (unsigned int k = 0; !broken && k < curves[c].keyCount; k++)
+            broken = k == 0 ? keys[curves[c].firstKey].frame != 0 : keys[curves[c].firstKey + k].frame <= keys[curves[c].firstKey + k - 1].frame;
+        if (broken) {
+            fprintf(stderr, "[platform.h] Corrupt mesh %s: curve %u has bad keys\n", filename, c);
+            return -1;
+        }
+    }
+    MeshHeader zeroed = *header;
+    zeroed.crc = 0;
+    unsigned int crc = mesh_crc32(0, &zeroed, sizeof(zeroed));
+    crc = mesh_crc32(crc, (const unsigned char *) data + sizeof(MeshHeader), header->fileSize - sizeof(MeshHeader));
+    if (crc != header->crc) {
+        fprintf(stderr, "[platform.h] Corrupt mesh %s: crc %08x, expected %08x\n", filename, crc, header->crc);
+        return -1;
+    }
+    return 0;
+}
+
+/* MESH CODEC */
+// *info* the vertex and index sections of a MESH_FLAG_COMPRESSED mesh are streams written by data/models/mesh_format.h
+// a stream is cut in blocks of MESH_CODEC_BLOCK elements that decode on their own: the block count, the offset of every
+// block from the start of the stream (u32s), then the blocks. A block has a lane per byte of an element, the vertex
+// stride or 4 for indices, and a lane is a 2 bit mode per group of 16 bytes followed by the groups:
+// 0 all zero, 1 2 bits per byte, 2 4 bits per byte, 3 the bytes as they are
+// a vertex lane holds the zigzag of the difference of a byte with the same byte of the vertex before, index lanes hold the
+// bytes of the zigzag of the difference of an index with the index before, both start from zero in every block
+// the LZ of the asset pack goes over the streams as the generic stage, they are mostly small repeating values
+#define MESH_CODEC_BLOCK 256
+#define MESH_CODEC_GROUP 16
+#define MESH_CODEC_MAX_LANES 64
+#define MESH_CODEC_BLOCKS_PER_JOB 16
+
+static unsigned int mesh_read32(const void *p) {
+    unsigned int x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+#if (defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || _M_IX86_FP >= 2))) && !defined(__TINYC__)
+#include <emmintrin.h>
+#define MESH_SIMD "sse2"
+typedef __m128i mesh_v128;
+#define mv_load4(p) _mm_cvtsi32_si128((int) mesh_read32(p))
+#define mv_load8(p) _mm_loadl_epi64((const __m128i *) (p))
+#define mv_load16(p) _mm_loadu_si128((const __m128i *) (p))
+#define mv_store16(p, x) _mm_storeu_si128((__m128i *) (p), x)
+#define mv_splat8(c) _mm_set1_epi8((char) (c))
+#define mv_splat32(c) _mm_set1_epi32((int) (c))
+#define mv_and(a, b) _mm_and_si128(a, b)
+#define mv_xor(a, b) _mm_xor_si128(a, b)
+#define mv_add8(a, b) _mm_add_epi8(a, b)
+#define mv_sub8(a, b) _mm_sub_epi8(a, b)
+#define mv_add32(a, b) _mm_add_epi32(a, b)
+#define mv_sub32(a, b) _mm_sub_epi32(a, b)
+#define mv_shr8(x, n) _mm_and_si128(_mm_srli_epi16(x, n), _mm_set1_epi8((char) (0xff >> (n))))
+#define mv_shr32(x, n) _mm_srli_epi32(x, n)
+#define mv_shl_bytes(x, n) _mm_slli_si128(x, n)
+#define mv_zip_lo8(a, b) _mm_unpacklo_epi8(a, b)
+#define mv_zip_hi8(a, b) _mm_unpackhi_epi8(a, b)
+#define mv_zip_lo16(a, b) _mm_unpacklo_epi16(a, b)
+#define mv_zip_hi16(a, b) _mm_unpackhi_epi16(a, b)
+#define mv_zip_lo32(a, b) _mm_unpacklo_epi32(a, b)
+#define mv_zip_hi32(a, b) _mm_unpackhi_epi32(a, b)
+#define mv_zip_lo64(a, b) _mm_unpacklo_epi64(a, b)
+#define mv_zip_hi64(a, b) _mm_unpackhi_epi64(a, b)
+#define mv_last8(x) _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_unpackhi_epi8(x, x), 0xff), 0xff)
+#define mv_last32(x) _mm_shuffle_epi32(x, 0xff)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MESH_SIMD "neon"
+typedef uint8x16_t mesh_v128;
+#define mv_load4(p) vreinterpretq_u8_u32(vsetq_lane_u32(mesh_read32(p), vdupq_n_u32(0), 0))
+#define mv_load8(p) vcombine_u8(vld1_u8((const uint8_t *) (p)), vdup_n_u8(0))
+#define mv_load16(p) vld1q_u8((const uint8_t *) (p))
+#define mv_store16(p, x) vst1q_u8((uint8_t *) (p), x)
+#define mv_splat8(c) vdupq_n_u8((uint8_t) (c))
+#define mv_splat32(c) vreinterpretq_u8_u32(vdupq_n_u32((uint32_t) (c)))
+#define mv_and(a, b) vandq_u8(a, b)
+#define mv_xor(a, b) veorq_u8(a, b)
+#define mv_add8(a, b) vaddq_u8(a, b)
+#define mv_sub8(a, b) vsubq_u8(a, b)
+#define mv_add32(a, b) vreinterpretq_u8_u32(vaddq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b)))
+#define mv_sub32(a, b) vreinterpretq_u8_u32(vsubq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b)))
+#define mv_shr8(x, n) vshrq_n_u8(x, n)
+#define mv_shr32(x, n) vreinterpretq_u8_u32(vshrq_n_u32(vreinterpretq_u32_u8(x), n))
+#define mv_shl_bytes(x, n) vextq_u8(vdupq_n_u8(0), x, 16 - (n))
+#define mv_zip_lo8(a, b) vzip1q_u8(a, b)
+#define mv_zip_hi8(a, b) vzip2q_u8(a, b)
+#define mv_zip_lo16(a, b) vreinterpretq_u8_u16(vzip1q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)))
+#define mv_zip_hi16(a, b) vreinterpretq_u8_u16(vzip2q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)))
+#define mv_zip_lo32(a, b) vreinterpretq_u8_u32(vzip1q_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b)))
+#define mv_zip_hi32(a, b) vreinterpretq_u8_u32(vzip2q_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b)))
+#define mv_zip_lo64(a, b) vreinterpretq_u8_u64(vzip1q_u64(vreinterpretq_u64_u8(a), vreinterpretq_u64_u8(b)))
+#define mv_zip_hi64(a, b) vreinterpretq_u8_u64(vzip2q_u64(vreinterpretq_u64_u8(a), vreinterpretq_u64_u8(b)))
+#define mv_last8(x) vdupq_laneq_u8(x, 15)
+#define mv_last32(x) vreinterpretq_u8_u32(vdupq_laneq_u32(vreinterpretq_u32_u8(x), 3))
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define MESH_SIMD "simd128"
+typedef v128_t mesh_v128;
+#define mv_load4(p) wasm_v128_load32_zero(p)
+#define mv_load8(p) wasm_v128_load64_zero(p)
+#define mv_load16(p) wasm_v128_load(p)
+#define mv_store16(p, x) wasm_v128_store(p, x)
+#define mv_splat8(c) wasm_i8x16_splat((int8_t) (c))
+#define mv_splat32(c) wasm_i32x4_splat((int32_t) (c))
+#define mv_and(a, b) wasm_v128_and(a, b)
+#define mv_xor(a, b) wasm_v128_xor(a, b)
+#define mv_add8(a, b) wasm_i8x16_add(a, b)
+#define mv_sub8(a, b) wasm_i8x16_sub(a, b)
+#define mv_add32(a, b) wasm_i32x4_add(a, b)
+#define mv_sub32(a, b) wasm_i32x4_sub(a, b)
+#define mv_shr8(x, n) wasm_u8x16_shr(x, n)
+#define mv_shr32(x, n) wasm_u32x4_shr(x, n)
+// the shuffle needs constant lanes, n is 1, 2, 4 or 8
+#define mv_shl_bytes(x, n) ((n) == 1 ? wasm_i8x16_shuffle(wasm_i8x16_splat(0), x, 0, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30) \
+                          : (n) == 2 ? wasm_i8x16_shuffle(wasm_i8x16_splat(0), x, 0, 1, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29) \
+                          : (n) == 4 ? wasm_i8x16_shuffle(wasm_i8x16_splat(0), x, 0, 1, 2, 3, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27) \
+                          : wasm_i8x16_shuffle(wasm_i8x16_splat(0), x, 0, 1, 2, 3, 4, 5, 6, 7, 16, 17, 18, 19, 20, 21, 22, 23))
+#define mv_zip_lo8(a, b) wasm_i8x16_shuffle(a, b, 0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23)
+#define mv_zip_hi8(a, b) wasm_i8x16_shuffle(a, b, 8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31)
+#define mv_zip_lo16(a, b) wasm_i16x8_shuffle(a, b, 0, 8, 1, 9, 2, 10, 3, 11)
+#define mv_zip_hi16(a, b) wasm_i16x8_shuffle(a, b, 4, 12, 5, 13, 6, 14, 7, 15)
+#define mv_zip_lo32(a, b) wasm_i32x4_shuffle(a, b, 0, 4, 1, 5)
+#define mv_zip_hi32(a, b) wasm_i32x4_shuffle(a, b, 2, 6, 3, 7)
+#define mv_zip_lo64(a, b) wasm_i64x2_shuffle(a, b, 0, 2)
+#define mv_zip_hi64(a, b) wasm_i64x2_shuffle(a, b, 1, 3)
+#define mv_last8(x) wasm_i8x16_shuffle(x, x, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15)
+#define mv_last32(x) wasm_i32x4_shuffle(x, x, 3, 3, 3, 3)
+#endif
+
+#ifdef MESH_SIMD
+// 16 bytes of a group, in the order of the stream
+static mesh_v128 mesh_unpack_group(const unsigned char *data, int mode) {
+    if (mode == 3) return mv_load16(data);
+    if (mode == 2) {
+        mesh_v128 x = mv_load8(data), mask = mv_splat8(15);
+        return mv_zip_lo8(mv_and(x, mask), mv_and(mv_shr8(x, 4), mask));
+    }
+    if (mode == 1) {
+        mesh_v128 x = mv_load4(data), mask = mv_splat8(3);
+        mesh_v128 a = mv_zip_lo8(mv_and(x, mask), mv_and(mv_shr8(x, 2), mask));
+        mesh_v128 b = mv_zip_lo8(mv_and(mv_shr8(x, 4), mask), mv_shr8(x, 6));
+        return mv_zip_lo16(a, b);
+    }
+    return mv_splat8(0);
+}
+
+// one lane of a block into lane[], with the deltas of a vertex lane added up, NULL if the stream ends early
+static const unsigned char *mesh_decode_lane(const unsigned char *data, const unsigned char *end, unsigned char *lane, int group_count, int vertex) {
+    const unsigned char *modes = data;
+    data += (group_count + 3) / 4;
+    if (data > end) return NULL;
+    mesh_v128 carry = mv_splat8(0), one = mv_splat8(1), zero = mv_splat8(0);
+    for (int g = 0; g < group_count; g++) {
+        int mode = (modes[g >> 2] >> ((g & 3) * 2)) & 3;
+        int size = mode ? 2 << mode : 0;
+        if (end - data < size) return NULL;
+        mesh_v128 x = mesh_unpack_group(data, mode);
+        data += size;
+        if (vertex) {
+            x = mv_xor(mv_shr8(x, 1), mv_sub8(zero, mv_and(x, one))); // zigzag
+            x = mv_add8(x, mv_shl_bytes(x, 1));
+            x = mv_add8(x, mv_shl_bytes(x, 2));
+            x = mv_add8(x, mv_shl_bytes(x, 4));
+            x = mv_add8(x, mv_shl_bytes(x, 8));
+            x = mv_add8(x, carry);
+            carry = mv_last8(x);
+        }
+        mv_store16(lane + g * MESH_CODEC_GROUP, x);
+    }
+    return data;
+}
+
+// 4 lanes of 16 elements to 16 elements of 4 bytes
+static void mesh_transpose(const unsigned char *l0, const unsigned char *l1, const unsigned char *l2, const unsigned char *l3, mesh_v128 out[4]) {
+    mesh_v128 a = mv_load16(l0), b = mv_load16(l1), c = mv_load16(l2), d = mv_load16(l3);
+    mesh_v128 ab_lo = mv_zip_lo8(a, b), ab_hi = mv_zip_hi8(a, b), cd_lo = mv_zip_lo8(c, d), cd_hi = mv_zip_hi8(c, d);
+    out[0] = mv_zip_lo16(ab_lo, cd_lo);
+    out[1] = mv_zip_hi16(ab_lo, cd_lo);
+    out[2] = mv_zip_lo16(ab_hi, cd_hi);
+    out[3] = mv_zip_hi16(ab_hi, cd_hi);
+}
+
+// 16 lanes of 16 elements to 16 rows of 16 bytes, row v has byte l of element v from lane l
+static void mesh_transpose16(const unsigned char *lane, mesh_v128 rows[16]) {
+    mesh_v128 x[4][4];
+    for (int q = 0; q < 4; q++) {
+        const unsigned char *l = lane + 4 * q * MESH_CODEC_BLOCK;
+        mesh_transpose(l, l + MESH_CODEC_BLOCK, l + 2 * MESH_CODEC_BLOCK, l + 3 * MESH_CODEC_BLOCK, x[q]);
+    }
+    for (int k = 0; k < 4; k++) {
+        mesh_v128 ab_lo = mv_zip_lo32(x[0][k], x[1][k]), ab_hi = mv_zip_hi32(x[0][k], x[1][k]);
+        mesh_v128 cd_lo = mv_zip_lo32(x[2][k], x[3][k]), cd_hi = mv_zip_hi32(x[2][k], x[3][k]);
+        rows[4 * k] = mv_zip_lo64(ab_lo, cd_lo);
+        rows[4 * k + 1] = mv_zip_hi64(ab_lo, cd_lo);
+        rows[4 * k + 2] = mv_zip_lo64(ab_hi, cd_hi);
+        rows[4 * k + 3] = mv_zip_hi64(ab_hi, cd_hi);
+    }
+}
+
+// the lanes of a block back to vertices, the stride is a multiple of 4
+// *info* 16 lanes at a time go out as whole 16 byte rows, a stride that is not a multiple of 16 (24, 40) ends with a row
+// that overlaps the one before it, only strides under 16 go out 4 bytes at a time
+static void mesh_interleave_vertices(const unsigned char *lanes, unsigned char *out, int count, int stride) {
+    for (int first = 0; first < count; first += MESH_CODEC_GROUP) {
+        int n = count - first < MESH_CODEC_GROUP ? count - first : MESH_CODEC_GROUP;
+        unsigned char *o = out + (size_t) first * stride;
+        if (stride < 16) {
+            unsigned char words[64];
+            for (int l = 0; l < stride; l += 4) {
+                mesh_v128 x[4];
+                const unsigned char *lane = lanes + l * MESH_CODEC_BLOCK + first;
+                mesh_transpose(lane, lane + MESH_CODEC_BLOCK, lane + 2 * MESH_CODEC_BLOCK, lane + 3 * MESH_CODEC_BLOCK, x);
+                for (int k = 0; k < 4; k++) mv_store16(words + k * 16, x[k]);
+                for (int v = 0; v < n; v++) memcpy(o + (size_t) v * stride + l, words + v * 4, 4);
+            }
+            continue;
+        }
+        for (int l = 0; l < stride; l += 16) {
+            int at = l + 16 > stride ? stride - 16 : l;
+            mesh_v128 rows[16];
+            mesh_transpose16(lanes + at * MESH_CODEC_BLOCK + first, rows);
+            for (int v = 0; v < n; v++) mv_store16(o + (size_t) v * stride + at, rows[v]);
+        }
+    }
+}
+
+// the 4 lanes of a block back to indices
+static void mesh_interleave_indices(const unsigned char *lanes, unsigned int *out, int count) {
+    mesh_v128 carry = mv_splat8(0), one = mv_splat32(1), zero = mv_splat8(0);
+    unsigned int words[16];
+    for (int first = 0; first < count; first += MESH_CODEC_GROUP) {
+        mesh_v128 x[4];
+        mesh_transpose(lanes + first, lanes + MESH_CODEC_BLOCK + first, lanes + 2 * MESH_CODEC_BLOCK + first, lanes + 3 * MESH_CODEC_BLOCK + first, x);
+        for (int k = 0; k < 4; k++) {
+            mesh_v128 d = mv_xor(mv_shr32(x[k], 1), mv_sub32(zero, mv_and(x[k], one))); // zigzag
+            d = mv_add32(d, mv_shl_bytes(d, 4));
+            d = mv_add32(d, mv_shl_bytes(d, 8));
+            d = mv_add32(d, carry);
+            carry = mv_last32(d);
+            x[k] = d;
+        }
+        int n = count - first < MESH_CODEC_GROUP ? count - first : MESH_CODEC_GROUP;
+        if (n == MESH_CODEC_GROUP) {
+            for (int k = 0; k < 4; k++) mv_store16(out + first + k * 4, x[k]);
+            continue;
+        }
+        for (int k = 0; k < 4; k++) mv_store16(words + k * 4, x[k]);
+        memcpy(out + first, words, n * sizeof(unsigned int));
+    }
+}
+#else
+#define MESH_SIMD "scalar"
+static const unsigned char *mesh_decode_lane(const unsigned char *data, const unsigned char *end, unsigned char *lane, int group_count, int vertex) {
+    const unsigned char *modes = data;
+    data += (group_count + 3) / 4;
+    if (data > end) return NULL;
+    unsigned char previous = 0;
+    for (int g = 0; g < group_count; g++) {
+        int mode = (modes[g >> 2] >> ((g & 3) * 2)) & 3;
+        int size = mode ? 2 << mode : 0;
+        if (end - data < size) return NULL;
+        unsigned char *x = lane + g * MESH_CODEC_GROUP;
+        for (int k = 0; k < MESH_CODEC_GROUP; k++) {
+            if (mode == 0) x[k] = 0;
+            else if (mode == 1) x[k] = (data[k >> 2] >> ((k & 3) * 2)) & 3;
+            else if (mode == 2) x[k] = (data[k >> 1] >> ((k & 1) * 4)) & 15;
+            else x[k] = data[k];
+            if (vertex) x[k] = previous = (unsigned char) (previous + ((x[k] >> 1) ^ -(x[k] & 1)));
+        }
+        data += size;
+    }
+    return data;
+}
+
+static void mesh_interleave_vertices(const unsigned char *lanes, unsigned char *out, int count, int stride) {
+    for (int v = 0; v < count; v++)
+        for (int l = 0; l < stride; l++) out[(size_t) v * stride + l] = lanes[l * MESH_CODEC_BLOCK + v];
+}
+
+static void mesh_interleave_indices(const unsigned char *lanes, unsigned int *out, int count) {
+    unsigned int previous = 0;
+    for (int i = 0; i < count; i++) {
+        unsigned int z = lanes[i] | (lanes[MESH_CODEC_BLOCK + i] << 8) | (lanes[2 * MESH_CODEC_BLOCK + i] << 16) | ((unsigned int) lanes[3 * MESH_CODEC_BLOCK + i] << 24);
+        out[i] = previous = previous + ((z >> 1) ^ (0u - (z & 1)));
+    }
+}
+#endif
+
+// one block of a stream to out, where the block goes and not the stream, lane_data holds MESH_CODEC_MAX_LANES lanes, 0 if the stream is corrupt
+static int mesh_decode_block(const unsigned char *stream, size_t stream_size, int block, size_t count, int stride, int index_stream, unsigned char *out, unsigned char *lane_data) {
+    unsigned int block_count = mesh_read32(stream);
+    unsigned int offset = mesh_read32(stream + 4 + 4 * block);
+    unsigned int next = block + 1 < (int) block_count ? mesh_read32(stream + 8 + 4 * block) : (unsigned int) stream_size;
+    if (offset > next || next > stream_size) return 0;
+    int first = block * MESH_CODEC_BLOCK;
+    int n = count - first < MESH_CODEC_BLOCK ? (int) (count - first) : MESH_CODEC_BLOCK;
+    int lanes = index_stream ? 4 : stride;
+    int groups = (n + MESH_CODEC_GROUP - 1) / MESH_CODEC_GROUP;
+    const unsigned char *data = stream + offset, *end = stream + next;
+    for (int l = 0; l < lanes && data; l++) data = mesh_decode_lane(data, end, lane_data + l * MESH_CODEC_BLOCK, groups, !index_stream);
+    if (!data) return 0;
+    if (index_stream) mesh_interleave_indices(lane_data, (unsigned int *) out, n);
+    else mesh_interleave_vertices(lane_data, out, n, stride);
+    return 1;
+}
+
+static int mesh_stream_block_count(const unsigned char *stream, size_t stream_size, size_t count) {
+    unsigned int block_count = stream_size >= 4 ? mesh_read32(stream) : 0;
+    size_t expected = (count + MESH_CODEC_BLOCK - 1) / MESH_CODEC_BLOCK;
+    if (block_count != expected || stream_size < 4 + 4 * (size_t) block_count) return -1;
+    return (int) block_count;
+}
+
+struct MeshDecodeJob {
+    const unsigned char *vertex_stream, *index_stream;
+    size_t vertex_stream_size, index_stream_size, vertex_count, index_count;
+    int stride, vertex_blocks, index_blocks;
+    int first_block; // of the stream, vertices and indices hold the blocks from there on
+    unsigned char *vertices, *indices;
+    int failed;
+};
+
+// MESH_CODEC_BLOCKS_PER_JOB blocks, the vertex blocks first and then the index blocks
+static void mesh_decode_job(void *data, int index) {
+    struct MeshDecodeJob *job = (struct MeshDecodeJob *) data;
+    unsigned char lane_data[MESH_CODEC_MAX_LANES * MESH_CODEC_BLOCK];
+    int total = job->vertex_blocks + job->index_blocks;
+    for (int b = index * MESH_CODEC_BLOCKS_PER_JOB; b < total && b < (index + 1) * MESH_CODEC_BLOCKS_PER_JOB; b++) {
+        int v = b, i = b - job->vertex_blocks;
+        int ok = b < job->vertex_blocks
+            ? mesh_decode_block(job->vertex_stream, job->vertex_stream_size, job->first_block + v, job->vertex_count, job->stride, 0, job->vertices + (size_t) v * MESH_CODEC_BLOCK * job->stride, lane_data)
+            : mesh_decode_block(job->index_stream, job->index_stream_size, job->first_block + i, job->index_count, 4, 1, job->indices + (size_t) i * MESH_CODEC_BLOCK * 4, lane_data);
+        if (!ok) job->failed = 1;
+    }
+}
+
+// the streams of a validated MESH_FLAG_COMPRESSED mesh, the blocks are checked as they are decoded
+static struct MeshDecodeJob mesh_decode_streams(const void *data, const char *filename) {
+    const MeshHeader *header = (const MeshHeader *) data;
+    struct MeshDecodeJob job = {0};
+    job.vertex_stream = (const unsigned char *) data + header->vertexArrayOffset;
+    job.index_stream = (const unsigned char *) data + header->indexArrayOffset;
+    job.vertex_stream_size = header->vertexStreamSize; job.index_stream_size = header->indexStreamSize;
+    job.vertex_count = header->vertexCount; job.index_count = header->indexCount;
+    job.stride = (int) header->vertexStride;
+    job.vertex_blocks = mesh_stream_block_count(job.vertex_stream, job.vertex_stream_size, job.vertex_count);
+    job.index_blocks = mesh_stream_block_count(job.index_stream, job.index_stream_size, job.index_count);
+    if (job.vertex_blocks < 0 || job.index_blocks < 0 || job.stride % 4 || job.stride > MESH_CODEC_MAX_LANES) {
+        fprintf(stderr, "[platform.h] Corrupt mesh %s: bad streams\n", filename);
+        job.failed = 1;
+    }
+    return job;
+}
+
+// count blocks of one stream from first on into out, for decoding straight into an upload buffer, -1 if they are corrupt
+static int decode_mesh_blocks(struct Platform *p, const struct MeshDecodeJob *streams, int index_stream, int first, int count, void *out) {
+    struct MeshDecodeJob job = *streams;
+    job.first_block = first;
+    job.vertex_blocks = index_stream ? 0 : count;
+    job.index_blocks = index_stream ? count : 0;
+    job.vertices = job.indices = (unsigned char *) out;
+    int jobs = (count + MESH_CODEC_BLOCKS_PER_JOB - 1) / MESH_CODEC_BLOCKS_PER_JOB;
+    if (jobs > 1) p->run_jobs(mesh_decode_job, &job, jobs);
+    else if (jobs == 1) mesh_decode_job(&job, 0);
+    return job.failed ? -1 : 0;
+}
+
+// the mesh with its streams decoded, in memory that unmap_asset frees, the mapped file is unmapped
+static struct MappedMemory decode_mesh(struct Platform *p, struct MappedMemory *mm, const char *filename) {
+    const MeshHeader *header = (const MeshHeader *) mm->data;
+    struct MeshDecodeJob job = mesh_decode_streams(mm->data, filename);
+    struct MappedMemory decoded = {0};
+    if (job.failed) {
+        unmap_asset(p, mm);
+        return decoded;
+    }
+    // the same layout with the streams as plain arrays, the sections after them move along
+    unsigned int vertex_offset = (sizeof(MeshHeader) + MESH_ALIGNMENT - 1) & ~(MESH_ALIGNMENT - 1);
+    unsigned int index_offset = (vertex_offset + header->vertexCount * header->vertexStride + MESH_ALIGNMENT - 1) & ~(MESH_ALIGNMENT - 1);
+    unsigned int tail_offset = (index_offset + header->indexCount * 4 + MESH_ALIGNMENT - 1) & ~(MESH_ALIGNMENT - 1);
+    unsigned int tail_size = header->fileSize - header->boneFramesArrayOffset;
+    decoded = alloc_asset(tail_offset + tail_size);
+    if (!decoded.data) {
+        unmap_asset(p, mm);
+        return (struct MappedMemory){0};
+    }
+    MeshHeader *out = (MeshHeader *) decoded.data;
+    *out = *header;
+    unsigned int shift = tail_offset - header->boneFramesArrayOffset; // unsigned, wraps around when the tail moves down
+    out->flags &= ~MESH_FLAG_COMPRESSED;
+    out->fileSize = (unsigned int) decoded.size;
+    out->crc = 0;
+    out->vertexStreamSize = out->indexStreamSize = 0;
+    out->vertexArrayOffset = vertex_offset;
+    out->indexArrayOffset = index_offset;
+    out->boneFramesArrayOffset += shift; out->clipTableOffset += shift; out->submeshTableOffset += shift;
+    out->lodTableOffset += shift; out->meshletTableOffset += shift;
+    out->curveTableOffset += shift; out->keyTableOffset += shift;
+    memcpy((unsigned char *) decoded.data + tail_offset, (const unsigned char *) mm->data + header->boneFramesArrayOffset, tail_size);
+    job.vertices = (unsigned char *) decoded.data + vertex_offset;
+    job.indices = (unsigned char *) decoded.data + index_offset;
+    int jobs = (job.vertex_blocks + job.index_blocks + MESH_CODEC_BLOCKS_PER_JOB - 1) / MESH_CODEC_BLOCKS_PER_JOB;
+    if (jobs > 1) p->run_jobs(mesh_decode_job, &job, jobs);
+    else if (jobs == 1) mesh_decode_job(&job, 0);
+    unmap_asset(p, mm);
+    if (job.failed) {
+        fprintf(stderr, "[platform.h] Corrupt mesh %s: bad streams\n", filename);
+        free(decoded.data);
+        return (struct MappedMemory){0};
+    }
+    return decoded;
+}
+
+/* ANIMATION */
+// *info* the clips of an animated mesh stay in memory as they are in the file: the curves and keys written by
+// data/models/blender/gltf_to_binary.c (see ANIMATION KEYS there), or the baked bone frames when the keys could not keep
+// every vertex close enough. The pose of an instance is sampled from them every frame, see ANIMATION in present.c
+typedef struct {
+    unsigned int clip_count, bone_count;
+    float *frames; // bone_count matrices per frame, NULL when there are keys
+    AnimationClip *clips;
+    AnimationCurve *curves; // clip_count * bone_count curves (clip major), NULL for baked frames
+    AnimationKey *keys;
+} MeshAnimation;
+
+// the clips, and the curves and keys or the bone frames, of a validated mesh in one allocation to free(), so the mesh
+// itself can be unmapped once it is uploaded, NULL if it has no clips
+static MeshAnimation *copy_animation(const void *data) {
+    const MeshHeader *header = (const MeshHeader *) data;
+    int keyed = (header->flags & MESH_FLAG_ANIMATION_KEYS) != 0;
+    if (header->clipCount == 0 || header->boneCount == 0) return NULL;
+    size_t frames_size = keyed ? 0 : (size_t) header->frameCount * header->boneCount * 16 * sizeof(float);
+    size_t clips_size = (size_t) header->clipCount * sizeof(AnimationClip);
+    size_t curves_size = keyed ? (size_t) header->clipCount * header->boneCount * sizeof(AnimationCurve) : 0;
+    size_t keys_size = keyed ? (size_t) header->keyCount * sizeof(AnimationKey) : 0;
+    MeshAnimation *animation = (MeshAnimation *) malloc(sizeof(MeshAnimation) + frames_size + clips_size + curves_size + keys_size);
+    if (!animation) return NULL;
+    unsigned char *at = (unsigned char *) (animation + 1);
+    animation->clip_count = header->clipCount;
+    animation->bone_count = header->boneCount;
+    animation->frames = keyed ? NULL : (float *) at;
+    memcpy(at, (const unsigned char *) data + header->boneFramesArrayOffset, frames_size);
+    at += frames_size;
+    animation->clips = (AnimationClip *) at;
+    memcpy(at, (const unsigned char *) data + header->clipTableOffset, clips_size);
+    at += clips_size;
+    animation->curves = keyed ? (AnimationCurve *) at : NULL;
+    memcpy(at, (const unsigned char *) data + header->curveTableOffset, curves_size);
+    at += curves_size;
+    animation->keys = keyed ? (AnimationKey *) at : NULL;
+    memcpy(at, (const unsigned char *) data + header->keyTableOffset, keys_size);
+    return animation;
+}
+
+// the same math as animation_key_matrix in data/models/mesh_format.h, the converter measured its error with that one
+static void sample_animation_key(const AnimationCurve *curve, const AnimationKey *a, const AnimationKey *b, float t, float *out) {
+    int dot = 0;
+    for (int i = 0; i < 4; i++) dot += a->rotation[i] * b->rotation[i];
+    float sign = dot < 0 ? -1.0f : 1.0f, q[4], length = 0, translation[3], scale[3];
+    for (int i = 0; i < 4; i++) {
+        q[i] = a->rotation[i] * (1.0f - t) + sign * b->rotation[i] * t;
+        length += q[i] * q[i];
+    }
+    length = length > 0 ? 1.0f / sqrtf(length) : 0;
+    for (int i = 0; i < 4; i++) q[i] *= length;
+    for (int c = 0; c < 3; c++) {
+        translation[c] = curve->translationMin[c] + curve->translationExtent[c] * ((a->translation[c] * (1.0f - t) + b->translation[c] * t) / 65535.0f);
+        scale[c] = curve->scaleMin[c] + curve->scaleExtent[c] * ((a->scale[c] * (1.0f - t) + b->scale[c] * t) / 65535.0f);
+    }
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+    float m[16] = {
+        (1 - 2*y*y - 2*z*z) * scale[0], (2*x*y + 2*z*w) * scale[0],     (2*x*z - 2*y*w) * scale[0],     0,
+        (2*x*y - 2*z*w) * scale[1],     (1 - 2*x*x - 2*z*z) * scale[1], (2*y*z + 2*x*w) * scale[1],     0,
+        (2*x*z + 2*y*w) * scale[2],     (2*y*z - 2*x*w) * scale[2],     (1 - 2*x*x - 2*y*y) * scale[2], 0,
+        translation[0],                 translation[1],                 translation[2],                 1
+    };
+    memcpy(out, m, sizeof(m));
+}
+
+// all bones of a clip at a fractional frame into out, bone_count matrices, between two keys or two baked frames the pose
+// is interpolated, past the last frame of the clip the last pose is held
+static void sample_animation(const MeshAnimation *animation, unsigned int clip, float frame, float *out) {
+    const AnimationClip *c = &animation->clips[clip];
+    float last = c->frameCount > 0 ? (float) (c->frameCount - 1) : 0.0f;
+    frame = frame < 0.0f ? 0.0f : frame > last ? last : frame;
+    for (unsigned int b = 0; b < animation->bone_count; b++) {
+        float *m = &out[b * 16];
+        if (!animation->curves) {
+            unsigned int f = (unsigned int) frame, next = (float) f < last ? f + 1 : f;
+            float t = frame - (float) f;
+            const float *m0 = &animation->frames[((size_t) (c->firstFrame + f) * animation->bone_count + b) * 16];
+            const float *m1 = &animation->frames[((size_t) (c->firstFrame + next) * animation->bone_count + b) * 16];
+            for (int k = 0; k < 16; k++) m[k] = m0[k] + (m1[k] - m0[k]) * t;
+            continue;
+        }
+        const AnimationCurve *curve = &animation->curves[clip * animation->bone_count + b];
+        const AnimationKey *keys = &animation->keys[curve->firstKey];
+        // the last key at or before the frame
+        unsigned int low = 0, high = curve->keyCount - 1;
+        while (low < high) {
+            unsigned int mid = (low + high + 1) / 2;
+            if (keys[mid].frame <= frame) low = mid; else high = mid - 1;
+        }
+        const AnimationKey *a = &keys[low], *next = low + 1 < curve->keyCount ? &keys[low + 1] : a;
+        float t = next->frame > a->frame ? (frame - a->frame) / (float) (next->frame - a->frame) : 0.0f;
+        sample_animation_key(curve, a, next, t > 1.0f ? 1.0f : t, m);
+    }
+}
+
+// a mesh that is missing or fails validation is unmapped and loads as an empty mesh, so that it draws nothing
+static struct MappedMemory load_mesh(struct Platform *p, const char *filename, void** v, int *vc, void** i, int *ic, int *vf) {
+    struct MappedMemory mm = map_asset(p, filename);
+    *v = NULL; *vc = 0; *i = NULL; *ic = 0; *vf = 0;
+    if (!mm.data) return mm;
+    if (validate_mesh(mm.data, mm.size, filename) != 0) {
+        unmap_asset(p, &mm);
+        return mm;
+    }
+    if (((MeshHeader*)mm.data)->flags & MESH_FLAG_COMPRESSED) {
+        mm = decode_mesh(p, &mm, filename);
+        if (!mm.data) return mm;
+    }
     
     MeshHeader *header = (MeshHeader*)mm.data;
     // Set pointers into the mapped memory using the header's offsets
@@ -31,51 +710,292 @@ static struct MappedMemory load_mesh(struct Platform *p, const char *filename, v
     *v = (unsigned char*)mm.data + header->vertexArrayOffset;
     *ic  = header->indexCount;
     *i  = (unsigned int*)((unsigned char*)mm.data + header->indexArrayOffset);
+    *vf = header->vertexFormat;
     
     return mm;
 }
 static struct MappedMemory load_animated_mesh(struct Platform *p, const char *filename,
                                    void** vertices, int *vertexCount,
                                    void** indices, int *indexCount,
-                                   void** boneFrames, int *boneCount,
-                                   int *frameCount) {
-    // Map the file into memory.
-    struct MappedMemory mm = p->map_file(filename);
-    if (!mm.data) {
-        // printf("Error: could not map file %s\n", filename); // todo; put this validation in platform map_file() code instead
-        return mm;
-    }
-    
-    // The file begins with an AnimatedMeshHeader.
-    MeshHeader *header = (MeshHeader*) mm.data;
-    
-    // Set the vertex pointer and count.
-    *vertexCount = header->vertexCount;
-    *vertices = (unsigned char*) mm.data + header->vertexArrayOffset;
-    
-    // Set the index pointer and count.
-    *indexCount = header->indexCount;
-    *indices = (unsigned int*)((unsigned char*) mm.data + header->indexArrayOffset);
-    
-    // Set the bone frames pointer, bone count, and frame count.
-    *boneCount = header->boneCount;
-    *frameCount = header->frameCount;
-    *boneFrames = (unsigned char*) mm.data + header->boneFramesArrayOffset;
-    
+                                   int *vertexFormat, MeshAnimation **animation) {
+    *animation = NULL;
+    // The vertices and indices are read like those of any mesh, a corrupt file leaves everything empty.
+    struct MappedMemory mm = load_mesh(p, filename, vertices, vertexCount, indices, indexCount, vertexFormat);
+    if (!mm.data) return mm;
+    // Every animation in the source file is a clip, they outlive the mesh, it is unmapped after the upload.
+    *animation = copy_animation(mm.data);
     return mm;
 }
 /* MEMORY MAPPING TEXTURE */
 typedef struct {
     int width;
     int height;
+    int mip_count;    // full chain down to 1x1, written by data/textures/convert_to_binary.c
+    int pixel_offset; // rgba8 levels follow each other, largest first
 } ImageHeader;  
-static struct MappedMemory load_texture(struct Platform *p, const char *filename, int *out_width, int *out_height) {
-    struct MappedMemory mm = p->map_file(filename);
+static struct MappedMemory load_texture(struct Platform *p, const char *filename, void **pixels, int *out_width, int *out_height, int *out_mip_count) {
+    struct MappedMemory mm = map_asset(p, filename);
 
     ImageHeader *header = (ImageHeader*)mm.data;
+    *pixels = (unsigned char*)mm.data + header->pixel_offset;
     *out_width  = header->width;
     *out_height = header->height;
+    *out_mip_count = header->mip_count;
+    return mm;
+}
+
+/* UNIVERSAL TEXTURE */
+// *info* written by data/textures/convert_to_binary.c: a BC1 mip chain, in LZ compressed bands of block rows
+#define TEX_MAGIC 0x58455455 // "UTEX"
+#define TEX_VERSION 1
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    int width;
+    int height;
+    int mip_count;
+    int chunk_count; // TextureChunk[chunk_count] follows the header, then the compressed data
+} TextureFileHeader;
+typedef struct {
+    int mip;
+    int first_row; // in blocks
+    int row_count; // in blocks
+    unsigned int offset; // from the start of the file
+    unsigned int compressed_size;
+    unsigned int size; // BC1 bytes after decompression
+} TextureChunk;
+
+// returns the number of bytes written to dst, or -1 if the data is corrupt
+static int lz_decompress(const unsigned char *src, int src_size, unsigned char *dst, int dst_size) {
+    const unsigned char *ip = src, *end = src + src_size;
+    unsigned char *op = dst, *op_end = dst + dst_size;
+    while (ip < end) {
+        int token = *ip++;
+        int literals = token >> 4;
+        if (literals == 15) { int b; do { if (ip >= end) return -1; b = *ip++; literals += b; } while (b == 255); }
+        if (literals > end - ip || literals > op_end - op) return -1;
+        memcpy(op, ip, literals); op += literals; ip += literals;
+        if (ip >= end) break; // the last sequence only has literals
+        if (end - ip < 2) return -1;
+        int offset = ip[0] | (ip[1] << 8); ip += 2;
+        int length = (token & 15) + 4;
+        if ((token & 15) == 15) { int b; do { if (ip >= end) return -1; b = *ip++; length += b; } while (b == 255); }
+        if (offset == 0 || offset > op - dst || length > op_end - op) return -1;
+        const unsigned char *ref = op - offset;
+        while (length--) *op++ = *ref++; // byte by byte, matches can overlap
+    }
+    return (int) (op - dst);
+}
+
+static void bc1_decode_block(const unsigned char *block, unsigned char *rgba, int stride) {
+    unsigned int c[2] = {block[0] | (block[1] << 8), block[2] | (block[3] << 8)};
+    unsigned char pal[4][4];
+    for (int i = 0; i < 2; i++) {
+        int r = (c[i] >> 11) & 31, g = (c[i] >> 5) & 63, b = c[i] & 31;
+        pal[i][0] = (r << 3) | (r >> 2); pal[i][1] = (g << 2) | (g >> 4); pal[i][2] = (b << 3) | (b >> 2); pal[i][3] = 255;
+    }
+    for (int k = 0; k < 3; k++) {
+        if (c[0] > c[1]) {
+            pal[2][k] = (2 * pal[0][k] + pal[1][k]) / 3;
+            pal[3][k] = (pal[0][k] + 2 * pal[1][k]) / 3;
+        } else {
+            pal[2][k] = (pal[0][k] + pal[1][k]) / 2;
+            pal[3][k] = 0;
+        }
+    }
+    pal[2][3] = 255; pal[3][3] = c[0] > c[1] ? 255 : 0;
+    unsigned int bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int) block[7] << 24);
+    for (int i = 0; i < 16; i++) memcpy(rgba + (i >> 2) * stride + (i & 3) * 4, pal[(bits >> (i * 2)) & 3], 4);
+}
+
+struct TranscodeJob {
+    const unsigned char *file;
+    const TextureChunk *chunks;
+    unsigned char *out;
+    size_t level_offset[16];
+    int level_w[16], level_h[16];
+    int to_rgba8;
+    int failed;
+};
+
+// decompress one band of block rows, and write it as BC1 or decode it to rgba8
+static void transcode_chunk(void *data, int index) {
+    struct TranscodeJob *job = (struct TranscodeJob *) data;
+    const TextureChunk *chunk = &job->chunks[index];
+    int w = job->level_w[chunk->mip], h = job->level_h[chunk->mip];
+    int blocks_x = (w + 3) / 4;
+    size_t row_size = (size_t) blocks_x * 8;
+    if (!job->to_rgba8) {
+        unsigned char *dst = job->out + job->level_offset[chunk->mip] + chunk->first_row * row_size;
+        if (lz_decompress(job->file + chunk->offset, chunk->compressed_size, dst, chunk->size) != (int) chunk->size) job->failed = 1;
+        return;
+    }
+    unsigned char *blocks = malloc(chunk->size);
+    if (lz_decompress(job->file + chunk->offset, chunk->compressed_size, blocks, chunk->size) != (int) chunk->size) {
+        job->failed = 1;
+        free(blocks);
+        return;
+    }
+    unsigned char pixels[4 * 4 * 4];
+    for (int row = 0; row < chunk->row_count; row++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            bc1_decode_block(blocks + row * row_size + bx * 8, pixels, 16);
+            // mips smaller than a block only keep the pixels that exist
+            for (int y = 0; y < 4; y++) {
+                int py = (chunk->first_row + row) * 4 + y;
+                if (py >= h) break;
+                int count = w - bx * 4 < 4 ? w - bx * 4 : 4;
+                memcpy(job->out + job->level_offset[chunk->mip] + ((size_t) py * w + bx * 4) * 4, pixels + y * 16, count * 4);
+            }
+        }
+    }
+    free(blocks);
+}
+
+// loads a .tex file and returns its mip chain, packed largest level first, as BC1 or as rgba8 for gpus without BC
+// the returned pixels are malloc'ed, free them after uploading
+static void *load_universal_texture(struct Platform *p, const char *filename, int to_rgba8, int *out_width, int *out_height, int *out_mip_count) {
+    struct MappedMemory mm = map_asset(p, filename);
+    if (!mm.data) return NULL;
+    TextureFileHeader *header = (TextureFileHeader *) mm.data;
+    if (header->magic != TEX_MAGIC || header->version != TEX_VERSION || header->mip_count > 16) {
+        fprintf(stderr, "[platform.h] Not a universal texture: %s\n", filename);
+        unmap_asset(p, &mm);
+        return NULL;
+    }
+    struct TranscodeJob job = {0};
+    job.file = mm.data;
+    job.chunks = (const TextureChunk *) (header + 1);
+    job.to_rgba8 = to_rgba8;
+    size_t size = 0;
+    int w = header->width, h = header->height;
+    for (int mip = 0; mip < header->mip_count; mip++) {
+        job.level_offset[mip] = size;
+        job.level_w[mip] = w; job.level_h[mip] = h;
+        size += to_rgba8 ? (size_t) w * h * 4 : (size_t) ((w + 3) / 4) * ((h + 3) / 4) * 8;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    job.out = malloc(size);
+    p->run_jobs(transcode_chunk, &job, header->chunk_count);
+    *out_width = header->width;
+    *out_height = header->height;
+    *out_mip_count = header->mip_count;
+    unmap_asset(p, &mm);
+    if (job.failed) {
+        fprintf(stderr, "[platform.h] Corrupt universal texture: %s\n", filename);
+        free(job.out);
+        return NULL;
+    }
+    return job.out;
+}
+
+/* ASSET PACK */
+// *info* written by data/pack.c: all the files the game loads in one file, so that one mapping serves every load
+// the toc is an open addressing hash table on the 64 bit fnv1a hash of the path, at most half full so a lookup always ends on an empty slot
+#define PACK_MAGIC 0x4b434150 // "PACK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 256 // the buffer offset and bytes per row alignment of webgpu copies, the data of an entry can go to the gpu as is
+#define PACK_COMPRESSED 1 // PackEntry.flags, the entry is LZ compressed and gets decompressed into its own memory when it is mapped
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int slot_count; // power of two, PackEntry[slot_count] follows the header
+    unsigned int entry_count;
+} PackHeader;
+typedef struct { // 32 bytes
+    unsigned long long hash; // pack_hash of the path as the game asks for it, 0 is an empty slot
+    unsigned long long offset; // from the start of the pack, a multiple of PACK_ALIGNMENT
+    unsigned int size; // after decompression
+    unsigned int stored_size; // in the pack
+    unsigned int flags;
+    unsigned int name_offset; // the zero terminated path, from the start of the pack
+} PackEntry;
+
+// 64 bit fnv1a
+static unsigned long long pack_hash(const void *data, size_t size) {
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= ((const unsigned char *) data)[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash ? hash : 1; // 0 marks an empty slot
+}
+
+static struct {
+    struct MappedMemory mm;
+    const PackHeader *header;
+    const PackEntry *entries;
+} asset_pack;
+#define PACK_VIEW ((void *) &asset_pack) // MappedMemory.mapping of an entry that points into the pack, unmapping it does nothing
+#define PACK_COPY ((void *) &asset_pack.entries) // MappedMemory.mapping of an entry that was decompressed, unmapping it frees it
+
+// open before any other load, without a pack the loose files are used
+static int open_asset_pack(struct Platform *p, const char *filename) {
+    struct MappedMemory mm = p->map_file(filename);
+    if (!mm.data) return -1;
+    const PackHeader *header = (const PackHeader *) mm.data;
+    if (header->magic != PACK_MAGIC || header->version != PACK_VERSION || !header->slot_count || (header->slot_count & (header->slot_count - 1))) {
+        fprintf(stderr, "[platform.h] Not an asset pack: %s\n", filename);
+        p->unmap_file(&mm);
+        return -1;
+    }
+    asset_pack.mm = mm;
+    asset_pack.header = header;
+    asset_pack.entries = (const PackEntry *) (header + 1);
+    printf("[platform.h] Loading %u assets from %s\n", header->entry_count, filename);
+    return 0;
+}
+
+static const PackEntry *find_pack_entry(const char *filename) {
+    if (!asset_pack.header) return NULL;
+    unsigned long long hash = pack_hash(filename, strlen(filename));
+    unsigned int mask = asset_pack.header->slot_count - 1;
+    for (unsigned int slot = (unsigned int) hash & mask;; slot = (slot + 1) & mask) {
+        const PackEntry *entry = &asset_pack.entries[slot];
+        if (!entry->hash) return NULL;
+        if (entry->hash == hash && strcmp((const char *) asset_pack.mm.data + entry->name_offset, filename) == 0) return entry;
+    }
+}
+
+static struct MappedMemory map_asset(struct Platform *p, const char *filename) {
+    const PackEntry *entry = find_pack_entry(filename);
+    if (!entry) return p->map_file(filename);
+    const unsigned char *data = (const unsigned char *) asset_pack.mm.data + entry->offset;
+    if (!(entry->flags & PACK_COMPRESSED)) return (struct MappedMemory){(void *) data, PACK_VIEW, entry->size};
+    struct MappedMemory mm = alloc_asset(entry->size);
+    if (lz_decompress(data, entry->stored_size, mm.data, entry->size) != (int) entry->size) {
+        fprintf(stderr, "[platform.h] Corrupt asset in pack: %s\n", filename);
+        free(mm.data);
+        return (struct MappedMemory){0};
+    }
+    return mm;
+}
+
+static struct MappedMemory alloc_asset(size_t size) {
+    struct MappedMemory mm = {malloc(size), PACK_COPY, size};
+    if (!mm.data) mm.size = 0;
     return mm;
 }
 
+static void unmap_asset(struct Platform *p, struct MappedMemory *mm) {
+    if (mm->mapping == PACK_COPY) free(mm->data);
+    else if (mm->mapping != PACK_VIEW) p->unmap_file(mm);
+    mm->data = NULL;
+    mm->mapping = NULL;
+    mm->size = 0;
+}
+
+// reads a range of an asset straight into dst, eg. a mapped gpu staging buffer, without mapping or copying the whole file
+// compressed entries of the pack cannot be read in ranges, returns -1 for those
+static int read_asset(struct Platform *p, const char *filename, size_t offset, void *dst, int size) {
+    const PackEntry *entry = find_pack_entry(filename);
+    if (!entry) return p->read_file(filename, offset, dst, size);
+    if (entry->flags & PACK_COMPRESSED) return -1;
+    if (offset >= entry->size) return 0;
+    if ((size_t) size > entry->size - offset) size = (int) (entry->size - offset);
+    memcpy(dst, (const unsigned char *) asset_pack.mm.data + entry->offset + offset, size);
+    return size;
+}
+
 #endif
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <math.h>
 
 #pragma region GLOBALS
 struct GlobalUniforms global_uniforms; // global uniform data in RAM
@@ -35,6 +36,7 @@ enum SHADERS {
     SHADOW_SHADER = 2,
     REFLECTION_SHADER = 3,
     ENV_CUBE_SHADER = 4,
+    SHADER_COUNT
 };
 #pragma endregion
 
@@ -67,7 +69,7 @@ static struct Instance ground_instance = {
     },
     .data = {2, BASE_SHADER, 0},
     .norms = {FLOAT_TO_U16(0.975), 0, 0, 0},
-    .animation = 0,
+    .animation = {0},
     .frame = 0.0f,
     .atlas_uv = {0}
 };
@@ -81,13 +83,441 @@ struct Instance pine = {
     },
     .data = {4, BASE_SHADER, 0},
     .norms = {0},
-    .animation = 0,
+    .animation = {0},
     .frame = 0.0f,
     .atlas_uv = {0}
 };
 struct Instance pines[10];
 #pragma endregion
 
+#pragma region ANIMATION
+// *info* the clips stay in memory as keys (MeshAnimation in platform.h), every frame the pose of an animated instance is
+// sampled from them on the cpu and written to its own row of the animation texture, Instance.animation[0] is that row
+#define ANIMATION_CROSSFADE_MS 200.0f
+struct Animator { // what an animated instance plays, the instance only points at the row of its pose
+    const MeshAnimation *animation;
+    int mesh_id, row; // setGPUMeshBoneData
+    unsigned int clip[2]; float frame[2]; // the current clip and the clip that is being faded out
+    float blend; // weight of clip[1]
+};
+
+// loop point of a clip: the last baked frame is the same pose as the first
+static float animation_loop_frames(const MeshAnimation *animation, unsigned int clip) {
+    int frames = (int) animation->clips[clip].frameCount - 1;
+    return frames > 0 ? (float) frames : 0.0f;
+}
+
+// switch to another clip, the current clip keeps playing while it fades out
+void play_animation(struct Animator *animator, unsigned int clip) {
+    if (!animator->animation || clip >= animator->animation->clip_count || animator->clip[0] == clip) return;
+    animator->clip[1] = animator->clip[0];
+    animator->frame[1] = animator->frame[0];
+    animator->blend = 1.0f;
+    animator->clip[0] = clip;
+    animator->frame[0] = 0.0f;
+}
+
+// advance the current clip and the clip being faded out, and write their blended pose to the row of the instance
+void update_animation(void *context, struct Animator *animator, double delta_ms) {
+    static float pose[MAX_BONES * 16], faded[MAX_BONES * 16];
+    if (!animator->animation || animator->row < 0 || animator->animation->bone_count > MAX_BONES) return;
+    float frames = (float) delta_ms * ANIMATION_FPS / 1000.0f;
+    for (int c = 0; c < 2; c++) {
+        float loop = animation_loop_frames(animator->animation, animator->clip[c]);
+        animator->frame[c] = loop > 0.0f ? fmodf(animator->frame[c] + frames, loop) : 0.0f;
+    }
+    sample_animation(animator->animation, animator->clip[0], animator->frame[0], pose);
+    if (animator->blend > 0.0f) {
+        sample_animation(animator->animation, animator->clip[1], animator->frame[1], faded);
+        for (unsigned int k = 0; k < animator->animation->bone_count * 16; k++) pose[k] += (faded[k] - pose[k]) * animator->blend;
+        animator->blend -= (float) delta_ms / ANIMATION_CROSSFADE_MS;
+    }
+    setGPUMeshBoneData(context, animator->mesh_id, animator->row, pose, (int) animator->animation->bone_count);
+}
+#pragma endregion
+
+#pragma region TEXTURES
+// *info* only the tail of a page (the mips below TEXTURE_STREAMED_MIPS) is uploaded at load, the gpu reports the finest mip it sampled from every page
+// pages that want their full resolution mips get a slot in the texture array, when all slots are taken the page that was wanted longest ago gives up its slot
+#define MAX_STREAMED_TEXTURES 256
+#define TEXTURE_STREAMS_PER_FEEDBACK 1 // pages that start loading per feedback readback, a next one only starts once the last one is uploaded
+struct StreamedTexture {
+    const char *filename; // has to stay valid, the full resolution mips get loaded from it again when the page becomes resident
+    struct TextureRegion region;
+};
+static struct StreamedTexture streamed_textures[MAX_STREAMED_TEXTURES];
+static int streamed_texture_count = 0;
+static int page_slot[TEXTURE_LIMIT]; // slot in the texture array, -1 if only the tail is resident
+static int slot_page[TEXTURE_LIMIT]; // page in the slot, -1 if it is free
+static unsigned int page_wanted[TEXTURE_LIMIT]; // last feedback that asked for the full resolution mips of the page
+static unsigned int texture_feedback_count = 0;
+static int resident_page_count = 0;
+
+static void init_texture_streaming() {
+    for (int j = 0; j < TEXTURE_LIMIT; j++) {
+        page_slot[j] = -1;
+        slot_page[j] = -1;
+    }
+}
+
+// the texture gets packed into a page of the texture array that it can share with other textures
+static struct TextureRegion upload_array_texture(void *context, int mesh_id, const char *filename, void *pixels, int w, int h, int mips) {
+    if (!pixels) return (struct TextureRegion){.layer = -1};
+    struct TextureRegion region = createGPUTexture(context, mesh_id, pixels, w, h, mips);
+    if (region.layer >= 0 && streamed_texture_count < MAX_STREAMED_TEXTURES) {
+        streamed_textures[streamed_texture_count++] = (struct StreamedTexture){.filename = filename, .region = region};
+    }
+    return region;
+}
+
+// the full resolution mips of the textures of a page are loaded (and transcoded) by background jobs, one page at a time
+struct TextureLoad {
+    int texture; // in streamed_textures
+    void *pixels; int w, h, mips;
+};
+static struct TextureLoad page_loads[MAX_STREAMED_TEXTURES];
+static volatile int page_load_done[MAX_STREAMED_TEXTURES]; // set by the platform once the job of the texture is done
+static int page_load_count = 0;
+static int loading_page = -1, loading_slot = -1; // -1 while no page is loading
+static struct Platform *texture_platform; // for the jobs
+static int texture_stream_rgba8; // transcode, when the texture array is not BC1
+
+static void load_page_texture_job(void *data, int index) {
+    struct TextureLoad *load = &((struct TextureLoad *) data)[index];
+    load->pixels = load_universal_texture(texture_platform, streamed_textures[load->texture].filename, texture_stream_rgba8, &load->w, &load->h, &load->mips);
+}
+
+static void start_page_load(struct Platform *p, void *context, int page, int slot) {
+    texture_platform = p;
+    texture_stream_rgba8 = getGPUTextureFormat(context) != TEXTURE_FORMAT_BC1;
+    page_load_count = 0;
+    for (int j = 0; j < streamed_texture_count; j++) {
+        if (streamed_textures[j].region.layer != page) continue;
+        page_loads[page_load_count] = (struct TextureLoad){.texture = j};
+        page_load_done[page_load_count++] = 0;
+    }
+    loading_page = page;
+    loading_slot = slot;
+    if (page_load_count > 0) p->start_jobs(load_page_texture_job, page_loads, page_load_count, page_load_done);
+}
+
+// once every texture of the loading page is in, they are uploaded into its slot and the page points at it
+static void finish_page_load(void *context) {
+    if (loading_page < 0) return;
+    for (int j = 0; j < page_load_count; j++) if (!page_load_done[j]) return;
+    for (int j = 0; j < page_load_count; j++) {
+        if (!page_loads[j].pixels) continue;
+        streamGPUTexture(context, streamed_textures[page_loads[j].texture].region, loading_slot, page_loads[j].pixels, page_loads[j].w, page_loads[j].h, page_loads[j].mips);
+        free(page_loads[j].pixels);
+    }
+    setGPUPageResidency(context, loading_page, loading_slot);
+    loading_page = loading_slot = -1;
+}
+
+static void update_texture_streaming(struct Platform *p, void *context) {
+    finish_page_load(context);
+    unsigned char requested_mip[TEXTURE_LIMIT];
+    if (!getGPUTextureFeedback(context, requested_mip)) return;
+    texture_feedback_count += 1;
+    for (int page = 0; page < TEXTURE_LIMIT; page++) {
+        if (requested_mip[page] < TEXTURE_STREAMED_MIPS) page_wanted[page] = texture_feedback_count;
+    }
+    int slot_count = getGPUTextureSlots(context);
+    int streamed = 0;
+    for (int page = 0; page < TEXTURE_LIMIT && streamed < TEXTURE_STREAMS_PER_FEEDBACK && loading_page < 0; page++) {
+        if (page_wanted[page] != texture_feedback_count || page_slot[page] >= 0) continue;
+        // a free slot, otherwise the slot of the coldest page that was not wanted in this feedback
+        int slot = -1;
+        unsigned int coldest = texture_feedback_count;
+        for (int s = 0; s < slot_count; s++) {
+            if (slot_page[s] < 0) { slot = s; break; }
+            if (page_wanted[slot_page[s]] < coldest) { coldest = page_wanted[slot_page[s]]; slot = s; }
+        }
+        if (slot < 0) break; // every resident page is in view, the budget is too small
+        if (slot_page[slot] >= 0) {
+            setGPUPageResidency(context, slot_page[slot], -1);
+            page_slot[slot_page[slot]] = -1;
+            resident_page_count -= 1;
+        }
+        // the page keeps sampling its tail until its textures are loaded and uploaded into the slot
+        start_page_load(p, context, page, slot);
+        page_slot[page] = slot;
+        slot_page[slot] = page;
+        resident_page_count += 1;
+        streamed += 1;
+    }
+}
+
+// point the instances at the page and the rect in that page where their texture was packed
+static void set_instance_texture(struct Instance *instances, int count, struct TextureRegion region) {
+    if (region.layer < 0) return;
+    for (int j = 0; j < count; j++) {
+        instances[j].data[0] = region.layer;
+        instances[j].atlas_uv[0] = region.atlas_uv[0];
+        instances[j].atlas_uv[1] = region.atlas_uv[1];
+        instances[j].norms[3] = region.atlas_size;
+    }
+}
+#pragma endregion
+
+#pragma region PIPELINES
+// one pipeline per shader and vertex format, the draws are grouped by pipeline
+static int main_pipelines[SHADER_COUNT][VERTEX_FORMAT_COUNT];
+
+static void init_pipelines() {
+    if (SHADER_COUNT * VERTEX_FORMAT_COUNT > MAX_PIPELINES) {
+        fprintf(stderr, "MAX_PIPELINES is %d, not every shader fits in every vertex format (%d)\n", MAX_PIPELINES, SHADER_COUNT * VERTEX_FORMAT_COUNT);
+    }
+    for (int s = 0; s < SHADER_COUNT; s++) {
+        for (int f = 0; f < VERTEX_FORMAT_COUNT; f++) main_pipelines[s][f] = -1;
+    }
+}
+
+// the pipeline for the meshes of this shader in this vertex format, created by the first mesh that needs it
+static int mesh_pipeline(void *context, enum SHADERS shader, int format) {
+    if (format < 0 || format >= VERTEX_FORMAT_COUNT) {
+        fprintf(stderr, "Unknown vertex format %d\n", format);
+        return -1;
+    }
+    if (main_pipelines[shader][format] >= 0) return main_pipelines[shader][format];
+    int pipeline_id = create_main_pipeline(context, "data/shaders/shader.wgsl", shader, format);
+    main_pipelines[shader][format] = pipeline_id;
+    // the reflection probe only draws the sky and the opaque meshes, not the reflective ones it sits in
+    if (pipeline_id >= 0 && (shader == BASE_SHADER || shader == ENV_CUBE_SHADER)) {
+        create_probe_pipeline(context, pipeline_id, "data/shaders/shader.wgsl", shader);
+    }
+    return pipeline_id;
+}
+#pragma endregion
+
+#pragma region ASSET LOADING
+// *info* background jobs map and decode the files, the render thread hands the finished ones to the gpu in the order they were queued
+// at most ASSET_UPLOAD_BUDGET bytes per frame, so the scene fills in over the first frames instead of stalling the first one
+// compressed meshes and the env cube are staged: their data is decoded or read straight into the gpu staging buffers, piece by piece
+#define ASSET_UPLOAD_BUDGET (8 * 1024 * 1024) // bytes per frame, one asset is always uploaded even if it is larger
+#define MAX_ASSETS 64
+enum AssetType { ASSET_MESH, ASSET_ANIMATED_MESH, ASSET_TEXTURE, ASSET_ENV_CUBE };
+struct Asset {
+    enum AssetType type;
+    const char *filename; // the env cube is a pattern with a %s for the face
+    int id; // the scene code switches on it to decide what to do with the asset
+    // filled in by the job
+    struct MappedMemory mm;
+    void *v, *i; int vc, ic;
+    int vf; // enum VertexFormat of the vertices
+    MeshAnimation *animation; // of an animated mesh, it stays after the mesh is unmapped
+    void *pixels; int w, h, mips;
+    struct MappedMemory face_mm[6]; void *faces[6];
+    int staged; // only the headers were read, the data is read into the staging buffers by update_staged_uploads
+    size_t face_offset[6]; // in the file, for staging
+    struct MeshDecodeJob streams; // of a staged mesh, in mm until they are decoded into the staging buffers
+    size_t bytes; // what it will upload, counts against ASSET_UPLOAD_BUDGET, staged assets are bounded by the staging buffers instead
+};
+static struct Asset assets[MAX_ASSETS];
+static volatile int asset_loaded[MAX_ASSETS]; // set by the platform once the job of the asset is done
+static int asset_count = 0;
+static int asset_next_upload = 0;
+static struct Platform *asset_platform; // for the jobs
+static int asset_textures_rgba8; // transcode the universal textures, when the texture array is not BC1
+static const char *env_cube_faces[6] = {"ft", "bk", "up", "dn", "rt", "lf"};
+
+#define MAX_STAGED_RANGES 64
+struct StagedRange { // a range of a file that goes to the gpu through the staging buffers
+    char filename[256];
+    size_t file_offset, size, done;
+    size_t row_size; // the pieces of a texture copy are whole rows
+    enum UploadTarget target; int index; // the mesh, or the face of the env cube
+    int finishes_env_cube; // all faces are in once this range is, then the mips are filtered
+    const struct MeshDecodeJob *streams; int index_stream; // instead of the file, whole blocks of a stream of a compressed mesh
+    struct MappedMemory *unmap; // the streams, once this range is in
+};
+static struct StagedRange staged_ranges[MAX_STAGED_RANGES];
+static int staged_range_count = 0;
+static int staged_next = 0;
+
+static void queue_asset(enum AssetType type, const char *filename, int id) {
+    if (asset_count >= MAX_ASSETS) {
+        fprintf(stderr, "Too many assets queued, %s is not loaded\n", filename);
+        return;
+    }
+    assets[asset_count++] = (struct Asset){.type = type, .filename = filename, .id = id};
+}
+
+// read one byte of every page, so that the disk is waited on by the job and not by the render thread
+static void prefault(const void *data, size_t size) {
+    volatile unsigned char touch = 0;
+    for (size_t offset = 0; offset < size; offset += 4096) touch += ((const unsigned char *) data)[offset];
+}
+
+static void load_asset_job(void *data, int index) {
+    struct Asset *asset = &((struct Asset *) data)[index];
+    struct Platform *p = asset_platform;
+    switch (asset->type) {
+    case ASSET_MESH: {
+        MeshHeader header;
+        // a compressed mesh stays mapped as it is and is staged: the blocks of its streams are decoded straight into the
+        // staging buffers, so there is never a decoded copy of it on the cpu, one with animation keys is loaded whole
+        if (read_asset(p, asset->filename, 0, &header, sizeof(header)) == sizeof(header) && (header.flags & MESH_FLAG_COMPRESSED) && !(header.flags & MESH_FLAG_ANIMATION_KEYS)) {
+            asset->mm = map_asset(p, asset->filename);
+            if (!asset->mm.data) return;
+            const MeshHeader *mapped = (const MeshHeader *) asset->mm.data;
+            if (validate_mesh(asset->mm.data, asset->mm.size, asset->filename) != 0 || mapped->vertexStride != (unsigned int) VERTEX_SIZE[mapped->vertexFormat]
+                || (asset->streams = mesh_decode_streams(asset->mm.data, asset->filename)).failed) {
+                fprintf(stderr, "Mesh %s is not loaded\n", asset->filename);
+                unmap_asset(p, &asset->mm);
+                return;
+            }
+            asset->staged = 1;
+            asset->vc = mapped->vertexCount; asset->vf = mapped->vertexFormat; asset->ic = mapped->indexCount;
+            return;
+        }
+        asset->mm = load_mesh(p, asset->filename, &asset->v, &asset->vc, &asset->i, &asset->ic, &asset->vf);
+        break;
+    }
+    case ASSET_ANIMATED_MESH:
+        asset->mm = load_animated_mesh(p, asset->filename, &asset->v, &asset->vc, &asset->i, &asset->ic, &asset->vf, &asset->animation);
+        break;
+    case ASSET_TEXTURE:
+        asset->pixels = load_universal_texture(p, asset->filename, asset_textures_rgba8, &asset->w, &asset->h, &asset->mips);
+        // 4 bytes per texel as rgba8, half a byte as BC1, the mips add a third
+        asset->bytes = (asset_textures_rgba8 ? (size_t) asset->w * asset->h * 4 : (size_t) asset->w * asset->h / 2) * 4 / 3;
+        break;
+    case ASSET_ENV_CUBE: {
+        asset->staged = 1;
+        for (int face = 0; face < 6; face++) {
+            char filename[256];
+            ImageHeader header;
+            snprintf(filename, sizeof(filename), asset->filename, env_cube_faces[face]);
+            int read = read_asset(p, filename, 0, &header, sizeof(header));
+            asset->staged &= read == sizeof(header) && header.width == ENV_TEXTURE_SIZE && header.height == ENV_TEXTURE_SIZE;
+            if (read == sizeof(header)) asset->face_offset[face] = header.pixel_offset;
+        }
+        if (asset->staged) return;
+        for (int face = 0; face < 6; face++) {
+            char filename[256];
+            snprintf(filename, sizeof(filename), asset->filename, env_cube_faces[face]);
+            asset->face_mm[face] = load_texture(p, filename, &asset->faces[face], &asset->w, &asset->h, &asset->mips);
+            prefault(asset->faces[face], (size_t) asset->w * asset->h * 4);
+        }
+        asset->bytes = 6 * (size_t) asset->w * asset->h * 4;
+        break;
+    }
+    }
+    if ((asset->type == ASSET_MESH || asset->type == ASSET_ANIMATED_MESH) && asset->mm.data && asset->vf >= 0 && asset->vf < VERTEX_FORMAT_COUNT) {
+        prefault(asset->v, (size_t) asset->vc * VERTEX_SIZE[asset->vf]);
+        prefault(asset->i, (size_t) asset->ic * sizeof(uint32_t));
+        asset->bytes += (size_t) asset->vc * VERTEX_SIZE[asset->vf] + (size_t) asset->ic * sizeof(uint32_t);
+    }
+}
+
+static void start_loading_assets(struct Platform *p, void *context) {
+    asset_platform = p;
+    asset_textures_rgba8 = getGPUTextureFormat(context) != TEXTURE_FORMAT_BC1;
+    p->start_jobs(load_asset_job, assets, asset_count, asset_loaded);
+}
+
+// the next asset in queue order if it is loaded and fits in what is left of the budget of this frame
+static struct Asset *next_loaded_asset(size_t *upload_bytes) {
+    if (asset_next_upload >= asset_count || !asset_loaded[asset_next_upload]) return NULL;
+    struct Asset *asset = &assets[asset_next_upload];
+    if (*upload_bytes > 0 && *upload_bytes + asset->bytes > ASSET_UPLOAD_BUDGET) return NULL;
+    *upload_bytes += asset->bytes;
+    asset_next_upload += 1;
+    return asset;
+}
+
+static struct StagedRange *stage_range(const char *filename, size_t file_offset, size_t size, size_t row_size, enum UploadTarget target, int index) {
+    if (size == 0) return NULL;
+    if (staged_range_count >= MAX_STAGED_RANGES) {
+        fprintf(stderr, "Too many staged uploads, %s is not uploaded\n", filename);
+        return NULL;
+    }
+    struct StagedRange *range = &staged_ranges[staged_range_count++];
+    *range = (struct StagedRange){.file_offset = file_offset, .size = size, .row_size = row_size, .target = target, .index = index};
+    snprintf(range->filename, sizeof(range->filename), "%s", filename);
+    return range;
+}
+
+// createGPUMesh only reserved the space of a staged mesh, until its data is copied in it draws nothing
+// the pieces are whole blocks of the streams, so every block decodes on its own into its place in the staging buffer
+static void stage_mesh(struct Platform *p, struct Asset *asset, int mesh_id) {
+    if (!asset->staged) return;
+    if (mesh_id < 0 || staged_range_count + 2 > MAX_STAGED_RANGES) {
+        if (mesh_id >= 0) fprintf(stderr, "Too many staged uploads, %s is not uploaded\n", asset->filename);
+        unmap_asset(p, &asset->mm);
+        return;
+    }
+    size_t stride = VERTEX_SIZE[asset->vf];
+    struct StagedRange *vertices = stage_range(asset->filename, 0, (size_t) asset->vc * stride, MESH_CODEC_BLOCK * stride, UPLOAD_VERTICES, mesh_id);
+    struct StagedRange *indices = stage_range(asset->filename, 0, (size_t) asset->ic * sizeof(uint32_t), MESH_CODEC_BLOCK * sizeof(uint32_t), UPLOAD_INDICES, mesh_id);
+    if (vertices) vertices->streams = &asset->streams;
+    if (indices) { indices->streams = &asset->streams; indices->index_stream = 1; }
+    struct StagedRange *last = indices ? indices : vertices;
+    if (last) last->unmap = &asset->mm;
+    else unmap_asset(p, &asset->mm);
+}
+
+static void stage_env_cube(struct Asset *asset) {
+    for (int face = 0; face < 6; face++) {
+        char filename[256];
+        snprintf(filename, sizeof(filename), asset->filename, env_cube_faces[face]);
+        stage_range(filename, asset->face_offset[face], (size_t) 4 * ENV_TEXTURE_SIZE * ENV_TEXTURE_SIZE, 4 * ENV_TEXTURE_SIZE, UPLOAD_ENV_CUBE, face);
+    }
+    if (staged_range_count > 0) staged_ranges[staged_range_count - 1].finishes_env_cube = 1;
+}
+
+// fills every free staging buffer with the next pieces of the staged ranges, the rest waits until the gpu hands buffers back
+static void update_staged_uploads(struct Platform *p, void *context) {
+    while (staged_next < staged_range_count) {
+        void *data;
+        int staging = acquireGPUStaging(context, &data);
+        if (staging < 0) return;
+        size_t used = 0;
+        int filter_env_cube = 0;
+        while (staged_next < staged_range_count && used < STAGING_BUFFER_SIZE) {
+            struct StagedRange *range = &staged_ranges[staged_next];
+            size_t piece = range->size - range->done;
+            if (piece > STAGING_BUFFER_SIZE - used) piece = STAGING_BUFFER_SIZE - used;
+            if (range->row_size && piece < range->size - range->done) piece -= piece % range->row_size; // the last block of a stream is short
+            if (piece == 0) break; // not a single row fits anymore
+            int ok = range->streams
+                ? decode_mesh_blocks(p, range->streams, range->index_stream, (int) (range->done / range->row_size), (int) ((piece + range->row_size - 1) / range->row_size), (unsigned char *) data + used) == 0
+                : read_asset(p, range->filename, range->file_offset + range->done, (unsigned char *) data + used, (int) piece) == (int) piece;
+            if (ok) {
+                copyGPUStaging(context, staging, used, piece, range->target, range->index, range->done);
+                range->done += piece;
+                used = (used + piece + STAGING_ALIGNMENT - 1) & ~(size_t) (STAGING_ALIGNMENT - 1);
+            } else {
+                fprintf(stderr, "Failed to read %s for uploading\n", range->filename); // or a block of its streams is corrupt
+                range->done = range->size;
+            }
+            if (range->done == range->size) {
+                filter_env_cube |= range->finishes_env_cube;
+                if (range->unmap) unmap_asset(p, range->unmap);
+                staged_next++;
+            }
+        }
+        submitGPUStaging(context, staging);
+        if (filter_env_cube) set_env_cube(context, NULL, ENV_TEXTURE_SIZE); // after the copies, they are on the queue first
+    }
+}
+#pragma endregion
+
+#pragma region LIGHTS
+static struct Light lights[MAX_LIGHTS];
+static int light_count = 0;
+
+// a torch next to every pine, flickering a bit
+void update_lights(float time) {
+    for (int j = 0; j < light_count; j++) {
+        float flicker = 0.85f + 0.15f * sinf(time * 11.0f + j * 1.7f) * sinf(time * 7.3f + j * 0.9f);
+        lights[j].color[0] = 3.0f * flicker;
+        lights[j].color[1] = 1.6f * flicker;
+        lights[j].color[2] = 0.5f * flicker;
+    }
+}
+#pragma endregion
+
 #pragma region PRINT_ON_SCREEN
 // HUD quad (2D UI element)
 static struct Vertex quad_vertices[4] = {
@@ -140,6 +570,7 @@ static uint32_t quad_indices[6] = {0, 2, 1, 2, 3, 1};
 #define CHAR_HEIGHT (1.0 / CHAR_HALF_ROWS)  // height of one character
 
 static struct Instance char_instances[MAX_CHAR_ON_SCREEN] = {0};
+static int font_layer = 1; // the font atlas is a whole page, the hud uses atlas_uv to pick the glyph in it
 int screen_chars_index = 0;
 int current_screen_char = 0;
 void print_on_screen(const char *str) {
@@ -193,7 +624,7 @@ void print_on_screen(const char *str) {
         inst->atlas_uv[1] = ((uint16_t) atlas_row) * 8192;
         
         // (Other fields like data, norms, animation, etc. remain zero for now)
-        inst->data[0] = 1;
+        inst->data[0] = font_layer;
 
         screen_chars_index++;
         current_screen_char++;
@@ -206,6 +637,21 @@ void print_on_screen(const char *str) {
 
 #include "game.c" // todo: put game.c very isolated like graphics, platform. // Q: what to expose to game.c? print_on_screen?
 
+// the assets of the scene, tick() switches on these when an asset is ready to be uploaded
+enum SceneAsset {
+    SCENE_FONT_TEXTURE,
+    SCENE_ENV_CUBE,
+    SCENE_ENV_CUBE_MESH,
+    SCENE_GROUND_TEXTURE,
+    SCENE_CHARACTER,
+    SCENE_CHARACTER_TEXTURE,
+    SCENE_CUBE,
+    SCENE_SPHERE,
+    SCENE_CUBE_TEXTURE,
+    SCENE_PINE,
+    SCENE_PINE_TEXTURE
+};
+
 // todo: we need a much better way to manage meshes etc.
 int tick(struct Platform *p, void *context) {
 
@@ -241,14 +687,13 @@ int tick(struct Platform *p, void *context) {
     // todo: use precompiled shader for faster loading
     
     #pragma region statics
-    static int main_pipeline;
-    
     static int character_mesh_id;
     static int character_shadow_id;
     static int char2_mesh_id;
     static int cube_mesh_id;
     static int sphere_id;
     static int env_cube_id;
+    static int pines_mesh_id;
 
 
     static int ground_mesh_id;
@@ -258,10 +703,10 @@ int tick(struct Platform *p, void *context) {
     int pine_texture_id[10];
     struct GameObject pineo[10];
 
-    static int cube_texture_id;
-    static int quad_texture_id;
-    static int ground_texture_id;
-    static int colormap_texture_id;
+    static struct TextureRegion cube_texture;
+    static struct TextureRegion quad_texture;
+    static struct TextureRegion ground_texture;
+    static struct TextureRegion colormap_texture;
 
     float f = 1.0f / tan(fov / 2.0f);
     float projection[16] = {
@@ -284,6 +729,7 @@ int tick(struct Platform *p, void *context) {
         .data = {3, BASE_SHADER, 3},
         .atlas_uv = {0, 0}
     };
+    static struct Animator character_animator = {.row = -1};
     static struct Instance character2 = {
         .transform = {
             1., 0, 0, 0,
@@ -331,105 +777,40 @@ int tick(struct Platform *p, void *context) {
 
         // {
         //     void *cube_data[6];
-        //     int w, h = 0;
-        //     cube_data[0] = load_texture(p, "data/textures/bin/cube_face_+X.bin", &w, &h).data;
-        //     cube_data[1] = load_texture(p, "data/textures/bin/cube_face_-X.bin", &w, &h).data;
-        //     cube_data[2] = load_texture(p, "data/textures/bin/cube_face_+Y.bin", &w, &h).data;
-        //     cube_data[3] = load_texture(p, "data/textures/bin/cube_face_-Y.bin", &w, &h).data;
-        //     cube_data[4] = load_texture(p, "data/textures/bin/cube_face_+Z.bin", &w, &h).data;
-        //     cube_data[5] = load_texture(p, "data/textures/bin/cube_face_-Z.bin", &w, &h).data;
+        //     int w, h, mips = 0;
+        //     load_texture(p, "data/textures/bin/cube_face_+X.bin", &cube_data[0], &w, &h, &mips);
+        //     load_texture(p, "data/textures/bin/cube_face_-X.bin", &cube_data[1], &w, &h, &mips);
+        //     load_texture(p, "data/textures/bin/cube_face_+Y.bin", &cube_data[2], &w, &h, &mips);
+        //     load_texture(p, "data/textures/bin/cube_face_-Y.bin", &cube_data[3], &w, &h, &mips);
+        //     load_texture(p, "data/textures/bin/cube_face_+Z.bin", &cube_data[4], &w, &h, &mips);
+        //     load_texture(p, "data/textures/bin/cube_face_-Z.bin", &cube_data[5], &w, &h, &mips);
         //     load_cube_map(context, cube_data, w);
         // }
         
-        {
-            void *cube_data[6];
-            int w, h = 0;
-            cube_data[0] = load_texture(p, "data/textures/bin/bluecloud_ft.bin", &w, &h).data;
-            cube_data[1] = load_texture(p, "data/textures/bin/bluecloud_bk.bin", &w, &h).data;
-            cube_data[2] = load_texture(p, "data/textures/bin/bluecloud_up.bin", &w, &h).data;
-            cube_data[3] = load_texture(p, "data/textures/bin/bluecloud_dn.bin", &w, &h).data;
-            cube_data[4] = load_texture(p, "data/textures/bin/bluecloud_rt.bin", &w, &h).data;
-            cube_data[5] = load_texture(p, "data/textures/bin/bluecloud_lf.bin", &w, &h).data;
-            set_env_cube(context, cube_data, ENV_TEXTURE_SIZE); // size of the image has to be 1024
-        }
+        // every load below reads from the pack when there is one, it stays mapped for the whole run
+        open_asset_pack(p, "data/assets.pack");
+
+        // every pipeline is created by the first mesh that needs it, the meshes on disk add the ones of their format as they come in
+        init_pipelines();
 
-        main_pipeline = create_main_pipeline(context, "data/shaders/shader.wgsl");
-         
-        int vc, ic; void *v, *i;
-        void *bf; int bc, fc;
-
-        // ENVIRONMENT CUBE
-        struct MappedMemory env_cube_mm = load_mesh(p, "data/models/blender/bin/env_cube.bin", &v, &vc, &i, &ic);
-        env_cube_id = createGPUMesh(context, main_pipeline, 2, v, vc, i, ic, &env_cube, 1);
-        material_uniforms[env_cube_id].shader = ENV_CUBE_SHADER;
-        p->unmap_file(&env_cube_mm);
- 
         // PREDEFINED MESHES
-        ground_mesh_id = createGPUMesh(context, main_pipeline, 0, &quad_vertices, 4, &quad_indices, 6, &ground_instance, 1);
-        quad_mesh_id = createGPUMesh(context, main_pipeline, 0, &quad_vertices, 4, &quad_indices, 6, &char_instances, MAX_CHAR_ON_SCREEN);
-        material_uniforms[quad_mesh_id].shader = HUD_SHADER;
- 
-        // LOAD MESHES FROM DISK
-        struct MappedMemory character_mm = load_animated_mesh(p, "data/models/blender/bin/charA.bin", &v, &vc, &i, &ic, &bf, &bc, &fc);
-        printf("frame count: %d, bone count: %d\n", fc, bc);
-        character_mesh_id = createGPUMesh(context, main_pipeline, 2, v, vc, i, ic, &character, 1);
-        character_shadow_id = createGPUMesh(context, main_pipeline, 2, v, vc, i, ic, &character, 1);
-        material_uniforms[3].animated = 1;
-        material_uniforms[character_shadow_id].shader = SHADOW_SHADER;
-        // todo: problem: less than 131kb to read from -> segfault
-        setGPUMeshBoneData(context, character_mesh_id, bf, bc, fc);
-        setGPUMeshBoneData(context, character_shadow_id, bf, bc, fc);
-        // todo: below: we will just save all the bone data to the gpu, then unmap, same for textures and meshes
-        // todo: we cannot unmap the bones data, maybe memcpy it here to make it persist
-        // todo: fix script for correct UVs etc.
-        // p->unmap_file(&character_mm);
-
-        // void *bf1; int bc1, fc1;
-        // struct MappedMemory char2_mm = load_animated_mesh(p, "data/models/blender/bin/charA2.bin", &v, &vc, &i, &ic, &bf1, &bc1, &fc1);
-        // printf("frame count: %d, bone count: %d\n", fc1, bc1);
-        // char2_mesh_id = createGPUMesh(context, main_pipeline, 2, v, vc, i, ic, &character2, 1);
-        // addGPUMaterialUniform(context, char2_mesh_id, &shadow_shader_id, sizeof(shadow_shader_id));
-        // setGPUMeshBoneData(context, char2_mesh_id, bf1, bc1, fc1);
-        // // todo: we cannot unmap the bones data, maybe memcpy it here to make it persist
-        // // todo: fix script for correct UVs etc.
-        // p->unmap_file(&char2_mm);
-        
-        struct MappedMemory cube_mm = load_mesh(p, "data/models/bin/cube.bin", &v, &vc, &i, &ic);
-        for (int c = 0;c<1;c++) {
-            for (int j = 0; j < 1; j++) {
-                cube[c] = cube_i;
-                cube[c].transform[12] = (rand() % 50) - 25; // X
-                cube[c].transform[13] = (rand() % 25); // Y
-                cube[c].transform[14] = (rand() % 50) - 25; // Z
-            }
-            cube_mesh_id = createGPUMesh(context, main_pipeline, 2, v, vc, i, ic, &cube[c], 1);
-            material_uniforms[1].shader = REFLECTION_SHADER;
-            material_uniforms[1].reflective = 0.5;
-        }
-        p->unmap_file(&cube_mm);
-       
-        struct MappedMemory sphere_mm = load_mesh(p, "data/models/blender/bin/sphere.bin", &v, &vc, &i, &ic);
-        sphere_id = createGPUMesh(context, main_pipeline, 2, v, vc, i, ic, &sphere, 1);
-        material_uniforms[2].shader = REFLECTION_SHADER;
-        material_uniforms[2].reflective = 1.0;
-        p->unmap_file(&sphere_mm);
-
-        // TEXTURE
-        int w, h = 0;
-        struct MappedMemory china_texture_mm = load_texture(p, "data/textures/bin/china.bin", &w, &h);
-        cube_texture_id = createGPUTexture(context, cube_mesh_id, china_texture_mm.data, w, h);
-        p->unmap_file(&china_texture_mm);
-        struct MappedMemory font_texture_mm = load_texture(p, "data/textures/bin/font_atlas_sq.bin", &w, &h);
-        quad_texture_id = createGPUTexture(context, quad_mesh_id, font_texture_mm.data, w, h);
-        p->unmap_file(&font_texture_mm);
-
-        struct MappedMemory ground_texture_mm = load_texture(p, "data/textures/bin/stone.bin", &w, &h);
-        ground_texture_id = createGPUTexture(context, ground_mesh_id, ground_texture_mm.data, w, h);
-        p->unmap_file(&ground_texture_mm);
-
-        struct MappedMemory colormap_mm = load_texture(p, "data/textures/bin/colormap.bin", &w, &h);
-        colormap_texture_id = createGPUTexture(context, character_mesh_id, colormap_mm.data, w, h);
-        p->unmap_file(&colormap_mm);
+        ground_mesh_id = createGPUMesh(context, mesh_pipeline(context, BASE_SHADER, VERTEX_FORMAT_FULL), 0, &quad_vertices, 4, &quad_indices, 6, &ground_instance, 1);
+        quad_mesh_id = createGPUMesh(context, mesh_pipeline(context, HUD_SHADER, VERTEX_FORMAT_FULL), 0, &quad_vertices, 4, &quad_indices, 6, &char_instances, MAX_CHAR_ON_SCREEN);
+
+        // LOAD FROM DISK, in the background, uploaded below as they come in
+        init_texture_streaming();
+        queue_asset(ASSET_TEXTURE, "data/textures/tex/font_atlas_sq.tex", SCENE_FONT_TEXTURE);
+        queue_asset(ASSET_ENV_CUBE, "data/textures/bin/bluecloud_%s.bin", SCENE_ENV_CUBE);
+        queue_asset(ASSET_MESH, "data/models/blender/bin/env_cube.bin", SCENE_ENV_CUBE_MESH);
+        queue_asset(ASSET_TEXTURE, "data/textures/tex/stone.tex", SCENE_GROUND_TEXTURE);
+        queue_asset(ASSET_ANIMATED_MESH, "data/models/blender/bin/charA.bin", SCENE_CHARACTER);
+        queue_asset(ASSET_TEXTURE, "data/textures/tex/colormap.tex", SCENE_CHARACTER_TEXTURE);
+        queue_asset(ASSET_MESH, "data/models/bin/cube.bin", SCENE_CUBE);
+        queue_asset(ASSET_MESH, "data/models/blender/bin/sphere.bin", SCENE_SPHERE);
+        queue_asset(ASSET_TEXTURE, "data/textures/tex/china.tex", SCENE_CUBE_TEXTURE);
+        queue_asset(ASSET_MESH, "data/models/bin/pine.bin", SCENE_PINE);
+        queue_asset(ASSET_TEXTURE, "data/textures/tex/colormap_2.tex", SCENE_PINE_TEXTURE);
+        start_loading_assets(p, context);
 
         // UNIFORMS
         global_uniforms.brightness = brightness;
@@ -464,18 +845,107 @@ int tick(struct Platform *p, void *context) {
             pineo[j].collisionBox.position.z = pines[j].transform[14];
             addGameObject(&gameState, &pineo[j]);
         }
-        struct MappedMemory pine_mm = load_mesh(p, "data/models/bin/pine.bin", &v, &vc, &i, &ic);
-        struct MappedMemory green_texture_mm = load_texture(p, "data/textures/bin/colormap_2.bin", &w, &h);
-        // mesh
-        int pine_mesh_id = createGPUMesh(context, main_pipeline, 2, v, vc, i, ic, &pines, NR_OF_PINES);
-        material_uniforms[pine_mesh_id].shader = BASE_SHADER;
-        // texture
-        int pine_texture_id = createGPUTexture(context, pine_mesh_id, green_texture_mm.data, w, h);
-        p->unmap_file(&green_texture_mm);
-        p->unmap_file(&pine_mm);
+
+        // LIGHTS
+        // the cluster shader indexes the light array with light_count, it never goes past MAX_LIGHTS
+        for (int j = 0; j < NR_OF_PINES && light_count < MAX_LIGHTS; j++) {
+            lights[light_count++] = (struct Light){
+                .position = {pines[j].transform[12] * 0.85f, 1.0f, pines[j].transform[14] * 0.85f},
+                .range = 6.0f,
+                .spot_cos = -1.0f, // point light
+            };
+        }
+        setGPULights(context, lights, light_count);
+        global_uniforms.light_count = light_count;
+        global_uniforms.cluster_near = nearClip;
+        global_uniforms.cluster_far = farClip;
     }
     #pragma endregion
 
+    #pragma region asset uploads
+    // upload what the background jobs have loaded so far, within the budget of this frame
+    // *info* the textures go after the meshes that use them in the queue, the region is copied into the instances of the mesh
+    double time_before_uploads = p->current_time_ms();
+    size_t upload_bytes = 0;
+    struct Asset *asset;
+    while ((asset = next_loaded_asset(&upload_bytes))) {
+        switch (asset->id) {
+        case SCENE_FONT_TEXTURE:
+            quad_texture = upload_array_texture(context, quad_mesh_id, asset->filename, asset->pixels, asset->w, asset->h, asset->mips);
+            if (quad_texture.layer >= 0) font_layer = quad_texture.layer;
+            break;
+        case SCENE_ENV_CUBE:
+            if (asset->staged) stage_env_cube(asset);
+            else set_env_cube(context, asset->faces, ENV_TEXTURE_SIZE); // size of the image has to be 1024
+            break;
+        case SCENE_ENV_CUBE_MESH:
+            env_cube_id = createGPUMesh(context, mesh_pipeline(context, ENV_CUBE_SHADER, asset->vf), 2, asset->v, asset->vc, asset->i, asset->ic, &env_cube, 1);
+            stage_mesh(p, asset, env_cube_id);
+            break;
+        case SCENE_GROUND_TEXTURE:
+            ground_texture = upload_array_texture(context, ground_mesh_id, asset->filename, asset->pixels, asset->w, asset->h, asset->mips);
+            set_instance_texture(&ground_instance, 1, ground_texture);
+            break;
+        case SCENE_CHARACTER: {
+            character_mesh_id = createGPUMesh(context, mesh_pipeline(context, BASE_SHADER, asset->vf), MESH_CAST_SHADOWS | MESH_ANIMATED, asset->v, asset->vc, asset->i, asset->ic, &character, 1);
+            character_shadow_id = createGPUMesh(context, mesh_pipeline(context, SHADOW_SHADER, asset->vf), MESH_CAST_SHADOWS | MESH_ANIMATED, asset->v, asset->vc, asset->i, asset->ic, &character, 1);
+            material_uniforms[3].animated = 1;
+            // one row for the pose of the instance, the shadow mesh draws the same instance so it reads the same row
+            if (character_mesh_id >= 0 && asset->animation) {
+                character_animator = (struct Animator){.animation = asset->animation, .mesh_id = character_mesh_id};
+                character_animator.row = setGPUMeshBoneData(context, character_mesh_id, -1, NULL, 0);
+                if (character_animator.row >= 0) character.animation[0] = (unsigned short) character_animator.row;
+                for (unsigned int c = 0; c < asset->animation->clip_count; c++)
+                    printf("clip %u: %s, %u frames\n", c, asset->animation->clips[c].name, asset->animation->clips[c].frameCount);
+            }
+            // todo: fix script for correct UVs etc.
+            break;
+        }
+        case SCENE_CHARACTER_TEXTURE:
+            colormap_texture = upload_array_texture(context, character_mesh_id, asset->filename, asset->pixels, asset->w, asset->h, asset->mips);
+            set_instance_texture(&character, 1, colormap_texture);
+            break;
+        case SCENE_CUBE:
+            cube[0] = cube_i;
+            cube[0].transform[12] = (rand() % 50) - 25; // X
+            cube[0].transform[13] = (rand() % 25); // Y
+            cube[0].transform[14] = (rand() % 50) - 25; // Z
+            cube_mesh_id = createGPUMesh(context, mesh_pipeline(context, REFLECTION_SHADER, asset->vf), 2, asset->v, asset->vc, asset->i, asset->ic, &cube[0], 1);
+            stage_mesh(p, asset, cube_mesh_id);
+            material_uniforms[1].reflective = 0.5;
+            material_uniforms[1].roughness = 0.6;
+            break;
+        case SCENE_SPHERE:
+            sphere_id = createGPUMesh(context, mesh_pipeline(context, REFLECTION_SHADER, asset->vf), 2, asset->v, asset->vc, asset->i, asset->ic, &sphere, 1);
+            stage_mesh(p, asset, sphere_id);
+            material_uniforms[2].reflective = 1.0;
+            material_uniforms[2].roughness = 0.0;
+            break;
+        case SCENE_CUBE_TEXTURE:
+            cube_texture = upload_array_texture(context, cube_mesh_id, asset->filename, asset->pixels, asset->w, asset->h, asset->mips);
+            set_instance_texture(cube, 1, cube_texture);
+            set_instance_texture(&sphere, 1, cube_texture);
+            break;
+        case SCENE_PINE:
+            pines_mesh_id = createGPUMesh(context, mesh_pipeline(context, BASE_SHADER, asset->vf), 2, asset->v, asset->vc, asset->i, asset->ic, &pines, NR_OF_PINES);
+            stage_mesh(p, asset, pines_mesh_id);
+            break;
+        case SCENE_PINE_TEXTURE: {
+            struct TextureRegion pine_texture = upload_array_texture(context, pines_mesh_id, asset->filename, asset->pixels, asset->w, asset->h, asset->mips);
+            set_instance_texture(pines, NR_OF_PINES, pine_texture);
+            break;
+        }
+        }
+        // the queue writes copy the data, the clips of an animated mesh were copied out at load
+        if ((asset->type == ASSET_MESH && !asset->staged) || asset->type == ASSET_ANIMATED_MESH) unmap_asset(p, &asset->mm); // a staged one once its streams are decoded
+        if (asset->type == ASSET_ENV_CUBE) for (int face = 0; face < 6; face++) unmap_asset(p, &asset->face_mm[face]);
+        free(asset->pixels);
+        asset->pixels = NULL;
+    }
+    update_staged_uploads(p, context);
+    double uploads_ms = p->current_time_ms() - time_before_uploads;
+    #pragma endregion
+
     // poll input events as late as possible (after sleeping for vsync and gpu waiting)
     // this takes an additional 0.2ms to do though
     p->poll_inputs();
@@ -483,6 +953,7 @@ int tick(struct Platform *p, void *context) {
     // Update uniforms
     timeVal += 0.016f; // pretend 16ms per frame
     //yaw(0.001f * ms_last_frame, camera);
+    updateBroadphase(&gameState);
     playerMovement(movementSpeed, delta, &gameState.player);
     float playerLocation[3] = {gameState.player.instance->transform[12], gameState.player.instance->transform[13], gameState.player.instance->transform[14]};
     applyGravity(&gameState.player.velocity, playerLocation, delta);
@@ -505,9 +976,12 @@ int tick(struct Platform *p, void *context) {
     memcpy(global_uniforms.camera_world_space, camera_world_space, sizeof(camera_world_space));
     
     // Update animation
-    // todo: allow switching animation
     // todo: separate animation data from mesh; reuse skeleton and animations for all eg. humans/horses
-    character.frame = character.frame >= 32.0 ? 0.0 : character.frame + 0.1;
+    update_animation(context, &character_animator, delta);
+    update_lights(timeVal);
+    double time_before_streaming = p->current_time_ms();
+    update_texture_streaming(p, context);
+    double streaming_ms = p->current_time_ms() - time_before_streaming;
 
     // SET SHADOWS
     if (SHADOWS_ENABLED) {
@@ -522,25 +996,34 @@ int tick(struct Platform *p, void *context) {
     // keep track of how long the tick took to process
     double tick_ms = p->current_time_ms() - tick_start_ms;
 
+    // REFLECTION PROBE
+    // one face of the probe around the sphere per frame, so the reflections are at most six frames old
+    {
+        static int probe_face = 0, probe_faces_rendered = 0;
+        float probe_position[3] = {sphere.transform[12], sphere.transform[13], sphere.transform[14]};
+        float probe_views[6][16], probe_projection[16];
+        generateCubemapViews(probe_position, probe_views);
+        generateCubemapProjection(0.01f, 2000.0f, probe_projection);
+        struct GlobalUniforms probe_uniforms = global_uniforms;
+        memcpy(probe_uniforms.view, probe_views[probe_face], sizeof(probe_uniforms.view));
+        memcpy(probe_uniforms.projection, probe_projection, sizeof(probe_uniforms.projection));
+        memcpy(probe_uniforms.camera_world_space, probe_position, sizeof(probe_position));
+        float probe_viewport[4] = {0, 0, PROBE_SIZE, PROBE_SIZE};
+        memcpy(probe_uniforms.viewport, probe_viewport, sizeof(probe_viewport));
+        probe_uniforms.light_count = 0; // *info* the light clusters are binned for the camera, not for the probe
+        setGPUReflectionProbe(context, probe_face, &probe_uniforms);
+        probe_face = (probe_face + 1) % 6;
+        if (probe_faces_rendered < 6) probe_faces_rendered++;
+        float probe_world_space[4] = {probe_position[0], probe_position[1], probe_position[2], probe_faces_rendered == 6 ? 1.0f : 0.0f};
+        memcpy(global_uniforms.probe_world_space, probe_world_space, sizeof(probe_world_space));
+    }
+
+    float viewport[4] = {OFFSET_X, OFFSET_Y, VIEWPORT_WIDTH, VIEWPORT_HEIGHT};
+    memcpy(global_uniforms.viewport, viewport, sizeof(viewport));
     struct draw_result result = drawGPUFrame(context, p, OFFSET_X, OFFSET_Y, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, 0, 0, &global_uniforms, material_uniforms);
     double cpu_ms = result.cpu_ms;
 
     // todo: pass postprocessing settings etc. as parameter -> no global, to that we can switch instantly at runtime
-    // draw cubemap around eye, and save to disk
-    if (0) {
-        float eye[3] = {0.,1.,0.};
-        float cubemapViews[6][16];
-        float cubemapProj[16];
-        generateCubemapViews(eye, cubemapViews);
-        generateCubemapProjection(0.01f, 2000.0f, cubemapProj);
-        memcpy(global_uniforms.projection, cubemapProj, sizeof(projection));
-        for (int i = 0; i < 6; i++) {
-            memcpy(global_uniforms.view, cubemapViews[i], sizeof(view));
-            char filename[64]; char *cube_faces[6] = {"+X", "-X", "+Y", "-Y", "+Z", "-Z"};
-            snprintf(filename, sizeof(filename), "data/textures/cube/cube_face_%s.png", cube_faces[i]);    
-            drawGPUFrame(context, p, 0, 0, 128, 128, 1, filename, &global_uniforms, material_uniforms);
-        }
-    }
 
     // todo: create a central place for things that need to happen to initialize every frame iteration correctly
     // reset the debug text on screen
@@ -575,7 +1058,9 @@ int tick(struct Platform *p, void *context) {
 
     PRINT_MS("-> setup time: ", result.setup_ms, setup_time);
     PRINT_MS("-> write buffers time: ", result.write_buffer_ms, buffer_write_time);
+    PRINT_MS("-> light cluster time: ", result.light_cluster_ms, light_cluster_time);
     PRINT_MS("-> shadowmap time: ", result.shadowmap_ms, shadowmap_time);
+    PRINT_MS("-> probe pass time: ", result.probe_ms, probe_time);
     PRINT_MS("-> main pass time: ", result.main_pass_ms, mainpass_time);
     PRINT_MS("-> submit time: ", result.submit_ms, submit_time);
 
@@ -586,6 +1071,13 @@ int tick(struct Platform *p, void *context) {
     // print the total time we spent on this tick
     PRINT_MS("Total tick time: ", total_tick_time, tick_time);
     PRINT_MS("Delta time: ", delta, delta_time);
+    PRINT_MS("Texture streaming time: ", streaming_ms, texture_streaming_time);
+    PRINT_MS("Asset upload time: ", uploads_ms, asset_upload_time);
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "Resident texture pages: %d/%d\n", resident_page_count, getGPUTextureSlots(context));
+        print_on_screen(buf);
+    }
 
     vsync_delay = result.present_wait_ms + result.get_surface_ms;
 
@@ -9,18 +9,20 @@ if errorlevel 1 (
     echo emcc already available, skipping Emscripten setup
 )
 
+REM every asset the game loads is in the pack, it is read in with one request
+call ..\data\pack.bat
+
 call emcc ..\webgpu.c main.c -o index.html ^
   -sUSE_WEBGPU=1 ^
   -sUSE_PTHREADS=1 ^
-  -sPTHREAD_POOL_SIZE=1 ^
+  -sPTHREAD_POOL_SIZE=10 ^
   -sPROXY_TO_PTHREAD=1 ^
   -sOFFSCREENCANVAS_SUPPORT=1 ^
   -sALLOW_MEMORY_GROWTH=1 ^
+  -msimd128 ^
   -sEXPORTED_FUNCTIONS=_main ^
   -sEXPORTED_RUNTIME_METHODS=ccall,cwrap ^
-  --preload-file "../data/textures/bin@data/textures/bin" ^
-  --preload-file "../data/models/blender/bin@data/models/blender/bin" ^
-  --preload-file "../data/models/bin@data/models/bin" ^
+  --preload-file "../data/assets.pack@data/assets.pack" ^
   --preload-file "../data/shaders@data/shaders" ^
   -gsource-map
 
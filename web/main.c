@@ -57,9 +57,26 @@ static struct MappedMemory web_map_file(const char *filename) {
         return mm;
     }
     mm.mapping = NULL;  // No mapping handle needed on the web.
+    mm.size = filesize;
     return mm;
 }
 
+// Read a range of the file straight into dst, without reading the whole file into memory first.
+static int web_read_file(const char *filename, size_t offset, void *dst, int size) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        fprintf(stderr, "Failed to open file: %s\n", filename);
+        return -1;
+    }
+    if (fseek(f, (long) offset, SEEK_SET) != 0) {
+        fclose(f);
+        return -1;
+    }
+    size_t read = fread(dst, 1, size, f);
+    fclose(f);
+    return (int) read;
+}
+
 // Unmap file: simply free the allocated buffer.
 static void web_unmap_file(struct MappedMemory *mm) {
     if (mm->data) {
@@ -67,6 +84,70 @@ static void web_unmap_file(struct MappedMemory *mm) {
         mm->data = NULL;
     }
     mm->mapping = NULL;
+    mm->size = 0;
+}
+#pragma endregion
+
+#pragma region JOBS
+#define MAX_WORKERS 4 // keep below -sPTHREAD_POOL_SIZE in compile.bat, the main loop already uses one thread
+struct JobBatch {
+    void (*job)(void *data, int index);
+    void *data;
+    int count;
+    int next;
+};
+static void *job_worker(void *param) {
+    struct JobBatch *batch = (struct JobBatch *) param;
+    for (int i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED); i < batch->count; i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) {
+        batch->job(batch->data, i);
+    }
+    return NULL;
+}
+// the calling thread works along with the workers, and returns when every job is done
+static void web_run_jobs(void (*job)(void *data, int index), void *data, int count) {
+    struct JobBatch batch = {job, data, count, 0};
+    pthread_t workers[MAX_WORKERS];
+    int started = 0;
+    for (int i = 0; i < MAX_WORKERS && i < count - 1; i++) {
+        if (pthread_create(&workers[started], NULL, job_worker, &batch) == 0) started++;
+    }
+    job_worker(&batch);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+}
+
+#define BACKGROUND_WORKERS 1 // on top of MAX_WORKERS, each job can run_jobs too, keep -sPTHREAD_POOL_SIZE in compile.bat at 1 + 2 * MAX_WORKERS + BACKGROUND_WORKERS
+struct BackgroundBatch {
+    void (*job)(void *data, int index);
+    void *data;
+    int count;
+    int next;
+    int running;
+    volatile int *finished;
+};
+static void *background_worker(void *param) {
+    struct BackgroundBatch *batch = (struct BackgroundBatch *) param;
+    for (int i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED); i < batch->count; i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) {
+        batch->job(batch->data, i);
+        __atomic_store_n(&batch->finished[i], 1, __ATOMIC_SEQ_CST); // the results of the job are visible before the flag
+    }
+    if (__atomic_sub_fetch(&batch->running, 1, __ATOMIC_ACQ_REL) == 0) free(batch);
+    return NULL;
+}
+// the batch outlives this call, the last worker to finish frees it
+static void web_start_jobs(void (*job)(void *data, int index), void *data, int count, volatile int *finished) {
+    struct BackgroundBatch *batch = malloc(sizeof(struct BackgroundBatch));
+    *batch = (struct BackgroundBatch){job, data, count, 0, BACKGROUND_WORKERS + 1, finished};
+    // one extra count is held while starting, so that no worker can free the batch before all of them are started
+    for (int i = 0; i < BACKGROUND_WORKERS; i++) {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, background_worker, batch) == 0) pthread_detach(worker);
+        else __atomic_sub_fetch(&batch->running, 1, __ATOMIC_ACQ_REL);
+    }
+    if (__atomic_load_n(&batch->running, __ATOMIC_ACQUIRE) == 1) {
+        background_worker(batch); // no threads at all, do the jobs right here
+    } else if (__atomic_sub_fetch(&batch->running, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(batch);
+    }
 }
 #pragma endregion
 
@@ -138,8 +219,11 @@ void start_function(void) {
          .current_time_ms = current_time_ms_web,
          .map_file       = web_map_file,
          .unmap_file     = web_unmap_file,
+         .read_file      = web_read_file,
          .sleep_ms       = web_blocking_sleep,
-         .poll_inputs    = poll_inputs_web
+         .poll_inputs    = poll_inputs_web,
+         .run_jobs       = web_run_jobs,
+         .start_jobs     = web_start_jobs
     };
    
     // Now set up the main loop. This loop will repeatedly call main_called_by_browser()
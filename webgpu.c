@@ -19,41 +19,95 @@ void (*setup_callback)();
 #pragma region PREDEFINED DATA
 static const WGPUTextureFormat screen_color_format = WGPUTextureFormat_RGBA8UnormSrgb;
 static const WGPUTextureFormat depth_stencil_format = WGPUTextureFormat_Depth32Float;
-static const WGPUVertexBufferLayout VERTEX_LAYOUT[2] = {
-    {   // Vertex layout
-        .arrayStride = sizeof(struct Vertex),
-        .stepMode = WGPUVertexStepMode_Vertex,
-        .attributeCount = 7,
-        .attributes = (const WGPUVertexAttribute[]) {
-            { .format = WGPUVertexFormat_Uint32x4, .offset = 0,  .shaderLocation = 0 }, // data[4]  (16 bytes)
-            { .format = WGPUVertexFormat_Float32x3, .offset = 16, .shaderLocation = 1 }, // position[3] (12 bytes)
-            { .format = WGPUVertexFormat_Snorm8x4,   .offset = 28, .shaderLocation = 2 }, // normal[4]  (4 bytes)
-            { .format = WGPUVertexFormat_Snorm8x4,   .offset = 32, .shaderLocation = 3 }, // tangent[4] (4 bytes)
-            { .format = WGPUVertexFormat_Unorm16x2,  .offset = 36, .shaderLocation = 4 }, // uv[2]      (4 bytes)
-            { .format = WGPUVertexFormat_Unorm8x4,   .offset = 40, .shaderLocation = 5 }, // bone_weights[4] (4 bytes)
-            { .format = WGPUVertexFormat_Uint8x4,    .offset = 44, .shaderLocation = 6 }  // bone_indices[4] (4 bytes)
-        }
+// every vertex format has its own vertex layout, the instance layout is the same for all of them
+#define INSTANCE_LAYOUT \
+    {   /* Instance layout */ \
+        .arrayStride = sizeof(struct Instance), \
+        .stepMode = WGPUVertexStepMode_Instance, \
+        .attributeCount = 9, \
+        .attributes = (const WGPUVertexAttribute[]) { \
+            { .format = WGPUVertexFormat_Float32x4, .offset = 0,   .shaderLocation = 7  }, /* transform row0 (16 bytes) */ \
+            { .format = WGPUVertexFormat_Float32x4, .offset = 16,  .shaderLocation = 8  }, /* transform row1 (16 bytes) */ \
+            { .format = WGPUVertexFormat_Float32x4, .offset = 32,  .shaderLocation = 9  }, /* transform row2 (16 bytes) */ \
+            { .format = WGPUVertexFormat_Float32x4, .offset = 48,  .shaderLocation = 10 }, /* transform row3 (16 bytes) */ \
+            { .format = WGPUVertexFormat_Uint32x3,  .offset = 64,  .shaderLocation = 11 }, /* data[3] (12 bytes) */ \
+            { .format = WGPUVertexFormat_Unorm16x4, .offset = 76,  .shaderLocation = 12 }, /* norms[4] (8 bytes) */ \
+            { .format = WGPUVertexFormat_Uint16x2,  .offset = 84,  .shaderLocation = 13 }, /* animation[2] (4 bytes) */ \
+            { .format = WGPUVertexFormat_Float32,   .offset = 88,  .shaderLocation = 14 }, /* frame (4 bytes) */ \
+            { .format = WGPUVertexFormat_Unorm16x2, .offset = 92,  .shaderLocation = 15 }  /* atlas_uv[2] (4 bytes) */ \
+        } \
+    }
+static const WGPUVertexBufferLayout VERTEX_LAYOUTS[VERTEX_FORMAT_COUNT][2] = {
+    [VERTEX_FORMAT_FULL] = {
+        {   // Vertex layout
+            .arrayStride = sizeof(struct Vertex),
+            .stepMode = WGPUVertexStepMode_Vertex,
+            .attributeCount = 7,
+            .attributes = (const WGPUVertexAttribute[]) {
+                { .format = WGPUVertexFormat_Uint32x4, .offset = 0,  .shaderLocation = 0 }, // data[4]  (16 bytes)
+                { .format = WGPUVertexFormat_Float32x3, .offset = 16, .shaderLocation = 1 }, // position[3] (12 bytes)
+                { .format = WGPUVertexFormat_Snorm8x4,   .offset = 28, .shaderLocation = 2 }, // normal[4]  (4 bytes)
+                { .format = WGPUVertexFormat_Snorm8x4,   .offset = 32, .shaderLocation = 3 }, // tangent[4] (4 bytes)
+                { .format = WGPUVertexFormat_Unorm16x2,  .offset = 36, .shaderLocation = 4 }, // uv[2]      (4 bytes)
+                { .format = WGPUVertexFormat_Unorm8x4,   .offset = 40, .shaderLocation = 5 }, // bone_weights[4] (4 bytes)
+                { .format = WGPUVertexFormat_Uint8x4,    .offset = 44, .shaderLocation = 6 }  // bone_indices[4] (4 bytes)
+            }
+        },
+        INSTANCE_LAYOUT
     },
-    {   // Instance layout
-        .arrayStride = sizeof(struct Instance),
-        .stepMode = WGPUVertexStepMode_Instance,
-        .attributeCount = 9,
-        .attributes = (const WGPUVertexAttribute[]) {
-            { .format = WGPUVertexFormat_Float32x4, .offset = 0,   .shaderLocation = 7  }, // transform row0 (16 bytes)
-            { .format = WGPUVertexFormat_Float32x4, .offset = 16,  .shaderLocation = 8  }, // transform row1 (16 bytes)
-            { .format = WGPUVertexFormat_Float32x4, .offset = 32,  .shaderLocation = 9  }, // transform row2 (16 bytes)
-            { .format = WGPUVertexFormat_Float32x4, .offset = 48,  .shaderLocation = 10 }, // transform row3 (16 bytes)
-            { .format = WGPUVertexFormat_Uint32x3,  .offset = 64,  .shaderLocation = 11 }, // data[3] (12 bytes)
-            { .format = WGPUVertexFormat_Unorm16x4, .offset = 76,  .shaderLocation = 12 }, // norms[4] (8 bytes)
-            { .format = WGPUVertexFormat_Uint32,    .offset = 84,  .shaderLocation = 13 }, // animation (4 bytes)
-            { .format = WGPUVertexFormat_Float32,   .offset = 88,  .shaderLocation = 14 }, // frame (4 bytes)
-            { .format = WGPUVertexFormat_Unorm16x2, .offset = 92,  .shaderLocation = 15 },  // atlas_uv[2] (4 bytes)
-}
+    [VERTEX_FORMAT_STATIC] = {
+        {   // Vertex layout // *info* the data is not read by the shader, so it has no attribute
+            .arrayStride = sizeof(struct StaticVertex),
+            .stepMode = WGPUVertexStepMode_Vertex,
+            .attributeCount = 4,
+            .attributes = (const WGPUVertexAttribute[]) {
+                { .format = WGPUVertexFormat_Float16x4,  .offset = 0,  .shaderLocation = 1 }, // position[4] (8 bytes)
+                { .format = WGPUVertexFormat_Snorm16x2,  .offset = 8,  .shaderLocation = 2 }, // normal[2], octahedral (4 bytes)
+                { .format = WGPUVertexFormat_Snorm8x4,   .offset = 12, .shaderLocation = 3 }, // tangent[4] (4 bytes)
+                { .format = WGPUVertexFormat_Unorm16x2,  .offset = 16, .shaderLocation = 4 }  // uv[2]      (4 bytes)
+            }
+        },
+        INSTANCE_LAYOUT
+    },
+    [VERTEX_FORMAT_SKINNED] = {
+        {   // Vertex layout
+            .arrayStride = sizeof(struct SkinnedVertex),
+            .stepMode = WGPUVertexStepMode_Vertex,
+            .attributeCount = 6,
+            .attributes = (const WGPUVertexAttribute[]) {
+                { .format = WGPUVertexFormat_Float16x4,  .offset = 0,  .shaderLocation = 1 }, // position[4] (8 bytes)
+                { .format = WGPUVertexFormat_Snorm16x2,  .offset = 8,  .shaderLocation = 2 }, // normal[2], octahedral (4 bytes)
+                { .format = WGPUVertexFormat_Snorm8x4,   .offset = 12, .shaderLocation = 3 }, // tangent[4] (4 bytes)
+                { .format = WGPUVertexFormat_Unorm16x2,  .offset = 16, .shaderLocation = 4 }, // uv[2]      (4 bytes)
+                { .format = WGPUVertexFormat_Unorm8x4,   .offset = 20, .shaderLocation = 5 }, // bone_weights[4] (4 bytes)
+                { .format = WGPUVertexFormat_Uint8x4,    .offset = 24, .shaderLocation = 6 }  // bone_indices[4] (4 bytes)
+            }
+        },
+        INSTANCE_LAYOUT
     }
 };
+// the vertex entry point of the main shader for every vertex format
+static const char *VERTEX_ENTRY_POINTS[VERTEX_FORMAT_COUNT] = {"vs_main", "vs_static", "vs_skinned"};
 #pragma endregion
 
 #pragma region STRUCT DEFINITIONS
+enum TextureFeedbackState {
+    TEXTURE_FEEDBACK_IDLE,    // the next frame copies the feedback into the readback buffer
+    TEXTURE_FEEDBACK_COPIED,  // the copy is in the frame's commands, map it after submitting
+    TEXTURE_FEEDBACK_MAPPING  // waiting for the map callback, the feedback keeps accumulating meanwhile
+};
+
+enum StagingState {
+    STAGING_MAPPED,  // free, the cpu can write into it
+    STAGING_FILLING, // acquired, copies are recorded until it is submitted
+    STAGING_MAPPING  // the copies are submitted, waiting for the map callback to hand it out again
+};
+#define MAX_STAGING_COPIES 32
+typedef struct {
+    WGPUBuffer buffer; void *mapped; enum StagingState state;
+    struct StagingCopy { uint64_t offset, size; enum UploadTarget target; int index; uint64_t target_offset; } copies[MAX_STAGING_COPIES]; int copy_count;
+} StagingBuffer;
+
 typedef struct {
     bool               used;
     int                pipeline_id;
@@ -64,6 +118,7 @@ typedef struct {
     bool       used;
     enum MeshFlags  flags;
     int        material_id;
+    enum VertexFormat vertex_format; // of its pipeline
     // todo: do we even need this struct and the material struct at all (?)
     int vertex_count; uint32_t first_vertex;
     int index_count; uint32_t first_index;
@@ -82,7 +137,8 @@ typedef struct {
     // setup
     int width; int height; int viewport_width; int viewport_height;
     // data
-    WGPURenderPipeline    main_pipeline;
+    WGPURenderPipeline    main_pipelines[MAX_PIPELINES]; int pipeline_count; // one per shader variant and vertex format
+    enum VertexFormat     pipeline_formats[MAX_PIPELINES];
     Material              materials[MAX_MATERIALS];
     Mesh                  meshes[MAX_MESHES];
     // current frame objects (global for simplicity)     // todo: make a bunch of these static to avoid global bloat
@@ -90,13 +146,22 @@ typedef struct {
     WGPUTextureView       swapchain_view;
     // draw indirect buffers
     WGPUBuffer indirect_draw_buffer; int indirect_count;
+    bool draws_dirty; // set when a mesh is added, the indirect draws are rebuilt before the next frame is drawn
+    int pipeline_first_draw[MAX_PIPELINES]; int pipeline_draw_count[MAX_PIPELINES]; // draws are grouped per pipeline, one multi draw per group
     WGPUBuffer indirect_count_buffer; // todo: for later, when we do gpu-culling
     // scene buffers
-    WGPUBuffer vertices; uint64_t vertex_count;
+    WGPUBuffer vertices; uint64_t vertex_bytes; // *info* the meshes of all vertex formats share it, each mesh starts at a multiple of its own stride
     WGPUBuffer indices; uint64_t index_count;
     WGPUBuffer instances; uint64_t instance_count;
     WGPUTexture animations; WGPUTextureView animations_view; WGPUSampler animations_sampler; uint64_t animation_count;
-    WGPUTexture texture_array; WGPUTextureView texture_array_view; WGPUSampler texture_array_sampler; uint64_t texture_count;
+    WGPUTexture texture_array; WGPUTextureView texture_array_view; WGPUSampler texture_array_sampler; uint64_t texture_count; enum TextureFormat texture_format;
+    unsigned char atlas_skyline[TEXTURE_LIMIT][ATLAS_COLUMNS]; // per page, height of the packed textures per column of the atlas grid
+    // texture streaming, texture_array only has room for the full resolution mips of texture_slot_count pages, the tail of every page stays resident
+    WGPUTexture texture_tail; WGPUTextureView texture_tail_view; int texture_slot_count;
+    WGPUBuffer texture_pages; uint32_t texture_pages_ram[TEXTURE_LIMIT]; // slot of every page, TEXTURE_NOT_RESIDENT if only its tail is resident
+    WGPUBuffer texture_feedback; WGPUBuffer texture_feedback_readback; enum TextureFeedbackState texture_feedback_state; int texture_feedback_new; uint32_t texture_feedback_ram[TEXTURE_LIMIT];
+    // uploads that are read from disk straight into mapped memory, created on first use
+    StagingBuffer staging[STAGING_BUFFER_COUNT];
     // optional postprocessing with intermediate texture
     WGPURenderPipeline    post_processing_pipeline;
     WGPUTexture           post_processing_texture;
@@ -104,7 +169,7 @@ typedef struct {
     WGPUSampler           post_processing_sampler;
     WGPUBindGroup         post_processing_bindgroup;
     // shadow texture // todo: cascading shadow maps
-    WGPURenderPipeline shadow_pipeline;
+    WGPURenderPipeline shadow_pipelines[VERTEX_FORMAT_COUNT];
     WGPUTexture        shadow_texture;
     WGPUTextureView    shadow_texture_view;
     WGPUSampler        shadow_sampler;
@@ -119,6 +184,20 @@ typedef struct {
     WGPUTexture        cubemap_texture;
     WGPUTextureView    cubemap_texture_view;
     WGPUSampler        cubemap_sampler;
+    // real-time reflection probe, a low res cube that gets one face per frame, drawn with the pipelines that have a probe variant
+    WGPUTexture        probe_texture;
+    WGPUTextureView    probe_texture_view;
+    WGPUTextureView    probe_face_views[6];
+    WGPUTextureView    probe_depth_view;
+    WGPUBuffer         probe_uniform_buffer;
+    WGPUBindGroup      probe_bindgroup; // the global bindgroup with the probe uniforms, and the env cube in place of the probe
+    WGPURenderPipeline probe_pipelines[MAX_PIPELINES];
+    int                probe_face; // rendered in the next frame, -1 if none
+    // clustered lights
+    WGPUBuffer          lights; struct Light *lights_ram; int light_count;
+    WGPUBuffer          light_clusters;
+    WGPUComputePipeline light_cluster_pipeline;
+    WGPUBindGroup       light_cluster_bindgroup;
     // global bindgroup
     WGPUBindGroupLayout global_layout;
     WGPUBindGroup       global_bindgroup;
@@ -135,10 +214,11 @@ struct GPUCounters { unsigned int vtx_cnt, idx_cnt, mlet_cnt; };
 struct GPUCounters zero = {0};
 #pragma endregion
 
-static void writeDataToTexture(void *context_ptr, WGPUTexture *tex, void *data, int w, int h, uint64_t offset, int byte_per_pixel, int layer) {
+static void writeDataToTexture(void *context_ptr, WGPUTexture *tex, void *data, int w, int h, uint64_t offset, int byte_per_pixel, int layer, int mip) {
     WebGPUContext *context = (WebGPUContext *)context_ptr;
     WGPUImageCopyTexture ict = {0};
     ict.texture = *tex;
+    ict.mipLevel = mip;
     ict.origin.y = (offset / byte_per_pixel) / w;
     ict.origin.z = layer;
     WGPUTextureDataLayout tdl = {0};
@@ -198,7 +278,7 @@ static void setup_context(WebGPUContext *context) {
 
     // Create the global bindgroup layout + create the bindgroup
     {
-        enum { entry_count = 10 };
+        enum { entry_count = 16 };
         WGPUBindGroupLayoutEntry layout_entries[entry_count] = {
             // Global uniforms
             {
@@ -274,6 +354,46 @@ static void setup_context(WebGPUContext *context) {
                 .sampler = {
                     .type = WGPUSamplerBindingType_Filtering,
                 },
+            },
+            // Lights
+            {
+                .binding = 10,
+                .visibility = WGPUShaderStage_Fragment,
+                .buffer.type = WGPUBufferBindingType_ReadOnlyStorage,
+                .buffer.minBindingSize = MAX_LIGHTS * sizeof(struct Light),
+            },
+            // Light indices per cluster, written by the light cluster compute pass
+            {
+                .binding = 11,
+                .visibility = WGPUShaderStage_Fragment,
+                .buffer.type = WGPUBufferBindingType_ReadOnlyStorage,
+                .buffer.minBindingSize = CLUSTER_COUNT * (MAX_LIGHTS_PER_CLUSTER + 1) * sizeof(uint32_t),
+            },
+            // Texture tail, the small mips of every page
+            {
+                .binding = 12,
+                .visibility = WGPUShaderStage_Fragment,
+                .texture = {.sampleType = WGPUTextureSampleType_Float, .viewDimension = WGPUTextureViewDimension_2DArray, .multisampled = false}
+            },
+            // Slot in the texture array of every page
+            {
+                .binding = 13,
+                .visibility = WGPUShaderStage_Fragment,
+                .buffer.type = WGPUBufferBindingType_ReadOnlyStorage,
+                .buffer.minBindingSize = TEXTURE_LIMIT * sizeof(uint32_t),
+            },
+            // Texture feedback, the finest mip the fragments wanted from every page
+            {
+                .binding = 14,
+                .visibility = WGPUShaderStage_Fragment,
+                .buffer.type = WGPUBufferBindingType_Storage,
+                .buffer.minBindingSize = TEXTURE_LIMIT * sizeof(uint32_t),
+            },
+            // Reflection probe cube
+            {
+                .binding = 15,
+                .visibility = WGPUShaderStage_Fragment,
+                .texture = {.sampleType = WGPUTextureSampleType_Float, .viewDimension = WGPUTextureViewDimension_Cube, .multisampled = false}
             }
         };
         WGPUBindGroupLayoutDescriptor bglDesc = {0};
@@ -295,7 +415,6 @@ static void setup_context(WebGPUContext *context) {
 
         // Create animations texture
         {
-            #define ANIMATION_LIMIT 200
             WGPUTextureDescriptor animTexDesc = {.size={.depthOrArrayLayers=1, .width=ANIMATION_TEXTURE_WIDTH, .height=ANIMATION_LIMIT}, .dimension=WGPUTextureDimension_2D,
             .format=WGPUTextureFormat_RGBA32Float, .usage=WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst, .mipLevelCount = 1, .sampleCount = 1, .label = "Animation Texture"};
             WGPUTextureViewDescriptor animViewDesc = {.format = animTexDesc.format, .dimension = WGPUTextureViewDimension_2D, .mipLevelCount = 1, .arrayLayerCount = 1, 
@@ -309,15 +428,34 @@ static void setup_context(WebGPUContext *context) {
 
         // Create texture array
         {
-            #define TEXTURE_LIMIT 256
-            WGPUTextureDescriptor texDesc = {.size={.depthOrArrayLayers=TEXTURE_LIMIT, .width=TEXTURE_SIZE, .height=TEXTURE_SIZE}, .dimension=WGPUTextureDimension_2D,
-            .format=WGPUTextureFormat_RGBA8Unorm, .usage=WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst, .mipLevelCount = 1, .sampleCount = 1, .label = "Textures array"};
-            WGPUTextureViewDescriptor viewDesc = {.format = texDesc.format, .dimension = WGPUTextureViewDimension_2DArray, .mipLevelCount = 1, .arrayLayerCount = TEXTURE_LIMIT, 
+            // *info* one format for the whole array, BC1 (8x smaller) if the device supports it, the textures are converted offline to both
+            context->texture_format = wgpuDeviceHasFeature(context->device, WGPUFeatureName_TextureCompressionBC) ? TEXTURE_FORMAT_BC1 : TEXTURE_FORMAT_RGBA8;
+            printf("[webgpu.c] Texture array format: %s\n", context->texture_format == TEXTURE_FORMAT_BC1 ? "BC1" : "RGBA8");
+            // *info* the full resolution mips only get a slot when the texture feedback asks for them, TEXTURE_RESIDENT_BUDGET decides how many slots there are
+            WGPUTextureFormat format = context->texture_format == TEXTURE_FORMAT_BC1 ? WGPUTextureFormat_BC1RGBAUnorm : WGPUTextureFormat_RGBA8Unorm;
+            size_t slot_size = 0;
+            for (int mip = 0; mip < TEXTURE_STREAMED_MIPS; mip++) {
+                int size = TEXTURE_SIZE >> mip;
+                slot_size += context->texture_format == TEXTURE_FORMAT_BC1 ? (size_t)size * size / 2 : (size_t)size * size * 4;
+            }
+            context->texture_slot_count = (int)(TEXTURE_RESIDENT_BUDGET / slot_size);
+            if (context->texture_slot_count < 1) context->texture_slot_count = 1;
+            if (context->texture_slot_count > TEXTURE_LIMIT) context->texture_slot_count = TEXTURE_LIMIT;
+            printf("[webgpu.c] Texture array has %d resident slots of %zu bytes\n", context->texture_slot_count, slot_size);
+            WGPUTextureDescriptor texDesc = {.size={.depthOrArrayLayers=context->texture_slot_count, .width=TEXTURE_SIZE, .height=TEXTURE_SIZE}, .dimension=WGPUTextureDimension_2D,
+            .format=format, .usage=WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst, .mipLevelCount = TEXTURE_STREAMED_MIPS, .sampleCount = 1, .label = "Textures array"};
+            WGPUTextureViewDescriptor viewDesc = {.format = texDesc.format, .dimension = WGPUTextureViewDimension_2DArray, .mipLevelCount = TEXTURE_STREAMED_MIPS, .arrayLayerCount = context->texture_slot_count, 
             .label = "Textures array View"};
+            WGPUTextureDescriptor tailDesc = {.size={.depthOrArrayLayers=TEXTURE_LIMIT, .width=TEXTURE_SIZE >> TEXTURE_STREAMED_MIPS, .height=TEXTURE_SIZE >> TEXTURE_STREAMED_MIPS}, .dimension=WGPUTextureDimension_2D,
+            .format=format, .usage=WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst, .mipLevelCount = TEXTURE_MIP_LEVELS - TEXTURE_STREAMED_MIPS, .sampleCount = 1, .label = "Textures tail"};
+            WGPUTextureViewDescriptor tailViewDesc = {.format = tailDesc.format, .dimension = WGPUTextureViewDimension_2DArray, .mipLevelCount = tailDesc.mipLevelCount, .arrayLayerCount = TEXTURE_LIMIT, 
+            .label = "Textures tail View"};
             WGPUSamplerDescriptor samplerDesc = {.label = "Textures array Sampler", .minFilter = WGPUFilterMode_Linear, .magFilter = WGPUFilterMode_Linear, .mipmapFilter = WGPUMipmapFilterMode_Linear,
             .maxAnisotropy = 1, .addressModeU = WGPUAddressMode_Repeat, .addressModeV = WGPUAddressMode_Repeat, .addressModeW = WGPUAddressMode_Repeat};
             context->texture_array = wgpuDeviceCreateTexture(context->device, &texDesc);
             context->texture_array_view = wgpuTextureCreateView(context->texture_array, &viewDesc);
+            context->texture_tail = wgpuDeviceCreateTexture(context->device, &tailDesc);
+            context->texture_tail_view = wgpuTextureCreateView(context->texture_tail, &tailViewDesc);
             context->texture_array_sampler = wgpuDeviceCreateSampler(context->device, &samplerDesc);
         }
 
@@ -351,12 +489,13 @@ static void setup_context(WebGPUContext *context) {
 
         // Create env cube texture + sampler
         {
+            // *info* mip 0 is uploaded by set_env_cube, the other mips are GGX prefiltered from it on the gpu for rough reflections
             WGPUTextureDescriptor texDesc = {
-                .usage = WGPUTextureUsage_CopyDst | WGPUTextureUsage_TextureBinding,
+                .usage = WGPUTextureUsage_CopyDst | WGPUTextureUsage_CopySrc | WGPUTextureUsage_TextureBinding | WGPUTextureUsage_StorageBinding,
                 .label = "env cube texture",
                 .dimension = WGPUTextureDimension_2D,
                 .size = (WGPUExtent3D){ .width = ENV_TEXTURE_SIZE, .height = ENV_TEXTURE_SIZE, .depthOrArrayLayers = 6 },
-                .mipLevelCount = 1,
+                .mipLevelCount = ENV_MIP_LEVELS,
                 .sampleCount = 1,
                 .format = WGPUTextureFormat_RGBA8Unorm,
             };
@@ -364,7 +503,7 @@ static void setup_context(WebGPUContext *context) {
             WGPUTextureViewDescriptor viewDesc = {
                 .dimension = WGPUTextureViewDimension_Cube,
                 .baseMipLevel = 0,
-                .mipLevelCount = 1,
+                .mipLevelCount = ENV_MIP_LEVELS,
                 .baseArrayLayer = 0,
                 .arrayLayerCount = 6,
             };
@@ -384,6 +523,63 @@ static void setup_context(WebGPUContext *context) {
             context->cubemap_sampler = wgpuDeviceCreateSampler(context->device, &samplerDesc);
         }
 
+        // Create reflection probe cube + its depth texture
+        {
+            // *info* rendered to in the frame, so there is no readback, the depth texture is shared by the six faces
+            WGPUTextureDescriptor texDesc = {
+                .usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding,
+                .label = "reflection probe texture",
+                .dimension = WGPUTextureDimension_2D,
+                .size = (WGPUExtent3D){ .width = PROBE_SIZE, .height = PROBE_SIZE, .depthOrArrayLayers = 6 },
+                .mipLevelCount = 1,
+                .sampleCount = 1,
+                .format = WGPUTextureFormat_RGBA8Unorm,
+            };
+            context->probe_texture = wgpuDeviceCreateTexture(context->device, &texDesc);
+            WGPUTextureViewDescriptor viewDesc = {.dimension = WGPUTextureViewDimension_Cube, .mipLevelCount = 1, .arrayLayerCount = 6};
+            context->probe_texture_view = wgpuTextureCreateView(context->probe_texture, &viewDesc);
+            for (int face = 0; face < 6; face++) {
+                WGPUTextureViewDescriptor faceDesc = {.dimension = WGPUTextureViewDimension_2D, .mipLevelCount = 1, .baseArrayLayer = face, .arrayLayerCount = 1};
+                context->probe_face_views[face] = wgpuTextureCreateView(context->probe_texture, &faceDesc);
+            }
+            WGPUTextureDescriptor depthDesc = {
+                .usage = WGPUTextureUsage_RenderAttachment,
+                .label = "reflection probe depth texture",
+                .dimension = WGPUTextureDimension_2D,
+                .size = (WGPUExtent3D){ .width = PROBE_SIZE, .height = PROBE_SIZE, .depthOrArrayLayers = 1 },
+                .mipLevelCount = 1,
+                .sampleCount = 1,
+                .format = depth_stencil_format,
+            };
+            // the view keeps the texture alive, only the view is kept
+            WGPUTexture probe_depth_texture = wgpuDeviceCreateTexture(context->device, &depthDesc);
+            context->probe_depth_view = wgpuTextureCreateView(probe_depth_texture, NULL);
+            wgpuTextureRelease(probe_depth_texture);
+            WGPUBufferDescriptor uniformDesc = {.label = "reflection probe uniforms", .size = GLOBAL_UNIFORM_CAPACITY, .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst};
+            context->probe_uniform_buffer = wgpuDeviceCreateBuffer(context->device, &uniformDesc);
+            context->probe_face = -1;
+        }
+
+        // Create lights + light clusters buffers
+        {
+            WGPUBufferDescriptor lightsDesc = {.label = "lights", .size = MAX_LIGHTS * sizeof(struct Light), .usage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst};
+            context->lights = wgpuDeviceCreateBuffer(context->device, &lightsDesc);
+            WGPUBufferDescriptor clustersDesc = {.label = "light clusters", .size = CLUSTER_COUNT * (MAX_LIGHTS_PER_CLUSTER + 1) * sizeof(uint32_t), .usage = WGPUBufferUsage_Storage};
+            context->light_clusters = wgpuDeviceCreateBuffer(context->device, &clustersDesc);
+        }
+
+        // Create texture page table + feedback buffers
+        {
+            WGPUBufferDescriptor pagesDesc = {.label = "texture pages", .size = TEXTURE_LIMIT * sizeof(uint32_t), .usage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst};
+            context->texture_pages = wgpuDeviceCreateBuffer(context->device, &pagesDesc);
+            for (int page = 0; page < TEXTURE_LIMIT; page++) context->texture_pages_ram[page] = TEXTURE_NOT_RESIDENT;
+            wgpuQueueWriteBuffer(context->queue, context->texture_pages, 0, context->texture_pages_ram, sizeof(context->texture_pages_ram));
+            WGPUBufferDescriptor feedbackDesc = {.label = "texture feedback", .size = TEXTURE_LIMIT * sizeof(uint32_t), .usage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopySrc | WGPUBufferUsage_CopyDst};
+            context->texture_feedback = wgpuDeviceCreateBuffer(context->device, &feedbackDesc);
+            WGPUBufferDescriptor readbackDesc = {.label = "texture feedback readback", .size = TEXTURE_LIMIT * sizeof(uint32_t), .usage = WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst};
+            context->texture_feedback_readback = wgpuDeviceCreateBuffer(context->device, &readbackDesc);
+        }
+
         WGPUBindGroupEntry entries[entry_count] = {
             {
                 .binding = 0,
@@ -428,6 +624,38 @@ static void setup_context(WebGPUContext *context) {
             {
                 .binding = 9,
                 .sampler = context->cubemap_sampler
+            },
+            {
+                .binding = 10,
+                .buffer = context->lights,
+                .offset = 0,
+                .size = MAX_LIGHTS * sizeof(struct Light),
+            },
+            {
+                .binding = 11,
+                .buffer = context->light_clusters,
+                .offset = 0,
+                .size = CLUSTER_COUNT * (MAX_LIGHTS_PER_CLUSTER + 1) * sizeof(uint32_t),
+            },
+            {
+                .binding = 12,
+                .textureView = context->texture_tail_view,
+            },
+            {
+                .binding = 13,
+                .buffer = context->texture_pages,
+                .offset = 0,
+                .size = TEXTURE_LIMIT * sizeof(uint32_t),
+            },
+            {
+                .binding = 14,
+                .buffer = context->texture_feedback,
+                .offset = 0,
+                .size = TEXTURE_LIMIT * sizeof(uint32_t),
+            },
+            {
+                .binding = 15,
+                .textureView = context->probe_texture_view,
             }
         };
         WGPUBindGroupDescriptor uBgDesc = {0};
@@ -435,6 +663,11 @@ static void setup_context(WebGPUContext *context) {
         uBgDesc.entryCount = entry_count;
         uBgDesc.entries = entries;
         context->global_bindgroup = wgpuDeviceCreateBindGroup(context->device, &uBgDesc);
+
+        // *info* the probe pass renders into the probe, so it cannot also be bound there, the env cube takes its place
+        entries[0].buffer = context->probe_uniform_buffer;
+        entries[15].textureView = context->cubemap_texture_view;
+        context->probe_bindgroup = wgpuDeviceCreateBindGroup(context->device, &uBgDesc);
     }
 
     // Create the depth texture attachment
@@ -521,7 +754,7 @@ static void setup_context(WebGPUContext *context) {
         #define INDEX_LIMIT (VERTEX_LIMIT * 2)
         #define INSTANCE_LIMIT (VERTEX_LIMIT / 2)
         // Create vertex buffer 
-        WGPUBufferDescriptor vertexBufDesc = {.size = VERTEX_LAYOUT[0].arrayStride * VERTEX_LIMIT, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex};
+        WGPUBufferDescriptor vertexBufDesc = {.size = sizeof(struct Vertex) * VERTEX_LIMIT, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex};
         context->vertices = wgpuDeviceCreateBuffer(context->device, &vertexBufDesc);
         assert(context->vertices);
         // Create index buffer
@@ -529,7 +762,7 @@ static void setup_context(WebGPUContext *context) {
         context->indices = wgpuDeviceCreateBuffer(context->device, &indexBufDesc);
         assert(context->indices);
         // Create instance buffer
-        WGPUBufferDescriptor instBufDesc = {.size = VERTEX_LAYOUT[1].arrayStride * INSTANCE_LIMIT, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex};
+        WGPUBufferDescriptor instBufDesc = {.size = sizeof(struct Instance) * INSTANCE_LIMIT, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex};
         context->instances = wgpuDeviceCreateBuffer(context->device, &instBufDesc);
         assert(context->instances);
     }
@@ -538,6 +771,11 @@ static void setup_context(WebGPUContext *context) {
     {
         create_shadow_pipeline(context);
     }
+
+    // Create light cluster compute pipeline
+    {
+        create_light_cluster_pipeline(context);
+    }
     
     context->initialized = true;
     printf("[webgpu.c] wgpuInit done.\n");
@@ -572,8 +810,12 @@ static void handle_request_adapter(WGPURequestAdapterStatus status, WGPUAdapter
         context->adapter = adapter;
         assert(context->adapter);
         WGPUDeviceDescriptor desc = {0}; desc.deviceLostCallback = my_error_cb;
-        desc.requiredFeatures = (WGPUFeatureName[]){ WGPUNativeFeature_MultiDrawIndirect, WGPUNativeFeature_TextureAdapterSpecificFormatFeatures, WGPUNativeFeature_TextureFormat16bitNorm, WGPUNativeFeature_TextureCompressionAstcHdr };
-        desc.requiredFeatureCount = 4;
+        WGPUFeatureName features[5] = { WGPUNativeFeature_MultiDrawIndirect, WGPUNativeFeature_TextureAdapterSpecificFormatFeatures, WGPUNativeFeature_TextureFormat16bitNorm, WGPUNativeFeature_TextureCompressionAstcHdr };
+        int feature_count = 4;
+        // block compressed textures when the gpu can sample them, otherwise the textures stay rgba8
+        if (wgpuAdapterHasFeature(context->adapter, WGPUFeatureName_TextureCompressionBC)) features[feature_count++] = WGPUFeatureName_TextureCompressionBC;
+        desc.requiredFeatures = features;
+        desc.requiredFeatureCount = feature_count;
         wgpuAdapterRequestDevice(context->adapter, &desc, handle_request_device, context);
     } else fprintf(stderr, "[webgpu.c] RequestAdapter failed: %s\n", message);
 }
@@ -622,8 +864,11 @@ static void setup_gpu_device(WebGPUContext *context) {
 
         context->adapter = selectedAdapter;
         WGPUDeviceDescriptor desc = {0}; desc.deviceLostCallback = my_error_cb;
-        desc.requiredFeatures = (WGPUFeatureName[]){ WGPUNativeFeature_MultiDrawIndirect };
-        desc.requiredFeatureCount = 1;
+        WGPUFeatureName features[2] = { WGPUNativeFeature_MultiDrawIndirect };
+        int feature_count = 1;
+        if (wgpuAdapterHasFeature(context->adapter, WGPUFeatureName_TextureCompressionBC)) features[feature_count++] = WGPUFeatureName_TextureCompressionBC;
+        desc.requiredFeatures = features;
+        desc.requiredFeatureCount = feature_count;
         wgpuAdapterRequestDevice(context->adapter, &desc, handle_request_device, context);
         return;
     }
@@ -689,6 +934,25 @@ void *createGPUContext(void *hInstance, void *hwnd, int width, int height, int v
     return (void *) &context;
 }
 
+// *info* compiled shader modules keyed by a hash of their source, so that pipelines sharing a shader (eg. the variants
+// of the main pipeline) parse and validate it only once
+// *info* the cache only lives as long as the process, nothing goes to disk: every launch, cold or warm, still compiles
+// every module and builds every pipeline, the wgpu-native build in this tree has no pipeline cache to persist
+// todo: persist a pipeline cache keyed by the same hash once wgpu-native exposes one
+#define SHADER_CACHE_SIZE 16
+static struct { uint64_t hash; WGPUShaderModule module; } shader_cache[SHADER_CACHE_SIZE];
+static int shader_cache_count = 0;
+
+static uint64_t fnv1a_64(const char *s, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)s[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// the returned module must be released by the caller, the cache keeps its own reference
 static WGPUShaderModule loadWGSL(WGPUDevice device, const char* filePath) {
     FILE* fp = fopen(filePath, "rb");
     if (!fp) {
@@ -706,6 +970,14 @@ static WGPUShaderModule loadWGSL(WGPUDevice device, const char* filePath) {
     fread(wgslSource, 1, (size_t)size, fp);
     wgslSource[size] = '\0';
     fclose(fp);
+    uint64_t hash = fnv1a_64(wgslSource, (size_t)size);
+    for (int i = 0; i < shader_cache_count; i++) {
+        if (shader_cache[i].hash == hash) {
+            free(wgslSource);
+            wgpuShaderModuleReference(shader_cache[i].module);
+            return shader_cache[i].module;
+        }
+    }
     WGPUShaderModuleWGSLDescriptor wgslDesc = {0};
     wgslDesc.chain.sType = WGPUSType_ShaderModuleWGSLDescriptor;
     wgslDesc.code = wgslSource;
@@ -713,19 +985,32 @@ static WGPUShaderModule loadWGSL(WGPUDevice device, const char* filePath) {
     desc.nextInChain = (const WGPUChainedStruct*)&wgslDesc;
     WGPUShaderModule module = wgpuDeviceCreateShaderModule(device, &desc);
     free(wgslSource);
+    if (module && shader_cache_count < SHADER_CACHE_SIZE) {
+        wgpuShaderModuleReference(module);
+        shader_cache[shader_cache_count].hash = hash;
+        shader_cache[shader_cache_count].module = module;
+        shader_cache_count++;
+    }
     return module;
 }
 
-int create_main_pipeline(void *context_ptr, const char *shader) {
-    WebGPUContext *context = (WebGPUContext *)context_ptr;
-    if (!context->initialized) {
-        fprintf(stderr, "[webgpu.c] wgpuCreatePipeline called before init!\n");
-        return -1;
+#ifdef __EMSCRIPTEN__
+static void handle_create_pipeline(WGPUCreatePipelineAsyncStatus status, WGPURenderPipeline pipeline, const char* message, void* userdata) {
+    if (status != WGPUCreatePipelineAsyncStatus_Success) {
+        fprintf(stderr, "[webgpu.c] Async pipeline creation failed: %s\n", message ? message : "");
+        return;
     }
+    *(WGPURenderPipeline *)userdata = pipeline; // the draws of this pipeline are skipped until it is ready
+}
+#endif
+
+// *info* the variant is set as the SHADER override constant, the branches for the other shaders are compiled out
+// the render pipeline of a shader variant, for a color target of this format and sample count
+static bool build_main_pipeline(WebGPUContext *context, const char *shader, unsigned int variant, enum VertexFormat vertex_format, WGPUTextureFormat format, uint32_t sample_count, WGPURenderPipeline *pipeline) {
     WGPUShaderModule shaderModule = loadWGSL(context->device, shader);
     if (!shaderModule) {
         fprintf(stderr, "[webgpu.c] Failed to load shader: %s\n", shader);
-        return -1;
+        return false;
     }
 
     #define LAYOUT_COUNT 1
@@ -744,18 +1029,23 @@ int create_main_pipeline(void *context_ptr, const char *shader) {
     
     // Vertex stage.
     rpDesc.vertex.module = shaderModule;
-    rpDesc.vertex.entryPoint = "vs_main";
+    rpDesc.vertex.entryPoint = VERTEX_ENTRY_POINTS[vertex_format];
+    WGPUConstantEntry variant_constant = {.key = "SHADER", .value = (double) variant};
+    rpDesc.vertex.constantCount = 1;
+    rpDesc.vertex.constants = &variant_constant;
 
     rpDesc.vertex.bufferCount = 2;
-    rpDesc.vertex.buffers = VERTEX_LAYOUT;
+    rpDesc.vertex.buffers = VERTEX_LAYOUTS[vertex_format];
     
     // Fragment stage.
     WGPUFragmentState fragState = {0};
     fragState.module = shaderModule;
     fragState.entryPoint = "fs_main";
+    fragState.constantCount = 1;
+    fragState.constants = &variant_constant;
     fragState.targetCount = 1;
     WGPUColorTargetState colorTarget = {0};
-    colorTarget.format = context->config.format;
+    colorTarget.format = format;
     colorTarget.writeMask = WGPUColorWriteMask_All;
     // --- enable alpha blending ---
     {
@@ -781,21 +1071,57 @@ int create_main_pipeline(void *context_ptr, const char *shader) {
     prim.frontFace = WGPUFrontFace_CCW;
     rpDesc.primitive = prim;
     WGPUMultisampleState ms = {0};
-    ms.count = MSAA_ENABLED ? 4 : 1; // *MSAA anti aliasing* ~set it to 1 to avoid, and don't set the target to msaa texture in draw_frame
+    ms.count = sample_count;
     ms.mask = 0xFFFFFFFF;
     rpDesc.multisample = ms;
     // add depth texture
     rpDesc.depthStencil = &context->depthStencilState;
 
+    #ifdef __EMSCRIPTEN__
+    // the browser compiles in the background while the meshes and textures are uploaded
+    *pipeline = NULL;
+    wgpuDeviceCreateRenderPipelineAsync(context->device, &rpDesc, handle_create_pipeline, pipeline);
+    #else
+    // *info* wgpu-native does not implement the async variant (yet), so create it in place
     // todo: this has exception when running with windows compiler...
-    WGPURenderPipeline gpu_pipeline = wgpuDeviceCreateRenderPipeline(context->device, &rpDesc);
-    context->main_pipeline = gpu_pipeline;
+    *pipeline = wgpuDeviceCreateRenderPipeline(context->device, &rpDesc);
+    #endif
    
     wgpuShaderModuleRelease(shaderModule);
     wgpuPipelineLayoutRelease(pipelineLayout);
-    
-    printf("[webgpu.c] Created main pipeline");
-    return 0;
+    return true;
+}
+
+int create_main_pipeline(void *context_ptr, const char *shader, unsigned int variant, enum VertexFormat vertex_format) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    if (!context->initialized) {
+        fprintf(stderr, "[webgpu.c] wgpuCreatePipeline called before init!\n");
+        return -1;
+    }
+    if (context->pipeline_count >= MAX_PIPELINES) {
+        fprintf(stderr, "[webgpu.c] No more pipeline slots!\n");
+        return -1;
+    }
+    // *MSAA anti aliasing* ~set the sample count to 1 to avoid, and don't set the target to msaa texture in draw_frame
+    if (!build_main_pipeline(context, shader, variant, vertex_format, context->config.format, MSAA_ENABLED ? 4 : 1, &context->main_pipelines[context->pipeline_count])) {
+        return -1;
+    }
+    context->pipeline_formats[context->pipeline_count] = vertex_format;
+    int pipeline_id = context->pipeline_count++;
+    printf("[webgpu.c] Created main pipeline %d for shader variant %u, vertex format %d\n", pipeline_id, variant, vertex_format);
+    return pipeline_id;
+}
+
+// the probe pass draws the meshes of this pipeline as well, keep it to the meshes that matter in a reflection
+void create_probe_pipeline(void *context_ptr, int pipeline_id, const char *shader, unsigned int variant) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    if (pipeline_id < 0 || pipeline_id >= context->pipeline_count) {
+        fprintf(stderr, "[webgpu.c] No main pipeline %d for the probe pipeline\n", pipeline_id);
+        return;
+    }
+    if (build_main_pipeline(context, shader, variant, context->pipeline_formats[pipeline_id], WGPUTextureFormat_RGBA8Unorm, 1, &context->probe_pipelines[pipeline_id])) {
+        printf("[webgpu.c] Created probe pipeline %d for shader variant %u\n", pipeline_id, variant);
+    }
 }
 void create_postprocessing_pipeline(void *context_ptr, int viewport_width, int viewport_height) {
     WebGPUContext *context = (WebGPUContext *)context_ptr;
@@ -1011,7 +1337,6 @@ void create_shadow_pipeline(void *context_ptr) {
     shadowRPDesc.vertex.module = shadowShaderModule;
     shadowRPDesc.vertex.entryPoint = "vs_main";
     shadowRPDesc.vertex.bufferCount = 2;
-    shadowRPDesc.vertex.buffers = VERTEX_LAYOUT;
 
     // For a depth-only pass, the fragment stage can be omitted.
     shadowRPDesc.fragment = NULL;
@@ -1032,14 +1357,97 @@ void create_shadow_pipeline(void *context_ptr) {
     // Attach the depth stencil state.
     shadowRPDesc.depthStencil = &shadowDepthStencil;
 
-    // 7. Create the shadow render pipeline.
-    context->shadow_pipeline = wgpuDeviceCreateRenderPipeline(context->device, &shadowRPDesc);
-    assert(context->shadow_pipeline);
+    // 7. Create the shadow render pipelines, one per vertex format, the shader only reads the position
+    for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+        shadowRPDesc.vertex.buffers = VERTEX_LAYOUTS[format];
+        context->shadow_pipelines[format] = wgpuDeviceCreateRenderPipeline(context->device, &shadowRPDesc);
+        assert(context->shadow_pipelines[format]);
+    }
 
     // Optionally, release the shader module and pipeline layout if no longer needed.
     wgpuShaderModuleRelease(shadowShaderModule);
     wgpuPipelineLayoutRelease(shadowPipelineLayout);
-    printf("[webgpu.c] Created shadow pipeline \n");
+    printf("[webgpu.c] Created shadow pipelines \n");
+}
+
+void create_light_cluster_pipeline(void *context_ptr) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    enum { entry_count = 3 };
+    WGPUBindGroupLayoutEntry layout_entries[entry_count] = {
+        // Global uniforms (view, projection, light count, cluster depth range)
+        {
+            .binding = 0,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_Uniform,
+            .buffer.minBindingSize = GLOBAL_UNIFORM_CAPACITY,
+        },
+        // Lights
+        {
+            .binding = 1,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_ReadOnlyStorage,
+            .buffer.minBindingSize = MAX_LIGHTS * sizeof(struct Light),
+        },
+        // Light indices per cluster
+        {
+            .binding = 2,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_Storage,
+            .buffer.minBindingSize = CLUSTER_COUNT * (MAX_LIGHTS_PER_CLUSTER + 1) * sizeof(uint32_t),
+        },
+    };
+    WGPUBindGroupLayoutDescriptor bglDesc = {0};
+    bglDesc.entryCount = entry_count;
+    bglDesc.entries = layout_entries;
+    WGPUBindGroupLayout bindgroup_layout = wgpuDeviceCreateBindGroupLayout(context->device, &bglDesc);
+
+    WGPUBindGroupEntry entries[entry_count] = {
+        {
+            .binding = 0,
+            .buffer = context->global_uniform_buffer,
+            .offset = 0,
+            .size = GLOBAL_UNIFORM_CAPACITY,
+        },
+        {
+            .binding = 1,
+            .buffer = context->lights,
+            .offset = 0,
+            .size = MAX_LIGHTS * sizeof(struct Light),
+        },
+        {
+            .binding = 2,
+            .buffer = context->light_clusters,
+            .offset = 0,
+            .size = CLUSTER_COUNT * (MAX_LIGHTS_PER_CLUSTER + 1) * sizeof(uint32_t),
+        },
+    };
+    WGPUBindGroupDescriptor bgDesc = {0};
+    bgDesc.layout = bindgroup_layout;
+    bgDesc.entryCount = entry_count;
+    bgDesc.entries = entries;
+    context->light_cluster_bindgroup = wgpuDeviceCreateBindGroup(context->device, &bgDesc);
+
+    WGPUPipelineLayoutDescriptor plDesc = {0};
+    plDesc.bindGroupLayoutCount = 1;
+    plDesc.bindGroupLayouts = &bindgroup_layout;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(context->device, &plDesc);
+    assert(pipelineLayout);
+
+    WGPUShaderModule shaderModule = loadWGSL(context->device, "data/shaders/cluster.wgsl");
+    assert(shaderModule);
+
+    WGPUComputePipelineDescriptor cpDesc = {0};
+    cpDesc.label = "light cluster pipeline";
+    cpDesc.layout = pipelineLayout;
+    cpDesc.compute.module = shaderModule;
+    cpDesc.compute.entryPoint = "cs_main";
+    context->light_cluster_pipeline = wgpuDeviceCreateComputePipeline(context->device, &cpDesc);
+    assert(context->light_cluster_pipeline);
+
+    wgpuShaderModuleRelease(shaderModule);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+    wgpuBindGroupLayoutRelease(bindgroup_layout);
+    printf("[webgpu.c] Created light cluster pipeline \n");
 }
 
 int createGPUMesh(void *context_ptr, int pipeline_id, enum MeshFlags flags, void *v, int vc, void *i, int ic, void *ii, int iic) {
@@ -1064,7 +1472,12 @@ int createGPUMesh(void *context_ptr, int pipeline_id, enum MeshFlags flags, void
         return -1;
     }
     Material *material = &context->materials[material_id]; // todo: separate and don't create a new one every time
-    int mesh_id = -1;
+    if (pipeline_id < 0 || pipeline_id >= context->pipeline_count) {
+        fprintf(stderr, "[webgpu.c] Invalid pipeline %d for mesh!\n", pipeline_id);
+        context->materials[material_id].used = false;
+        return -1;
+    }
+    int mesh_id = -1, mesh_index = -1;
     for (int i = 0; i < MAX_MESHES; i++) {
         if (!context->meshes[i].used) {
             mesh_id = i;
@@ -1075,6 +1488,7 @@ int createGPUMesh(void *context_ptr, int pipeline_id, enum MeshFlags flags, void
             for (int j = 0; j < MAX_MESHES; j++) {
                 if (material->mesh_ids[j] == -1) {
                     material->mesh_ids[j] = mesh_id;
+                    mesh_index = j;
                     break;
                 }
             }
@@ -1084,18 +1498,30 @@ int createGPUMesh(void *context_ptr, int pipeline_id, enum MeshFlags flags, void
     }
     if (mesh_id < 0) {
         fprintf(stderr, "[webgpu.c] No more mesh slots!\n");
+        context->materials[material_id].used = false;
         return -1;
     }
     Mesh *mesh = &context->meshes[mesh_id];
 
-    // Write into vertex buffer (same as in wgpuCreateMesh)
-    wgpuQueueWriteBuffer(context->queue, context->vertices, context->vertex_count * sizeof(struct Vertex), v, vc * sizeof(struct Vertex));
-    mesh->first_vertex = context->vertex_count;
-    context->vertex_count += vc;
+    // Write into vertex buffer (same as in wgpuCreateMesh), without data the range is only reserved for copyGPUStaging
+    // *info* the range starts at a multiple of the stride, so that the first vertex can be the base vertex of the draws
+    mesh->vertex_format = context->pipeline_formats[pipeline_id];
+    uint64_t stride = VERTEX_SIZE[mesh->vertex_format];
+    uint64_t first_vertex = (context->vertex_bytes + stride - 1) / stride;
+    if ((first_vertex + vc) * stride > sizeof(struct Vertex) * VERTEX_LIMIT) {
+        fprintf(stderr, "[webgpu.c] No more room in the vertex buffer!\n");
+        context->meshes[mesh_id].used = false;
+        if (mesh_index >= 0) material->mesh_ids[mesh_index] = -1;
+        context->materials[material_id].used = false;
+        return -1;
+    }
+    if (v) wgpuQueueWriteBuffer(context->queue, context->vertices, first_vertex * stride, v, vc * stride);
+    mesh->first_vertex = (uint32_t) first_vertex;
+    context->vertex_bytes = (first_vertex + vc) * stride;
     mesh->vertex_count = vc;
     
     // Write into index buffer
-    wgpuQueueWriteBuffer(context->queue, context->indices, context->index_count * sizeof(uint32_t), i, ic * sizeof(uint32_t));
+    if (i) wgpuQueueWriteBuffer(context->queue, context->indices, context->index_count * sizeof(uint32_t), i, ic * sizeof(uint32_t));
     mesh->first_index = context->index_count;
     context->index_count += ic;
     mesh->index_count = ic;
@@ -1155,41 +1581,355 @@ int createGPUMesh(void *context_ptr, int pipeline_id, enum MeshFlags flags, void
 
     mesh->material_id = mesh_id;
     material->pipeline_id = pipeline_id;
+    context->draws_dirty = true;
     printf("[webgpu.c] Created instanced mesh %d with %d vertices, %d indices, and %d instances for pipeline %d\n",
            mesh_id, vc, ic, iic, pipeline_id);
     return mesh_id;
 }
 
-void setGPUMeshBoneData(void *context_ptr, int mesh_id, float *bf[MAX_BONES][16], int bc, int fc) {
+int setGPUMeshBoneData(void *context_ptr, int mesh_id, int row, float *bones, int bc) {
     WebGPUContext *context = (WebGPUContext *)context_ptr;
     Mesh* mesh = &context->meshes[mesh_id];
+    if (row < 0) {
+        if (context->animation_count >= ANIMATION_LIMIT) {
+            fprintf(stderr, "[webgpu.c] No more animation slots!\n");
+            return -1;
+        }
+        row = (int) context->animation_count++; // used as Instance.animation
+    }
     mesh->flags = mesh->flags | MESH_ANIMATED; // todo: this should be an instance thing (!)
-    writeDataToTexture(context, &context->animations, bf, ANIMATION_TEXTURE_WIDTH, 1, context->animation_count * ANIMATION_SIZE, 16, 0);
-    context->animation_count += 1;
+    // a row is always MAX_BONES bones, the bones that are not given are zero
+    static unsigned char pose[SKELETON_SIZE];
+    size_t size = bones && bc > 0 ? (size_t) (bc < MAX_BONES ? bc : MAX_BONES) * 64 : 0;
+    if (size) memcpy(pose, bones, size);
+    memset(pose + size, 0, SKELETON_SIZE - size);
+    writeDataToTexture(context, &context->animations, pose, ANIMATION_TEXTURE_WIDTH, 1, (uint64_t) row * SKELETON_SIZE, 16, 0, 0);
+    return row;
+}
+
+// *info* skyline packer, every layer of the texture array is an atlas page that keeps the height of what was packed per column
+// a texture goes where its bottom ends up lowest (ties go left), on the first page where it fits, otherwise on a new page
+static int atlas_find_position(unsigned char skyline[ATLAS_COLUMNS], int w, int h, int *x, int *y) {
+    int best_x = -1, best_y = ATLAS_COLUMNS + 1;
+    for (int cx = 0; cx + w <= ATLAS_COLUMNS; cx++) {
+        int cy = 0;
+        for (int i = cx; i < cx + w; i++) {
+            cy = skyline[i] > cy ? skyline[i] : cy;
+        }
+        if (cy + h <= ATLAS_COLUMNS && cy < best_y) {
+            best_x = cx;
+            best_y = cy;
+        }
+    }
+    if (best_x < 0) return 0;
+    *x = best_x;
+    *y = best_y;
+    return 1;
+}
+
+static size_t texture_level_size(enum TextureFormat format, int w, int h) {
+    if (format == TEXTURE_FORMAT_BC1) return (size_t)((w + 3) / 4) * ((h + 3) / 4) * 8;
+    return (size_t)w * h * 4;
 }
 
-int createGPUTexture(void *context_ptr, int mesh_id, void *data, int w, int h) {
+// textures larger than a page start at the first mip that fits
+static void fit_texture_to_page(enum TextureFormat format, unsigned char **level, int *w, int *h, int *mip_count) {
+    while ((*w > TEXTURE_SIZE || *h > TEXTURE_SIZE) && *mip_count > 1) {
+        *level += texture_level_size(format, *w, *h);
+        *w = *w > 1 ? *w / 2 : 1;
+        *h = *h > 1 ? *h / 2 : 1;
+        *mip_count -= 1;
+    }
+}
+
+// whether mip of a region of the page (in texels of mip 0) is still a rect of its own, of whole BC1 blocks
+// *info* the region of a texture that has the whole page keeps every mip, its mips smaller than a block are copied as a whole block
+static int atlas_mip_fits(enum TextureFormat format, int x, int y, int w, int h, int mip) {
+    int unit = (format == TEXTURE_FORMAT_BC1 ? 4 : 1) << mip;
+    if (x % unit == 0 && y % unit == 0 && w % unit == 0 && h % unit == 0) return 1;
+    return x == 0 && y == 0 && w >= TEXTURE_SIZE && h >= TEXTURE_SIZE;
+}
+
+// writes mip_count levels of a texture (packed one after the other) at origin in a layer of a texture array that is page_size at its mip 0
+// the caller keeps mip_count within TextureRegion.mip_count, so that every level is whole and inside the region
+static void write_texture_levels(WebGPUContext *context, WGPUTexture texture, int page_size, int layer, int origin_x, int origin_y,
+                                 unsigned char *level, int w, int h, int mip_count) {
+    for (int mip = 0; mip < mip_count && (page_size >> mip) > 0; mip++) {
+        size_t level_size = texture_level_size(context->texture_format, w, h);
+        WGPUImageCopyTexture ict = {.texture = texture, .mipLevel = mip, .origin = {.x = origin_x >> mip, .y = origin_y >> mip, .z = layer}};
+        if (context->texture_format == TEXTURE_FORMAT_BC1) {
+            // 4x4 blocks of 8 bytes, mips smaller than a block are still copied as a whole block
+            int blocks_x = (w + 3) / 4, blocks_y = (h + 3) / 4;
+            WGPUTextureDataLayout tdl = {.bytesPerRow = blocks_x * 8, .rowsPerImage = blocks_y};
+            WGPUExtent3D ext = {.width = blocks_x * 4, .height = blocks_y * 4, .depthOrArrayLayers = 1};
+            wgpuQueueWriteTexture(context->queue, &ict, level, level_size, &tdl, &ext);
+        } else {
+            WGPUTextureDataLayout tdl = {.bytesPerRow = w * 4, .rowsPerImage = h};
+            WGPUExtent3D ext = {.width = w, .height = h, .depthOrArrayLayers = 1};
+            wgpuQueueWriteTexture(context->queue, &ict, level, level_size, &tdl, &ext);
+        }
+        level += level_size;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+}
+
+// packs the texture into a page and uploads its tail, the full resolution mips are streamed in with streamGPUTexture once the page is visible
+struct TextureRegion createGPUTexture(void *context_ptr, int mesh_id, void *data, int w, int h, int mip_count) {
     WebGPUContext *context = (WebGPUContext *)context_ptr;
     Mesh* mesh = &context->meshes[mesh_id];
-    Material* material = &context->materials[mesh->material_id];
-    if (context->texture_count >= TEXTURE_LIMIT) {
-        fprintf(stderr, "No more texture slots in mesh!"); // todo: allow re-assigning a new texture to a slot that was occupied
-        return -1;
+    struct TextureRegion region = {.layer = -1};
+    unsigned char *level = data;
+
+    fit_texture_to_page(context->texture_format, &level, &w, &h, &mip_count);
+    if (w > TEXTURE_SIZE || h > TEXTURE_SIZE) {
+        fprintf(stderr, "[webgpu.c] Texture of %dx%d does not fit in a %d page!\n", w, h, TEXTURE_SIZE);
+        return region;
     }
-    int slot = context->texture_count; // e.g. 0 => binding=1, etc.
-    context->texture_count += 1;
-    
-    // Upload the pixel data.
-    writeDataToTexture(context, &context->texture_array, data, w, h, 0, 4, slot);
+    int full_mip_count = 1;
+    for (int size = w > h ? w : h; size > 1; size /= 2) full_mip_count += 1;
+    if (mip_count < full_mip_count) {
+        printf("[webgpu.c] Texture of %dx%d has %d of %d mip levels, re-run the texture converter\n", w, h, mip_count, full_mip_count);
+    }
+
+    // pack it on the atlas grid
+    int columns_w = (w + ATLAS_GRANULARITY - 1) / ATLAS_GRANULARITY;
+    int columns_h = (h + ATLAS_GRANULARITY - 1) / ATLAS_GRANULARITY;
+    int layer, x = 0, y = 0;
+    for (layer = 0; layer < context->texture_count; layer++) {
+        if (atlas_find_position(context->atlas_skyline[layer], columns_w, columns_h, &x, &y)) break;
+    }
+    if (layer == context->texture_count) {
+        if (context->texture_count >= TEXTURE_LIMIT) {
+            fprintf(stderr, "[webgpu.c] No more texture pages to pack a %dx%d texture into!\n", w, h); // todo: allow re-assigning a region that was occupied
+            return region;
+        }
+        context->texture_count += 1;
+        x = 0;
+        y = 0;
+    }
+    for (int i = x; i < x + columns_w; i++) {
+        context->atlas_skyline[layer][i] = (unsigned char)(y + columns_h);
+    }
+    region.layer = layer;
+    region.x = (unsigned short)(x * ATLAS_GRANULARITY);
+    region.y = (unsigned short)(y * ATLAS_GRANULARITY);
+    region.atlas_uv[0] = (unsigned short)((region.x * 65535) / TEXTURE_SIZE);
+    region.atlas_uv[1] = (unsigned short)((region.y * 65535) / TEXTURE_SIZE);
+    // the mips down to where the region stops being a rect of its own, the shader clamps the lod to the last one
+    int region_w = columns_w * ATLAS_GRANULARITY, region_h = columns_h * ATLAS_GRANULARITY;
+    while (region.mip_count < mip_count && atlas_mip_fits(context->texture_format, region.x, region.y, region_w, region_h, region.mip_count)) {
+        region.mip_count += 1;
+    }
+    mip_count = region.mip_count;
+    int units_w = (w + ATLAS_UNIT - 1) / ATLAS_UNIT, units_h = (h + ATLAS_UNIT - 1) / ATLAS_UNIT;
+    region.atlas_size = (unsigned short)(((TEXTURE_MIP_LEVELS - region.mip_count) << 12) | ((units_w & 63) << 6) | (units_h & 63));
+    if (mip_count <= TEXTURE_STREAMED_MIPS) {
+        printf("[webgpu.c] Texture of %dx%d keeps %d mips in its region, its tail is empty\n", w, h, mip_count); // todo: copy the last mip into the tail
+    }
+
+    // Upload the tail, the mips below TEXTURE_STREAMED_MIPS
+    for (int mip = 0; mip < TEXTURE_STREAMED_MIPS && mip_count > TEXTURE_STREAMED_MIPS; mip++) {
+        level += texture_level_size(context->texture_format, w, h);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    write_texture_levels(context, context->texture_tail, TEXTURE_SIZE >> TEXTURE_STREAMED_MIPS, layer,
+                         region.x >> TEXTURE_STREAMED_MIPS, region.y >> TEXTURE_STREAMED_MIPS, level, w, h, mip_count - TEXTURE_STREAMED_MIPS);
+    printf("Packed texture for material %d at %d,%d of page %d\n", mesh->material_id, region.x, region.y, layer);
+
+    return region;
+}
+
+// uploads the full resolution mips of a texture into the slot that its page is resident in
+void streamGPUTexture(void *context_ptr, struct TextureRegion region, int slot, void *data, int w, int h, int mip_count) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    if (region.layer < 0 || slot < 0 || slot >= context->texture_slot_count) return;
+    unsigned char *level = data;
+    fit_texture_to_page(context->texture_format, &level, &w, &h, &mip_count);
+    if (mip_count > region.mip_count) mip_count = region.mip_count;
+    write_texture_levels(context, context->texture_array, TEXTURE_SIZE, slot, region.x, region.y, level, w, h,
+                         mip_count < TEXTURE_STREAMED_MIPS ? mip_count : TEXTURE_STREAMED_MIPS);
+}
+
+// points a page at a slot of the texture array, TEXTURE_NOT_RESIDENT falls back to its tail
+void setGPUPageResidency(void *context_ptr, int page, int slot) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    if (page < 0 || page >= TEXTURE_LIMIT) return;
+    context->texture_pages_ram[page] = slot < 0 ? TEXTURE_NOT_RESIDENT : (uint32_t)slot;
+    wgpuQueueWriteBuffer(context->queue, context->texture_pages, page * sizeof(uint32_t), &context->texture_pages_ram[page], sizeof(uint32_t));
+}
+
+int getGPUTextureSlots(void *context_ptr) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    return context->texture_slot_count;
+}
+
+// the finest mip the fragments wanted from every page in the last feedback that was read back, 255 if the page was not seen
+// returns 0 if no new feedback arrived since the last call
+int getGPUTextureFeedback(void *context_ptr, unsigned char requested_mip[TEXTURE_LIMIT]) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    if (!context->texture_feedback_new) return 0;
+    context->texture_feedback_new = 0;
+    for (int page = 0; page < TEXTURE_LIMIT; page++) {
+        uint32_t value = context->texture_feedback_ram[page];
+        requested_mip[page] = value ? (unsigned char)(TEXTURE_MIP_LEVELS - value) : 255;
+    }
+    return 1;
+}
+
+static void textureFeedbackMapCallback(WGPUBufferMapAsyncStatus status, void *userdata) {
+    WebGPUContext *context = (WebGPUContext *)userdata;
+    if (status == WGPUBufferMapAsyncStatus_Success) {
+        const void *mapped = wgpuBufferGetConstMappedRange(context->texture_feedback_readback, 0, TEXTURE_LIMIT * sizeof(uint32_t));
+        memcpy(context->texture_feedback_ram, mapped, TEXTURE_LIMIT * sizeof(uint32_t));
+        context->texture_feedback_new = 1;
+        wgpuBufferUnmap(context->texture_feedback_readback);
+    }
+    context->texture_feedback_state = TEXTURE_FEEDBACK_IDLE;
+}
+
+enum TextureFormat getGPUTextureFormat(void *context_ptr) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    return context->texture_format;
+}
+
+// mip 0 is copied into a source cube that is box filtered down first, then every mip is filtered from the whole source
+// *info* filtering a mip from the prefiltered mip above it would blur it with every lobe above it as well
+// one compute pass per mip of each, the source and the pipeline are thrown away afterwards
+static void prefilter_env_cube(WebGPUContext *context) {
+    enum { entry_count = 4 };
+    WGPUBindGroupLayoutEntry layout_entries[entry_count] = {
+        {
+            .binding = 0,
+            .visibility = WGPUShaderStage_Compute,
+            .sampler = { .type = WGPUSamplerBindingType_Filtering },
+        },
+        // Source, every mip or only the one above
+        {
+            .binding = 1,
+            .visibility = WGPUShaderStage_Compute,
+            .texture = {.sampleType = WGPUTextureSampleType_Float, .viewDimension = WGPUTextureViewDimension_Cube, .multisampled = false},
+        },
+        // Mip that is written
+        {
+            .binding = 2,
+            .visibility = WGPUShaderStage_Compute,
+            .storageTexture = {.access = WGPUStorageTextureAccess_WriteOnly, .format = WGPUTextureFormat_RGBA8Unorm, .viewDimension = WGPUTextureViewDimension_2DArray},
+        },
+        // Roughness + size of the mip + size of the source
+        {
+            .binding = 3,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_Uniform,
+            .buffer.minBindingSize = 4 * sizeof(uint32_t),
+        },
+    };
+    WGPUBindGroupLayoutDescriptor bglDesc = {0};
+    bglDesc.entryCount = entry_count;
+    bglDesc.entries = layout_entries;
+    WGPUBindGroupLayout bindgroup_layout = wgpuDeviceCreateBindGroupLayout(context->device, &bglDesc);
 
-    printf("Added texture to material %d at slot %d (binding=%d)\n", mesh->material_id, slot, slot+1);
+    WGPUPipelineLayoutDescriptor plDesc = {0};
+    plDesc.bindGroupLayoutCount = 1;
+    plDesc.bindGroupLayouts = &bindgroup_layout;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(context->device, &plDesc);
+    WGPUShaderModule shaderModule = loadWGSL(context->device, "data/shaders/prefilter.wgsl");
+    if (!shaderModule) {
+        fprintf(stderr, "[webgpu.c] Could not load the env cube prefilter shader, rough reflections will be wrong\n");
+        wgpuPipelineLayoutRelease(pipelineLayout);
+        wgpuBindGroupLayoutRelease(bindgroup_layout);
+        return;
+    }
+    WGPUComputePipelineDescriptor cpDesc = {0};
+    cpDesc.label = "env cube prefilter pipeline";
+    cpDesc.layout = pipelineLayout;
+    cpDesc.compute.module = shaderModule;
+    cpDesc.compute.entryPoint = "cs_main";
+    WGPUComputePipeline pipeline = wgpuDeviceCreateComputePipeline(context->device, &cpDesc);
+
+    WGPUTextureDescriptor sourceTexDesc = {
+        .usage = WGPUTextureUsage_CopyDst | WGPUTextureUsage_TextureBinding | WGPUTextureUsage_StorageBinding,
+        .label = "env cube prefilter source",
+        .dimension = WGPUTextureDimension_2D,
+        .size = (WGPUExtent3D){ .width = ENV_TEXTURE_SIZE, .height = ENV_TEXTURE_SIZE, .depthOrArrayLayers = 6 },
+        .mipLevelCount = ENV_MIP_LEVELS,
+        .sampleCount = 1,
+        .format = WGPUTextureFormat_RGBA8Unorm,
+    };
+    WGPUTexture source = wgpuDeviceCreateTexture(context->device, &sourceTexDesc);
+
+    // the parameters of every mip at 256 byte offsets (minUniformBufferOffsetAlignment), the box filter passes first
+    struct { float roughness; uint32_t size; uint32_t source_size; uint32_t padding[61]; } params[2 * ENV_MIP_LEVELS] = {0};
+    for (int mip = 1; mip < ENV_MIP_LEVELS; mip++) {
+        params[mip].size = ENV_TEXTURE_SIZE >> mip;
+        params[ENV_MIP_LEVELS + mip].roughness = (float)mip / (ENV_MIP_LEVELS - 1);
+        params[ENV_MIP_LEVELS + mip].size = ENV_TEXTURE_SIZE >> mip;
+        params[ENV_MIP_LEVELS + mip].source_size = ENV_TEXTURE_SIZE;
+    }
+    WGPUBufferDescriptor paramsDesc = {.label = "env cube prefilter params", .size = sizeof(params), .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst};
+    WGPUBuffer params_buffer = wgpuDeviceCreateBuffer(context->device, &paramsDesc);
+    wgpuQueueWriteBuffer(context->queue, params_buffer, 0, params, sizeof(params));
+
+    WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(context->device, NULL);
+    WGPUImageCopyTexture copySrc = {.texture = context->cubemap_texture, .mipLevel = 0};
+    WGPUImageCopyTexture copyDst = {.texture = source, .mipLevel = 0};
+    WGPUExtent3D copySize = {.width = ENV_TEXTURE_SIZE, .height = ENV_TEXTURE_SIZE, .depthOrArrayLayers = 6};
+    wgpuCommandEncoderCopyTextureToTexture(encoder, &copySrc, &copyDst, &copySize);
+
+    // pass i < ENV_MIP_LEVELS box filters source mip i - 1 into source mip i, pass ENV_MIP_LEVELS + i filters env cube mip i
+    WGPUTextureView views[4 * ENV_MIP_LEVELS] = {0};
+    WGPUBindGroup bindgroups[2 * ENV_MIP_LEVELS] = {0};
+    for (int pass_index = 1; pass_index < 2 * ENV_MIP_LEVELS; pass_index++) {
+        int mip = pass_index % ENV_MIP_LEVELS;
+        if (mip == 0) continue;
+        int box_filter = pass_index < ENV_MIP_LEVELS;
+        WGPUTextureViewDescriptor sourceDesc = {.dimension = WGPUTextureViewDimension_Cube, .baseMipLevel = box_filter ? mip - 1 : 0, .mipLevelCount = box_filter ? 1 : ENV_MIP_LEVELS, .arrayLayerCount = 6};
+        WGPUTextureViewDescriptor destinationDesc = {.dimension = WGPUTextureViewDimension_2DArray, .baseMipLevel = mip, .mipLevelCount = 1, .arrayLayerCount = 6};
+        views[2 * pass_index] = wgpuTextureCreateView(source, &sourceDesc);
+        views[2 * pass_index + 1] = wgpuTextureCreateView(box_filter ? source : context->cubemap_texture, &destinationDesc);
+        WGPUBindGroupEntry entries[entry_count] = {
+            { .binding = 0, .sampler = context->cubemap_sampler },
+            { .binding = 1, .textureView = views[2 * pass_index] },
+            { .binding = 2, .textureView = views[2 * pass_index + 1] },
+            { .binding = 3, .buffer = params_buffer, .offset = pass_index * sizeof(params[0]), .size = 4 * sizeof(uint32_t) },
+        };
+        WGPUBindGroupDescriptor bgDesc = {.layout = bindgroup_layout, .entryCount = entry_count, .entries = entries};
+        bindgroups[pass_index] = wgpuDeviceCreateBindGroup(context->device, &bgDesc);
+
+        // a pass per mip, so that the source mips are written before they are read
+        WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, NULL);
+        wgpuComputePassEncoderSetPipeline(pass, pipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, bindgroups[pass_index], 0, NULL);
+        uint32_t groups = (params[pass_index].size + 7) / 8;
+        wgpuComputePassEncoderDispatchWorkgroups(pass, groups, groups, 6);
+        wgpuComputePassEncoderEnd(pass);
+        wgpuComputePassEncoderRelease(pass);
+    }
+    WGPUCommandBuffer cmdBuf = wgpuCommandEncoderFinish(encoder, NULL);
+    wgpuQueueSubmit(context->queue, 1, &cmdBuf);
+    wgpuCommandBufferRelease(cmdBuf);
+    wgpuCommandEncoderRelease(encoder);
 
-    return slot;
+    for (int pass_index = 1; pass_index < 2 * ENV_MIP_LEVELS; pass_index++) {
+        if (!bindgroups[pass_index]) continue;
+        wgpuBindGroupRelease(bindgroups[pass_index]);
+        wgpuTextureViewRelease(views[2 * pass_index]);
+        wgpuTextureViewRelease(views[2 * pass_index + 1]);
+    }
+    wgpuTextureRelease(source);
+    wgpuBufferRelease(params_buffer);
+    wgpuComputePipelineRelease(pipeline);
+    wgpuShaderModuleRelease(shaderModule);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+    wgpuBindGroupLayoutRelease(bindgroup_layout);
+    printf("[webgpu.c] Prefiltered %d env cube mips\n", ENV_MIP_LEVELS - 1);
 }
 
+// without data the faces were already copied in with copyGPUStaging, only the mips are filtered
 int set_env_cube(void *context_ptr, void *data[6], int face_size) {
     WebGPUContext *context = (WebGPUContext *)context_ptr;
-    for (int face = 0; face < 6; face++) {
+    for (int face = 0; data && face < 6; face++) {
         WGPUImageCopyTexture copyTex = {
             .texture = context->cubemap_texture,
             .mipLevel = 0,
@@ -1201,7 +1941,92 @@ int set_env_cube(void *context_ptr, void *data[6], int face_size) {
         WGPUExtent3D ext = { .width = (uint32_t)face_size, .height = (uint32_t)face_size, .depthOrArrayLayers = 1 };
         wgpuQueueWriteTexture(context->queue, &copyTex, data[face], (size_t)(4 * face_size * face_size), &tdl, &ext);
     }
+    prefilter_env_cube(context);
+    return 0;
+}
+
+#pragma region STAGING
+// *info* the staging buffers are MapWrite buffers that stay mapped while they are free, the file data is read straight into them
+// and copied on the gpu, instead of wgpuQueueWrite* copying it once more into a staging area of its own
+static void stagingMapCallback(WGPUBufferMapAsyncStatus status, void *userdata) {
+    StagingBuffer *staging = (StagingBuffer *)userdata;
+    if (status != WGPUBufferMapAsyncStatus_Success) {
+        fprintf(stderr, "[webgpu.c] Failed to map a staging buffer again: %d\n", status); // it stays out of use
+        return;
+    }
+    staging->mapped = wgpuBufferGetMappedRange(staging->buffer, 0, STAGING_BUFFER_SIZE);
+    staging->state = STAGING_MAPPED;
+}
+
+// a mapped staging buffer of STAGING_BUFFER_SIZE bytes, -1 while all of them are in flight
+int acquireGPUStaging(void *context_ptr, void **data) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    for (int s = 0; s < STAGING_BUFFER_COUNT; s++) {
+        StagingBuffer *staging = &context->staging[s];
+        if (!staging->buffer) {
+            WGPUBufferDescriptor desc = {.label = "staging", .size = STAGING_BUFFER_SIZE, .usage = WGPUBufferUsage_MapWrite | WGPUBufferUsage_CopySrc, .mappedAtCreation = true};
+            staging->buffer = wgpuDeviceCreateBuffer(context->device, &desc);
+            staging->mapped = wgpuBufferGetMappedRange(staging->buffer, 0, STAGING_BUFFER_SIZE);
+            staging->state = STAGING_MAPPED;
+        }
+        if (staging->state == STAGING_MAPPED && staging->mapped) {
+            staging->state = STAGING_FILLING;
+            staging->copy_count = 0;
+            *data = staging->mapped;
+            return s;
+        }
+    }
+    return -1;
+}
+
+// offset has to be a multiple of STAGING_ALIGNMENT, size a multiple of 4
+void copyGPUStaging(void *context_ptr, int staging_id, unsigned long long offset, unsigned long long size, enum UploadTarget target, int index, unsigned long long target_offset) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    StagingBuffer *staging = &context->staging[staging_id];
+    assert(staging->state == STAGING_FILLING && offset + size <= STAGING_BUFFER_SIZE);
+    if (staging->copy_count >= MAX_STAGING_COPIES) {
+        fprintf(stderr, "[webgpu.c] Too many copies out of one staging buffer!\n");
+        return;
+    }
+    staging->copies[staging->copy_count++] = (struct StagingCopy){offset, size, target, index, target_offset};
+}
+
+// the copies go to the queue before the next frame, the buffer is handed out again once the gpu is done with it
+void submitGPUStaging(void *context_ptr, int staging_id) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    StagingBuffer *staging = &context->staging[staging_id];
+    wgpuBufferUnmap(staging->buffer);
+    staging->mapped = NULL;
+    WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(context->device, &(WGPUCommandEncoderDescriptor){.label = "staging copies"});
+    for (int c = 0; c < staging->copy_count; c++) {
+        uint64_t offset = staging->copies[c].offset, size = staging->copies[c].size, target_offset = staging->copies[c].target_offset;
+        Mesh *mesh = &context->meshes[staging->copies[c].index];
+        switch (staging->copies[c].target) {
+        case UPLOAD_VERTICES:
+            wgpuCommandEncoderCopyBufferToBuffer(encoder, staging->buffer, offset, context->vertices, mesh->first_vertex * VERTEX_SIZE[mesh->vertex_format] + target_offset, size);
+            break;
+        case UPLOAD_INDICES:
+            wgpuCommandEncoderCopyBufferToBuffer(encoder, staging->buffer, offset, context->indices, mesh->first_index * sizeof(uint32_t) + target_offset, size);
+            break;
+        case UPLOAD_ENV_CUBE: {
+            uint32_t row_size = 4 * ENV_TEXTURE_SIZE; // rgba8
+            WGPUImageCopyBuffer source = {.buffer = staging->buffer, .layout = {.offset = offset, .bytesPerRow = row_size, .rowsPerImage = (uint32_t)(size / row_size)}};
+            WGPUImageCopyTexture destination = {.texture = context->cubemap_texture, .mipLevel = 0, .origin = {0, (uint32_t)(target_offset / row_size), (uint32_t)staging->copies[c].index}};
+            WGPUExtent3D extent = {ENV_TEXTURE_SIZE, (uint32_t)(size / row_size), 1};
+            wgpuCommandEncoderCopyBufferToTexture(encoder, &source, &destination, &extent);
+            break;
+        }
+        }
+    }
+    WGPUCommandBuffer commands = wgpuCommandEncoderFinish(encoder, &(WGPUCommandBufferDescriptor){0});
+    wgpuQueueSubmit(context->queue, 1, &commands);
+    wgpuCommandBufferRelease(commands);
+    wgpuCommandEncoderRelease(encoder);
+    // *info* like the texture feedback, the callback fires when polling the device (native) or from the browser event loop
+    staging->state = STAGING_MAPPING;
+    wgpuBufferMapAsync(staging->buffer, WGPUMapMode_Write, 0, STAGING_BUFFER_SIZE, stagingMapCallback, staging);
 }
+#pragma endregion
 
 void setGPUInstanceBuffer(void *context_ptr, int mesh_id, void* ii, int iic) {
     WebGPUContext *context = (WebGPUContext *)context_ptr;
@@ -1211,6 +2036,21 @@ void setGPUInstanceBuffer(void *context_ptr, int mesh_id, void* ii, int iic) {
     mesh->instance_count = iic;
 }
 
+void setGPULights(void *context_ptr, struct Light *lights, int light_count) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    // the lights stay in RAM and are written to the gpu every frame, like the instances
+    context->lights_ram = lights;
+    context->light_count = light_count > MAX_LIGHTS ? MAX_LIGHTS : light_count;
+}
+
+void setGPUReflectionProbe(void *context_ptr, int face, struct GlobalUniforms *probe_uniforms) {
+    WebGPUContext *context = (WebGPUContext *)context_ptr;
+    if (face < 0 || face >= 6) return;
+    // the view of the face goes in its own uniform buffer, the main pass keeps the camera
+    wgpuQueueWriteBuffer(context->queue, context->probe_uniform_buffer, 0, probe_uniforms, sizeof(struct GlobalUniforms));
+    context->probe_face = face;
+}
+
 static void fenceCallback(WGPUQueueWorkDoneStatus status, WGPU_NULLABLE void *userdata) {
     bool *done = (bool*)userdata;
     *done = true;
@@ -1260,21 +2100,29 @@ void createDrawIndirectBuffers(void *context_ptr) {
     struct DrawIndexedIndirect drawCommands[MAX_DRAW_CALLS];
     uint32_t drawCount = 0;
     
-    for (int k = 0; k < MAX_MESHES; k++) {
-        assert(drawCount <= MAX_DRAW_CALLS);
-        Mesh *mesh = &context->meshes[k];
-        if (mesh->used) {
-            struct DrawIndexedIndirect cmd = {0};
-            cmd.index_count    = mesh->index_count;
-            cmd.instanceCount = mesh->instance_count;
-            cmd.firstIndex    = mesh->first_index; 
-            cmd.baseVertex    = mesh->first_vertex;
-            cmd.firstInstance = mesh->first_instance;
-            drawCommands[drawCount++] = cmd;
+    // sort the draws by pipeline, so that every pipeline draws its meshes with one multi draw call
+    for (int pipeline_id = 0; pipeline_id < context->pipeline_count; pipeline_id++) {
+        context->pipeline_first_draw[pipeline_id] = drawCount;
+        for (int k = 0; k < MAX_MESHES; k++) {
+            assert(drawCount <= MAX_DRAW_CALLS);
+            Mesh *mesh = &context->meshes[k];
+            if (mesh->used && context->materials[mesh->material_id].pipeline_id == pipeline_id) {
+                struct DrawIndexedIndirect cmd = {0};
+                cmd.index_count    = mesh->index_count;
+                cmd.instanceCount = mesh->instance_count;
+                cmd.firstIndex    = mesh->first_index; 
+                cmd.baseVertex    = mesh->first_vertex;
+                cmd.firstInstance = mesh->first_instance;
+                drawCommands[drawCount++] = cmd;
+            }
         }
+        context->pipeline_draw_count[pipeline_id] = drawCount - context->pipeline_first_draw[pipeline_id];
     }
     
     // create the two buffers
+    if (context->indirect_draw_buffer) {
+        wgpuBufferRelease(context->indirect_draw_buffer);
+    }
     WGPUBufferDescriptor indirect_draw_buffer_desc = {0};
     indirect_draw_buffer_desc.size = drawCount * sizeof(struct DrawIndexedIndirect);
     indirect_draw_buffer_desc.usage = WGPUBufferUsage_Indirect | WGPUBufferUsage_CopyDst;
@@ -1378,11 +2226,14 @@ struct draw_result drawGPUFrame(
         // todo: make this based on mesh setting UPDATE_MESH_INSTANCES, then we don't need to do this for static meshes
         // If the mesh requires instance data updates, update the instance buffer (this is really expensive!)
         if (1 && mesh->used) {
-            unsigned long long instanceDataSize = VERTEX_LAYOUT[1].arrayStride * mesh->instance_count;
+            unsigned long long instanceDataSize = sizeof(struct Instance) * mesh->instance_count;
             // write RAM instances to GPU instances
             wgpuQueueWriteBuffer(context->queue,context->instances,mesh->first_instance*sizeof(struct Instance),mesh->instances, instanceDataSize);
         }
     }
+    if (context->lights_ram && context->light_count > 0) {
+        wgpuQueueWriteBuffer(context->queue, context->lights, 0, context->lights_ram, context->light_count * sizeof(struct Light));
+    }
     result.write_buffer_ms = p->current_time_ms() - mut_ms; mut_ms = p->current_time_ms();
     #pragma endregion
 
@@ -1412,6 +2263,20 @@ struct draw_result drawGPUFrame(
     WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(context->device, &encDesc);
     #pragma endregion
    
+    #pragma region LIGHT CLUSTER PASS
+    // bin the lights into the froxel grid, so the main pass only shades the lights of its own cluster
+    {
+        WGPUComputePassDescriptor computePassDesc = {0};
+        WGPUComputePassEncoder clusterPass = wgpuCommandEncoderBeginComputePass(encoder, &computePassDesc);
+        wgpuComputePassEncoderSetPipeline(clusterPass, context->light_cluster_pipeline);
+        wgpuComputePassEncoderSetBindGroup(clusterPass, 0, context->light_cluster_bindgroup, 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(clusterPass, (CLUSTER_COUNT + 63) / 64, 1, 1);
+        wgpuComputePassEncoderEnd(clusterPass);
+        wgpuComputePassEncoderRelease(clusterPass);
+    }
+    result.light_cluster_ms = p->current_time_ms() - mut_ms; mut_ms = p->current_time_ms();
+    #pragma endregion
+
     #pragma region SHADOW PASS
     // Reuse the global pipeline uniform data in the shader uniforms // todo: is it possible to reuse the same gpu-buffer and write only once?
     // wgpuQueueWriteBuffer(context->queue, context->shadow_uniform_buffer, 0, context->pipelines[0].global_uniform_data, GLOBAL_UNIFORM_CAPACITY);
@@ -1439,19 +2304,21 @@ struct draw_result drawGPUFrame(
             }; 
             WGPURenderBundleEncoder shadow_bundle_encoder = wgpuDeviceCreateRenderBundleEncoder(context->device, &bundle_desc);
 
-            // 4. Bind the shadow pipeline.
-            wgpuRenderBundleEncoderSetPipeline(shadow_bundle_encoder, context->shadow_pipeline);
+            // 4. Bind the shadow bindgroup, the pipeline is set per vertex format
             wgpuRenderBundleEncoderSetBindGroup(shadow_bundle_encoder, 0, context->shadow_bindgroup, 0, NULL);
 
             // Set the scene's vertex/index/instance buffers
             wgpuRenderBundleEncoderSetVertexBuffer(shadow_bundle_encoder, 0, context->vertices, 0, VERTEX_LIMIT * sizeof(struct Vertex));
             wgpuRenderBundleEncoderSetVertexBuffer(shadow_bundle_encoder, 1, context->instances, 0, INSTANCE_LIMIT * sizeof(struct Instance));
             wgpuRenderBundleEncoderSetIndexBuffer(shadow_bundle_encoder, context->indices, WGPUIndexFormat_Uint32, 0, INDEX_LIMIT * sizeof(uint32_t));
-            // 5. For each mesh that casts shadows, draw
-            for (int mesh_id = 0; mesh_id < MAX_MESHES; mesh_id++) {
-                Mesh *mesh = &context->meshes[mesh_id];
-                if (mesh->flags & MESH_CAST_SHADOWS && mesh->used) {
-                    wgpuRenderBundleEncoderDrawIndexed(shadow_bundle_encoder, mesh->index_count, mesh->instance_count, mesh->first_index, mesh->first_vertex, mesh->first_instance);
+            // 5. For each mesh that casts shadows, draw, grouped per vertex format
+            for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+                wgpuRenderBundleEncoderSetPipeline(shadow_bundle_encoder, context->shadow_pipelines[format]);
+                for (int mesh_id = 0; mesh_id < MAX_MESHES; mesh_id++) {
+                    Mesh *mesh = &context->meshes[mesh_id];
+                    if (mesh->flags & MESH_CAST_SHADOWS && mesh->used && mesh->vertex_format == format) {
+                        wgpuRenderBundleEncoderDrawIndexed(shadow_bundle_encoder, mesh->index_count, mesh->instance_count, mesh->first_index, mesh->first_vertex, mesh->first_instance);
+                    }
                 }
             }
             WGPURenderBundleDescriptor desc = {0}; desc.label = "shadow bundle";
@@ -1469,6 +2336,47 @@ struct draw_result drawGPUFrame(
     result.shadowmap_ms = p->current_time_ms() - mut_ms; mut_ms = p->current_time_ms();
     #pragma endregion
 
+    // meshes keep coming in while the assets load in the background
+    if (context->draws_dirty) {
+        createDrawIndirectBuffers(context);
+        context->draws_dirty = false;
+    }
+
+    #pragma region PROBE PASS
+    // one face of the reflection probe per frame, only the pipelines with a probe variant, at PROBE_SIZE instead of a full frame
+    if (context->probe_face >= 0) {
+        WGPURenderPassColorAttachment probeColorAtt = {
+            .view = context->probe_face_views[context->probe_face],
+            .loadOp = WGPULoadOp_Clear,
+            .storeOp = WGPUStoreOp_Store,
+            .clearValue = (WGPUColor){0., 0., 0., 1.0},
+            .depthSlice = WGPU_DEPTH_SLICE_UNDEFINED,
+        };
+        WGPURenderPassDepthStencilAttachment probeDepthAtt = {
+            .view = context->probe_depth_view,
+            .depthLoadOp = WGPULoadOp_Clear,
+            .depthStoreOp = WGPUStoreOp_Discard,
+            .depthClearValue = 1.0f,
+        };
+        WGPURenderPassDescriptor probePassDesc = {.colorAttachmentCount = 1, .colorAttachments = &probeColorAtt, .depthStencilAttachment = &probeDepthAtt};
+        WGPURenderPassEncoder probe_pass = wgpuCommandEncoderBeginRenderPass(encoder, &probePassDesc);
+        wgpuRenderPassEncoderSetVertexBuffer(probe_pass, 0, context->vertices, 0, VERTEX_LIMIT * sizeof(struct Vertex));
+        wgpuRenderPassEncoderSetVertexBuffer(probe_pass, 1, context->instances, 0, INSTANCE_LIMIT * sizeof(struct Instance));
+        wgpuRenderPassEncoderSetIndexBuffer(probe_pass, context->indices, WGPUIndexFormat_Uint32, 0, INDEX_LIMIT * sizeof(uint32_t));
+        wgpuRenderPassEncoderSetBindGroup(probe_pass, 0, context->probe_bindgroup, 0, NULL);
+        for (int pipeline_id = 0; pipeline_id < context->pipeline_count; pipeline_id++) {
+            if (context->pipeline_draw_count[pipeline_id] == 0 || !context->probe_pipelines[pipeline_id]) continue;
+            wgpuRenderPassEncoderSetPipeline(probe_pass, context->probe_pipelines[pipeline_id]);
+            wgpuRenderPassEncoderMultiDrawIndexedIndirect(probe_pass, context->indirect_draw_buffer,
+                context->pipeline_first_draw[pipeline_id] * sizeof(struct DrawIndexedIndirect), context->pipeline_draw_count[pipeline_id]);
+        }
+        wgpuRenderPassEncoderEnd(probe_pass);
+        wgpuRenderPassEncoderRelease(probe_pass);
+        context->probe_face = -1;
+    }
+    result.probe_ms = p->current_time_ms() - mut_ms; mut_ms = p->current_time_ms();
+    #pragma endregion
+
     #pragma region MAIN PASS
     // Bundle
     #define USE_BUNDLE 0
@@ -1488,13 +2396,15 @@ struct draw_result drawGPUFrame(
         wgpuRenderBundleEncoderSetVertexBuffer(main_bundle_encoder, 0, context->vertices, 0, VERTEX_LIMIT * sizeof(struct Vertex));
         wgpuRenderBundleEncoderSetVertexBuffer(main_bundle_encoder, 1, context->instances, 0, INSTANCE_LIMIT * sizeof(struct Instance));
         wgpuRenderBundleEncoderSetIndexBuffer(main_bundle_encoder, context->indices, WGPUIndexFormat_Uint32, 0, INDEX_LIMIT * sizeof(uint32_t));
-        // todo: is it possible to set the pipeline once at the beginning, and then avoid this call every frame?
-        wgpuRenderBundleEncoderSetPipeline(main_bundle_encoder, context->main_pipeline);
         wgpuRenderBundleEncoderSetBindGroup(main_bundle_encoder, 0, context->global_bindgroup, 0, NULL);
-        for (int mesh_id = 0; mesh_id < MAX_MESHES; mesh_id++) {
-            Mesh *mesh = &context->meshes[mesh_id];
-            if (mesh->used)
-                wgpuRenderBundleEncoderDrawIndexed(main_bundle_encoder, mesh->index_count,mesh->instance_count,mesh->first_index, mesh->first_vertex, mesh->first_instance);
+        for (int pipeline_id = 0; pipeline_id < context->pipeline_count; pipeline_id++) {
+            if (!context->main_pipelines[pipeline_id]) continue;
+            wgpuRenderBundleEncoderSetPipeline(main_bundle_encoder, context->main_pipelines[pipeline_id]);
+            for (int mesh_id = 0; mesh_id < MAX_MESHES; mesh_id++) {
+                Mesh *mesh = &context->meshes[mesh_id];
+                if (mesh->used && context->materials[mesh->material_id].pipeline_id == pipeline_id)
+                    wgpuRenderBundleEncoderDrawIndexed(main_bundle_encoder, mesh->index_count,mesh->instance_count,mesh->first_index, mesh->first_vertex, mesh->first_instance);
+            }
         }
         WGPURenderBundleDescriptor desc = {0}; desc.label = "main bundle";
         main_bundle = wgpuRenderBundleEncoderFinish(main_bundle_encoder, &desc);
@@ -1506,21 +2416,20 @@ struct draw_result drawGPUFrame(
     wgpuRenderPassEncoderSetViewport(main_pass, offset_x, offset_y, viewport_width, viewport_height, 0.0f, 1.0f);
     wgpuRenderPassEncoderSetScissorRect(main_pass, (uint32_t)offset_x, (uint32_t)offset_y, (uint32_t)viewport_width, (uint32_t)viewport_height);
 
-    static int buffers = 0;
-    if (!buffers) {
-        createDrawIndirectBuffers(context);
-        buffers = 1;
-    }
     if (USE_BUNDLE) {
         wgpuRenderPassEncoderExecuteBundles(main_pass, 1, &main_bundle);
     } else {
         wgpuRenderPassEncoderSetVertexBuffer(main_pass, 0, context->vertices, 0, VERTEX_LIMIT * sizeof(struct Vertex));
         wgpuRenderPassEncoderSetVertexBuffer(main_pass, 1, context->instances, 0, INSTANCE_LIMIT * sizeof(struct Instance));
         wgpuRenderPassEncoderSetIndexBuffer(main_pass, context->indices, WGPUIndexFormat_Uint32, 0, INDEX_LIMIT * sizeof(uint32_t));
-        wgpuRenderPassEncoderSetPipeline(main_pass, context->main_pipeline);
         wgpuRenderPassEncoderSetBindGroup(main_pass, 0, context->global_bindgroup, 0, NULL);
-        // todo: we can avoid the above 5 calls by putting draw indirect calls in a renderbundle, but then we cannot do multi anymore, so many calls
-        wgpuRenderPassEncoderMultiDrawIndexedIndirect(main_pass, context->indirect_draw_buffer, 0, context->indirect_count);
+        // todo: we can avoid the above 4 calls by putting draw indirect calls in a renderbundle, but then we cannot do multi anymore, so many calls
+        for (int pipeline_id = 0; pipeline_id < context->pipeline_count; pipeline_id++) {
+            if (context->pipeline_draw_count[pipeline_id] == 0 || !context->main_pipelines[pipeline_id]) continue;
+            wgpuRenderPassEncoderSetPipeline(main_pass, context->main_pipelines[pipeline_id]);
+            wgpuRenderPassEncoderMultiDrawIndexedIndirect(main_pass, context->indirect_draw_buffer,
+                context->pipeline_first_draw[pipeline_id] * sizeof(struct DrawIndexedIndirect), context->pipeline_draw_count[pipeline_id]);
+        }
     }
 
     wgpuRenderPassEncoderEnd(main_pass);
@@ -1601,11 +2510,23 @@ struct draw_result drawGPUFrame(
         wgpuRenderPassEncoderRelease(finalPass);
     }
 
+    // read back the texture feedback of this frame, and start over for the next one
+    if (context->texture_feedback_state == TEXTURE_FEEDBACK_IDLE) {
+        wgpuCommandEncoderCopyBufferToBuffer(encoder, context->texture_feedback, 0, context->texture_feedback_readback, 0, TEXTURE_LIMIT * sizeof(uint32_t));
+        wgpuCommandEncoderClearBuffer(encoder, context->texture_feedback, 0, TEXTURE_LIMIT * sizeof(uint32_t));
+        context->texture_feedback_state = TEXTURE_FEEDBACK_COPIED;
+    }
+
     // Finish command encoding and submit.
     double start_submit_ms = p->current_time_ms();
     WGPUCommandBufferDescriptor cmdDesc = {0};
     WGPUCommandBuffer cmdBuf = wgpuCommandEncoderFinish(encoder, &cmdDesc);
     wgpuQueueSubmit(context->queue, 1, &cmdBuf);
+    if (context->texture_feedback_state == TEXTURE_FEEDBACK_COPIED) {
+        // *info* the callback fires a few frames later, when polling the device (native) or from the browser event loop
+        context->texture_feedback_state = TEXTURE_FEEDBACK_MAPPING;
+        wgpuBufferMapAsync(context->texture_feedback_readback, WGPUMapMode_Read, 0, TEXTURE_LIMIT * sizeof(uint32_t), textureFeedbackMapCallback, context);
+    }
     wgpuCommandEncoderRelease(encoder);
     wgpuCommandBufferRelease(cmdBuf);
     result.submit_ms = p->current_time_ms() - start_submit_ms; mut_ms = p->current_time_ms();